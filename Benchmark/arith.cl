@@ -0,0 +1,54 @@
+(*
+ *  arith: Int and Bool arithmetic in loops, with few objects besides
+ *  the numbers themselves; for the runbench default set.
+ *)
+class Main inherits IO {
+   (* steps for n to reach 1 *)
+   collatz(n : Int) : Int {
+      let steps : Int <- 0 in {
+         while not n = 1 loop {
+            if n - n / 2 * 2 = 0 then n <- n / 2 else n <- 3 * n + 1 fi;
+            steps <- steps + 1;
+         } pool;
+         steps;
+      }
+   };
+
+   gcd(a : Int, b : Int) : Int {
+      let t : Int in {
+         while not b = 0 loop {
+            t <- a - a / b * b;
+            a <- b;
+            b <- t;
+         } pool;
+         a;
+      }
+   };
+
+   (* Newton's method, from above *)
+   isqrt(n : Int) : Int {
+      let x : Int <- n, y : Int <- (n + 1) / 2 in {
+         while y < x loop {
+            x <- y;
+            y <- (x + n / x) / 2;
+         } pool;
+         x;
+      }
+   };
+
+   main() : Object {
+      let i : Int <- 1, longest : Int <- 0, at : Int <- 0, g : Int <- 0, r : Int <- 0 in {
+         while i <= 100000 loop {
+            let c : Int <- collatz(i) in
+               if longest < c then { longest <- c; at <- i; } else 0 fi;
+            g <- g + gcd(i * 7919, 123456);
+            r <- r + isqrt(i * 20000) / 16;
+            i <- i + 1;
+         } pool;
+         out_int(at); out_string(" ");
+         out_int(longest); out_string(" ");
+         out_int(g); out_string(" ");
+         out_int(r); out_string("\n");
+      }
+   };
+};
@@ -0,0 +1,338 @@
+/*
+ *  coolbench: times the lexer, parser and semant phases on programs
+ *  written by gencool, varying one size at a time from a base program.
+ *
+ *    coolbench [options] > results.json
+ *    coolbench -compare old.json new.json
+ *
+ *  Each phase runs on the previous phase's output the way mycoolc runs
+ *  them, -runs times; the run with the median wall time is kept. Every
+ *  (axis, value, phase) gives one JSON line on stdout with the wall and
+ *  CPU time, the peak RSS and the throughput in source bytes and lines
+ *  per second. A table of each axis goes to stderr, with the growth of
+ *  each phase between points: the exponent k in time ~ size^k.
+ *
+ *  -compare matches the lines of two result files and reports the
+ *  points that got more than -threshold percent (10) slower; it exits
+ *  with 1 if there are any, so that it can gate a commit.
+ *
+ *    -lexer P, -parser P, -semant P, -gencool P    the programs to use
+ *    -runs N           runs of each phase (3)
+ *    -seed N           passed to gencool (1)
+ *    -dir D            where the programs and phase outputs go
+ *    -base axis=N      size of the base program along an axis
+ *    -axis axis=N,N..  an axis to vary; replaces the default suite
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+enum bench_phase { P_LEXER, P_PARSER, P_SEMANT, P_PHASES };
+static const char *phaseNames[P_PHASES] = { "lexer", "parser", "semant" };
+
+#define AXES 7
+static const char *axisNames[AXES] = { "classes", "depth", "features", "nesting", "block", "strings", "words" };
+static long baseSizes[AXES] = { 100, 4, 6, 4, 4, 0, 0 };
+
+/* the default suite: each axis with the others at their base sizes */
+static const char *defaultAxes[] = {
+    "classes=50,100,200,400,800,1600",
+    "depth=1,2,4,8,16,32,64",
+    "features=2,4,8,16,32",
+    "nesting=2,8,32,128,512",
+    "block=1,4,16,64",
+    "strings=0,256,1024,4096,16384"
+};
+
+struct run_result {
+    int status;							/* as from wait4, -1 if it could not run */
+    double wall, cpu;					/* in ms */
+    long rss;							/* peak resident set, in KB */
+};
+
+struct axis_spec {
+    int axis;
+    std::vector<long> values;
+};
+
+static double now(){
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+static int axisIndex(const std::string& name){
+    for(int i = 0; i < AXES; i++)
+        if(name == axisNames[i])
+            return i;
+    return -1;
+}
+
+/* run argv with stdin and stdout redirected to the files given; stderr goes to errFile */
+static run_result run(std::vector<std::string>& args, const char *in, const char *out, const char *errFile){
+    run_result r = { -1, 0, 0, 0 };
+    std::vector<char *> argv;
+    for(size_t i = 0; i < args.size(); i++)
+        argv.push_back((char *) args[i].c_str());
+    argv.push_back(NULL);
+
+    double start = now();
+    pid_t pid = fork();
+    if(pid < 0)
+        return r;
+    if(pid == 0){
+        int fd;
+        if(in != NULL && (fd = open(in, O_RDONLY)) >= 0)
+            dup2(fd, 0);
+        if((fd = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0666)) >= 0)
+            dup2(fd, 1);
+        if((fd = open(errFile, O_WRONLY | O_CREAT | O_TRUNC, 0666)) >= 0)
+            dup2(fd, 2);
+        execvp(argv[0], &argv[0]);
+        _exit(127);
+    }
+    int status;
+    rusage usage;
+    if(wait4(pid, &status, 0, &usage) != pid)
+        return r;
+    r.wall = now() - start;
+    r.cpu = usage.ru_utime.tv_sec * 1e3 + usage.ru_utime.tv_usec / 1e3
+          + usage.ru_stime.tv_sec * 1e3 + usage.ru_stime.tv_usec / 1e3;
+    r.rss = usage.ru_maxrss;
+    r.status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    return r;
+}
+
+static bool byWall(const run_result& a, const run_result& b){
+    return a.wall < b.wall;
+}
+
+static void countSource(const char *path, long& bytes, long& lines){
+    bytes = lines = 0;
+    FILE *f = fopen(path, "r");
+    if(f == NULL)
+        return;
+    int c;
+    while((c = getc(f)) != EOF){
+        bytes++;
+        if(c == '\n')
+            lines++;
+    }
+    fclose(f);
+}
+
+static void usage(){
+    fprintf(stderr, "usage: coolbench [-lexer P] [-parser P] [-semant P] [-gencool P] [-runs N] [-seed N]\n"
+                    "                 [-dir D] [-base axis=N] [-axis axis=N,N,...]\n"
+                    "       coolbench -compare old.json new.json [-threshold percent]\n");
+    exit(2);
+}
+
+/*
+ *  Results. The lines are written and read back by this program only, so
+ *  reading looks the fields up by name without a general JSON parser.
+ */
+static std::string field(const std::string& line, const char *name){
+    std::string key = std::string("\"") + name + "\":";
+    size_t at = line.find(key);
+    if(at == std::string::npos)
+        return "";
+    at += key.size();
+    if(line[at] == '"')
+        return line.substr(at + 1, line.find('"', at + 1) - at - 1);
+    return line.substr(at, line.find_first_of(",}", at) - at);
+}
+
+static std::map<std::string, double> readResults(const char *path){
+    std::map<std::string, double> walls;
+    FILE *f = fopen(path, "r");
+    if(f == NULL){
+        fprintf(stderr, "coolbench: cannot read %s\n", path);
+        exit(2);
+    }
+    char buf[1024];
+    while(fgets(buf, sizeof(buf), f) != NULL){
+        std::string line(buf);
+        if(field(line, "status") != "0")
+            continue;
+        std::string key = field(line, "axis") + "=" + field(line, "value") + " " + field(line, "phase");
+        walls[key] = atof(field(line, "wall_ms").c_str());
+    }
+    fclose(f);
+    return walls;
+}
+
+static int compare(const char *oldPath, const char *newPath, double threshold){
+    std::map<std::string, double> before = readResults(oldPath), after = readResults(newPath);
+    int regressions = 0;
+    fprintf(stderr, "%-24s %10s %10s %8s\n", "point", "old ms", "new ms", "ratio");
+    for(std::map<std::string, double>::iterator it = after.begin(); it != after.end(); ++it){
+        std::map<std::string, double>::iterator old = before.find(it->first);
+        if(old == before.end())
+            continue;
+        double ratio = old->second > 0 ? it->second / old->second : 1;
+        bool slower = ratio > 1 + threshold / 100;
+        regressions += slower;
+        fprintf(stderr, "%-24s %10.3f %10.3f %8.3f%s\n", it->first.c_str(), old->second, it->second, ratio,
+                slower ? "  slower" : "");
+    }
+    fprintf(stderr, "%d of %d points more than %g%% slower\n", regressions, (int) after.size(), threshold);
+    return regressions ? 1 : 0;
+}
+
+int main(int argc, char **argv){
+    std::string programs[P_PHASES] = { "../Lexer/lexer", "../Parser/parser", "../Semantic/semant" };
+    std::string gencool = "./gencool";
+    int runs = 3;
+    long seed = 1;
+    char dirBuf[64];
+    snprintf(dirBuf, sizeof(dirBuf), "/tmp/coolbench.%d", (int) getpid());
+    std::string dir = dirBuf;
+    std::vector<axis_spec> axes;
+    std::vector<std::string> axisArgs;
+
+    if(argc >= 2 && strcmp(argv[1], "-compare") == 0){
+        if(argc != 4 && !(argc == 6 && strcmp(argv[4], "-threshold") == 0))
+            usage();
+        return compare(argv[2], argv[3], argc == 6 ? atof(argv[5]) : 10);
+    }
+    for(int i = 1; i < argc; i++){
+        if(i + 1 == argc)
+            usage();
+        std::string opt = argv[i], value = argv[++i];
+        if(opt == "-lexer")
+            programs[P_LEXER] = value;
+        else if(opt == "-parser")
+            programs[P_PARSER] = value;
+        else if(opt == "-semant")
+            programs[P_SEMANT] = value;
+        else if(opt == "-gencool")
+            gencool = value;
+        else if(opt == "-runs")
+            runs = atoi(value.c_str());
+        else if(opt == "-seed")
+            seed = atol(value.c_str());
+        else if(opt == "-dir")
+            dir = value;
+        else if(opt == "-axis")
+            axisArgs.push_back(value);
+        else if(opt == "-base"){
+            size_t eq = value.find('=');
+            int axis = axisIndex(value.substr(0, eq));
+            if(eq == std::string::npos || axis < 0)
+                usage();
+            baseSizes[axis] = atol(value.c_str() + eq + 1);
+        }
+        else
+            usage();
+    }
+    if(runs < 1)
+        usage();
+    if(axisArgs.empty())
+        axisArgs.assign(defaultAxes, defaultAxes + sizeof(defaultAxes) / sizeof(defaultAxes[0]));
+    for(size_t i = 0; i < axisArgs.size(); i++){
+        size_t eq = axisArgs[i].find('=');
+        axis_spec spec;
+        spec.axis = axisIndex(axisArgs[i].substr(0, eq));
+        if(eq == std::string::npos || spec.axis < 0)
+            usage();
+        for(const char *p = axisArgs[i].c_str() + eq + 1; *p; p++){
+            spec.values.push_back(strtol(p, (char **) &p, 10));
+            if(*p != ',')
+                break;
+        }
+        axes.push_back(spec);
+    }
+    mkdir(dir.c_str(), 0777);
+
+    std::string source = dir + "/bench.cl", errors = dir + "/errors";
+    std::string outputs[P_PHASES] = { dir + "/bench.tokens", dir + "/bench.ast", dir + "/bench.out" };
+    int failures = 0;
+
+    for(size_t a = 0; a < axes.size(); a++){
+        axis_spec& spec = axes[a];
+        fprintf(stderr, "%-10s %10s %10s %10s %10s   growth lexer parser semant\n",
+                axisNames[spec.axis], "lexer ms", "parser ms", "semant ms", "semant KB");
+        double last[P_PHASES] = { 0, 0, 0 };
+        long lastValue = 0;
+
+        for(size_t v = 0; v < spec.values.size(); v++){
+            long sizes[AXES];
+            std::copy(baseSizes, baseSizes + AXES, sizes);
+            sizes[spec.axis] = spec.values[v];
+
+            std::vector<std::string> gen(1, gencool);
+            char number[32];
+            for(int i = 0; i < AXES; i++){
+                snprintf(number, sizeof(number), "%ld", sizes[i]);
+                gen.push_back(std::string("-") + axisNames[i]);
+                gen.push_back(number);
+            }
+            snprintf(number, sizeof(number), "%ld", seed);
+            gen.push_back("-seed");
+            gen.push_back(number);
+            if(run(gen, NULL, source.c_str(), errors.c_str()).status != 0){
+                fprintf(stderr, "coolbench: %s failed, see %s\n", gencool.c_str(), errors.c_str());
+                return 2;
+            }
+            long bytes, lines;
+            countSource(source.c_str(), bytes, lines);
+
+            run_result kept[P_PHASES];
+            bool ok = true;
+            for(int p = 0; p < P_PHASES; p++){
+                std::vector<std::string> args(1, programs[p]);
+                if(p == P_LEXER)
+                    args.push_back(source);
+                const char *in = p == P_LEXER ? NULL : outputs[p - 1].c_str();
+                std::vector<run_result> results;
+                for(int i = 0; i < runs && ok; i++){
+                    results.push_back(run(args, in, outputs[p].c_str(), errors.c_str()));
+                    ok = results.back().status == 0;
+                }
+                std::sort(results.begin(), results.end(), byWall);
+                kept[p] = ok ? results[results.size() / 2] : results.back();
+
+                run_result& r = kept[p];
+                printf("{\"axis\":\"%s\",\"value\":%ld,\"phase\":\"%s\",\"seed\":%ld,\"status\":%d,"
+                       "\"source_bytes\":%ld,\"source_lines\":%ld,\"wall_ms\":%.3f,\"cpu_ms\":%.3f,"
+                       "\"max_rss_kb\":%ld,\"mb_per_s\":%.3f,\"lines_per_s\":%.0f}\n",
+                       axisNames[spec.axis], spec.values[v], phaseNames[p], seed, r.status,
+                       bytes, lines, r.wall, r.cpu, r.rss,
+                       r.wall > 0 ? bytes / r.wall / 1e3 : 0, r.wall > 0 ? lines / r.wall * 1e3 : 0);
+                if(!ok){
+                    fprintf(stderr, "coolbench: %s exited with %d on %s=%ld, see %s\n", programs[p].c_str(),
+                            r.status, axisNames[spec.axis], spec.values[v], errors.c_str());
+                    failures++;
+                    break;
+                }
+            }
+            fflush(stdout);
+            if(!ok)
+                continue;
+
+            fprintf(stderr, "%10ld %10.3f %10.3f %10.3f %10ld  ", spec.values[v],
+                    kept[P_LEXER].wall, kept[P_PARSER].wall, kept[P_SEMANT].wall, kept[P_SEMANT].rss);
+            for(int p = 0; p < P_PHASES; p++){
+                if(lastValue > 0 && spec.values[v] > lastValue && last[p] > 0)
+                    fprintf(stderr, " %6.2f", log(kept[p].wall / last[p]) / log((double) spec.values[v] / lastValue));
+                last[p] = kept[p].wall;
+            }
+            lastValue = spec.values[v];
+            fprintf(stderr, "\n");
+        }
+        fprintf(stderr, "\n");
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,20 @@
+(*
+ *  fib: recursive calls on Int arguments, then a loop of Int
+ *  arithmetic three million steps long; s wraps around, the same on
+ *  every engine. For the runbench default set.
+ *)
+class Main inherits IO {
+   fib(n : Int) : Int { if n < 2 then n else fib(n - 1) + fib(n - 2) fi };
+
+   main() : Object {{
+      out_int(fib(27)); out_string("\n");
+      let i : Int <- 0, s : Int <- 0 in {
+         while i < 3000000 loop {
+            s <- s + i * 3 / 2;
+            i <- i + 1;
+         } pool;
+         out_int(s);
+      };
+      out_string("\n");
+   }};
+};
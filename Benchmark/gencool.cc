@@ -0,0 +1,317 @@
+/*
+ *  gencool: writes a synthetic, type correct COOL program for the
+ *  benchmarks. Each size below can be varied on its own, and the same
+ *  options and seed always give the same program.
+ *
+ *    -classes N    classes besides Main (100)
+ *    -depth N      classes in each inheritance chain (4)
+ *    -features N   attributes and methods in each class (6)
+ *    -nesting N    nesting depth of each method's result expression (4)
+ *    -block N      statements in front of it in each method body (4)
+ *    -strings N    characters of string literals in each method (0)
+ *    -words N      let names and short literals to draw from, 0 for a
+ *                  new one each time (0); the string tables grow with
+ *                  each new one, so deep programs want a few hundred
+ *    -seed N       (1)
+ *
+ *  Every class overrides run(), so the override checks run for each
+ *  class; the other methods and the attributes are named after their
+ *  class. Method bodies call the methods and use the attributes of the
+ *  class and its ancestors. There is no static dispatch: semant checks
+ *  the body of the method it names, so methods calling themselves that
+ *  way never finish checking.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+struct gen_options {
+    int classes, depth, features, nesting, block, strings, words;
+    unsigned long seed;
+};
+
+struct method_ref {
+    std::string name;
+    int arity;
+    int owner;							/* index in ancestors of the class defining it */
+};
+
+static unsigned long long rngState;
+
+/* xorshift64*: the same sequence on every platform */
+static unsigned rnd(unsigned n){
+    rngState ^= rngState >> 12;
+    rngState ^= rngState << 25;
+    rngState ^= rngState >> 27;
+    return (unsigned) ((rngState * 2685821657736338717ULL) >> 33) % n;
+}
+
+static std::vector<std::string> scope;			/* Int variables and attributes in scope */
+static std::vector<method_ref> methods;			/* Int methods callable on self */
+static std::vector<std::string> ancestors;		/* the class and its ancestors */
+static int letCount;
+static int words;						/* -words */
+
+static std::string number(long n){
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%ld", n);
+    return buf;
+}
+
+static void literal(std::string& out, int length){
+    out += '"';
+    for(int i = 0; i < length; i++)
+        out += (char) ('a' + rnd(26));
+    out += '"';
+}
+
+static void leaf(std::string& out){
+    switch(rnd(4)){
+    case 0:
+        out += number(rnd(1000));
+        break;
+    case 1:
+        if(words > 0)
+            out += "\"w" + number(rnd(words)) + "\"";
+        else
+            literal(out, 1 + rnd(8));
+        out += ".length()";
+        break;
+    default:
+        out += scope[rnd(scope.size())];
+    }
+}
+
+/* what is left to write of an expression once its nested operand is written */
+struct expr_frame {
+    int kind;							/* the case of expr() below */
+    int method;							/* for calls, in methods */
+    int nested;							/* for calls, the argument nested */
+};
+
+/*
+ *  an Int expression nested exactly depth deep along one of its operands.
+ *  Each level writes what comes before its nested operand on the way down
+ *  and the rest on the way back up, with a stack instead of recursion, so
+ *  that -nesting is not limited by the C stack.
+ */
+static void expr(std::string& out, int depth){
+    std::vector<expr_frame> frames;
+    for(; depth > 0; depth--){
+        expr_frame f = { (int) rnd(9), 0, 0 };
+        switch(f.kind){
+        case 0:
+        case 2:
+            out += "(";
+            break;
+        case 1:
+            out += "(";
+            leaf(out);
+            out += " - ";
+            break;
+        case 3:
+            out += "(if ";
+            leaf(out);
+            out += rnd(2) ? " < " : " = ";
+            leaf(out);
+            out += " then ";
+            break;
+        case 4: {
+            std::string name = "v" + number(words > 0 ? letCount++ % words : letCount++);
+            out += "(let " + name + " : Int <- ";
+            leaf(out);
+            out += " in ";
+            scope.push_back(name);
+            break;
+        }
+        case 5: {
+            f.method = rnd(methods.size());
+            method_ref& m = methods[f.method];
+            f.nested = rnd(m.arity);
+            if(rnd(3) == 0)
+                out += "(new " + ancestors[m.owner + rnd(ancestors.size() - m.owner)] + ").";
+            out += m.name + "(";
+            for(int i = 0; i < f.nested; i++){
+                leaf(out);
+                out += ", ";
+            }
+            break;
+        }
+        case 6:
+            out += "(case ";
+            break;
+        case 7:
+            out += "{ ";
+            leaf(out);
+            out += "; ";
+            break;
+        default:
+            out += "(~";
+        }
+        frames.push_back(f);
+    }
+    leaf(out);
+
+    while(!frames.empty()){
+        expr_frame f = frames.back();
+        frames.pop_back();
+        switch(f.kind){
+        case 0:
+            out += " + ";
+            leaf(out);
+            out += ")";
+            break;
+        case 2:
+            out += " * ";
+            leaf(out);
+            out += ")";
+            break;
+        case 3:
+            out += " else ";
+            leaf(out);
+            out += " fi)";
+            break;
+        case 4:
+            scope.pop_back();
+            out += ")";
+            break;
+        case 5:
+            for(int i = f.nested + 1; i < methods[f.method].arity; i++){
+                out += ", ";
+                leaf(out);
+            }
+            out += ")";
+            break;
+        case 6:
+            out += " of n : Int => n; o : Object => ";
+            leaf(out);
+            out += "; esac)";
+            break;
+        case 7:
+            out += "; }";
+            break;
+        default:
+            out += ")";
+        }
+    }
+}
+
+static void methodBody(std::string& out, const gen_options& opt){
+    out += "{\n";
+    for(int i = 0; i < opt.block; i++){
+        out += "\t\t\t";
+        if(rnd(4) == 0){
+            out += "while ";
+            leaf(out);
+            out += " < 0 loop ";
+            expr(out, 1);
+            out += " pool";
+        }
+        else
+            expr(out, opt.nesting < 2 ? opt.nesting : 2);
+        out += ";\n";
+    }
+    for(int left = opt.strings; left > 0; left -= 64){
+        out += "\t\t\t";
+        literal(out, left < 64 ? left : 64);
+        out += ".length();\n";
+    }
+    out += "\t\t\t";
+    expr(out, opt.nesting);
+    out += ";\n\t\t}";
+}
+
+static void genClass(std::string& out, int i, const gen_options& opt){
+    std::string name = "C" + number(i);
+    bool root = i % opt.depth == 0;
+    if(root){
+        scope.clear();
+        methods.clear();
+        ancestors.clear();
+        method_ref run = { "run", 1, 0 };
+        methods.push_back(run);
+    }
+    ancestors.push_back(name);
+    int attrs = opt.features / 2;
+    for(int k = 0; k < attrs; k++)
+        scope.push_back("a" + number(i) + "_" + number(k));
+    for(int k = attrs; k < opt.features; k++){
+        method_ref m = { "m" + number(i) + "_" + number(k), 2, (int) ancestors.size() - 1 };
+        methods.push_back(m);
+    }
+
+    out += "class " + name + " inherits " + (root ? std::string("Object") : "C" + number(i - 1)) + " {\n";
+    for(int k = 0; k < attrs; k++)
+        out += "\ta" + number(i) + "_" + number(k) + " : Int <- " + number(rnd(1000)) + ";\n";
+
+    scope.push_back("x");
+    scope.push_back("y");
+    for(int k = attrs; k <= opt.features; k++){
+        letCount = 0;
+        if(k == opt.features)
+            out += "\trun(x : Int) : Int {\n\t\tlet y : Int <- x in ";
+        else
+            out += "\tm" + number(i) + "_" + number(k) + "(x : Int, y : Int) : Int {\n\t\t";
+        methodBody(out, opt);
+        out += "\n\t};\n";
+    }
+    scope.pop_back();
+    scope.pop_back();
+    out += "};\n\n";
+}
+
+int main(int argc, char **argv){
+    gen_options opt = { 100, 4, 6, 4, 4, 0, 0, 1 };
+    for(int i = 1; i < argc; i++){
+        if(i + 1 == argc){
+            fprintf(stderr, "gencool: %s needs a value\n", argv[i]);
+            return 1;
+        }
+        long value = atol(argv[i + 1]);
+        if(strcmp(argv[i], "-classes") == 0)
+            opt.classes = value;
+        else if(strcmp(argv[i], "-depth") == 0)
+            opt.depth = value;
+        else if(strcmp(argv[i], "-features") == 0)
+            opt.features = value;
+        else if(strcmp(argv[i], "-nesting") == 0)
+            opt.nesting = value;
+        else if(strcmp(argv[i], "-block") == 0)
+            opt.block = value;
+        else if(strcmp(argv[i], "-strings") == 0)
+            opt.strings = value;
+        else if(strcmp(argv[i], "-words") == 0)
+            opt.words = value;
+        else if(strcmp(argv[i], "-seed") == 0)
+            opt.seed = value;
+        else {
+            fprintf(stderr, "usage: gencool [-classes N] [-depth N] [-features N] [-nesting N] [-block N] [-strings N] [-words N] [-seed N]\n");
+            return 1;
+        }
+        i++;
+    }
+    if(opt.classes < 1 || opt.depth < 1 || opt.features < 0 || opt.nesting < 0 || opt.block < 0 || opt.words < 0){
+        fprintf(stderr, "gencool: sizes must be positive\n");
+        return 1;
+    }
+    words = opt.words;
+    rngState = opt.seed * 0x9E3779B97F4A7C15ULL + 1;	/* never zero */
+
+    std::string out;
+    out += "(* gencool -classes " + number(opt.classes) + " -depth " + number(opt.depth)
+         + " -features " + number(opt.features) + " -nesting " + number(opt.nesting)
+         + " -block " + number(opt.block) + " -strings " + number(opt.strings)
+         + (opt.words > 0 ? " -words " + number(opt.words) : std::string())
+         + " -seed " + number(opt.seed) + " *)\n\n";
+    for(int i = 0; i < opt.classes; i++){
+        genClass(out, i, opt);
+        fwrite(out.data(), 1, out.size(), stdout);
+        out.clear();
+    }
+    out += "class Main inherits IO {\n\tmain() : Object {\n\t\tout_int((new C"
+         + number(opt.classes - 1) + ").run(1))\n\t};\n};\n";
+    fwrite(out.data(), 1, out.size(), stdout);
+    return ferror(stdout) ? 1 : 0;
+}
@@ -0,0 +1,416 @@
+/*
+ *  runbench: times COOL programs run by each execution engine and checks
+ *  that the engines print the same thing.
+ *
+ *    runbench [options] [program.cl ...]
+ *
+ *  Each program is lexed and parsed once; then every engine runs it
+ *  -runs times on the same input, and the run with the median wall time
+ *  is kept. The engines:
+ *
+ *    ast     semant with COOL_RUN=ast, which runs the tree itself
+ *    vm      semant with COOL_RUN=vm, the bytecode VM
+ *    native  the x86-64 code from semant with COOL_CODEGEN=x86-64,
+ *            linked with the runtime; skipped when the runtime has not
+ *            been built
+ *    spim    semant, then cgen to MIPS assembly, run by spim; skipped
+ *            when cgen or spim cannot be found
+ *
+ *  Only running the program is timed: not semant, cgen or the linking.
+ *  spim's banner and its closing line are dropped from its output
+ *  before the comparison. ast, vm and native must also exit the same
+ *  way. A program with a .out file in place of its .cl, .test or .cool
+ *  must print what that holds under every engine, and one with a .ir
+ *  file must give what that holds on semant's stderr with COOL_IR=dump.
+ *  The lexer runs in the program's directory on its bare name, so the
+ *  runtime errors name the file the same way however the program was
+ *  given. runbench exits with 1 on any difference. Every (program, engine) gives one JSON line
+ *  on stdout; a table with each engine's speedup over spim goes to
+ *  stderr. Without programs, the grading programs that have a main
+ *  are run, life.cool on life.in, and arith.cl and fib.cl, which do
+ *  little but Int arithmetic and calls.
+ *  -programs D runs every .cl and .test file in D that mentions main
+ *  instead; the ones that do not compile are skipped, not failures.
+ *
+ *    -lexer P, -parser P, -semant P, -cgen P, -spim P, -cc P   the programs to use
+ *    -runtime F        the native code's runtime (../Runtime/cool-runtime.o)
+ *    -runs N           runs of each engine (3)
+ *    -input F          the programs' input (/dev/null)
+ *    -dir D            where the phase outputs go
+ *    -programs D       the programs in D
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+/*
+ *  The default set, each with its input; NULL is -input's. Not
+ *  ../Lexer/grading/arith.cool: semant, the baseline's too, crashes on
+ *  it, since it checks a static dispatch's callee body in the caller.
+ *  arith.cl stands in for it.
+ */
+static const struct {
+    const char *program, *input;
+} defaultPrograms[] = {
+    { "../Semantic/grading/hairyscary.cl.test", NULL },
+    { "../Semantic/grading/list.cl.test", NULL },
+    { "../Semantic/grading/cells.cl.test", NULL },
+    { "../Lexer/grading/sort_list.cl.cool", NULL },
+    { "../Lexer/grading/life.cool", "life.in" },
+    { "arith.cl", NULL },
+    { "fib.cl", NULL }
+};
+
+struct run_result {
+    int status;							/* as from wait4, -1 if it could not run */
+    double wall, cpu;					/* in ms */
+    long rss;							/* peak resident set, in KB */
+};
+
+static double now(){
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+/* run args with stdin and stdout redirected to the files given, and env added to the environment, in cwd if given */
+static run_result run(const std::vector<std::string>& args, const char *in, const char *out,
+                      const char *errFile, const std::vector<std::string>& env, const char *cwd = NULL){
+    run_result r = { -1, 0, 0, 0 };
+    std::vector<char *> argv;
+    for(size_t i = 0; i < args.size(); i++)
+        argv.push_back((char *) args[i].c_str());
+    argv.push_back(NULL);
+
+    double start = now();
+    pid_t pid = fork();
+    if(pid < 0)
+        return r;
+    if(pid == 0){
+        int fd;
+        if(in != NULL && (fd = open(in, O_RDONLY)) >= 0)
+            dup2(fd, 0);
+        if((fd = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0666)) >= 0)
+            dup2(fd, 1);
+        if((fd = open(errFile, O_WRONLY | O_CREAT | O_TRUNC, 0666)) >= 0)
+            dup2(fd, 2);
+        for(size_t i = 0; i < env.size(); i++)
+            putenv((char *) env[i].c_str());
+        if(cwd != NULL && chdir(cwd) != 0)
+            _exit(127);
+        execvp(argv[0], &argv[0]);
+        _exit(127);
+    }
+    int status;
+    rusage usage;
+    if(wait4(pid, &status, 0, &usage) != pid)
+        return r;
+    r.wall = now() - start;
+    r.cpu = usage.ru_utime.tv_sec * 1e3 + usage.ru_utime.tv_usec / 1e3
+          + usage.ru_stime.tv_sec * 1e3 + usage.ru_stime.tv_usec / 1e3;
+    r.rss = usage.ru_maxrss;
+    r.status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    return r;
+}
+
+static bool byWall(const run_result& a, const run_result& b){
+    return a.wall < b.wall;
+}
+
+static std::string readFile(const std::string& path){
+    std::string text;
+    FILE *f = fopen(path.c_str(), "r");
+    if(f == NULL)
+        return text;
+    char buf[65536];
+    size_t n;
+    while((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        text.append(buf, n);
+    fclose(f);
+    return text;
+}
+
+/* the file with extension in place of the program's .cl, .test or .cool, "" if there is none */
+static std::string expectedFile(const std::string& program, const char *extension){
+    size_t dot = program.rfind('.'), slash = program.rfind('/');
+    if(dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return "";
+    std::string path = program.substr(0, dot) + extension;
+    return access(path.c_str(), R_OK) == 0 ? path : "";
+}
+
+/* a path that still names the same file from another directory; a bare name is looked up in PATH */
+static std::string absolute(const std::string& path){
+    if(path.empty() || path[0] == '/' || path.find('/') == std::string::npos)
+        return path;
+    char cwd[4096];
+    return getcwd(cwd, sizeof(cwd)) != NULL ? std::string(cwd) + "/" + path : path;
+}
+
+/* what the program printed under spim: after the "Loaded:" banner line, without the closing line */
+static std::string spimOutput(const std::string& text){
+    size_t start = text.find("Loaded: ");
+    start = start == std::string::npos ? 0 : text.find('\n', start) + 1;
+    std::string out = text.substr(start);
+    const char *done = "COOL program successfully executed\n";
+    if(out.size() >= strlen(done) && out.compare(out.size() - strlen(done), strlen(done), done) == 0)
+        out.erase(out.size() - strlen(done));
+    return out;
+}
+
+static bool executable(const std::string& path){
+    if(path.find('/') != std::string::npos)
+        return access(path.c_str(), X_OK) == 0;
+    const char *env = getenv("PATH");
+    std::string dirs = env != NULL ? env : "";
+    for(size_t at = 0; at <= dirs.size(); ){
+        size_t end = dirs.find(':', at);
+        if(end == std::string::npos)
+            end = dirs.size();
+        if(access((dirs.substr(at, end - at) + "/" + path).c_str(), X_OK) == 0)
+            return true;
+        at = end + 1;
+    }
+    return false;
+}
+
+/* the .cl and .test files in dir that mention main, in order of name */
+static std::vector<std::string> programsIn(const std::string& dir){
+    std::vector<std::string> programs;
+    DIR *d = opendir(dir.c_str());
+    if(d == NULL){
+        perror(dir.c_str());
+        exit(2);
+    }
+    while(dirent *entry = readdir(d)){
+        std::string name = entry->d_name;
+        size_t dot = name.rfind('.');
+        if(dot == std::string::npos || (name.substr(dot) != ".cl" && name.substr(dot) != ".test"))
+            continue;
+        std::string path = dir + "/" + name;
+        if(readFile(path).find("main") != std::string::npos)
+            programs.push_back(path);
+    }
+    closedir(d);
+    std::sort(programs.begin(), programs.end());
+    return programs;
+}
+
+static void usage(){
+    fprintf(stderr, "usage: runbench [-lexer P] [-parser P] [-semant P] [-cgen P] [-spim P] [-cc P]\n"
+                    "                [-runtime F] [-runs N] [-input F] [-dir D] [-programs D] [program.cl ...]\n");
+    exit(2);
+}
+
+enum engine { E_AST, E_VM, E_NATIVE, E_SPIM, E_ENGINES };
+static const char *engineNames[E_ENGINES] = { "ast", "vm", "native", "spim" };
+
+int main(int argc, char **argv){
+    std::string lexer = "../Lexer/lexer", parser = "../Parser/parser", semant = "../Semantic/semant";
+    std::string cgen = "../Semantic/cgen", spim = "spim", input = "/dev/null";
+    std::string cc = "cc", runtime = "../Runtime/cool-runtime.o";
+    int runs = 3;
+    char dirBuf[64];
+    snprintf(dirBuf, sizeof(dirBuf), "/tmp/runbench.%d", (int) getpid());
+    std::string dir = dirBuf;
+    std::vector<std::string> programs, inputs;	/* inputs[p] is programs[p]'s, "" for -input's */
+    bool fromDir = false;					/* skip what does not compile */
+
+    for(int i = 1; i < argc; i++){
+        std::string opt = argv[i];
+        if(opt[0] != '-'){
+            programs.push_back(opt);
+            continue;
+        }
+        if(i + 1 == argc)
+            usage();
+        std::string value = argv[++i];
+        if(opt == "-lexer")
+            lexer = value;
+        else if(opt == "-parser")
+            parser = value;
+        else if(opt == "-semant")
+            semant = value;
+        else if(opt == "-cgen")
+            cgen = value;
+        else if(opt == "-spim")
+            spim = value;
+        else if(opt == "-cc")
+            cc = value;
+        else if(opt == "-runtime")
+            runtime = value;
+        else if(opt == "-runs")
+            runs = atoi(value.c_str());
+        else if(opt == "-input")
+            input = value;
+        else if(opt == "-dir")
+            dir = value;
+        else if(opt == "-programs"){
+            std::vector<std::string> more = programsIn(value);
+            programs.insert(programs.end(), more.begin(), more.end());
+            fromDir = true;
+        }
+        else
+            usage();
+    }
+    if(runs < 1)
+        usage();
+    if(programs.empty())
+        for(size_t p = 0; p < sizeof(defaultPrograms) / sizeof(defaultPrograms[0]); p++){
+            programs.push_back(defaultPrograms[p].program);
+            inputs.push_back(defaultPrograms[p].input != NULL ? defaultPrograms[p].input : "");
+        }
+    inputs.resize(programs.size());
+    lexer = absolute(lexer);
+    mkdir(dir.c_str(), 0777);
+    bool haveSpim = executable(cgen) && executable(spim);
+    if(!haveSpim)
+        fprintf(stderr, "runbench: no %s or %s, so no spim runs\n", cgen.c_str(), spim.c_str());
+    bool haveNative = access(runtime.c_str(), R_OK) == 0 && executable(cc);
+    if(!haveNative)
+        fprintf(stderr, "runbench: no %s or %s, so no native runs\n", runtime.c_str(), cc.c_str());
+
+    std::string tokens = dir + "/prog.tokens", ast = dir + "/prog.ast", typed = dir + "/prog.typed";
+    std::string assembly = dir + "/prog.s", native = dir + "/prog.native", errors = dir + "/errors";
+    std::vector<std::string> none;
+    int failures = 0, skipped = 0;
+
+    fprintf(stderr, "%-32s %10s %10s %10s %10s %10s %10s %10s\n", "program", "ast ms", "vm ms", "native ms", "spim ms",
+            "ast x", "vm x", "native x");
+    for(size_t p = 0; p < programs.size(); p++){
+        size_t slash = programs[p].rfind('/');
+        std::string where = slash == std::string::npos ? "." : programs[p].substr(0, slash + 1);
+        std::vector<std::string> args(1, lexer);
+        args.push_back(programs[p].substr(slash + 1));
+        bool ok = run(args, NULL, tokens.c_str(), errors.c_str(), none, where.c_str()).status == 0
+               && run(std::vector<std::string>(1, parser), tokens.c_str(), ast.c_str(), errors.c_str(), none).status == 0;
+        if(ok && (haveSpim || fromDir))
+            ok = run(std::vector<std::string>(1, semant), ast.c_str(), typed.c_str(), errors.c_str(), none).status == 0;
+        if(!ok && fromDir){
+            skipped++;
+            continue;
+        }
+        if(ok && haveSpim){
+            args.assign(1, cgen);
+            args.push_back("-o");
+            args.push_back(assembly);
+            ok = run(args, typed.c_str(), (dir + "/cgen.out").c_str(), errors.c_str(), none).status == 0;
+        }
+        bool nativeOk = false;
+        if(ok && haveNative){
+            std::vector<std::string> env(1, "COOL_CODEGEN=x86-64");
+            nativeOk = run(std::vector<std::string>(1, semant), ast.c_str(), (native + ".s").c_str(), errors.c_str(), env).status == 0;
+            args.assign(1, cc);
+            args.push_back(native + ".s");
+            args.push_back(runtime);
+            args.push_back("-o");
+            args.push_back(native);
+            nativeOk = nativeOk && run(args, NULL, (dir + "/cc.out").c_str(), errors.c_str(), none).status == 0;
+            ok = nativeOk;
+        }
+        if(!ok){
+            fprintf(stderr, "runbench: cannot compile %s, see %s\n", programs[p].c_str(), errors.c_str());
+            failures++;
+            continue;
+        }
+
+        /* semant's SSA form, with a .ir file to hold it to */
+        std::string irPath = expectedFile(programs[p], ".ir");
+        if(!irPath.empty()){
+            std::vector<std::string> env(1, "COOL_IR=dump");
+            std::string ir = dir + "/prog.ir";
+            run(std::vector<std::string>(1, semant), ast.c_str(), (dir + "/ir.out").c_str(), ir.c_str(), env);
+            if(readFile(ir) != readFile(irPath)){
+                fprintf(stderr, "runbench: %s does not build %s, see %s\n", programs[p].c_str(), irPath.c_str(), ir.c_str());
+                failures++;
+            }
+        }
+
+        run_result kept[E_ENGINES];
+        std::string outputs[E_ENGINES];
+        for(int e = 0; e < E_ENGINES; e++){
+            kept[e].status = -1;
+            if((e == E_SPIM && !haveSpim) || (e == E_NATIVE && !nativeOk))
+                continue;
+            std::vector<std::string> env;
+            const std::string& programInput = inputs[p].empty() ? input : inputs[p];
+            const char *in = programInput.c_str();
+            if(e == E_SPIM){
+                args.assign(1, spim);
+                args.push_back("-file");
+                args.push_back(assembly);
+            }
+            else if(e == E_NATIVE)
+                args.assign(1, native);
+            else {
+                args.assign(1, semant);
+                env.push_back(std::string("COOL_RUN=") + engineNames[e]);
+                env.push_back("COOL_RUN_INPUT=" + programInput);
+                in = ast.c_str();
+            }
+            std::string out = dir + "/out." + engineNames[e];
+            std::vector<run_result> results;
+            for(int i = 0; i < runs; i++)
+                results.push_back(run(args, in, out.c_str(), errors.c_str(), env));
+            std::sort(results.begin(), results.end(), byWall);
+            kept[e] = results[results.size() / 2];
+            outputs[e] = e == E_SPIM ? spimOutput(readFile(out)) : readFile(out);
+        }
+
+        /* the engines are checked against spim, or against the VM without it, and against the .out file */
+        int reference = haveSpim ? E_SPIM : E_VM;
+        std::string expectedPath = expectedFile(programs[p], ".out");
+        std::string expected = readFile(expectedPath);
+        for(int e = 0; e < E_ENGINES; e++){
+            if(kept[e].status < 0)
+                continue;
+            bool same = outputs[e] == outputs[reference];
+            bool asExpected = expectedPath.empty() || outputs[e] == expected;
+            bool sameStatus = e == E_SPIM || kept[e].status == kept[E_VM].status;
+            failures += !(same && asExpected && sameStatus);
+            run_result& r = kept[e];
+            printf("{\"program\":\"%s\",\"engine\":\"%s\",\"status\":%d,\"wall_ms\":%.3f,\"cpu_ms\":%.3f,"
+                   "\"max_rss_kb\":%ld,\"output\":\"%s\"}\n", programs[p].c_str(), engineNames[e], r.status,
+                   r.wall, r.cpu, r.rss, same && asExpected && sameStatus ? "same" : "differs");
+            if(!same)
+                fprintf(stderr, "runbench: %s prints something else under %s, see %s/out.%s\n",
+                        programs[p].c_str(), engineNames[e], dir.c_str(), engineNames[e]);
+            if(!asExpected)
+                fprintf(stderr, "runbench: %s does not print %s under %s, see %s/out.%s\n",
+                        programs[p].c_str(), expectedPath.c_str(), engineNames[e], dir.c_str(), engineNames[e]);
+            if(!sameStatus)
+                fprintf(stderr, "runbench: %s exits with %d under %s but %d under vm\n",
+                        programs[p].c_str(), r.status, engineNames[e], kept[E_VM].status);
+        }
+        fflush(stdout);
+
+        const char *name = strrchr(programs[p].c_str(), '/');
+        name = name != NULL ? name + 1 : programs[p].c_str();
+        /* the times, then the speedups over spim */
+        fprintf(stderr, "%-32s", name);
+        for(int e = 0; e < E_ENGINES; e++)
+            if(kept[e].status >= 0)
+                fprintf(stderr, " %10.3f", kept[e].wall);
+            else
+                fprintf(stderr, " %10s", "-");
+        for(int e = 0; e < E_SPIM; e++)
+            if(kept[e].status >= 0 && kept[E_SPIM].status >= 0 && kept[e].wall > 0)
+                fprintf(stderr, " %9.2fx", kept[E_SPIM].wall / kept[e].wall);
+            else
+                fprintf(stderr, " %10s", "-");
+        fprintf(stderr, "\n");
+    }
+    if(skipped)
+        fprintf(stderr, "runbench: skipped %d programs that do not compile\n", skipped);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,315 @@
+/*
+ *  serverbench: the latency of a compile through semant-server, against
+ *  the same compile started cold.
+ *
+ *    serverbench [options] [program.cl ...]
+ *
+ *  Each program is compiled -runs times each way, the two alternating:
+ *
+ *    cold    ../Lexer/lexer, ../Parser/parser and ../Semantic/semant,
+ *            each a new process on the previous one's output, as
+ *            mycoolc runs them; or, with -cold P, P on the source files,
+ *            for a front end built into one program
+ *    server  ../Server/semant-client on the source files, against a
+ *            server that serverbench starts on a socket of its own and
+ *            stops when it is done
+ *
+ *  A compile's latency is the wall time from starting its first process
+ *  to the end of its last. One compile each way runs untimed first, so
+ *  the server has built its basic classes and the files are cached.
+ *  Every (program, way) gives a JSON line on stdout with the p50, p99,
+ *  mean and worst latency; a table with the server's speedup at p50 and
+ *  p99 goes to stderr. Both ways must print the same tree and exit the
+ *  same way in every round, so serverbench exits with 1 when they do
+ *  not. Without programs, gencool writes ones of 1, 10 and 100 classes.
+ *
+ *    -lexer P, -parser P, -semant P     the cold phases
+ *    -cold P           one program for the whole cold compile instead
+ *    -client P, -server P               the server's (../Server/semant-*)
+ *    -gencool P        (./gencool)
+ *    -runs N           timed compiles of each program each way (100)
+ *    -dir D            where the programs, outputs and socket go
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+static const long defaultClasses[] = { 1, 10, 100 };
+
+enum way { W_COLD, W_SERVER, W_WAYS };
+static const char *wayNames[W_WAYS] = { "cold", "server" };
+
+struct compile_result {
+    int status;							/* the last process's, as a shell reports it; -1 if none ran */
+    double wall;						/* in ms */
+};
+
+static double now(){
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+static pid_t start(const std::vector<std::string>& args, const char *cwd, int in, int out, int err){
+    std::vector<char *> argv;
+    for(size_t i = 0; i < args.size(); i++)
+        argv.push_back((char *) args[i].c_str());
+    argv.push_back(NULL);
+    pid_t pid = fork();
+    if(pid == 0){
+        if(cwd != NULL && chdir(cwd) != 0)
+            _exit(127);
+        if(in >= 0)
+            dup2(in, 0);
+        dup2(out, 1);
+        dup2(err, 2);
+        for(int fd = 3; fd < 64; fd++)
+            close(fd);
+        execvp(argv[0], &argv[0]);
+        _exit(127);
+    }
+    return pid;
+}
+
+/*
+ * the commands in cwd, each reading the one before it through a pipe; the
+ * first reads /dev/null, the last writes to out, and all of them to errFile
+ */
+static compile_result pipeline(const std::vector<std::vector<std::string> >& commands, const char *cwd,
+                               const char *out, const char *errFile){
+    compile_result r = { -1, 0 };
+    int outFd = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    int errFd = open(errFile, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    int in = open("/dev/null", O_RDONLY);
+    if(outFd < 0 || errFd < 0 || in < 0)
+        return r;
+
+    double begin = now();
+    std::vector<pid_t> pids;
+    for(size_t i = 0; i < commands.size(); i++){
+        int p[2] = { -1, -1 };
+        bool last = i + 1 == commands.size();
+        if(!last && pipe(p) != 0)
+            break;
+        pids.push_back(start(commands[i], cwd, in, last ? outFd : p[1], errFd));
+        close(in);
+        if(!last)
+            close(p[1]);
+        in = p[0];
+    }
+    int status = 0;
+    bool ran = pids.size() == commands.size();
+    for(size_t i = 0; i < pids.size(); i++)
+        if(pids[i] < 0 || waitpid(pids[i], &status, 0) != pids[i])
+            ran = false;
+    r.wall = now() - begin;
+    if(ran)
+        r.status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    close(outFd);
+    close(errFd);
+    return r;
+}
+
+static std::string readFile(const std::string& path){
+    std::string text;
+    FILE *f = fopen(path.c_str(), "r");
+    if(f == NULL)
+        return text;
+    char buf[65536];
+    size_t n;
+    while((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        text.append(buf, n);
+    fclose(f);
+    return text;
+}
+
+/* a path that still names the same file from another directory; a bare name is looked up in PATH */
+static std::string absolute(const std::string& path){
+    if(path.empty() || path[0] == '/' || path.find('/') == std::string::npos)
+        return path;
+    char cwd[4096];
+    return getcwd(cwd, sizeof(cwd)) != NULL ? std::string(cwd) + "/" + path : path;
+}
+
+/* the latency that fraction p of the compiles took at most (nearest rank) */
+static double percentile(const std::vector<double>& sorted, double p){
+    size_t rank = (size_t) (p * sorted.size() + 0.999999);
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+/* semant-server on its own socket; false if it never answered */
+static bool startServer(const std::string& server, const std::string& socketPath, pid_t& pid){
+    int null = open("/dev/null", O_RDWR);
+    pid = start(std::vector<std::string>(1, server), NULL, null, null, null);
+    close(null);
+    if(pid < 0)
+        return false;
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", socketPath.c_str());
+    for(int tries = 0; tries < 500; tries++){
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        bool up = fd >= 0 && connect(fd, (sockaddr *) &address, sizeof(address)) == 0;
+        if(fd >= 0)
+            close(fd);
+        if(up)
+            return true;
+        if(waitpid(pid, NULL, WNOHANG) == pid)
+            return false;
+        timespec wait = { 0, 10000000 };
+        nanosleep(&wait, NULL);
+    }
+    return false;
+}
+
+static void usage(){
+    fprintf(stderr, "usage: serverbench [-lexer P] [-parser P] [-semant P] [-cold P] [-client P] [-server P]\n"
+                    "                   [-gencool P] [-runs N] [-dir D] [program.cl ...]\n");
+    exit(2);
+}
+
+int main(int argc, char **argv){
+    std::string lexer = "../Lexer/lexer", parser = "../Parser/parser", semant = "../Semantic/semant";
+    std::string cold, client = "../Server/semant-client", server = "../Server/semant-server";
+    std::string gencool = "./gencool";
+    int runs = 100;
+    char dirBuf[64];
+    snprintf(dirBuf, sizeof(dirBuf), "/tmp/serverbench.%d", (int) getpid());
+    std::string dir = dirBuf;
+    std::vector<std::string> programs;
+
+    for(int i = 1; i < argc; i++){
+        std::string opt = argv[i];
+        if(opt[0] != '-'){
+            programs.push_back(opt);
+            continue;
+        }
+        if(i + 1 >= argc)
+            usage();
+        std::string value = argv[++i];
+        if(opt == "-lexer") lexer = value;
+        else if(opt == "-parser") parser = value;
+        else if(opt == "-semant") semant = value;
+        else if(opt == "-cold") cold = value;
+        else if(opt == "-client") client = value;
+        else if(opt == "-server") server = value;
+        else if(opt == "-gencool") gencool = value;
+        else if(opt == "-runs") runs = atoi(value.c_str());
+        else if(opt == "-dir") dir = value;
+        else
+            usage();
+    }
+    if(runs < 1)
+        usage();
+    /* each compile runs in its program's directory, on the program's own name */
+    std::string *tools[] = { &lexer, &parser, &semant, &cold, &client, &server, &gencool };
+    for(size_t i = 0; i < sizeof(tools) / sizeof(tools[0]); i++)
+        *tools[i] = absolute(*tools[i]);
+    dir = absolute(dir.find('/') == std::string::npos ? "./" + dir : dir);
+    mkdir(dir.c_str(), 0777);
+    std::string errors = dir + "/errors";
+
+    if(programs.empty()){
+        for(size_t i = 0; i < sizeof(defaultClasses) / sizeof(defaultClasses[0]); i++){
+            char number[32], name[64];
+            snprintf(number, sizeof(number), "%ld", defaultClasses[i]);
+            snprintf(name, sizeof(name), "/classes-%ld.cl", defaultClasses[i]);
+            std::vector<std::vector<std::string> > gen(1, std::vector<std::string>(1, gencool));
+            gen[0].push_back("-classes");
+            gen[0].push_back(number);
+            programs.push_back(dir + name);
+            if(pipeline(gen, NULL, programs.back().c_str(), errors.c_str()).status != 0){
+                fprintf(stderr, "serverbench: %s failed, see %s\n", gencool.c_str(), errors.c_str());
+                return 2;
+            }
+        }
+    }
+
+    /* the client and the server it reaches share the socket through the environment */
+    std::string socketPath = dir + "/socket";
+    setenv("COOL_SEMANT_SERVER", socketPath.c_str(), 1);
+    setenv("COOL_SEMANT_SERVER_IDLE", "0", 1);
+    pid_t serverPid;
+    if(!startServer(server, socketPath, serverPid)){
+        fprintf(stderr, "serverbench: %s did not start\n", server.c_str());
+        return 2;
+    }
+
+    fprintf(stderr, "%-32s %10s %10s %10s %10s %8s %8s\n", "program",
+            "cold p50", "cold p99", "server p50", "server p99", "x p50", "x p99");
+    int failures = 0;
+    for(size_t p = 0; p < programs.size(); p++){
+        size_t slash = programs[p].rfind('/');
+        std::string where = slash == std::string::npos ? "." : programs[p].substr(0, slash + 1);
+        std::string name = programs[p].substr(slash + 1);
+        std::vector<std::vector<std::string> > commands[W_WAYS];
+        if(cold.empty()){
+            commands[W_COLD].push_back(std::vector<std::string>(1, lexer));
+            commands[W_COLD].back().push_back(name);
+            commands[W_COLD].push_back(std::vector<std::string>(1, parser));
+            commands[W_COLD].push_back(std::vector<std::string>(1, semant));
+        }
+        else{
+            commands[W_COLD].push_back(std::vector<std::string>(1, cold));
+            commands[W_COLD].back().push_back(name);
+        }
+        commands[W_SERVER].push_back(std::vector<std::string>(1, client));
+        commands[W_SERVER].back().push_back(name);
+        std::string outputs[W_WAYS] = { dir + "/cold.out", dir + "/server.out" };
+
+        std::vector<double> walls[W_WAYS];
+        int statuses[W_WAYS];
+        bool same = true;
+        for(int i = -1; i < runs && same; i++){
+            for(int w = 0; w < W_WAYS; w++){
+                compile_result r = pipeline(commands[w], where.c_str(), outputs[w].c_str(), errors.c_str());
+                statuses[w] = r.status;
+                if(i >= 0)
+                    walls[w].push_back(r.wall);
+            }
+            same = statuses[W_COLD] == statuses[W_SERVER] && statuses[W_COLD] >= 0
+                    && readFile(outputs[W_COLD]) == readFile(outputs[W_SERVER]);
+        }
+        if(!same){
+            fprintf(stderr, "serverbench: %s: the server's compile exited with %d, the cold one with %d;"
+                    " compare %s and %s\n", programs[p].c_str(), statuses[W_SERVER], statuses[W_COLD],
+                    outputs[W_SERVER].c_str(), outputs[W_COLD].c_str());
+            failures++;
+            continue;
+        }
+
+        double p50[W_WAYS], p99[W_WAYS];
+        for(int w = 0; w < W_WAYS; w++){
+            std::sort(walls[w].begin(), walls[w].end());
+            double total = 0;
+            for(size_t i = 0; i < walls[w].size(); i++)
+                total += walls[w][i];
+            p50[w] = percentile(walls[w], 0.50);
+            p99[w] = percentile(walls[w], 0.99);
+            printf("{\"program\":\"%s\",\"way\":\"%s\",\"status\":%d,\"runs\":%d,"
+                   "\"p50_ms\":%.3f,\"p99_ms\":%.3f,\"mean_ms\":%.3f,\"max_ms\":%.3f}\n",
+                   programs[p].c_str(), wayNames[w], statuses[w], runs,
+                   p50[w], p99[w], total / walls[w].size(), walls[w].back());
+        }
+        fflush(stdout);
+        fprintf(stderr, "%-32s %10.3f %10.3f %10.3f %10.3f %8.2f %8.2f\n", programs[p].c_str(),
+                p50[W_COLD], p99[W_COLD], p50[W_SERVER], p99[W_SERVER],
+                p50[W_COLD] / p50[W_SERVER], p99[W_COLD] / p99[W_SERVER]);
+    }
+
+    kill(serverPid, SIGTERM);
+    waitpid(serverPid, NULL, 0);
+    return failures ? 1 : 0;
+}
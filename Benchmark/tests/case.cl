@@ -0,0 +1,90 @@
+(*
+ *  Case on a hierarchy several levels deep: each object takes the
+ *  branch of its closest ancestor among the branches, whatever their
+ *  order, a case nested in another's branch and in its own expression
+ *  chooses on its own, and an object no branch covers stops the
+ *  program with the runtime's error.
+ *
+ *        A           Object
+ *       / \
+ *      B   E
+ *     / \   \
+ *    C   F   G
+ *    |
+ *    D
+ *)
+
+class A { name() : String { "A" }; };
+class B inherits A { name() : String { "B" }; };
+class C inherits B { name() : String { "C" }; };
+class D inherits C { name() : String { "D" }; };
+class E inherits A { name() : String { "E" }; };
+class F inherits B { name() : String { "F" }; };
+class G inherits E { name() : String { "G" }; };
+
+class Main inherits IO {
+    line(s : String) : IO { out_string(s.concat("\n")) };
+
+    (* the narrow branches come after the wide ones *)
+    outer(o : Object, p : Object) : Object {
+        case o of
+            x : Object => { line("Object"); x; };
+            a : A => { line("A ".concat(a.name())); a; };
+            c : C => {
+                out_string("C ".concat(c.name()).concat(", then "));
+                inner(p);
+                c;
+            };
+            g : G => { line("G ".concat(g.name())); g; };
+            e : E => { line("E ".concat(e.name())); e; };
+        esac
+    };
+
+    (* the same tags split another way *)
+    inner(o : Object) : Object {
+        case o of
+            d : D => { line("D"); d; };
+            f : F => { line("F"); f; };
+            b : B => { line("B ".concat(b.name())); b; };
+            s : String => { line("String ".concat(s)); s; };
+            x : Object => { line("Object ".concat(x.type_name())); x; };
+        esac
+    };
+
+    only(o : Object) : Object {
+        case o of
+            b : B => { line("B"); b; };
+            e : E => { line("E"); e; };
+        esac
+    };
+
+    make(s : String) : A {
+        if s = "A" then new A else
+        if s = "B" then new B else
+        if s = "C" then new C else
+        if s = "D" then new D else
+        if s = "E" then new E else
+        if s = "F" then new F else new G fi fi fi fi fi fi
+    };
+
+    main() : Object {
+        let all : String <- "ABCDEFG", i : Int, o : A in {
+            while i < all.length() loop {
+                o <- make(all.substr(i, 1));
+                self.outer(o, o);
+                i <- i + 1;
+            } pool;
+            self.outer(new C, new F);
+            self.outer(new D, "no class");
+            self.outer(new C, 3);
+            self.outer(new D, new A);
+            self.outer(1, 2);
+            self.outer(self, self);
+            inner(case new G of e : E => e; esac);
+            only(new D);
+            only(new G);
+            only(new A);
+            line("not reached");
+        }
+    };
+};
@@ -0,0 +1,56 @@
+(*
+ *  Constant folding, which must not change what a program prints:
+ *  arithmetic on literals wraps around as 32-bit Ints do, the
+ *  identities keep their other operand's effects, a conditional or a
+ *  loop on a literal keeps the branch it takes, and a division by a
+ *  literal zero is still reported when it runs, on its own line.
+ *)
+
+class Main inherits IO {
+    calls : Int;
+
+    int(n : Int) : IO { { out_int(n); out_string("\n"); } };
+    bool(b : Bool) : IO { if b then out_string("true\n") else out_string("false\n") fi };
+    counted(n : Int) : Int { { calls <- calls + 1; n; } };
+
+    main() : Object {
+        let zero : Int <- 0 in {
+            int(2147483647 + 1);
+            int(~2147483647 - 2);
+            int(2147483647 * 2);
+            int(65536 * 65536);
+            int(46341 * 46341);
+            int(~2147483647 - 1);
+            int(~(~2147483647 - 1));
+            int((~2147483647 - 1) / ~1);
+            int(7 / 2);
+            int(~7 / 2);
+            int(7 / ~2);
+            int(1 + 2 * 3 - 4 / 2);
+
+            bool(1 < 2);
+            bool(2 <= 1);
+            bool(3 = 3);
+            bool(not (3 = 4));
+            bool(not true);
+            bool(isvoid 5);
+
+            int(counted(5) + 0);
+            int(0 + counted(6));
+            int(counted(7) - 0);
+            int(counted(8) * 1);
+            int(1 * counted(9));
+            int(counted(10) / 1);
+            int(calls);
+
+            int(if 1 < 2 then 10 else counted(0) fi);
+            int(if false then counted(0) else 20 fi);
+            bool(isvoid while false loop counted(0) pool);
+            int(calls);
+
+            int(zero / 1);
+            int(3 / 0);
+            int(4);
+        }
+    };
+};
@@ -0,0 +1,72 @@
+(*
+ *  The native heap's collector, which must not change what a program
+ *  prints. A list of 20000 nodes lives through the whole run, promoted
+ *  into the old generation, while each of 400000 rounds makes garbage
+ *  and stores a new box into one of the old nodes, which the write
+ *  barrier must remember. Hundreds of megabytes go through the
+ *  nursery, so with the default sizes the young generation is collected
+ *  many times and the old one compacted once; the sums at the end see
+ *  every box and string.
+ *)
+
+class Box {
+    value : Int;
+    name : String;
+
+    set(v : Int, s : String) : Box { { value <- v; name <- s; self; } };
+    getValue() : Int { value };
+    getName() : String { name };
+};
+
+class Node {
+    box : Box;
+    next : Node;
+
+    init(b : Box, n : Node) : Node { { box <- b; next <- n; self; } };
+    getBox() : Box { box };
+    setBox(b : Box) : Box { box <- b };
+    getNext() : Node { next };
+};
+
+class Main inherits IO {
+    nodes : Node;
+
+    digits(n : Int) : String {
+        if n < 10 then "0123456789".substr(n, 1)
+        else digits(n / 10).concat(digits(n - n / 10 * 10)) fi
+    };
+
+    sum() : Int {
+        let total : Int, node : Node <- nodes in {
+            while not isvoid node loop {
+                total <- total + node.getBox().getValue() + node.getBox().getName().length();
+                node <- node.getNext();
+            } pool;
+            total;
+        }
+    };
+
+    main() : Object {
+        let i : Int, cursor : Node, garbage : String in {
+            while i < 20000 loop {
+                nodes <- (new Node).init((new Box).set(i, digits(i)), nodes);
+                i <- i + 1;
+            } pool;
+            out_int(sum());
+            out_string("\n");
+
+            i <- 0;
+            cursor <- nodes;
+            while i < 400000 loop {
+                garbage <- digits(i).concat("-").concat(digits(i * 7));
+                cursor.setBox((new Box).set(i - i / 1000 * 1000, garbage.substr(0, garbage.length() - 1)));
+                cursor <- if isvoid cursor.getNext() then nodes else cursor.getNext() fi;
+                i <- i + 1;
+            } pool;
+            out_int(sum());
+            out_string("\n");
+            out_string(nodes.getBox().getName());
+            out_string("\n");
+        }
+    };
+};
@@ -0,0 +1,78 @@
+(*
+ *  Inlining, which must not change what a program prints: small methods
+ *  that make no calls of their own run in their callers with the same
+ *  results, the actuals evaluated in order and then the receiver, each
+ *  once, the callee's formals and the caller's variables keeping apart
+ *  though they share names, self inside the body being the receiver, a
+ *  static dispatch running the method it names, and an inlined call on
+ *  a void receiver still reported on its own line.
+ *)
+
+class Point {
+    x : Int;
+    y : Int;
+
+    init(newX : Int, newY : Int) : Point { { x <- newX; y <- newY; self; } };
+    getX() : Int { x };
+    getY() : Int { y };
+    setX(newX : Int) : Int { x <- newX };
+    me() : Point { self };
+    scale(k : Int, x0 : Int) : Int { x * k + x0 };
+    swap(x : Int, y : Int) : Int { x - y };
+    kind() : String { "point" };
+    sum() : Int { getX() + getY() };
+};
+
+class Point3 inherits Point {
+    z : Int <- 100;
+
+    getX() : Int { z };
+    kind() : String { "point3" };
+    pointX() : Int { self@Point.getX() };
+};
+
+class Main inherits IO {
+    calls : String <- "";
+
+    line(s : String) : IO { out_string(s.concat("\n")) };
+    int(n : Int) : IO { { out_int(n); out_string("\n"); } };
+    bool(b : Bool) : IO { if b then line("true") else line("false") fi };
+    tick(s : String) : Int { { calls <- calls.concat(s); calls.length(); } };
+    pick(s : String, p : Point) : Point { { calls <- calls.concat(s); p; } };
+
+    main() : Object {
+        let p : Point <- (new Point).init(3, 4), q : Point3 <- new Point3, none : Point in {
+            q.init(5, 6);
+            int(p.getX());
+            int(p.getY());
+            int(q.getX());
+            int(q.pointX());
+            int(p.sum());
+            int(q.sum());
+            line(p.kind().concat(" ").concat(q.kind()));
+            line(q@Point.kind());
+
+            let k : Int <- 2, x : Int <- 7, y : Int <- 1 in {
+                int(p.scale(x, k));
+                int(p.swap(y, x));
+                int(p.swap(x, y));
+                int(x - y * k);
+            };
+
+            int(self.pick("r", p).scale(self.tick("a"), self.tick("b")));
+            line(calls);
+            int(self.pick("s", q).setX(self.tick("c")));
+            line(calls);
+            int(q.pointX());
+            int(q.getX());
+
+            bool(p.me() = p);
+            bool(q.me() = p);
+            int(p.init(8, 9).getY());
+            int(p.getX() * p.getY());
+
+            int(none.getY());
+            line("not reached");
+        }
+    };
+};
@@ -0,0 +1,90 @@
+(*
+ *  The tree interpreter's dispatch, which must not change what a program
+ *  prints: a site that sees more classes than its inline cache holds,
+ *  some inheriting the method and some overriding it, gets each one's
+ *  method every time, in whatever order they come, next to a site that
+ *  sees one class only; and recursion thousands of calls deep runs on
+ *  the interpreter's own stack.
+ *)
+
+class Shape {
+    next : Shape;
+
+    link(s : Shape) : Shape { { next <- s; self; } };
+    getNext() : Shape { next };
+    area() : Int { 0 };
+    name() : String { "shape" };
+};
+
+class Square inherits Shape { area() : Int { 4 }; name() : String { "square" }; };
+class Circle inherits Shape { area() : Int { 3 }; name() : String { "circle" }; };
+class Line inherits Shape { name() : String { "line" }; };
+class Triangle inherits Shape { area() : Int { 2 }; };
+class Hexagon inherits Shape { area() : Int { 6 }; name() : String { "hexagon" }; };
+class Cube inherits Square { area() : Int { 24 }; };
+
+class Counter {
+    count : Int;
+
+    bump() : Int { count <- count + 1 };
+};
+
+class Main inherits IO {
+    line(s : String) : IO { out_string(s.concat("\n")) };
+    int(n : Int) : IO { { out_int(n); out_string("\n"); } };
+
+    (* the list of shapes in the order the letters name them *)
+    shapes(kinds : String) : Shape {
+        let list : Shape, i : Int <- kinds.length(), k : String in {
+            while 0 < i loop {
+                i <- i - 1;
+                k <- kinds.substr(i, 1);
+                list <- (if k = "S" then new Square else
+                         if k = "C" then new Circle else
+                         if k = "L" then new Line else
+                         if k = "T" then new Triangle else
+                         if k = "H" then new Hexagon else
+                         if k = "U" then new Cube else new Shape fi fi fi fi fi fi).link(list);
+            } pool;
+            list;
+        }
+    };
+
+    (* one site for every shape's area and one for its name *)
+    walk(list : Shape, rounds : Int) : Int {
+        let total : Int, names : String <- "", s : Shape in {
+            while 0 < rounds loop {
+                s <- list;
+                while not isvoid s loop {
+                    total <- total + s.area();
+                    if rounds = 1 then names <- names.concat(s.name()).concat(" ") else names fi;
+                    s <- s.getNext();
+                } pool;
+                rounds <- rounds - 1;
+            } pool;
+            line(names);
+            total;
+        }
+    };
+
+    depth(n : Int) : Int { if n = 0 then 0 else 1 + depth(n - 1) fi };
+    even(n : Int) : Bool { if n = 0 then true else odd(n - 1) fi };
+    odd(n : Int) : Bool { if n = 0 then false else even(n - 1) fi };
+    build(n : Int) : Shape { if n = 0 then new Shape else (new Square).link(build(n - 1)) fi };
+    length(s : Shape) : Int { if isvoid s then 0 else 1 + length(s.getNext()) fi };
+
+    main() : Object {
+        let c : Counter <- new Counter, i : Int in {
+            int(self.walk(shapes("SCLTHUX"), 100));
+            int(self.walk(shapes("XUHTLCS"), 100));
+            int(self.walk(shapes("SSSCCC"), 10));
+            int(self.walk(shapes("UTUTLLXHC"), 1000));
+            while i < 10000 loop { c.bump(); i <- i + 1; } pool;
+            int(c.bump());
+
+            int(depth(10000));
+            if even(10001) then line("even") else line("odd") fi;
+            int(length(build(10000)));
+        }
+    };
+};
@@ -0,0 +1,93 @@
+(*
+ *  The SSA form (COOL_IR=dump, checked against ssa.ir): loops whose
+ *  variables meet their updates in phis, nested conditionals that assign
+ *  on some paths and not others, a case whose branches join, let
+ *  variables shadowing one another, and attributes read and written in
+ *  the object. Each engine must still print the same.
+ *)
+
+class Main inherits IO {
+    total : Int;
+
+    int(n : Int) : IO { { out_int(n); out_string("\n"); } };
+
+    (* i and sum each meet their update at the loop's header *)
+    triangle(n : Int) : Int {
+        let i : Int <- 1, sum : Int in {
+            while i <= n loop { sum <- sum + i; i <- i + 1; } pool;
+            sum;
+        }
+    };
+
+    (* a loop in a loop, the inner one's phis inside the outer's *)
+    grid(n : Int) : Int {
+        let row : Int, count : Int in {
+            while row < n loop {
+                let col : Int in
+                    while col <= row loop { count <- count + row * col; col <- col + 1; } pool;
+                row <- row + 1;
+            } pool;
+            count;
+        }
+    };
+
+    (* x is assigned on some paths only *)
+    classify(n : Int) : Int {
+        let x : Int <- 0 in {
+            if n < 0 then x <- ~n
+            else if n = 0 then x
+            else if n < 10 then x <- n * 2 else x <- n fi fi fi;
+            x;
+        }
+    };
+
+    (* n changes in the body the condition reads *)
+    collatz(n : Int) : Int {
+        let steps : Int in {
+            while not n = 1 loop {
+                if n - n / 2 * 2 = 0 then n <- n / 2 else n <- 3 * n + 1 fi;
+                steps <- steps + 1;
+            } pool;
+            steps;
+        }
+    };
+
+    kind(o : Object) : Int {
+        let k : Int <- 100 in {
+            case o of
+                i : Int => k <- k + i;
+                s : String => { k <- k + s.length(); s; };
+                x : Object => k <- 0;
+            esac;
+            k;
+        }
+    };
+
+    shadow(n : Int) : Int {
+        let a : Int <- n in {
+            let a : Int <- a * 10 in {
+                let a : Int <- a + 1 in total <- total + a;
+                a <- a + 2;
+                total <- total + a;
+            };
+            a + total;
+        }
+    };
+
+    main() : Object {
+        {
+            int(triangle(100));
+            int(grid(10));
+            int(classify(~5));
+            int(classify(0));
+            int(classify(7));
+            int(classify(42));
+            int(collatz(27));
+            int(kind(5));
+            int(kind("four"));
+            int(kind(self));
+            int(shadow(3));
+            int(total);
+        }
+    };
+};
@@ -0,0 +1,93 @@
+(*
+ *  The bytecode VM's instructions, each engine printing the same: the
+ *  attributes and their initializers, inherited and overridden, dispatch
+ *  on self and on other objects, static dispatch, new SELF_TYPE, the
+ *  basic methods, let and case variables over the frame, while, and the
+ *  equality of each kind of object.
+ *)
+
+class Counter inherits IO {
+    count : Int <- 10;
+    name : String <- "counter";
+    next : Counter;
+
+    bump(by : Int) : SELF_TYPE { { count <- count + by; self; } };
+    get() : Int { count };
+    label() : String { name.concat(" ").concat(type_name()) };
+    fresh() : SELF_TYPE { new SELF_TYPE };
+    link(c : Counter) : Counter { next <- c };
+    chain() : Int { if isvoid next then count else count + next.chain() fi };
+};
+
+class Doubler inherits Counter {
+    bump(by : Int) : SELF_TYPE { { self@Counter.bump(2 * by); self; } };
+    label() : String { "doubler ".concat(self@Counter.label()) };
+};
+
+class Main inherits IO {
+    line(s : String) : IO { out_string(s.concat("\n")) };
+    int(n : Int) : IO { { out_int(n); out_string("\n"); } };
+    bool(b : Bool) : IO { if b then line("true") else line("false") fi };
+
+    sum(n : Int) : Int {
+        let total : Int, i : Int <- 1 in {
+            while i <= n loop { total <- total + i; i <- i + 1; } pool;
+            total;
+        }
+    };
+
+    describe(o : Object) : Object {
+        case o of
+            d : Doubler => { line("a Doubler"); d; };
+            c : Counter => { line("a Counter"); c; };
+            s : String => { line("the String ".concat(s)); s; };
+            i : Int => { line("an Int"); i; };
+            x : Object => line(x.type_name());
+        esac
+    };
+
+    main() : Object {
+        let c : Counter <- new Counter, d : Counter <- new Doubler, s : String <- "hello, world" in {
+            int(c.bump(1).bump(2).get());
+            int(d.bump(1).bump(2).get());
+            line(c.label());
+            line(d.label());
+            line(d.fresh().type_name());
+            int(d.fresh().get());
+            c.link(d);
+            d.link(new Counter);
+            int(c.chain());
+
+            int(s.length());
+            line(s.substr(7, 5));
+            line(s.substr(0, 5).concat(s.substr(5, 7)));
+            line(s.copy());
+            line(type_name());
+            line(copy().type_name());
+
+            int(sum(100));
+            int(7 / 2);
+            int(~7 / 2);
+            int(3 - 10 * 2);
+            bool(2 < 3);
+            bool(3 <= 2);
+            bool(not (1 = 1));
+            bool(s = "hello, world");
+            bool(c = c.copy());
+            bool(c = c);
+            bool(isvoid c.link(c));
+
+            describe(c);
+            describe(d);
+            describe(s);
+            describe(42);
+            describe(true);
+            describe(self);
+
+            let c : Int <- 1 in {
+                let c : Int <- c + 1 in int(c);
+                int(c);
+            };
+        }
+    };
+};
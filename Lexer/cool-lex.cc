@@ -712,6 +712,13 @@ char *yytext;
 #include <cool-parse.h>
 #include <stringtab.h>
 #include <utilities.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
 
 /* The compiler assumes these identifiers. */
 #define yylval cool_yylval
@@ -727,9 +734,10 @@ extern FILE *fin; /* we read from this file */
  * This change makes it possible to use this scanner in
  * the Cool compiler.
  */
+static size_t traced_read(char *buf, size_t max_size);
 #undef YY_INPUT
 #define YY_INPUT(buf,result,max_size) \
-	if ( (result = fread( (char*)buf, sizeof(char), max_size, fin)) < 0) \
+	if ( (result = traced_read( (char*)buf, max_size)) < 0) \
 		YY_FATAL_ERROR( "read() in flex scanner failed");
 
 char string_buf[MAX_STR_CONST]; /* to assemble string constants */
@@ -746,6 +754,82 @@ extern YYSTYPE cool_yylval;
 
 int comm=0;		/* Variable for comment nesting */
 
+/*
+ * With COOL_TRACE=<file>, each read of the source is recorded as a
+ * Chrome trace event and appended to <file> at exit, next to the events
+ * of the later phases (see the parser and semant). Each phase leaves the
+ * array closed, so the file can be read between runs.
+ */
+#define TRACE_READS 4096	/* reads recorded; later ones are not */
+
+struct trace_read {
+	double start, dur;	/* in us */
+	size_t bytes;
+};
+
+static const char *trace_file;
+static int trace_checked;
+static double trace_start;
+static trace_read trace_reads[TRACE_READS];
+static int trace_count;
+
+static double trace_clock()
+{
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1e6 + now.tv_nsec / 1e3;
+}
+
+static void write_trace()
+{
+	int pid = getpid();
+	int fd = open(trace_file, O_RDWR | O_APPEND | O_CREAT, 0666);
+	if (fd < 0)
+		return;
+	struct stat st;
+	char tail[3];
+	flock(fd, LOCK_EX);
+	/* start the array, or reopen the one the last phase closed */
+	if (fstat(fd, &st) == 0 && st.st_size == 0)
+		write(fd, "[\n", 2);
+	else if (st.st_size >= 3 && pread(fd, tail, 3, st.st_size - 3) == 3 && memcmp(tail, "\n]\n", 3) == 0
+		 && ftruncate(fd, st.st_size - 3) == 0)
+		write(fd, ",\n", 2);
+	FILE *out = fdopen(fd, "a");
+	fprintf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"lexer\"}}", pid, pid);
+	fprintf(out, ",\n{\"name\":\"lexer\",\"cat\":\"phase\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d}",
+		trace_start, trace_clock() - trace_start, pid, pid);
+	for (int i = 0; i < trace_count; i++)
+		fprintf(out, ",\n{\"name\":\"read\",\"cat\":\"scanner\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d,\"args\":{\"bytes\":%lu}}",
+			trace_reads[i].start, trace_reads[i].dur, pid, pid, (unsigned long) trace_reads[i].bytes);
+	fputs("\n]\n", out);
+	fclose(out);	/* the lock is held until here */
+}
+
+static size_t traced_read(char *buf, size_t max_size)
+{
+	if (!trace_checked) {
+		trace_checked = 1;
+		trace_file = getenv("COOL_TRACE");
+		if (trace_file != NULL) {
+			trace_start = trace_clock();
+			atexit(write_trace);
+		}
+	}
+	if (trace_file == NULL)
+		return fread(buf, sizeof(char), max_size, fin);
+
+	double start = trace_clock();
+	size_t bytes = fread(buf, sizeof(char), max_size, fin);
+	if (trace_count < TRACE_READS) {
+		trace_reads[trace_count].start = start;
+		trace_reads[trace_count].dur = trace_clock() - start;
+		trace_reads[trace_count].bytes = bytes;
+		trace_count++;
+	}
+	return bytes;
+}
+
 /*
  * Define names for regular expressions here.
  */
@@ -753,7 +837,7 @@ int comm=0;		/* Variable for comment nesting */
  * State Definitions
  */
 
-#line 757 "cool-lex.cc"
+#line 841 "cool-lex.cc"
 
 #define INITIAL 0
 #define comment 1
@@ -1003,14 +1087,14 @@ YY_DECL
 	register int yy_act;
     
 /* %% [7.0] user's declarations go here */
-#line 68 "cool.flex"
+#line 152 "cool.flex"
 
 
 
  /*
   *  The multiple-character operators.
   */
-#line 1014 "cool-lex.cc"
+#line 1098 "cool-lex.cc"
 
 	if ( !(yy_init) )
 		{
@@ -1126,17 +1210,17 @@ do_action:	/* This label is used only to access EOF actions. */
 
 case 1:
 YY_RULE_SETUP
-#line 74 "cool.flex"
+#line 158 "cool.flex"
 return DARROW;
 	YY_BREAK
 case 2:
 YY_RULE_SETUP
-#line 75 "cool.flex"
+#line 159 "cool.flex"
 return ASSIGN;
 	YY_BREAK
 case 3:
 YY_RULE_SETUP
-#line 76 "cool.flex"
+#line 160 "cool.flex"
 return LE;
 	YY_BREAK
 /*
@@ -1144,87 +1228,87 @@ return LE;
   */
 case 4:
 YY_RULE_SETUP
-#line 81 "cool.flex"
+#line 165 "cool.flex"
 return CLASS;
 	YY_BREAK
 case 5:
 YY_RULE_SETUP
-#line 82 "cool.flex"
+#line 166 "cool.flex"
 return ELSE;
 	YY_BREAK
 case 6:
 YY_RULE_SETUP
-#line 83 "cool.flex"
+#line 167 "cool.flex"
 return FI;
 	YY_BREAK
 case 7:
 YY_RULE_SETUP
-#line 84 "cool.flex"
+#line 168 "cool.flex"
 return IF;
 	YY_BREAK
 case 8:
 YY_RULE_SETUP
-#line 85 "cool.flex"
+#line 169 "cool.flex"
 return IN;
 	YY_BREAK
 case 9:
 YY_RULE_SETUP
-#line 86 "cool.flex"
+#line 170 "cool.flex"
 return INHERITS;
 	YY_BREAK
 case 10:
 YY_RULE_SETUP
-#line 87 "cool.flex"
+#line 171 "cool.flex"
 return LET;
 	YY_BREAK
 case 11:
 YY_RULE_SETUP
-#line 88 "cool.flex"
+#line 172 "cool.flex"
 return LOOP;
 	YY_BREAK
 case 12:
 YY_RULE_SETUP
-#line 89 "cool.flex"
+#line 173 "cool.flex"
 return POOL;
 	YY_BREAK
 case 13:
 YY_RULE_SETUP
-#line 90 "cool.flex"
+#line 174 "cool.flex"
 return THEN;
 	YY_BREAK
 case 14:
 YY_RULE_SETUP
-#line 91 "cool.flex"
+#line 175 "cool.flex"
 return WHILE;
 	YY_BREAK
 case 15:
 YY_RULE_SETUP
-#line 92 "cool.flex"
+#line 176 "cool.flex"
 return CASE;
 	YY_BREAK
 case 16:
 YY_RULE_SETUP
-#line 93 "cool.flex"
+#line 177 "cool.flex"
 return ESAC;
 	YY_BREAK
 case 17:
 YY_RULE_SETUP
-#line 94 "cool.flex"
+#line 178 "cool.flex"
 return OF;
 	YY_BREAK
 case 18:
 YY_RULE_SETUP
-#line 95 "cool.flex"
+#line 179 "cool.flex"
 return NEW;
 	YY_BREAK
 case 19:
 YY_RULE_SETUP
-#line 96 "cool.flex"
+#line 180 "cool.flex"
 return ISVOID;
 	YY_BREAK
 case 20:
 YY_RULE_SETUP
-#line 97 "cool.flex"
+#line 181 "cool.flex"
 return NOT;
 	YY_BREAK
 /*
@@ -1232,7 +1316,7 @@ return NOT;
   */
 case 21:
 YY_RULE_SETUP
-#line 102 "cool.flex"
+#line 186 "cool.flex"
 {
 				cool_yylval.boolean = true;
 				return BOOL_CONST;
@@ -1240,7 +1324,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 22:
 YY_RULE_SETUP
-#line 106 "cool.flex"
+#line 190 "cool.flex"
 {
 				cool_yylval.boolean = false;
 				return BOOL_CONST;
@@ -1251,7 +1335,7 @@ YY_RULE_SETUP
   */
 case 23:
 YY_RULE_SETUP
-#line 114 "cool.flex"
+#line 198 "cool.flex"
 {
 				cool_yylval.symbol = inttable.add_string(yytext);
 				return INT_CONST;
@@ -1259,7 +1343,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 24:
 YY_RULE_SETUP
-#line 118 "cool.flex"
+#line 202 "cool.flex"
 {
 				cool_yylval.symbol = idtable.add_string(yytext);
 				return TYPEID;
@@ -1267,7 +1351,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 25:
 YY_RULE_SETUP
-#line 122 "cool.flex"
+#line 206 "cool.flex"
 {
 				cool_yylval.symbol = idtable.add_string(yytext);
 				return OBJECTID;
@@ -1278,7 +1362,7 @@ YY_RULE_SETUP
   */
 case 26:
 YY_RULE_SETUP
-#line 130 "cool.flex"
+#line 214 "cool.flex"
 return int(yytext[0]);
 	YY_BREAK
 /*
@@ -1286,7 +1370,7 @@ return int(yytext[0]);
   */
 case 27:
 YY_RULE_SETUP
-#line 135 "cool.flex"
+#line 219 "cool.flex"
 {
 				cool_yylval.error_msg = yytext;
 				return ERROR;
@@ -1297,12 +1381,12 @@ YY_RULE_SETUP
   */
 case 28:
 YY_RULE_SETUP
-#line 144 "cool.flex"
+#line 228 "cool.flex"
 
 	YY_BREAK
 case 29:
 YY_RULE_SETUP
-#line 146 "cool.flex"
+#line 230 "cool.flex"
 {
 				cool_yylval.error_msg = "Unmatched *)";
 				return ERROR;
@@ -1310,7 +1394,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 30:
 YY_RULE_SETUP
-#line 150 "cool.flex"
+#line 234 "cool.flex"
 {
 				++comm;
 				BEGIN(comment);				
@@ -1318,12 +1402,12 @@ YY_RULE_SETUP
 	YY_BREAK
 case 31:
 YY_RULE_SETUP
-#line 155 "cool.flex"
+#line 239 "cool.flex"
 ++comm;
 	YY_BREAK
 case 32:
 YY_RULE_SETUP
-#line 156 "cool.flex"
+#line 240 "cool.flex"
 {
 				--comm;
 				if(comm==0)
@@ -1339,21 +1423,21 @@ YY_RULE_SETUP
 case 33:
 /* rule 33 can match eol */
 YY_RULE_SETUP
-#line 167 "cool.flex"
+#line 251 "cool.flex"
 ++curr_lineno;
 	YY_BREAK
 case 34:
 YY_RULE_SETUP
-#line 168 "cool.flex"
+#line 252 "cool.flex"
 
 	YY_BREAK
 case 35:
 YY_RULE_SETUP
-#line 169 "cool.flex"
+#line 253 "cool.flex"
 
 	YY_BREAK
 case YY_STATE_EOF(comment):
-#line 170 "cool.flex"
+#line 254 "cool.flex"
 {
 				BEGIN(INITIAL);
 				if(comm>0){
@@ -1371,7 +1455,7 @@ case YY_STATE_EOF(comment):
   */
 case 36:
 YY_RULE_SETUP
-#line 186 "cool.flex"
+#line 270 "cool.flex"
 {
 				BEGIN(string);
 				string_buf_ptr = string_buf;
@@ -1379,7 +1463,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 37:
 YY_RULE_SETUP
-#line 191 "cool.flex"
+#line 275 "cool.flex"
 {
 				if(string_buf_ptr - string_buf > MAX_STR_CONST-1){
 					*string_buf = '\0';
@@ -1394,7 +1478,7 @@ YY_RULE_SETUP
 			}
 	YY_BREAK
 case YY_STATE_EOF(string):
-#line 203 "cool.flex"
+#line 287 "cool.flex"
 {
 				cool_yylval.error_msg = "EOF in string constant";
 				BEGIN(INITIAL);
@@ -1403,7 +1487,7 @@ case YY_STATE_EOF(string):
 	YY_BREAK
 case 38:
 YY_RULE_SETUP
-#line 208 "cool.flex"
+#line 292 "cool.flex"
 {
 				*string_buf = '\0';
 				cool_yylval.error_msg = "String contains null character";
@@ -1414,7 +1498,7 @@ YY_RULE_SETUP
 case 39:
 /* rule 39 can match eol */
 YY_RULE_SETUP
-#line 214 "cool.flex"
+#line 298 "cool.flex"
 {
 				*string_buf = '\0';
 				BEGIN(INITIAL);
@@ -1424,44 +1508,44 @@ YY_RULE_SETUP
 	YY_BREAK
 case 40:
 YY_RULE_SETUP
-#line 220 "cool.flex"
+#line 304 "cool.flex"
 *string_buf_ptr++ = '\n';
 	YY_BREAK
 case 41:
 YY_RULE_SETUP
-#line 221 "cool.flex"
+#line 305 "cool.flex"
 *string_buf_ptr++ = '\t';
 	YY_BREAK
 case 42:
 YY_RULE_SETUP
-#line 222 "cool.flex"
+#line 306 "cool.flex"
 *string_buf_ptr++ = '\b';
 	YY_BREAK
 case 43:
 YY_RULE_SETUP
-#line 223 "cool.flex"
+#line 307 "cool.flex"
 *string_buf_ptr++ = '\f';
 	YY_BREAK
 case 44:
 /* rule 44 can match eol */
 YY_RULE_SETUP
-#line 224 "cool.flex"
+#line 308 "cool.flex"
 *string_buf_ptr++ = yytext[1];
 	YY_BREAK
 case 45:
 YY_RULE_SETUP
-#line 225 "cool.flex"
+#line 309 "cool.flex"
 *string_buf_ptr++ = *yytext;
 	YY_BREAK
 case 46:
 /* rule 46 can match eol */
 YY_RULE_SETUP
-#line 227 "cool.flex"
+#line 311 "cool.flex"
 BEGIN(INITIAL);
 	YY_BREAK
 case 47:
 YY_RULE_SETUP
-#line 228 "cool.flex"
+#line 312 "cool.flex"
 
 	YY_BREAK
 /*
@@ -1470,12 +1554,12 @@ YY_RULE_SETUP
 case 48:
 /* rule 48 can match eol */
 YY_RULE_SETUP
-#line 233 "cool.flex"
+#line 317 "cool.flex"
 curr_lineno++;
 	YY_BREAK
 case 49:
 YY_RULE_SETUP
-#line 234 "cool.flex"
+#line 318 "cool.flex"
 
 	YY_BREAK
 /*
@@ -1483,7 +1567,7 @@ YY_RULE_SETUP
   */
 case 50:
 YY_RULE_SETUP
-#line 239 "cool.flex"
+#line 323 "cool.flex"
 {
 			cool_yylval.error_msg = yytext;
 			return ERROR;
@@ -1491,10 +1575,10 @@ YY_RULE_SETUP
 	YY_BREAK
 case 51:
 YY_RULE_SETUP
-#line 244 "cool.flex"
+#line 328 "cool.flex"
 ECHO;
 	YY_BREAK
-#line 1498 "cool-lex.cc"
+#line 1582 "cool-lex.cc"
 case YY_STATE_EOF(INITIAL):
 case YY_STATE_EOF(escape):
 	yyterminate();
@@ -2630,7 +2714,7 @@ void yyfree (void * ptr )
 
 /* %ok-for-header */
 
-#line 244 "cool.flex"
+#line 328 "cool.flex"
 
 
 
@@ -0,0 +1,96 @@
+/*
+ *  cool-alloc.cc
+ *
+ *  The global operator new and delete; see cool-alloc.h. They are out
+ *  of line in their own file, so that no caller sees free() behind a
+ *  delete. The hooks are weak: those no file defines are null.
+ */
+#include <stdlib.h>
+#include <new>
+#include "cool-alloc.h"
+
+#pragma weak parser_allocated
+#pragma weak semant_allocated
+#pragma weak semant_freeing
+
+static void *cool_alloc(size_t size)
+{
+  void *p = malloc(size != 0 ? size : 1);
+  if(p != NULL) {
+    if(parser_allocated)
+      parser_allocated(p, size);
+    if(semant_allocated)
+      semant_allocated(p, size);
+  }
+  return p;
+}
+
+static void cool_free(void *p)
+{
+  if(p != NULL && semant_freeing)
+    semant_freeing(p);
+  free(p);
+}
+
+void *cool_new(size_t size)
+{
+  void *p = cool_alloc(size);
+  if(p == NULL)
+    throw std::bad_alloc();
+  return p;
+}
+
+void cool_delete(void *p)
+{
+  cool_free(p);
+}
+
+void *operator new(size_t size)
+{
+  return cool_new(size);
+}
+
+void *operator new[](size_t size)
+{
+  return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t&) throw()
+{
+  return cool_alloc(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t&) throw()
+{
+  return cool_alloc(size);
+}
+
+void operator delete(void *p) throw()
+{
+  cool_free(p);
+}
+
+void operator delete[](void *p) throw()
+{
+  cool_free(p);
+}
+
+void operator delete(void *p, size_t) throw()
+{
+  cool_free(p);
+}
+
+void operator delete[](void *p, size_t) throw()
+{
+  cool_free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t&) throw()
+{
+  cool_free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t&) throw()
+{
+  cool_free(p);
+}
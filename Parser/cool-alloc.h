@@ -0,0 +1,34 @@
+/*
+ *  cool-alloc.h
+ *
+ *  The parser and semant replace the global operator new and delete
+ *  with the ones in cool-alloc.cc, which count what they allocate. Link
+ *  cool-alloc.o once into a program. Every form of new takes its block
+ *  from malloc and every form of delete gives it back to free, so that
+ *  none of them bypasses the counts and each release matches its
+ *  allocation.
+ */
+#ifndef COOL_ALLOC_H
+#define COOL_ALLOC_H
+
+#include <stddef.h>
+
+/* 
+ * The hooks, called after each allocation and before each block is
+ * freed (never with NULL). Each phase defines those it needs in one of
+ * its files; the operators call the ones linked into the program, so a
+ * program holding both phases counts for both.
+ */
+void parser_allocated(void *p, size_t size);
+void semant_allocated(void *p, size_t size);
+void semant_freeing(void *p);
+
+/*
+ * What operator new and delete do, for a class's own operators to call
+ * once they have counted: out of line, a compiler that inlines those
+ * still sees each block leave through the function that made it.
+ */
+void *cool_new(size_t size);
+void cool_delete(void *p);
+
+#endif
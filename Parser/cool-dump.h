@@ -0,0 +1,419 @@
+/*
+ *  cool-dump.h
+ *
+ *  dump_with_types without recursion, for trees nested deeper than the
+ *  C stack allows. A node's dump_parts() writes what comes before its
+ *  first child and queues the rest in order: its children, symbols,
+ *  text and its type. dump_tree() takes the queued parts off an explicit
+ *  stack. The output is the same as dumptype.cc's; with types false the
+ *  ": type" lines are left out. Include it in one file of a program,
+ *  after its cool-tree.h and utilities.h.
+ *
+ *  A node shared by hash-consing (COOL_HASH_CONS, see cool.y) has the
+ *  line it was built on. The line of a use of it on another line is
+ *  kept by the parser in a use_line_map, by the parent and the child's
+ *  place among the parent's expressions; dump_tree() is given the map
+ *  and prints that line instead. A shared node's children are all on
+ *  its line, so they are printed with the use's line too. Trees nobody
+ *  shared nodes in are dumped with an empty map.
+ *
+ *  A program that links the parser and semant together has the
+ *  definitions from one of them; the other defines COOL_DUMP_ELSEWHERE
+ *  before including this, and gets the declarations only.
+ */
+#ifndef COOL_DUMP_H
+#define COOL_DUMP_H
+
+#include <algorithm>
+#include <vector>
+#include <map>
+
+enum dump_kind { D_PROGRAM, D_CLASS, D_FEATURE, D_CASE, D_EXPR, D_SYMBOL, D_TEXT, D_TYPE };
+
+struct dump_part {
+  int kind;
+  int n;                          /* indentation */
+  int line;                       /* of a use on another line, else 0 */
+  union {
+    Program program;
+    Class_ class_;
+    Feature feature;
+    Case case_;
+    Expression expr;              /* D_EXPR, and the node whose type D_TYPE writes */
+    Symbol symbol;
+    const char *text;
+  };
+};
+
+typedef std::map<std::pair<tree_node *, int>, int> use_line_map;
+
+void dump_tree(ostream& stream, Program program, int n, const use_line_map& lines);
+void dump_tree(ostream& stream, Class_ class_, int n, bool types, const use_line_map& lines);
+void dump_tree(ostream& stream, Feature feature, int n, bool types, const use_line_map& lines);
+
+#ifndef COOL_DUMP_ELSEWHERE
+static int dump_line;             /* the line of the node being dumped */
+
+static dump_part new_part(int kind, int n)
+{
+  dump_part part;
+  part.kind = kind;
+  part.n = n;
+  part.line = 0;
+  return part;
+}
+
+static void dump_later(dump_stack& parts, int kind, int n, Expression e)
+{
+  dump_part part = new_part(kind, n);
+  part.expr = e;
+  parts.push_back(part);
+}
+
+static void dump_symbol(dump_stack& parts, int n, Symbol s)
+{
+  dump_part part = new_part(D_SYMBOL, n);
+  part.symbol = s;
+  parts.push_back(part);
+}
+
+static void dump_text(dump_stack& parts, int n, const char *text)
+{
+  dump_part part = new_part(D_TEXT, n);
+  part.text = text;
+  parts.push_back(part);
+}
+
+static void dump_header(ostream& stream, int n, const char *name)
+{
+  stream << pad(n) << "#" << dump_line << "\n";
+  stream << pad(n) << name << "\n";
+}
+
+static tree_node *dump_node(const dump_part& part)
+{
+  switch(part.kind) {
+  case D_PROGRAM: return part.program;
+  case D_CLASS:   return part.class_;
+  case D_FEATURE: return part.feature;
+  case D_CASE:    return part.case_;
+  default:        return part.expr;
+  }
+}
+
+/* the lines of the expressions node queued from parts[mark] on */
+static void use_lines(const use_line_map& lines, tree_node *node, dump_stack& parts, size_t mark)
+{
+  int slot = 0;
+  for(size_t i = mark; i < parts.size(); i++) {
+    if(parts[i].kind != D_EXPR)
+      continue;
+    use_line_map::const_iterator it = lines.find(std::make_pair(node, slot++));
+    int own = it != lines.end() ? it->second : parts[i].expr->get_line_number();
+    parts[i].line = dump_line != node->get_line_number() && own == node->get_line_number() ? dump_line : own;
+  }
+}
+
+static void dump_parts(dump_part part, ostream& stream, dump_stack& parts)
+{
+  switch(part.kind) {
+  case D_PROGRAM: part.program->dump_parts(stream, part.n, parts); break;
+  case D_CLASS:   part.class_->dump_parts(stream, part.n, parts); break;
+  case D_FEATURE: part.feature->dump_parts(stream, part.n, parts); break;
+  case D_CASE:    part.case_->dump_parts(stream, part.n, parts); break;
+  default:        part.expr->dump_parts(stream, part.n, parts);
+  }
+}
+
+static void dump_tree(ostream& stream, dump_part top, bool types, const use_line_map& lines)
+{
+  dump_stack parts(1, top);
+  while(!parts.empty()) {
+    dump_part part = parts.back();
+    parts.pop_back();
+    size_t mark = parts.size();
+    switch(part.kind) {
+    case D_SYMBOL:
+      dump_Symbol(stream, part.n, part.symbol);
+      break;
+    case D_TEXT:
+      stream << pad(part.n) << part.text;
+      break;
+    case D_TYPE:
+      if(types)
+        part.expr->dump_type(stream, part.n);
+      break;
+    default:
+      tree_node *node = dump_node(part);
+      dump_line = part.line != 0 ? part.line : node->get_line_number();
+      dump_parts(part, stream, parts);
+      if(!lines.empty())
+        use_lines(lines, node, parts, mark);
+    }
+    /* the parts were queued in order; take the first one first */
+    std::reverse(parts.begin() + mark, parts.end());
+  }
+}
+
+void dump_tree(ostream& stream, Program program, int n, const use_line_map& lines)
+{
+  dump_part top = new_part(D_PROGRAM, n);
+  top.program = program;
+  dump_tree(stream, top, true, lines);
+}
+
+void dump_tree(ostream& stream, Class_ class_, int n, bool types, const use_line_map& lines)
+{
+  dump_part top = new_part(D_CLASS, n);
+  top.class_ = class_;
+  dump_tree(stream, top, types, lines);
+}
+
+void dump_tree(ostream& stream, Feature feature, int n, bool types, const use_line_map& lines)
+{
+  dump_part top = new_part(D_FEATURE, n);
+  top.feature = feature;
+  dump_tree(stream, top, types, lines);
+}
+
+void program_class::dump_parts(ostream& stream, int n, dump_stack& parts)
+{
+  dump_header(stream, n, "_program");
+  for(int i = classes->first(); classes->more(i); i = classes->next(i)) {
+    dump_part part = new_part(D_CLASS, n + 2);
+    part.class_ = classes->nth(i);
+    parts.push_back(part);
+  }
+}
+
+void class__class::dump_parts(ostream& stream, int n, dump_stack& parts)
+{
+  dump_header(stream, n, "_class");
+  dump_Symbol(stream, n + 2, name);
+  dump_Symbol(stream, n + 2, parent);
+  stream << pad(n + 2) << "\"";
+  print_escaped_string(stream, filename->get_string());
+  stream << "\"\n" << pad(n + 2) << "(\n";
+  for(int i = features->first(); features->more(i); i = features->next(i)) {
+    dump_part part = new_part(D_FEATURE, n + 2);
+    part.feature = features->nth(i);
+    parts.push_back(part);
+  }
+  dump_text(parts, n + 2, ")\n");
+}
+
+void method_class::dump_parts(ostream& stream, int n, dump_stack& parts)
+{
+  dump_header(stream, n, "_method");
+  dump_Symbol(stream, n + 2, name);
+  for(int i = formals->first(); formals->more(i); i = formals->next(i))
+    formals->nth(i)->dump_with_types(stream, n + 2);
+  dump_Symbol(stream, n + 2, return_type);
+  dump_later(parts, D_EXPR, n + 2, expr);
+}
+
+void attr_class::dump_parts(ostream& stream, int n, dump_stack& parts)
+{
+  dump_header(stream, n, "_attr");
+  dump_Symbol(stream, n + 2, name);
+  dump_Symbol(stream, n + 2, type_decl);
+  dump_later(parts, D_EXPR, n + 2, init);
+}
+
+void branch_class::dump_parts(ostream& stream, int n, dump_stack& parts)
+{
+  dump_header(stream, n, "_branch");
+  dump_Symbol(stream, n + 2, name);
+  dump_Symbol(stream, n + 2, type_decl);
+  dump_later(parts, D_EXPR, n + 2, expr);
+}
+
+void assign_class::dump_parts(ostream& stream, int n, dump_stack& parts)
+{
+  dump_header(stream, n, "_assign");
+  dump_Symbol(stream, n + 2, name);
+  dump_later(parts, D_EXPR, n + 2, expr);
+  dump_later(parts, D_TYPE, n, this);
+}
+
+static void dump_actuals(dump_stack& parts, int n, Expressions actual)
+{
+  dump_text(parts, n + 2, "(\n");
+  for(int i = actual->first(); actual->more(i); i = actual->next(i))
+    dump_later(parts, D_EXPR, n + 2, actual->nth(i));
+  dump_text(parts, n + 2, ")\n");
+}
+
+void static_dispatch_class::dump_parts(ostream& stream, int n, dump_stack& parts)
+{
+  dump_header(stream, n, "_static_dispatch");
+  dump_later(parts, D_EXPR, n + 2, expr);
+  dump_symbol(parts, n + 2, type_name);
+  dump_symbol(parts, n + 2, name);
+  dump_actuals(parts, n, actual);
+  dump_later(parts, D_TYPE, n, this);
+}
+
+void dispatch_class::dump_parts(ostream& stream, int n, dump_stack& parts)
+{
+  dump_header(stream, n, "_dispatch");
+  dump_later(parts, D_EXPR, n + 2, expr);
+  dump_symbol(parts, n + 2, name);
+  dump_actuals(parts, n, actual);
+  dump_later(parts, D_TYPE, n, this);
+}
+
+void cond_class::dump_parts(ostream& stream, int n, dump_stack& parts)
+{
+  dump_header(stream, n, "_cond");
+  dump_later(parts, D_EXPR, n + 2, pred);
+  dump_later(parts, D_EXPR, n + 2, then_exp);
+  dump_later(parts, D_EXPR, n + 2, else_exp);
+  dump_later(parts, D_TYPE, n, this);
+}
+
+void loop_class::dump_parts(ostream& stream, int n, dump_stack& parts)
+{
+  dump_header(stream, n, "_loop");
+  dump_later(parts, D_EXPR, n + 2, pred);
+  dump_later(parts, D_EXPR, n + 2, body);
+  dump_later(parts, D_TYPE, n, this);
+}
+
+void typcase_class::dump_parts(ostream& stream, int n, dump_stack& parts)
+{
+  dump_header(stream, n, "_typcase");
+  dump_later(parts, D_EXPR, n + 2, expr);
+  for(int i = cases->first(); cases->more(i); i = cases->next(i)) {
+    dump_part part = new_part(D_CASE, n + 2);
+    part.case_ = cases->nth(i);
+    parts.push_back(part);
+  }
+  dump_later(parts, D_TYPE, n, this);
+}
+
+void block_class::dump_parts(ostream& stream, int n, dump_stack& parts)
+{
+  dump_header(stream, n, "_block");
+  for(int i = body->first(); body->more(i); i = body->next(i))
+    dump_later(parts, D_EXPR, n + 2, body->nth(i));
+  dump_later(parts, D_TYPE, n, this);
+}
+
+void let_class::dump_parts(ostream& stream, int n, dump_stack& parts)
+{
+  dump_header(stream, n, "_let");
+  dump_Symbol(stream, n + 2, identifier);
+  dump_Symbol(stream, n + 2, type_decl);
+  dump_later(parts, D_EXPR, n + 2, init);
+  dump_later(parts, D_EXPR, n + 2, body);
+  dump_later(parts, D_TYPE, n, this);
+}
+
+/* the binary and unary operators; e2 is NULL for the unary ones */
+static void dump_operator(ostream& stream, int n, dump_stack& parts, Expression e, const char *name,
+Expression e1, Expression e2)
+{
+  dump_header(stream, n, name);
+  dump_later(parts, D_EXPR, n + 2, e1);
+  if(e2 != NULL)
+    dump_later(parts, D_EXPR, n + 2, e2);
+  dump_later(parts, D_TYPE, n, e);
+}
+
+void plus_class::dump_parts(ostream& stream, int n, dump_stack& parts)
+{
+  dump_operator(stream, n, parts, this, "_plus", e1, e2);
+}
+
+void sub_class::dump_parts(ostream& stream, int n, dump_stack& parts)
+{
+  dump_operator(stream, n, parts, this, "_sub", e1, e2);
+}
+
+void mul_class::dump_parts(ostream& stream, int n, dump_stack& parts)
+{
+  dump_operator(stream, n, parts, this, "_mul", e1, e2);
+}
+
+void divide_class::dump_parts(ostream& stream, int n, dump_stack& parts)
+{
+  dump_operator(stream, n, parts, this, "_divide", e1, e2);
+}
+
+void neg_class::dump_parts(ostream& stream, int n, dump_stack& parts)
+{
+  dump_operator(stream, n, parts, this, "_neg", e1, NULL);
+}
+
+void lt_class::dump_parts(ostream& stream, int n, dump_stack& parts)
+{
+  dump_operator(stream, n, parts, this, "_lt", e1, e2);
+}
+
+void eq_class::dump_parts(ostream& stream, int n, dump_stack& parts)
+{
+  dump_operator(stream, n, parts, this, "_eq", e1, e2);
+}
+
+void leq_class::dump_parts(ostream& stream, int n, dump_stack& parts)
+{
+  dump_operator(stream, n, parts, this, "_leq", e1, e2);
+}
+
+void comp_class::dump_parts(ostream& stream, int n, dump_stack& parts)
+{
+  dump_operator(stream, n, parts, this, "_comp", e1, NULL);
+}
+
+void isvoid_class::dump_parts(ostream& stream, int n, dump_stack& parts)
+{
+  dump_operator(stream, n, parts, this, "_isvoid", e1, NULL);
+}
+
+void int_const_class::dump_parts(ostream& stream, int n, dump_stack& parts)
+{
+  dump_header(stream, n, "_int");
+  dump_Symbol(stream, n + 2, token);
+  dump_later(parts, D_TYPE, n, this);
+}
+
+void bool_const_class::dump_parts(ostream& stream, int n, dump_stack& parts)
+{
+  dump_header(stream, n, "_bool");
+  dump_Boolean(stream, n + 2, val);
+  dump_later(parts, D_TYPE, n, this);
+}
+
+void string_const_class::dump_parts(ostream& stream, int n, dump_stack& parts)
+{
+  dump_header(stream, n, "_string");
+  stream << pad(n + 2) << "\"";
+  print_escaped_string(stream, token->get_string());
+  stream << "\"\n";
+  dump_later(parts, D_TYPE, n, this);
+}
+
+void new__class::dump_parts(ostream& stream, int n, dump_stack& parts)
+{
+  dump_header(stream, n, "_new");
+  dump_Symbol(stream, n + 2, type_name);
+  dump_later(parts, D_TYPE, n, this);
+}
+
+void no_expr_class::dump_parts(ostream& stream, int n, dump_stack& parts)
+{
+  dump_header(stream, n, "_no_expr");
+  dump_later(parts, D_TYPE, n, this);
+}
+
+void object_class::dump_parts(ostream& stream, int n, dump_stack& parts)
+{
+  dump_header(stream, n, "_object");
+  dump_Symbol(stream, n + 2, name);
+  dump_later(parts, D_TYPE, n, this);
+}
+
+#endif /* COOL_DUMP_ELSEWHERE */
+
+#endif
@@ -5,6 +5,7 @@
 #define COOL_TREE_HANDCODE_H
 
 #include <iostream>
+#include <vector>
 #include "tree.h"
 #include "cool.h"
 #include "stringtab.h"
@@ -44,37 +45,51 @@ typedef Expressions_class *Expressions;
 typedef list_node<Case> Cases_class;
 typedef Cases_class *Cases;
 
+/* dump_with_types without recursion, see cool-dump.h */
+struct dump_part;
+typedef std::vector<dump_part> dump_stack;
+
 #define Program_EXTRAS                          \
-virtual void dump_with_types(ostream&, int) = 0; 
+virtual void dump_with_types(ostream&, int) = 0; \
+virtual void dump_parts(ostream&, int, dump_stack&) = 0; \
+void set_lineno(int l) { line_number = l; }
 
 
 
 #define program_EXTRAS                          \
-void dump_with_types(ostream&, int);            
+void dump_with_types(ostream&, int);            \
+void dump_parts(ostream&, int, dump_stack&);
 
 #define Class__EXTRAS                   \
 virtual Symbol get_filename() = 0;      \
-virtual void dump_with_types(ostream&,int) = 0; 
+virtual void dump_with_types(ostream&,int) = 0; \
+virtual void dump_parts(ostream&, int, dump_stack&) = 0; \
+void set_lineno(int l) { line_number = l; }
 
 
 #define class__EXTRAS                                 \
 Symbol get_filename() { return filename; }             \
-void dump_with_types(ostream&,int);                    
+void dump_with_types(ostream&,int);                   \
+void dump_parts(ostream&, int, dump_stack&);
 
 
 #define Feature_EXTRAS                                        \
-virtual void dump_with_types(ostream&,int) = 0; 
+virtual void dump_with_types(ostream&,int) = 0; \
+virtual void dump_parts(ostream&, int, dump_stack&) = 0;      \
+void set_lineno(int l) { line_number = l; }
 
 
 #define Feature_SHARED_EXTRAS                                       \
-void dump_with_types(ostream&,int);    
+void dump_with_types(ostream&,int);                                 \
+void dump_parts(ostream&, int, dump_stack&);
 
 
 
 
 
 #define Formal_EXTRAS                              \
-virtual void dump_with_types(ostream&,int) = 0;
+virtual void dump_with_types(ostream&,int) = 0; \
+void set_lineno(int l) { line_number = l; }
 
 
 #define formal_EXTRAS                           \
@@ -82,11 +97,14 @@ void dump_with_types(ostream&,int);
 
 
 #define Case_EXTRAS                             \
-virtual void dump_with_types(ostream& ,int) = 0;
+virtual void dump_with_types(ostream& ,int) = 0; \
+virtual void dump_parts(ostream&, int, dump_stack&) = 0; \
+void set_lineno(int l) { line_number = l; }
 
 
 #define branch_EXTRAS                                   \
-void dump_with_types(ostream& ,int);
+void dump_with_types(ostream& ,int);                    \
+void dump_parts(ostream&, int, dump_stack&);
 
 
 #define Expression_EXTRAS                    \
@@ -94,13 +112,16 @@ Symbol type;                                 \
 Symbol get_type() { return type; }           \
 Expression set_type(Symbol s) { type = s; return this; } \
 virtual void dump_with_types(ostream&,int) = 0;  \
+virtual void dump_parts(ostream&, int, dump_stack&) = 0; \
 void dump_type(ostream&, int);               \
+void set_lineno(int l) { line_number = l; }  \
 Expression_class() { type = (Symbol) NULL; }
 
 
 
 #define Expression_SHARED_EXTRAS           \
-void dump_with_types(ostream&,int); 
+void dump_with_types(ostream&,int);        \
+void dump_parts(ostream&, int, dump_stack&);
 
 
 #endif
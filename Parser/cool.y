@@ -5,30 +5,45 @@
 */
 %{
   #include <iostream>
+  #include <stdlib.h>
+  #include <stdio.h>
+  #include <string.h>
+  #include <time.h>
+  #include <new>
+  #include <pthread.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+  #include <sys/file.h>
+  #include <sys/stat.h>
+  #include <vector>
+  #include <deque>
+  #include <string>
+  #include <map>
+  #include <set>
   #include "cool-tree.h"
   #include "stringtab.h"
   #include "utilities.h"
+  #include "cool-alloc.h"
+  #include "cool-dump.h"
   
-  extern char *curr_filename;
   
+  /* Locations: bison's own YYLTYPE; only first_line is used. Being
+  trivial, it lets the parser stacks be moved when they grow. */
   
-  /* Locations */
-  #define YYLTYPE int              /* the type of locations */
-  #define cool_yylloc curr_lineno  /* use the curr_lineno from the lexer
-  for the location of tokens */
+  /* Grow the parser stacks as deep as the input nests; memory runs out first */
+  #define YYMAXDEPTH 100000000
     
-    extern int node_lineno;          /* set before constructing a tree node
-    to whatever you want the line number
-    for the tree node to be */
+    extern int node_lineno;          /* read by the tree constructors; never
+    written here, see at_line() below */
       
       
       #define YYLLOC_DEFAULT(Current, Rhs, N)         \
       Current = Rhs[1];                             \
-      node_lineno = Current;
+      ctx->lineno = (Current).first_line;
     
     
     #define SET_NODELOC(Current)  \
-    node_lineno = Current;
+    ctx->lineno = (Current).first_line;
     
     /* IMPORTANT NOTE ON LINE NUMBERS
     *********************************
@@ -61,9 +76,10 @@
       @$ = @3;
       
       
-      // Observe that we call SET_NODELOC(@3); this will set the global variable
-      // node_lineno to @3. Since the constructor call "plus" uses the value of 
-      // this global, the plus node will now have the correct line number.
+      // Observe that we call SET_NODELOC(@3); this will set the line
+      // number of the parser instance to @3. Since the constructor call
+      // "plus" is stamped with that line, the plus node will now have the
+      // correct line number.
       SET_NODELOC(@3);
       
       // construct the result node:
@@ -72,10 +88,78 @@
     
     */
     
+    /* The tree constructors take their line number from the global
+    node_lineno, which parser instances running on different threads
+    cannot share. Every node built in an action is stamped again with
+    the line of the instance that built it. */
+    template <class T> T at_line(T node, int line)
+    {
+      node->set_lineno(line);
+      return node;
+    }
+    
+    /* 
+    With COOL_HASH_CONS set, identical constant nodes are shared: the
+    literals, no_expr, self and new_, and operators whose operands are
+    all shared and used on the operator's line. A shared node keeps the
+    line it was first built on; the line of each use on another line is
+    kept by the node it is a child of (see uses_of() below) and printed
+    by dump_tree() in its place, so the dump is unchanged. Nothing here
+    gives a node a type, and semant reads the dump into a tree of its
+    own, so shared nodes never get one.
+    */
+    #define SHARED_LEAF(kind, a, node, cls) \
+    (find_leaf(ctx, kind, (void *) (long) (a)) ? ctx->shared_found \
+    : keep_shared(ctx, at_line(node, ctx->lineno), sizeof(cls)))
+    #define SHARED_OPERATOR(kind, e1, e2, node, cls) \
+    (find_operator(ctx, kind, e1, e2) ? ctx->shared_found \
+    : keep_shared(ctx, uses_of(ctx, at_line(node, ctx->lineno), e1, e2), sizeof(cls)))
+    
+    /* The driver prints the tree with dump_with_types, which would recurse
+    as deep as the program nests; the root prints it with dump_tree. It
+    keeps the lines of the shared nodes' uses the parse found, see
+    cool_parse(). */
+    class dumped_program_class : public program_class {
+    public:
+      use_line_map use_lines;
+      dumped_program_class(Classes a1) : program_class(a1) {}
+      void dump_with_types(ostream& stream, int n) { dump_tree(stream, this, n, use_lines); }
+    };
+    
+    #define program(a)                  at_line((Program) new dumped_program_class(a), ctx->lineno)
+    #define class_(a,b,c,d)             at_line(class_(a,b,c,d), ctx->lineno)
+    #define method(a,b,c,d)             make_method(ctx, a, b, c, d)
+    #define attr(a,b,c)                 make_attr(ctx, a, b, c)
+    #define formal(a,b)                 at_line(formal(a,b), ctx->lineno)
+    #define branch(a,b,c)               make_branch(ctx, a, b, c)
+    #define assign(a,b)                 make_assign(ctx, a, b)
+    #define static_dispatch(a,b,c,d)    make_static_dispatch(ctx, a, b, c, d)
+    #define dispatch(a,b,c)             make_dispatch(ctx, a, b, c)
+    #define self_dispatch(a,b,c)        make_self_dispatch(ctx, object(ctx->self_symbol), a, b, c)
+    #define cond(a,b,c)                 make_cond(ctx, a, b, c)
+    #define loop(a,b)                   make_loop(ctx, a, b)
+    #define typcase(a,b)                make_typcase(ctx, a, b)
+    #define block(a)                    make_block(ctx, a)
+    #define let(a,b,c,d)                make_let(ctx, a, b, c, d)
+    #define plus(a,b)                   SHARED_OPERATOR(SHARE_PLUS, a, b, plus(a,b), plus_class)
+    #define sub(a,b)                    SHARED_OPERATOR(SHARE_SUB, a, b, sub(a,b), sub_class)
+    #define mul(a,b)                    SHARED_OPERATOR(SHARE_MUL, a, b, mul(a,b), mul_class)
+    #define divide(a,b)                 SHARED_OPERATOR(SHARE_DIVIDE, a, b, divide(a,b), divide_class)
+    #define neg(a)                      SHARED_OPERATOR(SHARE_NEG, a, NULL, neg(a), neg_class)
+    #define lt(a,b)                     SHARED_OPERATOR(SHARE_LT, a, b, lt(a,b), lt_class)
+    #define eq(a,b)                     SHARED_OPERATOR(SHARE_EQ, a, b, eq(a,b), eq_class)
+    #define leq(a,b)                    SHARED_OPERATOR(SHARE_LEQ, a, b, leq(a,b), leq_class)
+    #define comp(a)                     SHARED_OPERATOR(SHARE_COMP, a, NULL, comp(a), comp_class)
+    #define int_const(a)                SHARED_LEAF(SHARE_INT, a, int_const(a), int_const_class)
+    #define bool_const(a)               SHARED_LEAF(SHARE_BOOL, a, bool_const(a), bool_const_class)
+    #define string_const(a)             SHARED_LEAF(SHARE_STRING, a, string_const(a), string_const_class)
+    #define new_(a)                     SHARED_LEAF(SHARE_NEW, a, new_(a), new__class)
+    #define isvoid(a)                   SHARED_OPERATOR(SHARE_ISVOID, a, NULL, isvoid(a), isvoid_class)
+    #define no_expr()                   SHARED_LEAF(SHARE_NO_EXPR, 0, no_expr(), no_expr_class)
+    #define object(a)                   ((a) == ctx->self_symbol ? SHARED_LEAF(SHARE_SELF, a, object(a), object_class) \
+                                                        : at_line(object(a), ctx->lineno))
     
     
-    void yyerror(char *s);        /*  defined below; called for each parse error */
-    extern int yylex();           /*  the entry point to the lexer  */
     
     /************************************************************************/
     /*                DONT CHANGE ANYTHING IN THIS SECTION                  */
@@ -85,6 +169,22 @@
     int omerrs = 0;               /* number of errors in lexing and parsing */
     %}
     
+    %define api.pure full
+    %parse-param {parse_context *ctx}
+    %lex-param {parse_context *ctx}
+    
+    %code requires {
+      #include <vector>
+      #include <deque>
+      #include <map>
+      #include <set>
+      #include <string>
+      #include "cool-tree.h"
+      
+      struct parse_context;
+      struct parse_trace;
+    }
+    
     /* A union of all the types that can be the result of parsing actions. */
     %union {
       Boolean boolean;
@@ -103,6 +203,203 @@
       char *error_msg;
     }
     
+    %code provides {
+      /* A token as the lexer delivered it. */
+      struct lexed_token {
+        int token;
+        YYSTYPE value;
+        int lineno;
+        char *filename;
+        Symbol file;                  /* filename as interned by read_tokens() */
+      };
+      
+      /* 
+      * The lexer handle: returns the next token, 0 at the end of the
+      * input, and fills in its value, line and file name.
+      */
+      typedef int (*cool_lexer)(void *state, YYSTYPE *value, int *lineno, char **filename);
+      
+      /* A syntax error, kept for the caller to report. */
+      struct parse_error {
+        lexed_token at;               /* the token the error was found at */
+        const char *message;
+      };
+      
+      enum share_kind {
+        SHARE_INT, SHARE_BOOL, SHARE_STRING, SHARE_NEW, SHARE_NO_EXPR, SHARE_SELF,
+        SHARE_PLUS, SHARE_SUB, SHARE_MUL, SHARE_DIVIDE, SHARE_LT, SHARE_EQ, SHARE_LEQ,
+        SHARE_NEG, SHARE_COMP, SHARE_ISVOID
+      };
+      
+      /* What makes two shareable nodes the same. */
+      struct shared_key {
+        int kind;
+        void *a, *b;                  /* operands: symbols, values or shared nodes */
+        
+        bool operator<(const shared_key& k) const {
+          if(kind != k.kind) return kind < k.kind;
+          if(a != k.a) return a < k.a;
+          return b < k.b;
+        }
+      };
+      
+      struct shared_node {
+        Expression node;
+        size_t size;
+      };
+      
+      /* A use of a shared node, waiting for the node it is a child of. */
+      struct shared_use {
+        Expression node;
+        int line;
+      };
+      
+      #define MAX_ERRORS 50           /* parsing stops once there are more errors than this */
+      
+      /* Wall and CPU time in ms and allocations, for COOL_TIME_REPORT. */
+      struct phase_time {
+        double wall, cpu;
+        long allocs;
+      };
+      
+      /* 
+      * Everything one compilation needs, so that any number of them can
+      * run in a process. The same structure is the state of each parser
+      * instance when the class regions are parsed in parallel.
+      */
+      struct parse_context {
+        cool_lexer lex;               /* the lexer handle */
+        void *lexer_state;
+        int nthreads;                 /* parse class regions in parallel when above 1 */
+        
+        Program result;               /* the program, set once it has been parsed */
+        Classes classes;              /* classes parsed so far */
+        int errors;                   /* number of syntax errors */
+        std::vector<parse_error> error_list;
+        
+        std::vector<lexed_token> tokens;  /* the saved token stream */
+        std::deque<std::string> error_text;  /* the messages of its ERROR tokens */
+        lexed_token *pos;             /* next token to hand to the parser */
+        lexed_token *end;             /* end of this instance's tokens */
+        int lookahead;                /* last token handed to the parser */
+        char *filename;               /* file the last token came from */
+        Symbol file;                  /* the same, interned, for the class nodes */
+        Symbol object_symbol, self_symbol;  /* interned by cool_parse() */
+        int lineno;                   /* line for nodes built by the current action */
+        bool quiet;                   /* count errors instead of keeping them */
+        
+        bool hash_cons;               /* share identical constant nodes */
+        std::map<shared_key, shared_node> shared;
+        std::set<Expression> shared_set;  /* the nodes in shared */
+        shared_key shared_pending;    /* key of the node about to be built */
+        bool sharing;                 /* whether that node is to be kept */
+        Expression shared_found;      /* the node the last lookup found */
+        int shared_lookups;           /* shareable nodes asked for */
+        int shared_hits;              /* nodes not built because one was shared */
+        long shared_bytes;            /* memory they would have taken */
+        std::vector<shared_use> shared_uses;  /* uses not yet given a parent, in order */
+        std::map<std::pair<tree_node *, int>, int> use_lines;  /* the lines of uses on another
+        line, by parent and place among its expressions; see cool-dump.h */
+        
+        parse_trace *trace;           /* where to record trace events, or NULL */
+        bool timing;                  /* fill in the times below */
+        phase_time lex_time;          /* reading the token stream */
+        phase_time parse_time;        /* building the tree from it */
+        
+        parse_context() : lex(NULL), lexer_state(NULL), nthreads(1), result(NULL),
+        classes(NULL), errors(0), pos(NULL), end(NULL), lookahead(0),
+        filename(NULL), file(NULL), object_symbol(NULL), self_symbol(NULL), lineno(0),
+        quiet(false), hash_cons(false), sharing(false),
+        shared_found(NULL), shared_lookups(0), shared_hits(0), shared_bytes(0),
+        trace(NULL), timing(false) { }
+      };
+      
+      /* 
+      * Read every token from ctx->lex and parse them. Returns the number
+      * of syntax errors; the messages are left in ctx->error_list, and
+      * the program in ctx->result with the lines it is to be dumped
+      * with (see dumped_program_class). The
+      * string tables are shared by all compilations in the process, so
+      * lexers running at the same time must not add to them concurrently.
+      */
+      int cool_parse(parse_context *ctx);
+      
+      /* 
+      * The parser phase: cool_parse() on lex, with the errors reported
+      * and the result left in ast_root, as the driver expects of
+      * yyparse(), which runs it on the token stream. Returns whether
+      * there were errors.
+      */
+      int parse_phase(cool_lexer lex, void *lexer_state);
+    }
+    
+    %{
+      void yyerror(YYLTYPE *loc, parse_context *ctx, const char *s);  /*  defined below; called for each parse error */
+      int yylex(YYSTYPE *lvalp, YYLTYPE *llocp, parse_context *ctx);  /*  hands the parser the saved tokens  */
+      bool find_leaf(parse_context *ctx, int kind, void *a);
+      bool find_operator(parse_context *ctx, int kind, Expression e1, Expression e2);
+      Expression keep_shared(parse_context *ctx, Expression node, size_t size);
+      void take_uses(parse_context *ctx, tree_node *node, const Expression *children, const int *slots, int n);
+      Expression make_self_dispatch(parse_context *ctx, Expression self, Symbol name, Expression first, Expressions rest);
+      
+      /* node's children, in the order they were built, take their uses (see take_uses()) */
+      template <class T> T uses_of(parse_context *ctx, T node, Expression e1, Expression e2 = NULL, Expression e3 = NULL)
+      {
+        if(!ctx->shared_uses.empty()) {
+          Expression children[3] = { e1, e2, e3 };
+          int slots[3] = { 0, 1, 2 };
+          take_uses(ctx, node, children, slots, 3);
+        }
+        return node;
+      }
+      
+      /* the same for a dispatch or a block; first is the receiver, NULL for a block */
+      template <class T> T uses_of_list(parse_context *ctx, T node, Expression first, Expressions list)
+      {
+        if(!ctx->shared_uses.empty()) {
+          std::vector<Expression> children;
+          if(first != NULL)
+            children.push_back(first);
+          for(int i = list->first(); list->more(i); i = list->next(i))
+            children.push_back(list->nth(i));
+          std::vector<int> slots;
+          for(size_t i = 0; i < children.size(); i++)
+            slots.push_back(i);
+          if(!children.empty())
+            take_uses(ctx, node, &children[0], &slots[0], children.size());
+        }
+        return node;
+      }
+      
+      /* 
+      The nodes with expressions in them, built by functions so that each
+      argument is evaluated once; the parentheses keep the macros above
+      from expanding.
+      */
+      static Feature make_method(parse_context *ctx, Symbol a, Formals b, Symbol c, Expression d)
+      { return uses_of(ctx, at_line((method)(a, b, c, d), ctx->lineno), d); }
+      static Feature make_attr(parse_context *ctx, Symbol a, Symbol b, Expression c)
+      { return uses_of(ctx, at_line((attr)(a, b, c), ctx->lineno), c); }
+      static Case make_branch(parse_context *ctx, Symbol a, Symbol b, Expression c)
+      { return uses_of(ctx, at_line((branch)(a, b, c), ctx->lineno), c); }
+      static Expression make_assign(parse_context *ctx, Symbol a, Expression b)
+      { return uses_of(ctx, at_line((assign)(a, b), ctx->lineno), b); }
+      static Expression make_static_dispatch(parse_context *ctx, Expression a, Symbol b, Symbol c, Expressions d)
+      { return uses_of_list(ctx, at_line((static_dispatch)(a, b, c, d), ctx->lineno), a, d); }
+      static Expression make_dispatch(parse_context *ctx, Expression a, Symbol b, Expressions c)
+      { return uses_of_list(ctx, at_line((dispatch)(a, b, c), ctx->lineno), a, c); }
+      static Expression make_cond(parse_context *ctx, Expression a, Expression b, Expression c)
+      { return uses_of(ctx, at_line((cond)(a, b, c), ctx->lineno), a, b, c); }
+      static Expression make_loop(parse_context *ctx, Expression a, Expression b)
+      { return uses_of(ctx, at_line((loop)(a, b), ctx->lineno), a, b); }
+      static Expression make_typcase(parse_context *ctx, Expression a, Cases b)
+      { return uses_of(ctx, at_line((typcase)(a, b), ctx->lineno), a); }
+      static Expression make_block(parse_context *ctx, Expressions a)
+      { return uses_of_list(ctx, at_line((block)(a), ctx->lineno), NULL, a); }
+      static Expression make_let(parse_context *ctx, Symbol a, Symbol b, Expression c, Expression d)
+      { return uses_of(ctx, at_line((let)(a, b, c, d), ctx->lineno), c, d); }
+    %}
+    
     /* 
     Declare the terminals; a few have types for associated lexemes.
     The token ERROR is never used in the parser; thus, it is a parse
@@ -162,21 +459,20 @@
     /* 
     Save the root of the abstract syntax tree in a global variable.
     */
-    program	: class_list	{ @$ = @1; ast_root = program($1); }
+    program	: class_list	{ @$ = @1; ctx->result = program($1); }
     ;
     
     
     class_list
     : class								{ $$ = single_Classes($1);
-    									  parse_results = $$; }
+    									  ctx->classes = $$; }
     | class_list class							{ $$ = append_Classes($1,single_Classes($2));
-    									  parse_results = $$; }						  
+    									  ctx->classes = $$; }						  
     ;
     
     class
-    : CLASS TYPEID '{' feature_list '}' ';'				{ $$ = class_($2,idtable.add_string("Object"),$4,
-    									  stringtable.add_string(curr_filename)); }
-    | CLASS TYPEID INHERITS TYPEID '{' feature_list '}' ';'		{ $$ = class_($2,$4,$6,stringtable.add_string(curr_filename)); }
+    : CLASS TYPEID '{' feature_list '}' ';'				{ $$ = class_($2,ctx->object_symbol,$4,ctx->file); }
+    | CLASS TYPEID INHERITS TYPEID '{' feature_list '}' ';'		{ $$ = class_($2,$4,$6,ctx->file); }
     
     | error								{ yyclearin; $$=NULL; }
     ;
@@ -236,8 +532,8 @@
     | expr '.' OBJECTID '(' expr expr_list ')'				{ $$ = dispatch($1, $3, append_Expressions(single_Expressions($5), $6)); }
     | expr '@' TYPEID '.' OBJECTID '(' ')'				{ $$ = static_dispatch($1, $3, $5, nil_Expressions()); }
     | expr '@' TYPEID '.' OBJECTID '(' expr expr_list ')'		{ $$ = static_dispatch($1, $3, $5, append_Expressions(single_Expressions($7), $8)); }
-    | OBJECTID '(' ')'							{ $$ = dispatch(object(idtable.add_string("self")),$1, nil_Expressions()); }
-    | OBJECTID '(' expr expr_list ')'					{ $$ = dispatch(object(idtable.add_string("self")),$1, append_Expressions($4, single_Expressions($3))); }
+    | OBJECTID '(' ')'							{ $$ = dispatch(object(ctx->self_symbol),$1, nil_Expressions()); }
+    | OBJECTID '(' expr expr_list ')'					{ $$ = self_dispatch($1, $3, $4); }
     | '{' expr ';' brace_expr_list '}'					{ $$ = block(append_Expressions(single_Expressions($2), $4)); }
     | CASE expr OF case_expr case_expr_list ESAC			{ $$ = typcase($2, append_Cases(single_Cases($4), $5)); }
     | LET let_expr							{ $$ = $2; }
@@ -279,16 +575,614 @@
     %%
     
     /* This function is called automatically when Bison detects a parse error. */
-    void yyerror(char *s)
+    void yyerror(YYLTYPE *loc, parse_context *ctx, const char *s)
     {
-      extern int curr_lineno;
+      ctx->errors++;
+      /* a region parsed ahead of time only needs to know that it failed */
+      if(ctx->quiet || ctx->errors > MAX_ERRORS + 1)
+        return;
       
-      cerr << "\"" << curr_filename << "\", line " << curr_lineno << ": " \
-      << s << " at or near ";
-      print_cool_token(yychar);
-      cerr << endl;
-      omerrs++;
-      
-      if(omerrs>50) {fprintf(stdout, "More than 50 errors\n"); exit(1);}
+      parse_error e;
+      e.at = ctx->pos[-1];
+      e.message = s;
+      if(ctx->lookahead == 0) {
+        /* the lexer ran out; report the end of the input as it was read */
+        e.at = ctx->end[-1];
+        e.at.token = 0;
+      }
+      ctx->error_list.push_back(e);
     } 
     
+    static void set_location(YYLTYPE *llocp, int lineno)
+    {
+      llocp->first_line = llocp->last_line = lineno;
+      llocp->first_column = llocp->last_column = 0;
+    }
+    
+    /* hand the parser the next saved token */
+    int yylex(YYSTYPE *lvalp, YYLTYPE *llocp, parse_context *ctx)
+    {
+      /* a failed region gets parsed again serially, so stop feeding it */
+      if(ctx->pos == ctx->end || (ctx->quiet && ctx->errors) || ctx->errors > MAX_ERRORS) {
+        set_location(llocp, ctx->end[-1].lineno);
+        return ctx->lookahead = 0;
+      }
+      
+      lexed_token *t = ctx->pos++;
+      *lvalp = t->value;
+      set_location(llocp, t->lineno);
+      ctx->filename = t->filename;
+      ctx->file = t->file;
+      return ctx->lookahead = t->token;
+    }
+    
+    /* 
+    * Trace. With COOL_TRACE=<file>, lexing, parsing and each class region
+    * parsed on its own are recorded as Chrome trace events and appended
+    * to <file> at exit, next to those of the other phases (see semant.cc).
+    * A compilation records into the parse_trace its context points to.
+    * Each of its threads records into a ring of its own, by the thread's
+    * number in the compilation (0 for the one calling cool_parse), so
+    * recording takes no lock; the rings are written out once the workers
+    * have been joined.
+    */
+    #define TRACE_RING 4096           /* latest events kept per thread */
+    #define TRACE_THREADS 256         /* threads traced; later ones are not */
+    
+    struct trace_event {
+      const char *name, *cat;
+      double start, dur;              /* in us */
+    };
+    
+    struct trace_ring {
+      int tid;
+      unsigned long count;            /* events recorded; the ring holds the last TRACE_RING */
+      trace_event events[TRACE_RING];
+    };
+    
+    struct parse_trace {
+      const char *file;
+      double start;                   /* when the phase started */
+      trace_ring *rings[TRACE_THREADS];  /* by thread number, allocated by their threads */
+    };
+    
+    static double trace_clock()
+    {
+      timespec now;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      return now.tv_sec * 1e6 + now.tv_nsec / 1e3;
+    }
+    
+    /* record a span from start until now on the ring of thread number tid */
+    static void trace_span(parse_trace *trace, int tid, const char *name, const char *cat, double start)
+    {
+      if(tid >= TRACE_THREADS)
+        return;
+      trace_ring *ring = trace->rings[tid];
+      if(ring == NULL) {
+        ring = trace->rings[tid] = (trace_ring *) calloc(1, sizeof(trace_ring));
+        if(ring == NULL)
+          return;
+        ring->tid = tid + 1;
+      }
+      trace_event& e = ring->events[ring->count++ % TRACE_RING];
+      e.name = name;
+      e.cat = cat;
+      e.start = start;
+      e.dur = trace_clock() - start;
+    }
+    
+    /* the file is locked so phases finishing together do not interleave */
+    static void write_trace(parse_trace *trace)
+    {
+      trace_span(trace, 0, "parser", "phase", trace->start);
+      std::string text;
+      char line[512];
+      int pid = getpid();
+      snprintf(line, sizeof(line), "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":1,\"args\":{\"name\":\"parser\"}},\n", pid);
+      text += line;
+      for(int i = 0; i < TRACE_THREADS; i++) {
+        trace_ring *ring = trace->rings[i];
+        if(ring == NULL)
+          continue;
+        snprintf(line, sizeof(line), "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}},\n",
+        pid, ring->tid, ring->tid);
+        text += line;
+        unsigned long first = ring->count > TRACE_RING ? ring->count - TRACE_RING : 0;
+        for(unsigned long j = first; j < ring->count; j++) {
+          trace_event& e = ring->events[j % TRACE_RING];
+          snprintf(line, sizeof(line), "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d},\n",
+          e.name, e.cat, e.start, e.dur, pid, ring->tid);
+          text += line;
+        }
+      }
+      
+      text.resize(text.size() - 2);   /* the last event's ",\n" */
+      text += "\n]\n";
+      
+      int fd = open(trace->file, O_RDWR | O_APPEND | O_CREAT, 0666);
+      if(fd < 0)
+        return;
+      struct stat st;
+      char tail[3];
+      flock(fd, LOCK_EX);
+      /* start the array, or reopen the one the last phase closed */
+      if(fstat(fd, &st) == 0 && st.st_size == 0)
+        write(fd, "[\n", 2);
+      else if(st.st_size >= 3 && pread(fd, tail, 3, st.st_size - 3) == 3 && memcmp(tail, "\n]\n", 3) == 0
+      && ftruncate(fd, st.st_size - 3) == 0)
+        write(fd, ",\n", 2);
+      write(fd, text.data(), text.size());
+      close(fd);
+    }
+    
+    /* 
+    * read the whole token stream, up to and including the EOF token. The
+    * file names are interned here, on the calling thread, so that the
+    * actions of parallel regions never add to the string tables.
+    */
+    static void read_tokens(parse_context *ctx)
+    {
+      lexed_token t;
+      char *filename = NULL;
+      Symbol file = NULL;
+      do {
+        t.token = ctx->lex(ctx->lexer_state, &t.value, &t.lineno, &t.filename);
+        /* lexers may reuse their buffers, so keep our own copies; they go with ctx */
+        if(t.token == ERROR) {
+          ctx->error_text.push_back(t.value.error_msg);
+          t.value.error_msg = &ctx->error_text.back()[0];
+        }
+        if(filename == NULL || strcmp(filename, t.filename) != 0) {
+          file = stringtable.add_string(t.filename);
+          filename = file->get_string();
+        }
+        t.filename = filename;
+        t.file = file;
+        ctx->tokens.push_back(t);
+      } while(t.token != 0);
+    }
+    
+    static void init_instance(parse_context *ctx, lexed_token *begin, lexed_token *end, bool quiet)
+    {
+      ctx->pos = begin;
+      ctx->end = end;
+      ctx->lookahead = 0;
+      ctx->filename = begin->filename;
+      ctx->file = begin->file;
+      ctx->lineno = 0;
+      ctx->result = NULL;
+      ctx->classes = NULL;
+      ctx->errors = 0;
+      ctx->quiet = quiet;
+      ctx->shared.clear();
+      ctx->shared_set.clear();
+      ctx->sharing = false;
+      ctx->shared_lookups = 0;
+      ctx->shared_hits = 0;
+      ctx->shared_bytes = 0;
+      ctx->shared_uses.clear();
+      ctx->use_lines.clear();
+    }
+    
+    /* 
+    * Each region starts at a CLASS token outside of any braces and runs
+    * up to the next one. Tokens in front of the first CLASS go with the
+    * first region.
+    */
+    static void split_regions(std::vector<lexed_token>& tokens, std::vector<parse_context>& regions)
+    {
+      lexed_token *first = &tokens[0];
+      lexed_token *last = &tokens[0] + tokens.size() - 1;   /* the EOF token */
+      lexed_token *start = first;
+      int depth = 0;
+      
+      for(lexed_token *t = first; t != last; t++) {
+        if(t->token == '{')
+          depth++;
+        else if(t->token == '}' && depth > 0)
+          depth--;
+        else if(t->token == CLASS && depth == 0 && t != first && start != t) {
+          regions.push_back(parse_context());
+          init_instance(&regions.back(), start, t, true);
+          start = t;
+        }
+      }
+      regions.push_back(parse_context());
+      init_instance(&regions.back(), start, last, true);
+    }
+    
+    struct region_queue {
+      std::vector<parse_context> *regions;
+      int next;                       /* next region to hand out */
+      parse_trace *trace;
+    };
+    
+    /* one of the threads taking regions off the queue */
+    struct region_worker {
+      region_queue *q;
+      int tid;                        /* its number, for the trace */
+    };
+    
+    static void *parse_regions(void *arg)
+    {
+      region_worker *w = (region_worker *) arg;
+      region_queue *q = w->q;
+      int i;
+      while((i = __sync_fetch_and_add(&q->next, 1)) < (int) q->regions->size()) {
+        parse_context *region = &(*q->regions)[i];
+        double start = q->trace ? trace_clock() : 0;
+        /* named after its class */
+        const char *name = region->pos + 1 < region->end && region->pos[1].token == TYPEID ?
+        region->pos[1].value.symbol->get_string() : "region";
+        yyparse(region);
+        if(q->trace)
+          trace_span(q->trace, w->tid, name, "region", start);
+      }
+      return NULL;
+    }
+    
+    /* 
+    * Parse the class regions on ctx->nthreads threads and join their
+    * classes in source order. Returns false if any region had a syntax
+    * error, in which case ctx is untouched and the caller parses serially.
+    */
+    static bool parse_parallel(parse_context *ctx)
+    {
+      std::vector<parse_context> regions;
+      split_regions(ctx->tokens, regions);
+      if(regions.size() < 2)
+        return false;
+      int nthreads = ctx->nthreads;
+      if(nthreads > (int) regions.size())
+        nthreads = regions.size();
+      
+      for(size_t i = 0; i < regions.size(); i++) {
+        regions[i].hash_cons = ctx->hash_cons;
+        regions[i].object_symbol = ctx->object_symbol;
+        regions[i].self_symbol = ctx->self_symbol;
+      }
+      
+      region_queue q = { &regions, 0, ctx->trace };
+      std::vector<region_worker> workers(nthreads);
+      std::vector<pthread_t> threads(nthreads - 1);
+      for(int i = 0; i < nthreads; i++) {
+        workers[i].q = &q;
+        workers[i].tid = i;
+      }
+      int started = 0;
+      while(started < nthreads - 1 && pthread_create(&threads[started], NULL, parse_regions, &workers[started + 1]) == 0)
+        started++;
+      /* this thread takes regions as well */
+      parse_regions(&workers[0]);
+      for(int i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+      
+      Classes classes = NULL;
+      for(size_t i = 0; i < regions.size(); i++) {
+        if(regions[i].errors || regions[i].result == NULL)
+          return false;
+        classes = classes ? append_Classes(classes, regions[i].classes) : regions[i].classes;
+      }
+      for(size_t i = 0; i < regions.size(); i++) {
+        ctx->shared_lookups += regions[i].shared_lookups;
+        ctx->shared_hits += regions[i].shared_hits;
+        ctx->shared_bytes += regions[i].shared_bytes;
+        ctx->use_lines.insert(regions[i].use_lines.begin(), regions[i].use_lines.end());
+      }
+      
+      /* the program node gets the line the first region gave it */
+      ctx->lineno = regions[0].lineno;
+      ctx->classes = classes;
+      ctx->result = program(classes);
+      return true;
+    }
+    
+    /* look up a shareable node; when there is none, the next keep_shared() keeps it */
+    static bool find_shared(parse_context *ctx, int kind, void *a, void *b)
+    {
+      shared_key key;
+      key.kind = kind;
+      key.a = a;
+      key.b = b;
+      ctx->shared_lookups++;
+      std::map<shared_key, shared_node>::iterator it = ctx->shared.find(key);
+      if(it == ctx->shared.end()) {
+        ctx->shared_pending = key;
+        ctx->sharing = true;
+        return false;
+      }
+      ctx->shared_found = it->second.node;
+      ctx->shared_hits++;
+      ctx->shared_bytes += it->second.size;
+      return true;
+    }
+    
+    /* each use of a shared node waits for its parent, with the line it is on */
+    static void use_shared(parse_context *ctx, Expression node)
+    {
+      shared_use use = { node, ctx->lineno };
+      ctx->shared_uses.push_back(use);
+    }
+    
+    bool find_leaf(parse_context *ctx, int kind, void *a)
+    {
+      ctx->sharing = false;
+      if(!ctx->hash_cons || !find_shared(ctx, kind, a, NULL))
+        return false;
+      use_shared(ctx, ctx->shared_found);
+      return true;
+    }
+    
+    /* 
+    * An operator is shareable when its operands are shared and used on
+    * its line, so that everything in it is on one line and a use of it
+    * on another line is printed with that line throughout.
+    */
+    bool find_operator(parse_context *ctx, int kind, Expression e1, Expression e2)
+    {
+      ctx->sharing = false;
+      if(!ctx->hash_cons || ctx->shared_set.count(e1) == 0 || (e2 != NULL && ctx->shared_set.count(e2) == 0))
+        return false;
+      size_t operands = e2 != NULL ? 2 : 1;     /* their uses are the last ones */
+      if(ctx->shared_uses.size() < operands)
+        return false;
+      for(size_t i = ctx->shared_uses.size() - operands; i < ctx->shared_uses.size(); i++)
+        if(ctx->shared_uses[i].line != ctx->lineno)
+          return false;
+      if(!find_shared(ctx, kind, e1, e2))
+        return false;
+      /* the operands are used inside the node found */
+      ctx->shared_uses.resize(ctx->shared_uses.size() - operands);
+      use_shared(ctx, ctx->shared_found);
+      return true;
+    }
+    
+    Expression keep_shared(parse_context *ctx, Expression node, size_t size)
+    {
+      if(ctx->sharing) {
+        shared_node kept = { node, size };
+        ctx->shared[ctx->shared_pending] = kept;
+        ctx->shared_set.insert(node);
+        ctx->sharing = false;
+        use_shared(ctx, node);
+      }
+      return node;
+    }
+    
+    /* 
+    * Give node the lines of its children's uses. The uses of its shared
+    * children are the last ones waiting: children are built before their
+    * parent, and each use of a shared node waits until its parent is
+    * built. children lists them in the order they were built, with their
+    * places among node's expressions in slots; a use on another line than
+    * its node's goes into use_lines under that place.
+    */
+    void take_uses(parse_context *ctx, tree_node *node, const Expression *children, const int *slots, int n)
+    {
+      size_t waiting = 0;
+      for(int i = 0; i < n; i++)
+        if(children[i] != NULL && ctx->shared_set.count(children[i]))
+          waiting++;
+      if(waiting > ctx->shared_uses.size())   /* after an error */
+        waiting = ctx->shared_uses.size();
+      size_t first = ctx->shared_uses.size() - waiting;
+      for(int i = 0; i < n; i++)
+        for(size_t j = first; children[i] != NULL && j < ctx->shared_uses.size(); j++) {
+          shared_use& use = ctx->shared_uses[j];
+          if(use.node != children[i])
+            continue;
+          if(use.line != children[i]->get_line_number())
+            ctx->use_lines[std::make_pair(node, slots[i])] = use.line;
+          use.node = NULL;                     /* taken */
+          break;
+        }
+      ctx->shared_uses.resize(first);
+    }
+    
+    /* 
+    * A call on self with arguments: self is built last, and the first
+    * argument is printed after the others.
+    */
+    Expression make_self_dispatch(parse_context *ctx, Expression self, Symbol name, Expression first, Expressions rest)
+    {
+      Expression node = at_line((dispatch)(self, name, append_Expressions(rest, single_Expressions(first))), ctx->lineno);
+      if(!ctx->shared_uses.empty()) {
+        std::vector<Expression> children(1, first);
+        std::vector<int> slots(1, rest->len() + 1);
+        for(int i = rest->first(); rest->more(i); i = rest->next(i)) {
+          children.push_back(rest->nth(i));
+          slots.push_back(1 + i);
+        }
+        children.push_back(self);
+        slots.push_back(0);
+        take_uses(ctx, node, &children[0], &slots[0], children.size());
+      }
+      return node;
+    }
+    
+    /* Allocations are counted while any context is being timed. */
+    static int counting;
+    static long allocations;
+    
+    /* the parser's hook in operator new, see cool-alloc.h */
+    void parser_allocated(void *, size_t)
+    {
+      if(counting)
+        __sync_fetch_and_add(&allocations, 1);
+    }
+    
+    static phase_time time_now()
+    {
+      timespec wall, cpu;
+      clock_gettime(CLOCK_MONOTONIC, &wall);
+      clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu);
+      phase_time t;
+      t.wall = wall.tv_sec * 1e3 + wall.tv_nsec / 1e6;
+      t.cpu = cpu.tv_sec * 1e3 + cpu.tv_nsec / 1e6;
+      t.allocs = allocations;
+      return t;
+    }
+    
+    /* store the time since *start in *spent, and start again */
+    static void time_since(phase_time *start, phase_time *spent)
+    {
+      phase_time now = time_now();
+      spent->wall = now.wall - start->wall;
+      spent->cpu = now.cpu - start->cpu;
+      spent->allocs = now.allocs - start->allocs;
+      *start = now;
+    }
+    
+    /* 
+    * With ctx->nthreads above 1 the class regions are parsed in parallel
+    * first; when that fails the stream is parsed serially, so error
+    * messages and recovery are always those of the serial parser.
+    */
+    int cool_parse(parse_context *ctx)
+    {
+      phase_time start = { 0, 0, 0 };
+      if(ctx->timing) {
+        __sync_fetch_and_add(&counting, 1);
+        start = time_now();
+      }
+      double trace = ctx->trace ? trace_clock() : 0;
+      read_tokens(ctx);
+      if(ctx->timing)
+        time_since(&start, &ctx->lex_time);
+      if(ctx->trace) {
+        trace_span(ctx->trace, 0, "lexing", "parser", trace);
+        trace = trace_clock();
+      }
+      
+      /* intern these before any thread does */
+      ctx->object_symbol = idtable.add_string("Object");
+      ctx->self_symbol = idtable.add_string("self");
+      
+      if(ctx->nthreads <= 1 || !parse_parallel(ctx)) {
+        if(ctx->trace && ctx->nthreads > 1)
+          trace_span(ctx->trace, 0, "parallel parse abandoned", "parser", trace);
+        lexed_token *begin = &ctx->tokens[0];
+        init_instance(ctx, begin, begin + ctx->tokens.size(), false);
+        yyparse(ctx);
+      }
+      if(ctx->trace)
+        trace_span(ctx->trace, 0, "parsing", "parser", trace);
+      /* the program keeps the lines it is dumped with */
+      if(ctx->result != NULL)
+        ((dumped_program_class *) ctx->result)->use_lines.swap(ctx->use_lines);
+      
+      if(ctx->timing) {
+        time_since(&start, &ctx->parse_time);
+        __sync_fetch_and_sub(&counting, 1);
+      }
+      return ctx->errors;
+    }
+    
+    /********************************************************/
+    
+    /* 
+    * The parser phase: the globals below are the interface of the
+    * provided lexer (tokens-lex.cc), utilities and driver.
+    */
+    extern char *curr_filename;
+    int curr_lineno;                  /* line of the last token read */
+    YYSTYPE cool_yylval;              /* value of the last token read */
+    extern int yylex();               /* the entry point to the lexer */
+    
+    static int phase_lexer(void *state, YYSTYPE *value, int *lineno, char **filename)
+    {
+      int token = yylex();
+      *value = cool_yylval;
+      *lineno = curr_lineno;
+      *filename = curr_filename;
+      return token;
+    }
+    
+    static parse_trace phase_trace;   /* COOL_TRACE, written at exit */
+    
+    static void write_phase_trace()
+    {
+      write_trace(&phase_trace);
+    }
+    
+    static void report_times(parse_context *ctx, bool json)
+    {
+      const char *names[2] = { "lexing", "parsing" };
+      phase_time *times[2] = { &ctx->lex_time, &ctx->parse_time };
+      char line[256];
+      if(json)
+        cerr << "{\n  \"phase\": \"parser\",\n  \"timers\": [";
+      else {
+        snprintf(line, sizeof(line), "%-32s %10s %10s %10s\n", "parser time report", "wall ms", "cpu ms", "allocs");
+        cerr << line;
+      }
+      for(int i = 0; i < 2; i++) {
+        if(json)
+          snprintf(line, sizeof(line), "%s\n    {\"name\": \"%s\", \"wall_ms\": %.3f, \"cpu_ms\": %.3f, \"allocs\": %ld}",
+          i ? "," : "", names[i], times[i]->wall, times[i]->cpu, times[i]->allocs);
+        else
+          snprintf(line, sizeof(line), "  %-30s %10.3f %10.3f %10ld\n", names[i],
+          times[i]->wall, times[i]->cpu, times[i]->allocs);
+        cerr << line;
+      }
+      if(json)
+        cerr << "\n  ]\n}" << endl;
+    }
+    
+    /* 
+    * The parser phase on the tokens lex returns. Reports the errors the
+    * way the phase always has. COOL_PARSE_THREADS parses class regions
+    * in parallel; COOL_HASH_CONS shares constant nodes and reports the
+    * memory saved; COOL_TIME_REPORT=text or json reports the time and
+    * allocations spent lexing and parsing; COOL_TRACE=<file> appends
+    * trace events to <file>. With more than MAX_ERRORS errors it says
+    * so and fails like any other erroneous parse.
+    */
+    int parse_phase(cool_lexer lex, void *lexer_state)
+    {
+      parse_context ctx;
+      ctx.lex = lex;
+      ctx.lexer_state = lexer_state;
+      char *threads = getenv("COOL_PARSE_THREADS");
+      if(threads != NULL)
+        ctx.nthreads = atoi(threads);
+      ctx.hash_cons = getenv("COOL_HASH_CONS") != NULL;
+      char *report = getenv("COOL_TIME_REPORT");
+      ctx.timing = report != NULL;
+      phase_trace.file = getenv("COOL_TRACE");
+      if(phase_trace.file != NULL) {
+        phase_trace.start = trace_clock();
+        ctx.trace = &phase_trace;
+        atexit(write_phase_trace);
+      }
+      
+      cool_parse(&ctx);
+      if(ctx.timing)
+        report_times(&ctx, strcmp(report, "json") == 0);
+      if(ctx.hash_cons)
+        cerr << "hash-consing: " << ctx.shared_hits << " of " << ctx.shared_lookups \
+        << " constant nodes shared, " \
+        << ctx.shared_bytes << " bytes saved" << endl;
+      for(size_t i = 0; i < ctx.error_list.size(); i++) {
+        parse_error& e = ctx.error_list[i];
+        cool_yylval = e.at.value;     /* print_cool_token shows the value from here */
+        cerr << "\"" << e.at.filename << "\", line " << e.at.lineno << ": " \
+        << e.message << " at or near ";
+        print_cool_token(e.at.token);
+        cerr << endl;
+      }
+      omerrs = ctx.errors;
+      if(omerrs>MAX_ERRORS)
+        fprintf(stdout, "More than 50 errors\n");
+      
+      ast_root = ctx.result;
+      parse_results = ctx.classes;
+      return omerrs != 0;
+    }
+    
+    /* Entry point of the parser phase, on the token stream the driver reads. */
+    int yyparse()
+    {
+      return parse_phase(phase_lexer, NULL);
+    }
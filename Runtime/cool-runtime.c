@@ -0,0 +1,492 @@
+/*
+ *  The runtime for the x86-64 code semant writes with COOL_CODEGEN=x86-64:
+ *  the heap, the basic classes' methods and the runtime errors. The
+ *  generated code provides main's cool_main, the prototypes of the basic
+ *  classes, the class names, the Bool constants and the stack maps.
+ *
+ *  Errors are reported as the SPIM runtime reports them, so a program
+ *  prints the same thing here, under spim and on semant's VM.
+ *
+ *  The heap has two generations. Objects are bump allocated in the
+ *  nursery, by the generated code while there is room and by allocate()
+ *  otherwise. When it is full, a minor collection copies the objects
+ *  still reachable into the old generation, Cheney style, and the
+ *  nursery starts over. When the old generation has grown past its
+ *  limit, a major collection marks what is reachable there and slides
+ *  it down over the rest (the Lisp 2 algorithm), and the limit becomes
+ *  twice what survived. Objects too big for the nursery go straight to
+ *  the old generation, which is a single reserved range of addresses.
+ *
+ *  The roots are the object slots of the COOL frames, found from the
+ *  stack maps (see ../Semantic/native.cc), the old objects the write
+ *  barrier remembered as pointing into the nursery, and the locals the
+ *  runtime itself protects while it allocates. Int, Bool and String
+ *  objects hold no pointers; every other object's attributes are all
+ *  pointers, to objects in the heap, to constants outside it, or void.
+ *  While collecting, an object's dispatch table pointer is borrowed to
+ *  hold where it moves to and put back from the prototype afterwards.
+ *
+ *  COOL_GC_STATS in the environment has the statistics written to
+ *  stderr at exit; COOL_GC_NURSERY sets the nursery's size in bytes.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+typedef struct object {
+    int tag;
+    int size;							/* in bytes, this header included; the low bits are flags */
+    void **dispatch;
+    long value;							/* Int and Bool: the value; String: the length */
+    char chars[];						/* a String's characters */
+} object;
+
+#define SIZE(o) ((o)->size & ~7)
+#define REMEMBERED 1					/* an old object in the remembered set */
+#define MOVED 2							/* the dispatch word says where the object went */
+#define MARKED 2						/* an old object found reachable */
+
+/* one for each call that can collect, in the order of the code and so of address */
+typedef struct stack_map {
+    char *address;						/* a return address in the generated code */
+    int first, count;					/* its offsets in cool_stack_offsets */
+} stack_map;
+
+extern object Int_protObj, Bool_protObj, String_protObj, cool_false, cool_true;
+extern object *class_nameTab[];
+extern struct { object *prototype; void *init; } class_objTab[];
+extern stack_map cool_stack_maps[];
+extern long cool_stack_map_count;
+extern int cool_stack_offsets[];
+extern void cool_main(void);
+
+char *cool_heap, *cool_heap_end;		/* the nursery's free space, where the generated code allocates */
+char *cool_nursery;
+long cool_nursery_size;
+char *cool_stack_limit;					/* the generated code says the stack overflowed below this */
+void **cool_gc_return;					/* where the return address into the newest COOL frame is */
+char *cool_gc_frame;					/* and that frame's %rbp */
+char *cool_gc_bottom;					/* cool_main's */
+
+static char *oldStart, *oldTop, *oldEnd;	/* the old generation and its reserve */
+static long oldLimit;					/* its size that brings on a major collection */
+static object **remembered;
+static long rememberedCount, rememberedCapacity;
+static object **marks;					/* the major collection's work list */
+static long markCount, markCapacity;
+static object **protect[8];				/* the runtime's own roots */
+static int protectCount;
+static object *scan;					/* the next promoted object to scan */
+
+static struct {
+    long allocated, promoted, minors, majors;
+    double minorTime, minorMax, majorTime, majorMax;
+} stats;
+
+#define PROTECT(p) (protect[protectCount++] = &(p))
+#define UNPROTECT(n) (protectCount -= (n))
+
+static void outOfMemory(void){
+    fflush(stdout);
+    fprintf(stderr, "cool: out of memory\n");
+    exit(1);
+}
+
+static int young(object *o){
+    return (unsigned long) ((char *) o - cool_nursery) < (unsigned long) cool_nursery_size;
+}
+
+static int old(object *o){
+    return (char *) o >= oldStart && (char *) o < oldTop;
+}
+
+static int pointers(object *o){
+    return o->tag != Int_protObj.tag && o->tag != Bool_protObj.tag && o->tag != String_protObj.tag;
+}
+
+static double now(void){
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/* called with a slot of each root and each attribute of the objects reached */
+static void eachRoot(void (*visit)(object **)){
+    for(int i = 0; i < protectCount; i++)
+        visit(protect[i]);
+    if(cool_gc_return == NULL)
+        return;
+    char *ret = *cool_gc_return, *frame = cool_gc_frame;
+    for(;;){
+        long low = 0, high = cool_stack_map_count;
+        while(low < high){
+            long mid = (low + high) / 2;
+            if(cool_stack_maps[mid].address < ret)
+                low = mid + 1;
+            else
+                high = mid;
+        }
+        if(low == cool_stack_map_count || cool_stack_maps[low].address != ret){
+            fprintf(stderr, "cool: no stack map for %p\n", (void *) ret);
+            abort();
+        }
+        stack_map *m = &cool_stack_maps[low];
+        for(int i = 0; i < m->count; i++)
+            visit((object **) (frame + cool_stack_offsets[m->first + i]));
+        if(frame == cool_gc_bottom)
+            break;
+        ret = ((char **) frame)[1];
+        frame = ((char **) frame)[0];
+    }
+}
+
+static void eachAttribute(object *o, void (*visit)(object **)){
+    if(!pointers(o))
+        return;
+    object **attrs = (object **) &o->value, **end = (object **) ((char *) o + SIZE(o));
+    for(; attrs < end; attrs++)
+        visit(attrs);
+}
+
+/* the minor collection: a nursery object reached is copied to the old generation */
+static void promote(object **slot){
+    object *o = *slot;
+    if(!young(o))
+        return;
+    if(o->size & MOVED){
+        *slot = (object *) o->dispatch;
+        return;
+    }
+    long size = SIZE(o);
+    if(oldTop + size > oldEnd)
+        outOfMemory();
+    object *copy = (object *) oldTop;
+    oldTop += size;
+    memcpy(copy, o, size);
+    o->size |= MOVED;
+    o->dispatch = (void **) copy;
+    *slot = copy;
+}
+
+static void minor(void){
+    double start = now();
+    char *promoted = oldTop;
+    scan = (object *) oldTop;
+    eachRoot(promote);
+    for(long i = 0; i < rememberedCount; i++){
+        remembered[i]->size &= ~REMEMBERED;
+        eachAttribute(remembered[i], promote);
+    }
+    rememberedCount = 0;
+    for(; (char *) scan < oldTop; scan = (object *) ((char *) scan + SIZE(scan)))
+        eachAttribute(scan, promote);
+
+    stats.allocated += cool_heap - cool_nursery;
+    stats.promoted += oldTop - promoted;
+    stats.minors++;
+    cool_heap = cool_nursery;
+    double pause = now() - start;
+    stats.minorTime += pause;
+    if(pause > stats.minorMax)
+        stats.minorMax = pause;
+}
+
+/* the major collection, once the nursery is empty */
+static void mark(object **slot){
+    object *o = *slot;
+    if(!old(o) || (o->size & MARKED))
+        return;
+    o->size |= MARKED;
+    if(markCount == markCapacity){
+        markCapacity = markCapacity ? 2 * markCapacity : 4096;
+        marks = realloc(marks, markCapacity * sizeof(object *));
+        if(marks == NULL)
+            outOfMemory();
+    }
+    marks[markCount++] = o;
+}
+
+static void forward(object **slot){
+    if(old(*slot))
+        *slot = (object *) (*slot)->dispatch;
+}
+
+static void major(void){
+    double start = now();
+    eachRoot(mark);
+    while(markCount > 0)
+        eachAttribute(marks[--markCount], mark);
+
+    char *to = oldStart;
+    for(char *p = oldStart; p < oldTop; p += SIZE((object *) p)){
+        object *o = (object *) p;
+        if(o->size & MARKED){
+            o->dispatch = (void **) to;
+            to += SIZE(o);
+        }
+    }
+    eachRoot(forward);
+    for(char *p = oldStart; p < oldTop; p += SIZE((object *) p))
+        if(((object *) p)->size & MARKED)
+            eachAttribute((object *) p, forward);
+    for(char *p = oldStart, *next; p < oldTop; p = next){
+        object *o = (object *) p;
+        next = p + SIZE(o);
+        if(o->size & MARKED){
+            object *dest = (object *) o->dispatch;
+            memmove(dest, o, SIZE(o));
+            dest->size &= ~MARKED;
+            dest->dispatch = class_objTab[dest->tag].prototype->dispatch;
+        }
+    }
+    oldTop = to;
+
+    oldLimit = 2 * (oldTop - oldStart);
+    if(oldLimit < 8 * cool_nursery_size)
+        oldLimit = 8 * cool_nursery_size;
+    stats.majors++;
+    double pause = now() - start;
+    stats.majorTime += pause;
+    if(pause > stats.majorMax)
+        stats.majorMax = pause;
+}
+
+/* a minor collection, and a major one too when the old generation has outgrown its limit */
+static void collect(long size){
+    minor();
+    if(oldTop + size - oldStart > oldLimit)
+        major();
+}
+
+static void *allocate(long size){
+    size = (size + 7) & ~7L;
+    if(size > cool_nursery_size / 2){
+        if(oldTop + size - oldStart > oldLimit)
+            collect(size);
+        if(oldTop + size > oldEnd)
+            outOfMemory();
+        void *p = oldTop;
+        oldTop += size;
+        return p;
+    }
+    if(cool_heap + size > cool_heap_end)
+        collect(0);
+    void *p = cool_heap;
+    cool_heap += size;
+    return p;
+}
+
+/* the write barrier's slow path: o is old and now points into the nursery */
+void cool_remember(object *o){
+    if(o->size & REMEMBERED)
+        return;
+    if(rememberedCount == rememberedCapacity){
+        rememberedCapacity = rememberedCapacity ? 2 * rememberedCapacity : 1024;
+        remembered = realloc(remembered, rememberedCapacity * sizeof(object *));
+        if(remembered == NULL)
+            outOfMemory();
+    }
+    o->size |= REMEMBERED;
+    remembered[rememberedCount++] = o;
+}
+
+object *cool_copy(object *self){
+    long size = SIZE(self);
+    PROTECT(self);
+    object *o = allocate(size);
+    UNPROTECT(1);
+    memcpy(o, self, size);
+    o->size = size;
+    if(!young(o) && pointers(o))
+        cool_remember(o);
+    return o;
+}
+
+object *cool_int(int value){
+    object *o = cool_copy(&Int_protObj);
+    o->value = value;
+    return o;
+}
+
+/* a new String of length characters, copied from s unless it is NULL */
+static object *string(const char *s, long length){
+    object *o = allocate(sizeof(object) + length + 1);
+    *o = String_protObj;
+    o->size = (sizeof(object) + length + 1 + 7) & ~7L;
+    o->value = length;
+    if(s != NULL)
+        memcpy(o->chars, s, length);
+    o->chars[length] = '\0';
+    return o;
+}
+
+static void report(void){
+    stats.allocated += cool_heap - cool_nursery;
+    fprintf(stderr, "gc: %ld bytes allocated, %ld KB nursery\n", stats.allocated, cool_nursery_size >> 10);
+    fprintf(stderr, "gc: %ld minor collections, %ld bytes promoted, %.3f ms paused, %.3f ms at most\n",
+            stats.minors, stats.promoted, stats.minorTime * 1e3, stats.minorMax * 1e3);
+    fprintf(stderr, "gc: %ld major collections, %.3f ms paused, %.3f ms at most\n",
+            stats.majors, stats.majorTime * 1e3, stats.majorMax * 1e3);
+    fprintf(stderr, "gc: %ld bytes in the old generation\n", (long) (oldTop - oldStart));
+}
+
+static void heapInit(void){
+    char *size = getenv("COOL_GC_NURSERY");
+    cool_nursery_size = size != NULL && atol(size) >= 64 ? (atol(size) + 7) & ~7L : 4 << 20;
+    cool_nursery = malloc(cool_nursery_size);
+    if(cool_nursery == NULL)
+        outOfMemory();
+    cool_heap = cool_nursery;
+    cool_heap_end = cool_nursery + cool_nursery_size;
+
+    /* addresses for the old generation to grow into; pages are only used once touched */
+    long reserve = 1L << 36;
+    void *p;
+    while((p = mmap(NULL, reserve, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0)) == MAP_FAILED)
+        if((reserve /= 2) < cool_nursery_size)
+            outOfMemory();
+    oldStart = oldTop = p;
+    oldEnd = oldStart + reserve;
+    oldLimit = 8 * cool_nursery_size;
+
+    if(getenv("COOL_GC_STATS") != NULL)
+        atexit(report);
+}
+
+object *cool_equal(object *a, object *b){
+    if(a == b)
+        return &cool_true;
+    if(a == NULL || b == NULL || a->tag != b->tag)
+        return &cool_false;
+    if(a->tag == Int_protObj.tag || a->tag == Bool_protObj.tag)
+        return (int) a->value == (int) b->value ? &cool_true : &cool_false;
+    if(a->tag == String_protObj.tag && a->value == b->value && memcmp(a->chars, b->chars, a->value) == 0)
+        return &cool_true;
+    return &cool_false;
+}
+
+/* errors at a line of a file; the generated code passes the object involved too */
+static void error(const char *file, int line, const char *message){
+    printf("%s:%d: %s\n", file, line, message);
+    exit(1);
+}
+
+void cool_dispatch_abort(const char *file, int line){
+    error(file, line, "Dispatch to void.");
+}
+
+void cool_case_void_abort(const char *file, int line){
+    error(file, line, "Match on void in case statement.");
+}
+
+/* SPIM's runtime gives no line here, so neither does this */
+void cool_case_abort(const char *file, int line, object *o){
+    (void) file;
+    (void) line;
+    printf("No match in case statement for Class %s\n", class_nameTab[o->tag]->chars);
+    exit(1);
+}
+
+void cool_divide_abort(const char *file, int line){
+    error(file, line, "Division by zero.");
+}
+
+void cool_stack_abort(const char *file, int line){
+    error(file, line, "Stack overflow.");
+}
+
+/* the basic classes' methods */
+
+object *cool_abort(object *self){
+    printf("Abort called from class %s\n", class_nameTab[self->tag]->chars);
+    exit(0);
+}
+
+object *cool_type_name(object *self){
+    return class_nameTab[self->tag];
+}
+
+object *cool_out_string(object *self, object *s){
+    fwrite(s->chars, 1, s->value, stdout);
+    return self;
+}
+
+object *cool_out_int(object *self, object *i){
+    printf("%d", (int) i->value);
+    return self;
+}
+
+/* a line without its newline; a line holding a null reads as "" */
+static object *readLine(void){
+    static char *line;
+    static long capacity;
+    long length = 0;
+    int c, null = 0;
+    while((c = getchar()) != EOF && c != '\n'){
+        if(length + 1 >= capacity){
+            capacity = capacity ? 2 * capacity : 256;
+            line = realloc(line, capacity);
+        }
+        null |= c == '\0';
+        line[length++] = c;
+    }
+    return null ? string("", 0) : string(line, length);
+}
+
+object *cool_in_string(object *self){
+    (void) self;
+    return readLine();
+}
+
+object *cool_in_int(object *self){
+    (void) self;
+    return cool_int(atoi(readLine()->chars));
+}
+
+object *cool_length(object *self){
+    return cool_int(self->value);
+}
+
+/* the arguments may move while the result is allocated */
+object *cool_concat(object *self, object *s){
+    PROTECT(self);
+    PROTECT(s);
+    object *o = string(NULL, self->value + s->value);
+    UNPROTECT(2);
+    memcpy(o->chars, self->chars, self->value);
+    memcpy(o->chars + self->value, s->chars, s->value);
+    return o;
+}
+
+object *cool_substr(object *self, object *i, object *l){
+    int start = i->value, length = l->value;
+    if(start < 0 || length < 0 || start + length > self->value){
+        printf("Index to substr is out of range\n");
+        exit(1);
+    }
+    PROTECT(self);
+    object *o = string(NULL, length);
+    UNPROTECT(1);
+    memcpy(o->chars, self->chars + start, length);
+    return o;
+}
+
+int main(void){
+    static char buf[1 << 16];
+    setvbuf(stdout, buf, _IOFBF, sizeof(buf));
+
+    /* leave room under the limit for the runtime's own calls */
+    struct rlimit stack;
+    long room = 1L << 30;
+    if(getrlimit(RLIMIT_STACK, &stack) == 0 && stack.rlim_cur != RLIM_INFINITY && (long) stack.rlim_cur < room)
+        room = stack.rlim_cur;
+    cool_stack_limit = (char *) &stack - room + (256 << 10);
+
+    heapInit();
+    cool_main();
+    fflush(stdout);
+    return 0;
+}
@@ -0,0 +1,47 @@
+/*
+ *  cha.cc
+ *
+ *  Class hierarchy analysis. Once the whole program is checked, a
+ *  dispatch whose receiver's static class and every class below it run
+ *  the same function for the method can call that function directly.
+ *  Each class's single table is merged into its parent's, children
+ *  first: the tags are in preorder, so going down the tags does that.
+ *  The marked sites are in chaTargets, which the VM and the native
+ *  code both consult; COOL_CHA_REPORT prints how many were found.
+ */
+#include <stdlib.h>
+#include "vm.h"
+#include "cha.h"
+
+std::map<Expression, int> chaTargets;
+
+void analyzeHierarchy(){
+    for(size_t tag = 0; tag < vmClasses.size(); tag++)
+        vmClasses[tag].single = vmClasses[tag].vtable;
+    for(size_t tag = vmClasses.size(); tag-- > 1; ){
+        vm_class& c = vmClasses[tag];
+        std::vector<int>& parent = vmClasses[c.parent].single;
+        for(size_t slot = 0; slot < parent.size(); slot++)
+            if(parent[slot] != c.single[slot])
+                parent[slot] = -1;
+    }
+
+    int sites = 0;
+    for(std::map<Class_, std::pair<int, int> >::iterator it = compactClassNodes.begin(); it != compactClassNodes.end(); ++it){
+        vm_class& self = vmClasses[vmTags[it->first->class_getName()]];
+        for(int id = it->second.first; id < it->second.second; id++){
+            compact_node& n = compactTree[id];
+            if(n.kind != K_DISPATCH)
+                continue;
+            sites++;
+            Symbol receiver = compactOrigin[n.a]->get_type();
+            vm_class& c = receiver == SELF_TYPE ? self : vmClasses[vmTags[receiver]];
+            int function = c.single[c.methodSlots[compactSymbols[n.b]]];
+            if(function >= 0)
+                chaTargets[compactOrigin[id]] = function;
+        }
+    }
+    if(getenv("COOL_CHA_REPORT") != NULL)
+        cerr << "cha: " << chaTargets.size() << " of " << sites << " dispatch sites bound statically ("
+             << (sites != 0 ? 100.0 * chaTargets.size() / sites : 0.0) << "%)" << endl;
+}
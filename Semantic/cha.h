@@ -0,0 +1,16 @@
+/*
+ *  cha.h
+ *
+ *  Class hierarchy analysis (see cha.cc): the dispatch sites that can
+ *  only ever call one function.
+ */
+#ifndef CHA_H_
+#define CHA_H_
+
+#include "semant.h"
+
+extern std::map<Expression, int> chaTargets;	/* dispatch site -> the function it always calls */
+
+void analyzeHierarchy();						/* once the classes are laid out */
+
+#endif
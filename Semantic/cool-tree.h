@@ -60,6 +60,7 @@ public:
    virtual Symbol feature_getType() = 0;
    virtual Formals feature_getFormals() = 0;
    virtual Expression feature_getExpr() = 0;
+   virtual void feature_setExpr(Expression) = 0;
 
    /* implemented in 'semant.cc' to add into symbol tables */
    virtual void toSymTab(Class_) = 0;
@@ -99,6 +100,16 @@ public:
    virtual Expression copy_Expression() = 0;
 
    virtual Symbol validate(Symbol) = 0;
+   virtual vm_object *eval() = 0;		/* run it on the tree, see interp.cc */
+   virtual int lower() = 0;		/* append to the compact tree, see semant.h */
+   virtual void compile() = 0;		/* append to the VM's bytecode, see vm.cc */
+   virtual void code() = 0;		/* append x86-64 assembly, see native.cc */
+   virtual void value();		/* the same, leaving an Int or Bool's value in %eax */
+   virtual Expression fold() = 0;	/* simplify before code generation, see fold.cc */
+   virtual int build() = 0;		/* append to the SSA form, see ssa.cc; returns the value */
+   virtual unsigned long long shape(std::vector<Expression>&) = 0;	/* hash it less its children, which it queues; see semant.cc */
+   virtual bool constant(int&) { return false; }	/* the value of an Int or Bool literal */
+   virtual bool isSelf() { return false; }	/* the object self */
 
 #ifdef Expression_EXTRAS
    Expression_EXTRAS
@@ -118,6 +129,7 @@ public:
    virtual Symbol case_getName() = 0;
    virtual Symbol case_getType() = 0;
    virtual Expression case_getExpr() = 0;
+   virtual void case_setExpr(Expression) = 0;
 
 #ifdef Case_EXTRAS
    Case_EXTRAS
@@ -225,6 +237,7 @@ public:
    Symbol feature_getType() { return return_type; }
    Formals feature_getFormals() { return formals; }
    Expression feature_getExpr() { return expr; }
+   void feature_setExpr(Expression e) { expr = e; }
 
    /* populate the method symbol table */
    void toSymTab(Class_);
@@ -259,6 +272,7 @@ public:
    Symbol feature_getType() { return type_decl; }
    Formals feature_getFormals() { return NULL; }
    Expression feature_getExpr() { return init; }
+   void feature_setExpr(Expression e) { init = e; }
 
    /* populate attribute symbol table */
    void toSymTab(Class_);
@@ -318,6 +332,7 @@ public:
    Symbol case_getName(){ return name; }
    Symbol case_getType(){ return type_decl; }
    Expression case_getExpr(){ return expr; }
+   void case_setExpr(Expression e) { expr = e; }
 
 #ifdef Case_SHARED_EXTRAS
    Case_SHARED_EXTRAS
@@ -342,6 +357,14 @@ public:
    void dump(ostream& stream, int n);
 
    Symbol validate(Symbol);
+   vm_object *eval();
+   int lower();
+   void compile();
+   void code();
+   void value();
+   Expression fold();
+   int build();
+   unsigned long long shape(std::vector<Expression>&);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -370,6 +393,13 @@ public:
    void dump(ostream& stream, int n);
 
    Symbol validate(Symbol);
+   vm_object *eval();
+   int lower();
+   void compile();
+   void code();
+   Expression fold();
+   int build();
+   unsigned long long shape(std::vector<Expression>&);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -396,6 +426,13 @@ public:
    void dump(ostream& stream, int n);
 
    Symbol validate(Symbol);
+   vm_object *eval();
+   int lower();
+   void compile();
+   void code();
+   Expression fold();
+   int build();
+   unsigned long long shape(std::vector<Expression>&);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -421,6 +458,14 @@ public:
    void dump(ostream& stream, int n);
 
    Symbol validate(Symbol);
+   vm_object *eval();
+   int lower();
+   void compile();
+   void code();
+   void value();
+   Expression fold();
+   int build();
+   unsigned long long shape(std::vector<Expression>&);
 
 
 #ifdef Expression_SHARED_EXTRAS
@@ -446,6 +491,13 @@ public:
    void dump(ostream& stream, int n);
 
    Symbol validate(Symbol);
+   vm_object *eval();
+   int lower();
+   void compile();
+   void code();
+   Expression fold();
+   int build();
+   unsigned long long shape(std::vector<Expression>&);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -470,6 +522,13 @@ public:
    void dump(ostream& stream, int n);
 
    Symbol validate(Symbol);
+   vm_object *eval();
+   int lower();
+   void compile();
+   void code();
+   Expression fold();
+   int build();
+   unsigned long long shape(std::vector<Expression>&);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -492,6 +551,14 @@ public:
    void dump(ostream& stream, int n);
 
    Symbol validate(Symbol);
+   vm_object *eval();
+   int lower();
+   void compile();
+   void code();
+   void value();
+   Expression fold();
+   int build();
+   unsigned long long shape(std::vector<Expression>&);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -520,6 +587,14 @@ public:
    void dump(ostream& stream, int n);
 
    Symbol validate(Symbol);
+   vm_object *eval();
+   int lower();
+   void compile();
+   void code();
+   void value();
+   Expression fold();
+   int build();
+   unsigned long long shape(std::vector<Expression>&);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -544,6 +619,14 @@ public:
    void dump(ostream& stream, int n);
 
    Symbol validate(Symbol);
+   vm_object *eval();
+   int lower();
+   void compile();
+   void code();
+   void value();
+   Expression fold();
+   int build();
+   unsigned long long shape(std::vector<Expression>&);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -568,6 +651,14 @@ public:
    void dump(ostream& stream, int n);
 
    Symbol validate(Symbol);
+   vm_object *eval();
+   int lower();
+   void compile();
+   void code();
+   void value();
+   Expression fold();
+   int build();
+   unsigned long long shape(std::vector<Expression>&);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -592,6 +683,14 @@ public:
    void dump(ostream& stream, int n);
 
    Symbol validate(Symbol);
+   vm_object *eval();
+   int lower();
+   void compile();
+   void code();
+   void value();
+   Expression fold();
+   int build();
+   unsigned long long shape(std::vector<Expression>&);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -616,6 +715,14 @@ public:
    void dump(ostream& stream, int n);
 
    Symbol validate(Symbol);
+   vm_object *eval();
+   int lower();
+   void compile();
+   void code();
+   void value();
+   Expression fold();
+   int build();
+   unsigned long long shape(std::vector<Expression>&);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -638,6 +745,14 @@ public:
    void dump(ostream& stream, int n);
 
    Symbol validate(Symbol);
+   vm_object *eval();
+   int lower();
+   void compile();
+   void code();
+   void value();
+   Expression fold();
+   int build();
+   unsigned long long shape(std::vector<Expression>&);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -662,6 +777,14 @@ public:
    void dump(ostream& stream, int n);
 
    Symbol validate(Symbol);
+   vm_object *eval();
+   int lower();
+   void compile();
+   void code();
+   void value();
+   Expression fold();
+   int build();
+   unsigned long long shape(std::vector<Expression>&);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -685,6 +808,14 @@ public:
    void dump(ostream& stream, int n);
 
    Symbol validate(Symbol);
+   vm_object *eval();
+   int lower();
+   void compile();
+   void code();
+   void value();
+   Expression fold();
+   int build();
+   unsigned long long shape(std::vector<Expression>&);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -708,6 +839,14 @@ public:
    void dump(ostream& stream, int n);
 
    Symbol validate(Symbol);
+   vm_object *eval();
+   int lower();
+   void compile();
+   void code();
+   void value();
+   Expression fold();
+   int build();
+   unsigned long long shape(std::vector<Expression>&);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -730,6 +869,14 @@ public:
    void dump(ostream& stream, int n);
 
    Symbol validate(Symbol);
+   vm_object *eval();
+   int lower();
+   void compile();
+   void code();
+   void value();
+   Expression fold();
+   int build();
+   unsigned long long shape(std::vector<Expression>&);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -752,6 +899,15 @@ public:
    void dump(ostream& stream, int n);
 
    Symbol validate(Symbol);
+   vm_object *eval();
+   int lower();
+   void compile();
+   void code();
+   void value();
+   Expression fold();
+   int build();
+   unsigned long long shape(std::vector<Expression>&);
+   bool constant(int&);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -774,6 +930,15 @@ public:
    void dump(ostream& stream, int n);
 
    Symbol validate(Symbol);
+   vm_object *eval();
+   int lower();
+   void compile();
+   void code();
+   void value();
+   Expression fold();
+   int build();
+   unsigned long long shape(std::vector<Expression>&);
+   bool constant(int&);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -796,6 +961,13 @@ public:
    void dump(ostream& stream, int n);
 
    Symbol validate(Symbol);
+   vm_object *eval();
+   int lower();
+   void compile();
+   void code();
+   Expression fold();
+   int build();
+   unsigned long long shape(std::vector<Expression>&);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -818,6 +990,13 @@ public:
    void dump(ostream& stream, int n);
 
    Symbol validate(Symbol);
+   vm_object *eval();
+   int lower();
+   void compile();
+   void code();
+   Expression fold();
+   int build();
+   unsigned long long shape(std::vector<Expression>&);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -840,6 +1019,14 @@ public:
    void dump(ostream& stream, int n);
 
    Symbol validate(Symbol);
+   vm_object *eval();
+   int lower();
+   void compile();
+   void code();
+   void value();
+   Expression fold();
+   int build();
+   unsigned long long shape(std::vector<Expression>&);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -860,6 +1047,13 @@ public:
    void dump(ostream& stream, int n);
 
    Symbol validate(Symbol);
+   vm_object *eval();
+   int lower();
+   void compile();
+   void code();
+   Expression fold();
+   int build();
+   unsigned long long shape(std::vector<Expression>&);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -881,6 +1075,15 @@ public:
    void dump(ostream& stream, int n);
 
    Symbol validate(Symbol);
+   vm_object *eval();
+   int lower();
+   void compile();
+   void code();
+   void value();
+   Expression fold();
+   int build();
+   unsigned long long shape(std::vector<Expression>&);
+   bool isSelf();
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
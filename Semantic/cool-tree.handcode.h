@@ -5,6 +5,7 @@
 #define COOL_TREE_HANDCODE_H
 
 #include <iostream>
+#include <vector>
 #include "tree.h"
 #include "cool.h"
 #include "stringtab.h"
@@ -44,51 +45,120 @@ typedef Expressions_class *Expressions;
 typedef list_node<Case> Cases_class;
 typedef Cases_class *Cases;
 
+/* dump_with_types without recursion, see cool-dump.h */
+struct dump_part;
+typedef std::vector<dump_part> dump_stack;
+
+/*
+ * COOL_MEM_REPORT: each tree class counts the objects of its own
+ * allocated and deleted while the report is on; semant.cc reports them.
+ */
+struct mem_kind {
+    const char *name;
+    long objects, bytes;			/* allocated */
+    long freed, freedBytes;			/* deleted again */
+    mem_kind *next;					/* all kinds that have been allocated */
+    mem_kind(const char *n);
+};
+extern bool memReport;
+void *memNew(mem_kind *kind, size_t size);		/* kind is NULL with the report off */
+void memDelete(mem_kind *kind, void *p, size_t size);
+
+/*
+ * The constants, the basic classes and their scopes, built once ahead
+ * of any program by a process that checks many (see ../Server); each
+ * semant() then starts from them. semant() builds them itself otherwise.
+ */
+void semantBasics();
+
+/*
+ * COOL_RUN=ast: eval() returns the VM's objects, and each dispatch keeps
+ * the functions it has called by the receiver's class tag, so that a
+ * class it has seen before is not looked up again; see interp.cc.
+ */
+struct vm_object;
+#define EVAL_CACHE_SIZE 4
+struct eval_cache {
+    int count;						/* classes seen, EVAL_CACHE_SIZE + 1 once there are more */
+    int tags[EVAL_CACHE_SIZE];
+    int functions[EVAL_CACHE_SIZE];
+    eval_cache() : count(0) {}
+};
+
+#define MEM_COUNTED(cls)                                        \
+static mem_kind& memKind() {                                    \
+    static mem_kind kind(#cls);                                 \
+    return kind;                                                \
+}                                                               \
+static void *operator new(size_t size) {                        \
+    return memNew(memReport ? &memKind() : NULL, size);         \
+}                                                               \
+static void operator delete(void *p, size_t size) {             \
+    memDelete(memReport ? &memKind() : NULL, p, size);          \
+}
+
 #define Program_EXTRAS                          \
 virtual void semant() = 0;			\
-virtual void dump_with_types(ostream&, int) = 0; 
+virtual void dump_with_types(ostream&, int) = 0; \
+virtual void dump_parts(ostream&, int, dump_stack&) = 0; \
+void set_lineno(int l) { line_number = l; }
 
 
 
 #define program_EXTRAS                          \
 void semant();     				\
-void dump_with_types(ostream&, int);            
+void dump_with_types(ostream&, int);            \
+void dump_parts(ostream&, int, dump_stack&);    \
+MEM_COUNTED(program_class)
 
 #define Class__EXTRAS                   \
 virtual Symbol get_filename() = 0;      \
-virtual void dump_with_types(ostream&,int) = 0; 
+virtual void dump_with_types(ostream&,int) = 0; \
+virtual void dump_parts(ostream&, int, dump_stack&) = 0; \
+void set_lineno(int l) { line_number = l; }
 
 
 #define class__EXTRAS                                 \
 Symbol get_filename() { return filename; }             \
-void dump_with_types(ostream&,int);                    
+void dump_with_types(ostream&,int);                    \
+void dump_parts(ostream&, int, dump_stack&);          \
+MEM_COUNTED(class__class)
 
 
 #define Feature_EXTRAS                                        \
-virtual void dump_with_types(ostream&,int) = 0; 
+virtual void dump_with_types(ostream&,int) = 0;               \
+virtual void dump_parts(ostream&, int, dump_stack&) = 0;      \
+void set_lineno(int l) { line_number = l; }
 
 
 #define Feature_SHARED_EXTRAS                                       \
-void dump_with_types(ostream&,int);    
+void dump_with_types(ostream&,int);                                 \
+void dump_parts(ostream&, int, dump_stack&);
 
 
 
 
 
 #define Formal_EXTRAS                              \
-virtual void dump_with_types(ostream&,int) = 0;
+virtual void dump_with_types(ostream&,int) = 0; \
+void set_lineno(int l) { line_number = l; }
 
 
 #define formal_EXTRAS                           \
-void dump_with_types(ostream&,int);
+void dump_with_types(ostream&,int);             \
+MEM_COUNTED(formal_class)
 
 
 #define Case_EXTRAS                             \
-virtual void dump_with_types(ostream& ,int) = 0;
+virtual void dump_with_types(ostream& ,int) = 0; \
+virtual void dump_parts(ostream&, int, dump_stack&) = 0; \
+void set_lineno(int l) { line_number = l; }
 
 
 #define branch_EXTRAS                                   \
-void dump_with_types(ostream& ,int);
+void dump_with_types(ostream& ,int);                    \
+void dump_parts(ostream&, int, dump_stack&);            \
+MEM_COUNTED(branch_class)
 
 
 #define Expression_EXTRAS                    \
@@ -96,10 +166,40 @@ Symbol type;                                 \
 Symbol get_type() { return type; }           \
 Expression set_type(Symbol s) { type = s; return this; } \
 virtual void dump_with_types(ostream&,int) = 0;  \
+virtual void dump_parts(ostream&, int, dump_stack&) = 0; \
 void dump_type(ostream&, int);               \
+void set_lineno(int l) { line_number = l; }  \
 Expression_class() { type = (Symbol) NULL; }
 
 #define Expression_SHARED_EXTRAS           \
-void dump_with_types(ostream&,int); 
+void dump_with_types(ostream&,int);        \
+void dump_parts(ostream&, int, dump_stack&);
+
+#define method_EXTRAS          MEM_COUNTED(method_class)
+#define attr_EXTRAS            MEM_COUNTED(attr_class)
+#define assign_EXTRAS          MEM_COUNTED(assign_class)
+#define static_dispatch_EXTRAS MEM_COUNTED(static_dispatch_class)
+#define dispatch_EXTRAS        MEM_COUNTED(dispatch_class) eval_cache cache;
+#define cond_EXTRAS            MEM_COUNTED(cond_class)
+#define loop_EXTRAS            MEM_COUNTED(loop_class)
+#define typcase_EXTRAS         MEM_COUNTED(typcase_class)
+#define block_EXTRAS           MEM_COUNTED(block_class)
+#define let_EXTRAS             MEM_COUNTED(let_class)
+#define plus_EXTRAS            MEM_COUNTED(plus_class)
+#define sub_EXTRAS             MEM_COUNTED(sub_class)
+#define mul_EXTRAS             MEM_COUNTED(mul_class)
+#define divide_EXTRAS          MEM_COUNTED(divide_class)
+#define neg_EXTRAS             MEM_COUNTED(neg_class)
+#define lt_EXTRAS              MEM_COUNTED(lt_class)
+#define eq_EXTRAS              MEM_COUNTED(eq_class)
+#define leq_EXTRAS             MEM_COUNTED(leq_class)
+#define comp_EXTRAS            MEM_COUNTED(comp_class)
+#define int_const_EXTRAS       MEM_COUNTED(int_const_class)
+#define bool_const_EXTRAS      MEM_COUNTED(bool_const_class)
+#define string_const_EXTRAS    MEM_COUNTED(string_const_class)
+#define new__EXTRAS            MEM_COUNTED(new__class)
+#define isvoid_EXTRAS          MEM_COUNTED(isvoid_class)
+#define no_expr_EXTRAS         MEM_COUNTED(no_expr_class)
+#define object_EXTRAS          MEM_COUNTED(object_class)
 
 #endif
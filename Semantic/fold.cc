@@ -0,0 +1,252 @@
+/*
+ *  fold.cc
+ *
+ *  Constant folding. Before code is generated, fold() replaces each
+ *  expression with a simpler one that does the same: arithmetic and
+ *  comparisons on literals become literals, wrapping around as 32-bit
+ *  Ints do, a conditional on a literal becomes the branch it takes, and
+ *  a loop on false becomes void. A division by a literal zero is left
+ *  for the runtime to report. Adding or subtracting 0 and multiplying
+ *  or dividing by 1 leave the other operand. A new node takes the line
+ *  of the node it replaces. A call to a small method is replaced by the
+ *  method's body, see inline.cc.
+ */
+#include <stdlib.h>
+#include "fold.h"
+#include "inline.h"
+
+extern int semant_debug;
+
+static int foldCount;
+Symbol foldFilename;
+
+static Expression folded(Expression e, tree_node *from, Symbol type){
+    foldCount++;
+    e->set(from);
+    return e->set_type(type);
+}
+
+static Expression foldInt(unsigned value, tree_node *from){
+    return folded(int_const(inttable.add_int((int) value)), from, Int);
+}
+
+static Expression foldBool(bool value, tree_node *from){
+    return folded(bool_const(value), from, Bool);
+}
+
+/* the list itself if folding changed none of its expressions */
+static Expressions foldList(Expressions list){
+    std::vector<Expression> exprs;
+    bool changed = false;
+    for(int i = list->first(); list->more(i); i = list->next(i)){
+        exprs.push_back(list->nth(i)->fold());
+        changed |= exprs.back() != list->nth(i);
+    }
+    if(!changed)
+        return list;
+    Expressions result = nil_Expressions();
+    for(size_t i = 0; i < exprs.size(); i++)
+        result = append_Expressions(result, single_Expressions(exprs[i]));
+    return result;
+}
+
+void foldProgram(){
+    inlineStart();
+    for(classMAP::iterator it = classGraph.begin(); it != classGraph.end(); ++it){
+        if(it->second->get_filename() == basicFilename)
+            continue;
+        foldFilename = it->second->get_filename();
+        Features features = it->second->class_getFeatures();
+        for(int i = features->first(); features->more(i); i = features->next(i))
+            features->nth(i)->feature_setExpr(features->nth(i)->feature_getExpr()->fold());
+    }
+    if(semant_debug)
+        cerr << "fold: " << foldCount << " expressions folded" << endl;
+    inlineEnd();
+}
+
+bool int_const_class::constant(int& value){
+    value = atoi(token->get_string());
+    return true;
+}
+
+bool bool_const_class::constant(int& value){
+    value = val;
+    return true;
+}
+
+Expression assign_class::fold(){
+    expr = expr->fold();
+    return this;
+}
+
+Expression static_dispatch_class::fold(){
+    expr = expr->fold();
+    actual = foldList(actual);
+    return inlineCall(this, expr, type_name, name, actual);
+}
+
+Expression dispatch_class::fold(){
+    expr = expr->fold();
+    actual = foldList(actual);
+    return inlineCall(this, expr, NULL, name, actual);
+}
+
+Expression cond_class::fold(){
+    pred = pred->fold();
+    then_exp = then_exp->fold();
+    else_exp = else_exp->fold();
+    int value;
+    if(!pred->constant(value))
+        return this;
+    foldCount++;
+    return value ? then_exp : else_exp;
+}
+
+Expression loop_class::fold(){
+    pred = pred->fold();
+    body = body->fold();
+    int value;
+    if(pred->constant(value) && !value)
+        return folded(no_expr(), this, Object);
+    return this;
+}
+
+Expression typcase_class::fold(){
+    expr = expr->fold();
+    for(int i = cases->first(); cases->more(i); i = cases->next(i))
+        cases->nth(i)->case_setExpr(cases->nth(i)->case_getExpr()->fold());
+    return this;
+}
+
+Expression block_class::fold(){
+    body = foldList(body);
+    return this;
+}
+
+Expression let_class::fold(){
+    init = init->fold();
+    body = body->fold();
+    return this;
+}
+
+Expression plus_class::fold(){
+    e1 = e1->fold();
+    e2 = e2->fold();
+    int a, b;
+    bool left = e1->constant(a), right = e2->constant(b);
+    if(left && right)
+        return foldInt((unsigned) a + (unsigned) b, this);
+    if(right && b == 0)
+        return e1;
+    if(left && a == 0)
+        return e2;
+    return this;
+}
+
+Expression sub_class::fold(){
+    e1 = e1->fold();
+    e2 = e2->fold();
+    int a, b;
+    bool left = e1->constant(a), right = e2->constant(b);
+    if(left && right)
+        return foldInt((unsigned) a - (unsigned) b, this);
+    if(right && b == 0)
+        return e1;
+    return this;
+}
+
+Expression mul_class::fold(){
+    e1 = e1->fold();
+    e2 = e2->fold();
+    int a, b;
+    bool left = e1->constant(a), right = e2->constant(b);
+    if(left && right)
+        return foldInt((unsigned) a * (unsigned) b, this);
+    if(right && b == 1)
+        return e1;
+    if(left && a == 1)
+        return e2;
+    return this;
+}
+
+Expression divide_class::fold(){
+    e1 = e1->fold();
+    e2 = e2->fold();
+    int a, b;
+    bool left = e1->constant(a), right = e2->constant(b);
+    if(left && right && b != 0)
+        return foldInt(b == -1 ? 0u - (unsigned) a : (unsigned) (a / b), this);
+    if(right && b == 1)
+        return e1;
+    return this;
+}
+
+Expression neg_class::fold(){
+    e1 = e1->fold();
+    int a;
+    return e1->constant(a) ? foldInt(0u - (unsigned) a, this) : this;
+}
+
+Expression lt_class::fold(){
+    e1 = e1->fold();
+    e2 = e2->fold();
+    int a, b;
+    return e1->constant(a) && e2->constant(b) ? foldBool(a < b, this) : this;
+}
+
+Expression eq_class::fold(){
+    e1 = e1->fold();
+    e2 = e2->fold();
+    int a, b;
+    if(e1->get_type() == e2->get_type() && e1->constant(a) && e2->constant(b))
+        return foldBool(a == b, this);
+    return this;
+}
+
+Expression leq_class::fold(){
+    e1 = e1->fold();
+    e2 = e2->fold();
+    int a, b;
+    return e1->constant(a) && e2->constant(b) ? foldBool(a <= b, this) : this;
+}
+
+Expression comp_class::fold(){
+    e1 = e1->fold();
+    int a;
+    return e1->constant(a) ? foldBool(!a, this) : this;
+}
+
+Expression int_const_class::fold(){
+    return this;
+}
+
+Expression bool_const_class::fold(){
+    return this;
+}
+
+Expression string_const_class::fold(){
+    return this;
+}
+
+Expression new__class::fold(){
+    return this;
+}
+
+Expression isvoid_class::fold(){
+    e1 = e1->fold();
+    int a;
+    return e1->constant(a) ? foldBool(false, this) : this;
+}
+
+Expression no_expr_class::fold(){
+    return this;
+}
+
+Expression object_class::fold(){
+    return this;
+}
+
+bool object_class::isSelf(){
+    return name == self;
+}
@@ -0,0 +1,16 @@
+/*
+ *  fold.h
+ *
+ *  Constant folding (see fold.cc), run on the checked program before
+ *  any code is generated for it.
+ */
+#ifndef FOLD_H_
+#define FOLD_H_
+
+#include "semant.h"
+
+extern Symbol foldFilename;						/* of the class being folded */
+
+void foldProgram();								/* fold every method and initializer */
+
+#endif
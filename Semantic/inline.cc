@@ -0,0 +1,153 @@
+/*
+ *  inline.cc
+ *
+ *  Inlining. With the hierarchy analysed, fold() replaces a call whose
+ *  function is known, from a static dispatch or from chaTargets, by the
+ *  body of the method, if that body makes no calls of its own, is in the
+ *  caller's file and has at most COOL_INLINE nodes (12; 0 turns inlining
+ *  off). e0.f(e1, ..., en), f having formals x1, ..., xn, becomes
+ *
+ *    let x1' <- e1, ..., xn' <- en, self' <- e0 in
+ *        if isvoid self' then self'.f(x1, ..., xn) else body fi
+ *
+ *  without the test when e0 is self; the call left in it only reports the
+ *  dispatch to void. The body is shared with the method, not copied. When
+ *  the code generators reach the let of self', they find it in inlineSites
+ *  and generate the body with self' as self and the method's class as the
+ *  class, the primed variables going by the formals' names and the
+ *  caller's variables out of sight, so neither captures the other's names.
+ *  COOL_INLINE_REPORT lists the sites inlined.
+ */
+#include <stdlib.h>
+#include <string>
+#include "vm.h"
+#include "cha.h"
+#include "inline.h"
+#include "fold.h"
+
+struct inline_callee {
+    Feature method;
+    int tag;							/* its class */
+    int size;							/* nodes in its body */
+    bool leaf;							/* the body makes no calls */
+};
+
+static std::map<int, inline_callee> inlineCallees;		/* function -> the method it runs */
+static std::map<Expression, inline_callee *> inlineSites;	/* let of an inlined call's receiver -> its callee */
+static int inlineBudget, inlineCount, inlineDispatches;
+static bool inlineReport;
+
+/* the methods of the program's classes, sized from the compact tree, where each body's nodes follow the last's */
+void inlineStart(){
+    char *budget = getenv("COOL_INLINE");
+    inlineBudget = budget != NULL ? atoi(budget) : 12;
+    inlineReport = getenv("COOL_INLINE_REPORT") != NULL;
+    if(inlineBudget <= 0)
+        return;
+    for(std::map<Class_, std::pair<int, int> >::iterator it = compactClassNodes.begin(); it != compactClassNodes.end(); ++it){
+        int tag = vmTags[it->first->class_getName()];
+        vm_class& c = vmClasses[tag];
+        Features features = it->first->class_getFeatures();
+        for(int i = features->first(); features->more(i); i = features->next(i)){
+            Feature f = features->nth(i);
+            int start = compactBodies[f];
+            int end = features->more(features->next(i)) ? compactBodies[features->nth(features->next(i))] : it->second.second;
+            if(f->feature_getFormals() == NULL)
+                continue;
+            inline_callee callee = { f, tag, end - start, true };
+            for(int id = start; id < end; id++)
+                if(compactTree[id].kind == K_DISPATCH || compactTree[id].kind == K_STATIC_DISPATCH)
+                    callee.leaf = false;
+            inlineCallees[c.vtable[c.methodSlots[f->feature_getName()]]] = callee;
+        }
+    }
+}
+
+static Expression inlineNode(Expression e, Expression site, Symbol type){
+    e->set(site);
+    return e->set_type(type);
+}
+
+static Symbol inlinePrimed(Symbol name){
+    std::string primed = std::string(name->get_string()) + "'";
+    return idtable.add_string((char *) primed.c_str());
+}
+
+Expression inlineCall(Expression site, Expression receiver, Symbol type_name, Symbol name, Expressions actual){
+    if(inlineBudget <= 0)
+        return site;
+    inlineDispatches++;
+    int function;
+    if(type_name != NULL){
+        vm_class& c = vmClasses[vmTags[type_name]];
+        function = c.vtable[c.methodSlots[name]];
+    }
+    else {
+        std::map<Expression, int>::iterator direct = chaTargets.find(site);
+        if(direct == chaTargets.end())
+            return site;
+        function = direct->second;
+    }
+    std::map<int, inline_callee>::iterator it = inlineCallees.find(function);
+    if(it == inlineCallees.end())
+        return site;
+    inline_callee& callee = it->second;
+    Class_ cls = vmClasses[callee.tag].cls;
+    if(!callee.leaf || callee.size > inlineBudget || cls->get_filename() != foldFilename)
+        return site;
+
+    Feature method = callee.method;
+    method->feature_setExpr(method->feature_getExpr()->fold());
+    Formals formals = method->feature_getFormals();
+    Symbol type = site->get_type(), receiverName = inlinePrimed(self);
+    Expression body = method->feature_getExpr();
+    if(!receiver->isSelf()){
+        Expressions names = nil_Expressions();
+        for(int i = formals->first(); formals->more(i); i = formals->next(i)){
+            Formal f = formals->nth(i);
+            names = append_Expressions(names, single_Expressions(inlineNode(object(f->formal_getName()), site, f->formal_getType())));
+        }
+        Expression call = object(receiverName);
+        call = type_name != NULL ? static_dispatch(call, type_name, name, names) : dispatch(call, name, names);
+        body = cond(inlineNode(isvoid(inlineNode(object(receiverName), site, receiver->get_type())), site, Bool),
+                    inlineNode(call, site, type), body);
+        inlineNode(body, site, type);
+    }
+    Expression result = inlineNode(let(receiverName, receiver->get_type(), receiver, body), site, type);
+    inlineSites[result] = &callee;
+    for(int i = formals->len(); i-- > 0; ){
+        Formal f = formals->nth(i);
+        result = inlineNode(let(inlinePrimed(f->formal_getName()), f->formal_getType(), actual->nth(i), result), site, type);
+    }
+    inlineCount++;
+    if(inlineReport)
+        cerr << foldFilename << ":" << site->get_line_number() << ": inlined " << cls->class_getName() << "."
+             << name << " (" << callee.size << " nodes)" << endl;
+    return result;
+}
+
+void inlineEnd(){
+    if(inlineReport)
+        cerr << "inline: " << inlineCount << " of " << inlineDispatches << " dispatch sites inlined" << endl;
+}
+
+/* the body of an inlined call starts below the let that binds its receiver in slot */
+inline_state inlineEnter(Expression let, int slot){
+    inline_state outer = { vmClass, vmReceiver, vmFloor };
+    std::map<Expression, inline_callee *>::iterator site = inlineSites.find(let);
+    if(site == inlineSites.end())
+        return outer;
+    Formals formals = site->second->method->feature_getFormals();
+    vmFloor = vmScope.size() - 1 - formals->len();
+    for(int i = 0; i < formals->len(); i++)
+        vmScope[vmFloor + i].first = formals->nth(i)->formal_getName();
+    vmReceiver = slot;
+    vmClass = &vmClasses[site->second->tag];
+    return outer;
+}
+
+void inlineLeave(const inline_state& outer){
+    vmClass = outer.cls;
+    vmReceiver = outer.receiver;
+    vmFloor = outer.floor;
+}
@@ -0,0 +1,25 @@
+/*
+ *  inline.h
+ *
+ *  Inlining (see inline.cc): fold() replaces small calls by the bodies
+ *  of their methods, and the code generators find those bodies again
+ *  at the lets that bind their receivers.
+ */
+#ifndef INLINE_H_
+#define INLINE_H_
+
+#include "vm.h"
+
+/* what an inlined call's body replaces while it is compiled */
+struct inline_state {
+    vm_class *cls;
+    int receiver, floor;
+};
+
+void inlineStart();								/* before the first fold() */
+Expression inlineCall(Expression site, Expression receiver, Symbol type_name, Symbol name, Expressions actual);
+void inlineEnd();
+inline_state inlineEnter(Expression let, int slot);	/* at a let binding the receiver in slot */
+void inlineLeave(const inline_state&);
+
+#endif
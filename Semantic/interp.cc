@@ -0,0 +1,363 @@
+/*
+ *  interp.cc
+ *
+ *  Tree interpreter. COOL_RUN=ast runs the checked program on the tree
+ *  itself, with nothing generated first: eval() returns an expression's
+ *  value. The objects, the basic methods and the runtime errors are the
+ *  VM's. The variables of the methods being run are in evalScope, the
+ *  current one's from evalBase up; a name not found there is an
+ *  attribute of evalSelf. A dispatch evaluates its actuals onto
+ *  evalScope unnamed, and the callee names them after its formals.
+ *
+ *  Each dispatch_class node has an inline cache of the functions it has
+ *  called by the receiver's tag. A hit costs a compare or a few; a miss
+ *  looks the method up in the class's method slots and adds it, until
+ *  the site has seen EVAL_CACHE_SIZE classes, after which it looks up
+ *  every class it does not have. Each COOL call is several C calls
+ *  deep, so the interpreter runs on a thread with a large stack, and
+ *  reports a stack overflow after VM_FRAMES calls as the VM does.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <algorithm>
+#include "vm.h"
+#include "interp.h"
+
+struct eval_method {
+    Feature method;
+    Symbol filename;					/* of its class, for the errors */
+    int basic;							/* the VM instruction of a basic method, -1 if it has a body */
+};
+
+static std::vector<eval_method> evalMethods;	/* by the VM's function numbers */
+static std::map<Expression, vm_case> evalCases;	/* each case's runs of tags, made the first time it runs */
+static std::vector<std::pair<Symbol, vm_object *> > evalScope;
+static size_t evalBase;
+static vm_object *evalSelf;
+static Symbol evalFilename;
+static int evalDepth;
+
+static void evalError(int line, const char *message){
+    printf("%s:%d: %s\n", evalFilename->get_string(), line, message);
+    exit(1);
+}
+
+static vm_object **evalVariable(Symbol name){
+    for(size_t i = evalScope.size(); i-- > evalBase; )
+        if(evalScope[i].first == name)
+            return &evalScope[i].second;
+    return &evalSelf->attrs[vmClasses[evalSelf->tag].attrSlots[name]];
+}
+
+static int evalLookup(eval_cache& cache, int tag, Symbol name){
+    for(int i = 0; i < cache.count && i < EVAL_CACHE_SIZE; i++)
+        if(cache.tags[i] == tag)
+            return cache.functions[i];
+    vm_class& c = vmClasses[tag];
+    int function = c.vtable[c.methodSlots[name]];
+    if(cache.count < EVAL_CACHE_SIZE){
+        cache.tags[cache.count] = tag;
+        cache.functions[cache.count] = function;
+    }
+    if(cache.count <= EVAL_CACHE_SIZE)
+        cache.count++;
+    return function;
+}
+
+/* the actuals are at args in evalScope */
+static vm_object *evalBasic(int op, vm_object *self, size_t args){
+    vm_object *o;
+    switch(op){
+    case OP_ABORT:
+        printf("Abort called from class %s\n", vmClasses[self->tag].cls->class_getName()->get_string());
+        exit(0);
+    case OP_TYPE_NAME:
+        return vmConsts[vmClasses[self->tag].name];
+    case OP_COPY:
+        o = vmAlloc(self->tag, vmSize(self));
+        memcpy(o, self, vmSize(self));
+        return o;
+    case OP_OUT_STRING:
+        fwrite(evalScope[args].second->chars, 1, evalScope[args].second->value, stdout);
+        return self;
+    case OP_OUT_INT:
+        printf("%d", evalScope[args].second->value);
+        return self;
+    case OP_IN_STRING:
+        return vmReadLine();
+    case OP_IN_INT:
+        return vmInt(atoi(vmReadLine()->chars));
+    case OP_LENGTH:
+        return vmInt(self->value);
+    case OP_CONCAT: {
+        vm_object *s = evalScope[args].second;
+        o = vmAlloc(vmStringTag, VM_HEADER + self->value + s->value + 1);
+        o->value = self->value + s->value;
+        memcpy(o->chars, self->chars, self->value);
+        memcpy(o->chars + self->value, s->chars, s->value + 1);
+        return o;
+    }
+    case OP_SUBSTR: {
+        int start = evalScope[args].second->value, length = evalScope[args + 1].second->value;
+        if(start < 0 || length < 0 || start + length > self->value){
+            printf("Index to substr is out of range\n");
+            exit(1);
+        }
+        return vmString(self->chars + start, length);
+    }
+    }
+    return NULL;
+}
+
+/* the last args entries of evalScope are the actuals */
+static vm_object *evalCall(int function, vm_object *self, int args, int line){
+    eval_method& m = evalMethods[function];
+    size_t base = evalScope.size() - args;
+    vm_object *result;
+    if(m.basic >= 0)
+        result = evalBasic(m.basic, self, base);
+    else {
+        if(++evalDepth >= VM_FRAMES)
+            evalError(line, "Stack overflow.");
+        Formals formals = m.method->feature_getFormals();
+        for(int i = 0; i < args; i++)
+            evalScope[base + i].first = formals->nth(i)->formal_getName();
+        size_t outerBase = evalBase;
+        vm_object *outerSelf = evalSelf;
+        Symbol outerFilename = evalFilename;
+        evalBase = base;
+        evalSelf = self;
+        evalFilename = m.filename;
+        result = m.method->feature_getExpr()->eval();
+        evalBase = outerBase;
+        evalSelf = outerSelf;
+        evalFilename = outerFilename;
+        evalDepth--;
+    }
+    evalScope.resize(base);
+    return result;
+}
+
+/* the parent's initializers, then the class's own */
+static void evalInit(int tag, vm_object *o){
+    vm_class& c = vmClasses[tag];
+    if(++evalDepth >= VM_FRAMES)
+        evalError(0, "Stack overflow.");
+    if(c.parent >= 0 && vmClasses[c.parent].init >= 0)
+        evalInit(c.parent, o);
+    size_t outerBase = evalBase;
+    vm_object *outerSelf = evalSelf;
+    Symbol outerFilename = evalFilename;
+    evalBase = evalScope.size();
+    evalSelf = o;
+    evalFilename = c.cls->get_filename();
+    Features features = c.cls->class_getFeatures();
+    for(int i = features->first(); features->more(i); i = features->next(i)){
+        Feature f = features->nth(i);
+        if(f->feature_getFormals() == NULL && f->feature_getExpr()->get_type() != No_type){
+            vm_object *value = f->feature_getExpr()->eval();
+            o->attrs[c.attrSlots[f->feature_getName()]] = value;
+        }
+    }
+    evalBase = outerBase;
+    evalSelf = outerSelf;
+    evalFilename = outerFilename;
+    evalDepth--;
+}
+
+static vm_object *evalNew(int tag){
+    vm_class& c = vmClasses[tag];
+    size_t n = c.attrs.size();
+    vm_object *o = vmAlloc(tag, VM_HEADER + n * sizeof(vm_object *));
+    o->value = 0;
+    o->attrs[0] = NULL;					/* an empty String */
+    if(n != 0)
+        memcpy(o->attrs, &c.attrs[0], n * sizeof(vm_object *));
+    if(c.init >= 0)
+        evalInit(tag, o);
+    return o;
+}
+
+/* (new Main).main() */
+static void *evalRun(void *){
+    evalMethods.resize(vmFunctions.size());
+    for(size_t tag = 0; tag < vmClasses.size(); tag++){
+        vm_class& c = vmClasses[tag];
+        Features features = c.cls->class_getFeatures();
+        for(int i = features->first(); features->more(i); i = features->next(i)){
+            Feature f = features->nth(i);
+            if(f->feature_getFormals() == NULL)
+                continue;
+            eval_method& m = evalMethods[c.vtable[c.methodSlots[f->feature_getName()]]];
+            m.method = f;
+            m.filename = c.cls->get_filename();
+            m.basic = m.filename == basicFilename ? vmBasic(f->feature_getName()) : -1;
+        }
+    }
+    vm_class& main = vmClasses[vmTags[Main]];
+    evalFilename = main.cls->get_filename();
+    vm_object *o = evalNew(vmTags[Main]);
+    evalCall(main.vtable[main.methodSlots[main_meth]], o, 0, 0);
+    return NULL;
+}
+
+/* on a thread of its own, with a stack deep enough for VM_FRAMES calls */
+void evalProgram(){
+    pthread_attr_t attr;
+    pthread_t thread;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, (size_t) 1 << 30);
+    int error = pthread_create(&thread, &attr, evalRun, NULL);
+    if(error != 0){
+        cerr << "semant: cannot start the interpreter: " << strerror(error) << endl;
+        exit(1);
+    }
+    pthread_join(thread, NULL);
+}
+
+vm_object *assign_class::eval(){
+    vm_object *value = expr->eval();
+    *evalVariable(name) = value;
+    return value;
+}
+
+vm_object *static_dispatch_class::eval(){
+    for(int i = actual->first(); actual->more(i); i = actual->next(i))
+        evalScope.push_back(std::make_pair((Symbol) NULL, actual->nth(i)->eval()));
+    vm_object *o = expr->eval();
+    if(o == NULL)
+        evalError(get_line_number(), "Dispatch to void.");
+    vm_class& c = vmClasses[vmTags[type_name]];
+    return evalCall(c.vtable[c.methodSlots[name]], o, actual->len(), get_line_number());
+}
+
+vm_object *dispatch_class::eval(){
+    for(int i = actual->first(); actual->more(i); i = actual->next(i))
+        evalScope.push_back(std::make_pair((Symbol) NULL, actual->nth(i)->eval()));
+    vm_object *o = expr->eval();
+    if(o == NULL)
+        evalError(get_line_number(), "Dispatch to void.");
+    return evalCall(evalLookup(cache, o->tag, name), o, actual->len(), get_line_number());
+}
+
+vm_object *cond_class::eval(){
+    return pred->eval()->value ? then_exp->eval() : else_exp->eval();
+}
+
+vm_object *loop_class::eval(){
+    while(pred->eval()->value)
+        body->eval();
+    return NULL;
+}
+
+vm_object *typcase_class::eval(){
+    vm_object *o = expr->eval();
+    if(o == NULL)
+        evalError(get_line_number(), "Match on void in case statement.");
+    std::map<Expression, vm_case>::iterator site = evalCases.find(this);
+    if(site == evalCases.end()){
+        site = evalCases.insert(std::make_pair((Expression) this, vm_case())).first;
+        vmCaseRuns(cases, site->second.starts, site->second.branches);
+    }
+    std::vector<int>& starts = site->second.starts;
+    int branch = site->second.branches[std::upper_bound(starts.begin(), starts.end(), o->tag) - starts.begin() - 1];
+    if(branch < 0){
+        printf("No match in case statement for Class %s\n", vmClasses[o->tag].cls->class_getName()->get_string());
+        exit(1);
+    }
+    Case c = cases->nth(branch);
+    evalScope.push_back(std::make_pair(c->case_getName(), o));
+    vm_object *result = c->case_getExpr()->eval();
+    evalScope.pop_back();
+    return result;
+}
+
+vm_object *block_class::eval(){
+    vm_object *value = NULL;
+    for(int i = body->first(); body->more(i); i = body->next(i))
+        value = body->nth(i)->eval();
+    return value;
+}
+
+vm_object *let_class::eval(){
+    vm_object *value = init->get_type() == No_type ? vmConsts[vmDefault(type_decl)] : init->eval();
+    evalScope.push_back(std::make_pair(identifier, value));
+    value = body->eval();
+    evalScope.pop_back();
+    return value;
+}
+
+vm_object *plus_class::eval(){
+    int a = e1->eval()->value;
+    return vmInt((int) ((unsigned) a + (unsigned) e2->eval()->value));
+}
+
+vm_object *sub_class::eval(){
+    int a = e1->eval()->value;
+    return vmInt((int) ((unsigned) a - (unsigned) e2->eval()->value));
+}
+
+vm_object *mul_class::eval(){
+    int a = e1->eval()->value;
+    return vmInt((int) ((unsigned) a * (unsigned) e2->eval()->value));
+}
+
+vm_object *divide_class::eval(){
+    int a = e1->eval()->value, b = e2->eval()->value;
+    if(b == 0)
+        evalError(get_line_number(), "Division by zero.");
+    return vmInt(b == -1 ? (int) (0u - (unsigned) a) : a / b);
+}
+
+vm_object *neg_class::eval(){
+    return vmInt((int) (0u - (unsigned) e1->eval()->value));
+}
+
+vm_object *lt_class::eval(){
+    int a = e1->eval()->value;
+    return a < e2->eval()->value ? vmTrue : vmFalse;
+}
+
+vm_object *eq_class::eval(){
+    vm_object *a = e1->eval();
+    return vmEqual(a, e2->eval()) ? vmTrue : vmFalse;
+}
+
+vm_object *leq_class::eval(){
+    int a = e1->eval()->value;
+    return a <= e2->eval()->value ? vmTrue : vmFalse;
+}
+
+vm_object *comp_class::eval(){
+    return e1->eval()->value ? vmFalse : vmTrue;
+}
+
+vm_object *int_const_class::eval(){
+    return vmConsts[vmConst(token, vmIntTag)];
+}
+
+vm_object *bool_const_class::eval(){
+    return val ? vmTrue : vmFalse;
+}
+
+vm_object *string_const_class::eval(){
+    return vmConsts[vmConst(token, vmStringTag)];
+}
+
+vm_object *new__class::eval(){
+    return evalNew(type_name == SELF_TYPE ? evalSelf->tag : vmTags[type_name]);
+}
+
+vm_object *isvoid_class::eval(){
+    return e1->eval() == NULL ? vmTrue : vmFalse;
+}
+
+vm_object *no_expr_class::eval(){
+    return NULL;
+}
+
+vm_object *object_class::eval(){
+    return name == self ? evalSelf : *evalVariable(name);
+}
@@ -0,0 +1,14 @@
+/*
+ *  interp.h
+ *
+ *  The tree interpreter of COOL_RUN=ast (see interp.cc), which runs the
+ *  checked program on the tree with the VM's objects and basic methods.
+ */
+#ifndef INTERP_H_
+#define INTERP_H_
+
+#include "semant.h"
+
+void evalProgram();								/* run (new Main).main() */
+
+#endif
@@ -0,0 +1,894 @@
+/*
+ *  native.cc
+ *
+ *  Native code. COOL_CODEGEN=x86-64 writes the checked program out as
+ *  assembly for the GNU assembler instead of the tree; linked with
+ *  Runtime/cool-runtime.o it runs under Linux. The classes, their tags,
+ *  layouts and method slots are the VM's (see vm.cc). An object is a
+ *  word holding its tag and its size in bytes, then its dispatch table,
+ *  then its attributes in the order build_hierarchy sees them; Int and
+ *  Bool hold their value there instead, and String its length and then
+ *  its characters.
+ *
+ *  The code() methods leave each expression's value in %rax and push
+ *  temporaries on the hardware stack. A caller pushes the actuals, then
+ *  self, and pops them when the call returns; the let and case
+ *  variables live below %rbp. A call into the C runtime keeps %rsp in
+ *  %rbx while it aligns the stack, so %rbx is never live in COOL code.
+ *  Runtime errors jump to cold paths placed after each function.
+ *
+ *  Int and Bool values stay unboxed where they can: value() leaves an
+ *  Int or Bool expression's value in %eax, so arithmetic, comparisons
+ *  and the tests of if and while allocate nothing, and Int and Bool
+ *  variables hold their values rather than objects unless they escape
+ *  (see nativeFunction). An object is only made when a value is passed,
+ *  returned, stored in an attribute or given to a case.
+ *
+ *  The runtime's collector moves objects, so it must find every object
+ *  pointer in the COOL frames on the stack. Each call that can collect
+ *  is followed by a label, and cool_stack_maps gives for each such
+ *  return address the offsets from %rbp of the frame's slots holding
+ *  objects: the boxed let and case variables bound there, and the
+ *  temporaries pushed that are objects. The actuals and self a caller
+ *  pushed are its temporaries. Unboxed values are left out, and no
+ *  object is kept in a register across such a call. Stores into
+ *  attributes go through a write barrier that remembers old objects
+ *  pointing into the nursery.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <sstream>
+#include "vm.h"
+#include "cha.h"
+#include "inline.h"
+#include "native.h"
+
+static std::ostringstream nativeCode;			/* the function being generated */
+static std::ostringstream nativeCold;			/* its error paths */
+static std::vector<std::string> nativeLabels;	/* label of each of the VM's functions */
+static std::map<Symbol, int> nativeFiles;		/* file names for the error messages */
+static Symbol nativeFilename;
+static int nativeLabelCount;
+static std::vector<bool> nativeUnboxed;			/* slots holding an Int or Bool's value */
+static std::vector<tree_node *> nativeOwner;	/* the let or formal bound to each slot */
+static std::vector<int> nativeDepth;			/* loops around each slot's binding */
+static std::set<tree_node *> nativeEscaped;		/* those boxed more often than bound */
+static int nativeLoops;							/* loops around the expression */
+static bool nativeRetry;						/* the function needs generating again */
+
+struct native_map {
+    int label;							/* the return address */
+    std::vector<int> slots;				/* the boxed variables bound */
+    std::vector<bool> temps;			/* which of the temporaries pushed are objects */
+};
+static std::vector<bool> nativeTemps;			/* the function's temporaries on the stack now */
+static std::vector<native_map> nativeMaps;		/* its stack maps */
+static std::vector<std::pair<int, std::vector<int> > > nativeStackMaps;	/* everyone's, as offsets from %rbp */
+
+/* allocation fast paths; they fall back on the runtime, which may collect, when the nursery is full */
+static const char *nativeStart =
+    "# %rax: a prototype; returns a copy of it in %rax\n"
+    "cool_clone:\n"
+    "\tmovl 4(%rax), %ecx\n"
+    "\tmov cool_heap(%rip), %rdi\n"
+    "\tlea (%rdi,%rcx), %rdx\n"
+    "\tcmp cool_heap_end(%rip), %rdx\n"
+    "\tja 1f\n"
+    "\tmov %rdx, cool_heap(%rip)\n"
+    "\tmov %rax, %rsi\n"
+    "\tmov %rdi, %rax\n"
+    "\tshr $3, %ecx\n"
+    "\trep movsq\n"
+    "\tret\n"
+    "1:\tmov %rax, %rdi\n"
+    "\tmov %rsp, cool_gc_return(%rip)\n\tmov %rbp, cool_gc_frame(%rip)\n"
+    "\tmov %rsp, %rbx\n\tand $-16, %rsp\n\tcall cool_copy\n\tmov %rbx, %rsp\n"
+    "\tret\n"
+    "\n"
+    "# %edi: a value; returns a new Int holding it in %rax\n"
+    "cool_box_int:\n"
+    "\tmov cool_heap(%rip), %rax\n"
+    "\tlea 24(%rax), %rdx\n"
+    "\tcmp cool_heap_end(%rip), %rdx\n"
+    "\tja 1f\n"
+    "\tmov %rdx, cool_heap(%rip)\n"
+    "\tmov Int_protObj(%rip), %rdx\n"
+    "\tmov %rdx, (%rax)\n"
+    "\tmov Int_protObj+8(%rip), %rdx\n"
+    "\tmov %rdx, 8(%rax)\n"
+    "\tmovslq %edi, %rdi\n"
+    "\tmov %rdi, 16(%rax)\n"
+    "\tret\n"
+    "1:\tmov %rsp, cool_gc_return(%rip)\n\tmov %rbp, cool_gc_frame(%rip)\n"
+    "\tmov %rsp, %rbx\n\tand $-16, %rsp\n\tcall cool_int\n\tmov %rbx, %rsp\n"
+    "\tret\n"
+    "\n"
+    "# %rcx: an old object just given %rax in an attribute; keeps %rax\n"
+    "cool_write_barrier:\n"
+    "\tmov %rax, %rdx\n"
+    "\tsub cool_nursery(%rip), %rdx\n"
+    "\tcmp cool_nursery_size(%rip), %rdx\n"
+    "\tjae 1f\n"
+    "\ttestl $1, 4(%rcx)\n"
+    "\tjnz 1f\n"
+    "\tpush %rax\n"
+    "\tmov %rcx, %rdi\n"
+    "\tmov %rsp, %rbx\n\tand $-16, %rsp\n\tcall cool_remember\n\tmov %rbx, %rsp\n"
+    "\tpop %rax\n"
+    "1:\tret\n\n";
+
+static const struct { const char *name, *function; } nativeBasics[] = {
+    { "abort", "cool_abort" }, { "type_name", "cool_type_name" }, { "copy", "cool_copy" },
+    { "out_string", "cool_out_string" }, { "out_int", "cool_out_int" }, { "in_string", "cool_in_string" },
+    { "in_int", "cool_in_int" }, { "length", "cool_length" }, { "concat", "cool_concat" }, { "substr", "cool_substr" }
+};
+
+static int nativeLabel(){
+    return nativeLabelCount++;
+}
+
+/* where a formal, self or a variable of the function lives */
+static std::string nativeSlot(int slot){
+    std::ostringstream s;
+    s << (slot <= vmSelf ? 16 + 8 * (vmSelf - slot) : -8 * (slot - vmSelf)) << "(%rbp)";
+    return s.str();
+}
+
+/* offset of an attribute of self, which is in the slot vmReceiver */
+static int nativeAttr(Symbol name){
+    return 16 + 8 * vmClass->attrSlots[name];
+}
+
+static void nativeCall(const char *function){
+    nativeCode << "\tmov %rsp, %rbx\n\tand $-16, %rsp\n\tcall " << function << "\n\tmov %rbx, %rsp\n";
+}
+
+static bool nativeIsUnboxed(int slot){
+    return slot >= 0 && slot < (int) nativeUnboxed.size() && nativeUnboxed[slot];
+}
+
+/* temporaries go through these so that the stack maps know where they are */
+static void nativePush(const char *operand, bool object){
+    nativeCode << "\tpush " << operand << "\n";
+    nativeTemps.push_back(object);
+}
+
+static void nativePop(const char *reg){
+    nativeCode << "\tpop " << reg << "\n";
+    nativeTemps.pop_back();
+}
+
+static void nativeDrop(int count){
+    nativeCode << "\tadd $" << 8 * count << ", %rsp\n";
+    nativeTemps.resize(nativeTemps.size() - count);
+}
+
+/* follows a call that may collect: where the objects in the frame are when it returns */
+static void nativeSafepoint(){
+    native_map m;
+    m.label = nativeLabel();
+    m.temps = nativeTemps;
+    for(size_t i = 0; i < vmScope.size(); i++)
+        if(vmScope[i].second > vmSelf && !nativeIsUnboxed(vmScope[i].second))
+            m.slots.push_back(vmScope[i].second);
+    nativeMaps.push_back(m);
+    nativeCode << ".L" << m.label << ":\n";
+}
+
+/* the function's stack maps, once its frame holds locals slots under %rbp */
+static void nativeMapsEnd(int locals){
+    for(size_t i = 0; i < nativeMaps.size(); i++){
+        native_map& m = nativeMaps[i];
+        std::vector<int> offsets;
+        for(size_t k = 0; k < m.slots.size(); k++)
+            offsets.push_back(-8 * (m.slots[k] - vmSelf));
+        for(size_t k = 0; k < m.temps.size(); k++)
+            if(m.temps[k])
+                offsets.push_back(-8 * (locals + (int) k + 1));
+        nativeStackMaps.push_back(std::make_pair(m.label, offsets));
+    }
+    nativeMaps.clear();
+}
+
+/* self's attribute name = %rax, remembering self if it is old and %rax young */
+static void nativeStore(Symbol name){
+    int young = nativeLabel();
+    nativeCode << "\tmov " << nativeSlot(vmReceiver) << ", %rcx\n\tmov %rax, " << nativeAttr(name) << "(%rcx)\n\tmov %rcx, %rdx\n"
+               << "\tsub cool_nursery(%rip), %rdx\n\tcmp cool_nursery_size(%rip), %rdx\n\tjb .L" << young
+               << "\n\tcall cool_write_barrier\n.L" << young << ":\n";
+}
+
+/* jump to a cold path that has the runtime report an error at line; it gets %rax too */
+static void nativeError(const char *jump, const char *function, int line){
+    int label = nativeLabel();
+    int file = nativeFiles.insert(std::make_pair(nativeFilename, (int) nativeFiles.size())).first->second;
+    nativeCode << "\t" << jump << " .L" << label << "\n";
+    nativeCold << ".L" << label << ":\n\tlea .Lfile" << file << "(%rip), %rdi\n\tmov $" << line
+               << ", %esi\n\tmov %rax, %rdx\n\tand $-16, %rsp\n\tcall " << function << "\n";
+}
+
+static void nativeStackCheck(int line){
+    nativeCode << "\tcmp cool_stack_limit(%rip), %rsp\n";
+    nativeError("jb", "cool_stack_abort", line);
+}
+
+/* %rax = true if the flags say cmov, else false */
+static void nativeBool(const char *cmov){
+    nativeCode << "\tlea const1(%rip), %rax\n\tlea const2(%rip), %rdx\n\t" << cmov << " %rdx, %rax\n";
+}
+
+/* the Int operands' values: e1's in %ecx, e2's in %eax */
+static void nativeOperands(Expression e1, Expression e2){
+    int n;
+    e1->value();
+    if(e2->constant(n)){
+        nativeCode << "\tmov %eax, %ecx\n\tmov $" << n << ", %eax\n";
+        return;
+    }
+    nativePush("%rax", false);
+    e2->value();
+    nativePop("%rcx");
+}
+
+static bool nativeScalar(Symbol type){
+    return type == Int || type == Bool;
+}
+
+/* %rax = the Int or Bool object for the value in %eax */
+static void nativeBox(Symbol type){
+    if(type == Bool){
+        nativeCode << "\ttest %eax, %eax\n";
+        nativeBool("cmovnz");
+    }
+    else {
+        nativeCode << "\tmov %eax, %edi\n\tcall cool_box_int\n";
+        nativeSafepoint();
+    }
+}
+
+/* an expression whose value is thrown away need not be boxed */
+static void nativeDiscard(Expression e){
+    if(nativeScalar(e->get_type()))
+        e->value();
+    else
+        e->code();
+}
+
+/* a variable, holding its value in the low half of the slot if unboxed */
+static int nativeBind(Symbol name, tree_node *owner, bool unboxed){
+    int slot = vmBind(name);
+    if((int) nativeUnboxed.size() <= slot){
+        nativeUnboxed.resize(slot + 1);
+        nativeOwner.resize(slot + 1);
+        nativeDepth.resize(slot + 1);
+    }
+    nativeUnboxed[slot] = unboxed;
+    nativeOwner[slot] = owner;
+    nativeDepth[slot] = nativeLoops;
+    return slot;
+}
+
+static void nativeNew(int tag, int line){
+    vm_class& c = vmClasses[tag];
+    nativeCode << "\tlea " << c.cls->class_getName()->get_string() << "_protObj(%rip), %rax\n\tcall cool_clone\n";
+    nativeSafepoint();
+    if(c.init < 0)
+        return;
+    nativeStackCheck(line);
+    nativePush("%rax", true);
+    nativeCode << "\tcall " << nativeLabels[c.init] << "\n";
+    nativeSafepoint();
+    nativeDrop(1);
+}
+
+/* the actuals, then the receiver, which is also left in %rax */
+static void nativeActuals(Expressions actual, Expression expr, int line){
+    for(int i = actual->first(); actual->more(i); i = actual->next(i)){
+        actual->nth(i)->code();
+        nativePush("%rax", true);
+    }
+    expr->code();
+    nativeCode << "\ttest %rax, %rax\n";
+    nativeError("jz", "cool_dispatch_abort", line);
+    nativeStackCheck(line);
+    nativePush("%rax", true);
+}
+
+static void nativeFunctionEnd(const std::string& label, int locals){
+    cout << label << ":\n\tpush %rbp\n\tmov %rsp, %rbp\n";
+    if(locals > 0)
+        cout << "\tsub $" << 8 * locals << ", %rsp\n";
+    cout << nativeCode.str() << "\tleave\n\tret\n" << nativeCold.str() << "\n";
+    nativeCode.str("");
+    nativeCold.str("");
+    nativeMapsEnd(locals);
+}
+
+/*
+ *  A method or an initializer, laid out as vmFunction does. Int and Bool
+ *  formals are copied unboxed into locals. A use that needs one of them
+ *  or a let variable boxed boxes it there, unless the use is inside a
+ *  loop the binding is not: then the function is generated again with
+ *  the variable boxed, which allocates once per assignment instead.
+ */
+static void nativeFunction(int index, Symbol filename, Formals formals, Expression body, Feature *attrs = NULL, int count = 0){
+    int args = formals != NULL ? formals->len() : 0;
+    nativeFilename = filename;
+    do {
+        nativeRetry = false;
+        nativeCode.str("");
+        nativeCold.str("");
+        nativeMaps.clear();
+        nativeUnboxed.assign(args + 1, false);
+        nativeOwner.assign(args + 1, (tree_node *) NULL);
+        nativeDepth.assign(args + 1, 0);
+        vmScope.clear();
+        for(int i = 0; i < args; i++)
+            vmScope.push_back(std::make_pair(formals->nth(i)->formal_getName(), i));
+        vmSelf = vmReceiver = args;
+        vmFloor = 0;
+        vmLocals = vmMaxLocals = args + 1;
+
+        if(body != NULL){
+            for(int i = 0; i < args; i++){
+                Formal f = formals->nth(i);
+                if(!nativeScalar(f->formal_getType()) || nativeEscaped.count(f))
+                    continue;
+                int slot = nativeBind(f->formal_getName(), f, true);
+                nativeCode << "\tmov " << nativeSlot(i) << ", %rax\n\tmovl 16(%rax), %eax\n\tmov %eax, " << nativeSlot(slot) << "\n";
+            }
+            body->code();
+        }
+        else {
+            if(vmClass->parent >= 0 && vmClasses[vmClass->parent].init >= 0){
+                nativePush("16(%rbp)", true);
+                nativeCode << "\tcall " << nativeLabels[vmClasses[vmClass->parent].init] << "\n";
+                nativeSafepoint();
+                nativeDrop(1);
+            }
+            for(int i = 0; i < count; i++){
+                attrs[i]->feature_getExpr()->code();
+                nativeStore(attrs[i]->feature_getName());
+            }
+            nativeCode << "\tmov 16(%rbp), %rax\n";
+        }
+    } while(nativeRetry);
+    nativeFunctionEnd(nativeLabels[index], vmMaxLocals - args - 1);
+}
+
+/* a basic method calls the runtime with self and the actuals */
+static void nativeBasic(int index, Feature f){
+    static const char *registers[] = { "%rsi", "%rdx" };
+    int args = f->feature_getFormals()->len();
+    cout << nativeLabels[index] << ":\n\tmov %rsp, cool_gc_return(%rip)\n\tmov %rbp, cool_gc_frame(%rip)\n\tmov 8(%rsp), %rdi\n";
+    for(int i = 0; i < args; i++)
+        cout << "\tmov " << 8 + 8 * (args - i) << "(%rsp), " << registers[i] << "\n";
+    for(size_t n = 0; n < sizeof(nativeBasics) / sizeof(nativeBasics[0]); n++)
+        if(strcmp(nativeBasics[n].name, f->feature_getName()->get_string()) == 0)
+            cout << "\tmov %rsp, %rbx\n\tand $-16, %rsp\n\tcall " << nativeBasics[n].function
+                 << "\n\tmov %rbx, %rsp\n\tret\n\n";
+}
+
+static void nativeAscii(const char *s, int length){
+    cout << "\t.ascii \"";
+    for(int i = 0; i < length; i++){
+        unsigned char c = s[i];
+        if(c == '"' || c == '\\')
+            cout << '\\' << c;
+        else if(c < ' ' || c >= 127){
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\%03o", c);
+            cout << buf;
+        }
+        else
+            cout << c;
+    }
+    cout << "\"\n";
+}
+
+/* the constant holding one of the VM's default values */
+static std::string nativeDefault(vm_object *o){
+    for(int i = 1; i <= 4; i++)
+        if(o == vmConsts[i]){
+            std::ostringstream s;
+            s << "const" << i;
+            return s.str();
+        }
+    return "0";
+}
+
+static void nativeData(){
+    cout << "\t.data\n\t.balign 8\n\t.globl Int_protObj, Bool_protObj, String_protObj, class_nameTab, class_objTab\n";
+    for(size_t tag = 0; tag < vmClasses.size(); tag++){
+        vm_class& c = vmClasses[tag];
+        const char *name = c.cls->class_getName()->get_string();
+        int tagged = tag;
+        if(tagged == vmStringTag)
+            cout << name << "_protObj:\n\t.long " << tag << ", 32\n\t.quad " << name << "_dispTab, 0, 0\n";
+        else if(tagged == vmIntTag || tagged == vmBoolTag)
+            cout << name << "_protObj:\n\t.long " << tag << ", 24\n\t.quad " << name << "_dispTab, 0\n";
+        else {
+            cout << name << "_protObj:\n\t.long " << tag << ", " << 16 + 8 * c.attrs.size() << "\n\t.quad "
+                 << name << "_dispTab\n";
+            for(size_t i = 0; i < c.attrs.size(); i++)
+                cout << "\t.quad " << nativeDefault(c.attrs[i]) << "\n";
+        }
+        cout << name << "_dispTab:\n";
+        for(size_t i = 0; i < c.vtable.size(); i++)
+            cout << "\t.quad " << nativeLabels[c.vtable[i]] << "\n";
+    }
+
+    /* new SELF_TYPE finds the prototype and initializer here, type_name the name */
+    cout << "class_objTab:\n";
+    for(size_t tag = 0; tag < vmClasses.size(); tag++)
+        cout << "\t.quad " << vmClasses[tag].cls->class_getName()->get_string() << "_protObj, "
+             << (vmClasses[tag].init >= 0 ? nativeLabels[vmClasses[tag].init] : "0") << "\n";
+    cout << "class_nameTab:\n";
+    for(size_t tag = 0; tag < vmClasses.size(); tag++)
+        cout << "\t.quad const" << vmClasses[tag].name << "\n";
+
+    /* each return address with the first of its offsets and how many there are */
+    cout << "\t.globl cool_stack_maps, cool_stack_map_count, cool_stack_offsets\n\t.balign 8\ncool_stack_map_count:\n\t.quad "
+         << nativeStackMaps.size() << "\ncool_stack_maps:\n";
+    for(size_t i = 0, first = 0; i < nativeStackMaps.size(); first += nativeStackMaps[i++].second.size())
+        cout << "\t.quad .L" << nativeStackMaps[i].first << "\n\t.long " << first << ", " << nativeStackMaps[i].second.size() << "\n";
+    cout << "cool_stack_offsets:\n";
+    for(size_t i = 0; i < nativeStackMaps.size(); i++)
+        for(size_t k = 0; k < nativeStackMaps[i].second.size(); k++)
+            cout << "\t.long " << nativeStackMaps[i].second[k] << "\n";
+
+    cout << "\t.balign 8\n";
+    for(size_t i = 1; i < vmConsts.size(); i++){
+        vm_object *o = vmConsts[i];
+        const char *name = vmClasses[o->tag].cls->class_getName()->get_string();
+        if(o->tag != vmStringTag){
+            cout << "const" << i << ":\n\t.long " << o->tag << ", 24\n\t.quad " << name << "_dispTab, " << o->value << "\n";
+            continue;
+        }
+        cout << "const" << i << ":\n\t.long " << o->tag << ", " << ((24 + o->value + 1 + 7) & ~7) << "\n\t.quad "
+             << name << "_dispTab, " << o->value << "\n";
+        nativeAscii(o->chars, o->value);
+        cout << "\t.byte 0\n\t.balign 8\n";
+    }
+    cout << "\t.globl cool_false, cool_true\n\t.set cool_false, const1\n\t.set cool_true, const2\n";
+
+    cout << "\t.section .rodata\n";
+    for(std::map<Symbol, int>::iterator it = nativeFiles.begin(); it != nativeFiles.end(); ++it){
+        cout << ".Lfile" << it->second << ":\n";
+        nativeAscii(it->first->get_string(), it->first->get_len());
+        cout << "\t.byte 0\n";
+    }
+    cout << "\t.section .note.GNU-stack,\"\",@progbits\n";
+}
+
+void emitNative(const char *target){
+    if(strcmp(target, "x86-64") != 0){
+        cerr << "semant: COOL_CODEGEN=" << target << " is not a target; use x86-64" << endl;
+        exit(1);
+    }
+    nativeLabels.resize(vmFunctions.size());
+    for(size_t tag = 0; tag < vmClasses.size(); tag++){
+        vm_class& c = vmClasses[tag];
+        std::string name = c.cls->class_getName()->get_string();
+        Features features = c.cls->class_getFeatures();
+        for(int i = features->first(); features->more(i); i = features->next(i)){
+            Feature f = features->nth(i);
+            if(f->feature_getFormals() != NULL)
+                nativeLabels[c.vtable[c.methodSlots[f->feature_getName()]]] = name + "." + f->feature_getName()->get_string();
+        }
+        if(c.init >= 0)
+            nativeLabels[c.init] = name + "_init";
+    }
+    static char buf[1 << 16];
+    cout.rdbuf()->pubsetbuf(buf, sizeof(buf));
+    cout << "\t.text\n" << nativeStart;
+
+    /* start: (new Main).main(); the collector walks the frames up to this one */
+    vmClass = &vmClasses[vmTags[Main]];
+    nativeFilename = vmClass->cls->get_filename();
+    vmScope.clear();
+    vmSelf = vmReceiver = vmFloor = 0;
+    nativeNew(vmTags[Main], 0);
+    nativePush("%rax", true);
+    nativeCode << "\tmov 8(%rax), %rcx\n\tcall *" << 8 * vmClass->methodSlots[main_meth] << "(%rcx)\n";
+    nativeSafepoint();
+    nativeDrop(1);
+    cout << "\t.globl cool_main\ncool_main:\n\tpush %rbx\n\tpush %rbp\n\tmov %rsp, %rbp\n\tmov %rbp, cool_gc_bottom(%rip)\n"
+         << nativeCode.str() << "\tmov %rbp, %rsp\n\tpop %rbp\n\tpop %rbx\n\tret\n" << nativeCold.str() << "\n";
+    nativeCode.str("");
+    nativeCold.str("");
+    nativeMapsEnd(0);
+
+    for(size_t tag = 0; tag < vmClasses.size(); tag++){
+        vmClass = &vmClasses[tag];
+        Class_ cur = vmClass->cls;
+        std::vector<Feature> inits;
+        Features features = cur->class_getFeatures();
+        for(int i = features->first(); features->more(i); i = features->next(i)){
+            Feature f = features->nth(i);
+            if(f->feature_getFormals() == NULL){
+                if(f->feature_getExpr()->get_type() != No_type)
+                    inits.push_back(f);
+                continue;
+            }
+            int index = vmClass->vtable[vmClass->methodSlots[f->feature_getName()]];
+            if(cur->get_filename() == basicFilename)
+                nativeBasic(index, f);
+            else
+                nativeFunction(index, cur->get_filename(), f->feature_getFormals(), f->feature_getExpr());
+        }
+        if(vmClass->init >= 0)
+            nativeFunction(vmClass->init, cur->get_filename(), NULL, NULL, inits.empty() ? NULL : &inits[0], inits.size());
+    }
+    nativeData();
+}
+
+void Expression_class::value(){
+    code();
+    nativeCode << "\tmovl 16(%rax), %eax\n";
+}
+
+void assign_class::code(){
+    int slot = vmLocal(name);
+    if(nativeIsUnboxed(slot)){
+        value();
+        nativeBox(get_type());
+        return;
+    }
+    expr->code();
+    if(slot >= 0)
+        nativeCode << "\tmov %rax, " << nativeSlot(slot) << "\n";
+    else
+        nativeStore(name);
+}
+
+void assign_class::value(){
+    int slot = vmLocal(name);
+    if(!nativeIsUnboxed(slot)){
+        Expression_class::value();
+        return;
+    }
+    expr->value();
+    nativeCode << "\tmov %eax, " << nativeSlot(slot) << "\n";
+}
+
+void static_dispatch_class::code(){
+    nativeActuals(actual, expr, get_line_number());
+    vm_class& c = vmClasses[vmTags[type_name]];
+    nativeCode << "\tcall " << nativeLabels[c.vtable[c.methodSlots[name]]] << "\n";
+    nativeSafepoint();
+    nativeDrop(actual->len() + 1);
+}
+
+void dispatch_class::code(){
+    nativeActuals(actual, expr, get_line_number());
+    std::map<Expression, int>::iterator direct = chaTargets.find(this);
+    if(direct != chaTargets.end()){
+        nativeCode << "\tcall " << nativeLabels[direct->second] << "\n";
+        nativeSafepoint();
+        nativeDrop(actual->len() + 1);
+        return;
+    }
+    Symbol receiver = expr->get_type();
+    vm_class& c = receiver == SELF_TYPE ? *vmClass : vmClasses[vmTags[receiver]];
+    nativeCode << "\tmov 8(%rax), %rcx\n\tcall *" << 8 * c.methodSlots[name] << "(%rcx)\n";
+    nativeSafepoint();
+    nativeDrop(actual->len() + 1);
+}
+
+/* the branches give an Int or Bool's value when boxed is false */
+static void nativeCond(Expression pred, Expression then_exp, Expression else_exp, bool boxed){
+    int toElse = nativeLabel(), toEnd = nativeLabel();
+    pred->value();
+    nativeCode << "\ttest %eax, %eax\n\tje .L" << toElse << "\n";
+    boxed ? then_exp->code() : then_exp->value();
+    nativeCode << "\tjmp .L" << toEnd << "\n.L" << toElse << ":\n";
+    boxed ? else_exp->code() : else_exp->value();
+    nativeCode << ".L" << toEnd << ":\n";
+}
+
+void cond_class::code(){
+    nativeCond(pred, then_exp, else_exp, true);
+}
+
+void cond_class::value(){
+    nativeCond(pred, then_exp, else_exp, false);
+}
+
+void loop_class::code(){
+    int start = nativeLabel(), toEnd = nativeLabel();
+    nativeCode << ".L" << start << ":\n";
+    nativeLoops++;
+    pred->value();
+    nativeCode << "\ttest %eax, %eax\n\tje .L" << toEnd << "\n";
+    nativeDiscard(body);
+    nativeLoops--;
+    nativeCode << "\tjmp .L" << start << "\n.L" << toEnd << ":\n\txor %eax, %eax\n";
+}
+
+/* a binary search on the tag in %ecx over the runs from lo up to hi, jumping to their branches */
+static void nativeCaseRuns(std::vector<int>& starts, std::vector<int>& branches, int lo, int hi,
+                           std::vector<int>& labels, int none){
+    if(hi - lo == 1){
+        nativeCode << "\tjmp .L" << (branches[lo] >= 0 ? labels[branches[lo]] : none) << "\n";
+        return;
+    }
+    int mid = (lo + hi) / 2;
+    if(hi - mid == 1){
+        nativeCode << "\tcmp $" << starts[mid] << ", %ecx\n\tjge .L" << (branches[mid] >= 0 ? labels[branches[mid]] : none) << "\n";
+        nativeCaseRuns(starts, branches, lo, mid, labels, none);
+        return;
+    }
+    int above = nativeLabel();
+    nativeCode << "\tcmp $" << starts[mid] << ", %ecx\n\tjge .L" << above << "\n";
+    nativeCaseRuns(starts, branches, lo, mid, labels, none);
+    nativeCode << ".L" << above << ":\n";
+    nativeCaseRuns(starts, branches, mid, hi, labels, none);
+}
+
+void typcase_class::code(){
+    expr->code();
+    nativeCode << "\ttest %rax, %rax\n";
+    nativeError("jz", "cool_case_void_abort", get_line_number());
+    int none = nativeLabel(), toEnd = nativeLabel();
+    std::vector<int> branches, starts, runs;
+    for(int i = cases->first(); cases->more(i); i = cases->next(i))
+        branches.push_back(nativeLabel());
+    vmCaseRuns(cases, starts, runs);
+    nativeCode << "\tmovl (%rax), %ecx\n";
+    nativeCaseRuns(starts, runs, 0, starts.size(), branches, none);
+    nativeCode << ".L" << none << ":\n";
+    nativeError("jmp", "cool_case_abort", get_line_number());
+    for(int i = cases->first(), b = 0; cases->more(i); i = cases->next(i), b++){
+        Case c = cases->nth(i);
+        int slot = nativeBind(c->case_getName(), c, false);
+        nativeCode << ".L" << branches[b] << ":\n\tmov %rax, " << nativeSlot(slot) << "\n";
+        c->case_getExpr()->code();
+        vmUnbind();
+        nativeCode << "\tjmp .L" << toEnd << "\n";
+    }
+    nativeCode << ".L" << toEnd << ":\n";
+}
+
+void block_class::code(){
+    for(int i = body->first(); body->more(i); i = body->next(i))
+        if(body->more(body->next(i)))
+            nativeDiscard(body->nth(i));
+        else
+            body->nth(i)->code();
+}
+
+void block_class::value(){
+    for(int i = body->first(); body->more(i); i = body->next(i))
+        if(body->more(body->next(i)))
+            nativeDiscard(body->nth(i));
+        else
+            body->nth(i)->value();
+}
+
+/* bind the variable, unboxed if it does not escape, then the body as code() or value() */
+static void nativeLet(let_class *let, Symbol identifier, Symbol type_decl, Expression init, Expression body, bool boxed){
+    bool unboxed = nativeScalar(type_decl) && nativeEscaped.count(let) == 0;
+    std::string value = nativeDefault(vmConsts[vmDefault(type_decl)]);
+    if(init->get_type() != No_type)
+        unboxed ? init->value() : init->code();
+    else if(value == "0" || unboxed)
+        nativeCode << "\txor %eax, %eax\n";
+    else
+        nativeCode << "\tlea " << value << "(%rip), %rax\n";
+    int slot = nativeBind(identifier, let, unboxed);
+    nativeCode << "\tmov " << (unboxed ? "%eax, " : "%rax, ") << nativeSlot(slot) << "\n";
+    inline_state outer = inlineEnter(let, slot);
+    boxed ? body->code() : body->value();
+    inlineLeave(outer);
+    vmUnbind();
+}
+
+void let_class::code(){
+    nativeLet(this, identifier, type_decl, init, body, true);
+}
+
+void let_class::value(){
+    nativeLet(this, identifier, type_decl, init, body, false);
+}
+
+void plus_class::code(){
+    value();
+    nativeBox(Int);
+}
+
+void plus_class::value(){
+    nativeOperands(e1, e2);
+    nativeCode << "\tadd %ecx, %eax\n";
+}
+
+void sub_class::code(){
+    value();
+    nativeBox(Int);
+}
+
+void sub_class::value(){
+    nativeOperands(e1, e2);
+    nativeCode << "\tsub %eax, %ecx\n\tmov %ecx, %eax\n";
+}
+
+void mul_class::code(){
+    value();
+    nativeBox(Int);
+}
+
+void mul_class::value(){
+    nativeOperands(e1, e2);
+    nativeCode << "\timul %ecx, %eax\n";
+}
+
+void divide_class::code(){
+    value();
+    nativeBox(Int);
+}
+
+/* x / -1 is negated rather than divided, since idiv traps on the smallest Int */
+void divide_class::value(){
+    int n, negate = nativeLabel(), done = nativeLabel();
+    nativeOperands(e1, e2);
+    if(e2->constant(n) && n != 0 && n != -1){
+        nativeCode << "\tmov %eax, %esi\n\tmov %ecx, %eax\n\tcltd\n\tidivl %esi\n";
+        return;
+    }
+    nativeCode << "\ttest %eax, %eax\n";
+    nativeError("jz", "cool_divide_abort", get_line_number());
+    nativeCode << "\tcmp $-1, %eax\n\tje .L" << negate << "\n\tmov %eax, %esi\n\tmov %ecx, %eax\n\tcltd\n\tidivl %esi\n"
+               << "\tjmp .L" << done << "\n.L" << negate << ":\n\tmov %ecx, %eax\n\tnegl %eax\n.L" << done << ":\n";
+}
+
+void neg_class::code(){
+    value();
+    nativeBox(Int);
+}
+
+void neg_class::value(){
+    e1->value();
+    nativeCode << "\tnegl %eax\n";
+}
+
+void lt_class::code(){
+    value();
+    nativeBox(Bool);
+}
+
+void lt_class::value(){
+    nativeOperands(e1, e2);
+    nativeCode << "\tcmp %eax, %ecx\n\tsetl %al\n\tmovzbl %al, %eax\n";
+}
+
+/* Ints and Bools are compared by value here, anything else by the runtime */
+void eq_class::code(){
+    if(nativeScalar(e1->get_type()) && e1->get_type() == e2->get_type()){
+        value();
+        nativeBox(Bool);
+        return;
+    }
+    int done = nativeLabel();
+    e1->code();
+    nativePush("%rax", true);
+    e2->code();
+    nativePop("%rdi");
+    nativeCode << "\tmov %rax, %rsi\n\tlea const2(%rip), %rax\n\tcmp %rsi, %rdi\n\tje .L" << done << "\n";
+    nativeCall("cool_equal");
+    nativeCode << ".L" << done << ":\n";
+}
+
+void eq_class::value(){
+    if(!nativeScalar(e1->get_type()) || e1->get_type() != e2->get_type()){
+        Expression_class::value();
+        return;
+    }
+    nativeOperands(e1, e2);
+    nativeCode << "\tcmp %eax, %ecx\n\tsete %al\n\tmovzbl %al, %eax\n";
+}
+
+void leq_class::code(){
+    value();
+    nativeBox(Bool);
+}
+
+void leq_class::value(){
+    nativeOperands(e1, e2);
+    nativeCode << "\tcmp %eax, %ecx\n\tsetle %al\n\tmovzbl %al, %eax\n";
+}
+
+void comp_class::code(){
+    value();
+    nativeBox(Bool);
+}
+
+void comp_class::value(){
+    e1->value();
+    nativeCode << "\txor $1, %eax\n";
+}
+
+void int_const_class::code(){
+    nativeCode << "\tlea const" << vmConst(token, vmIntTag) << "(%rip), %rax\n";
+}
+
+void int_const_class::value(){
+    nativeCode << "\tmov $" << atoi(token->get_string()) << ", %eax\n";
+}
+
+void bool_const_class::code(){
+    nativeCode << "\tlea const" << (val ? 2 : 1) << "(%rip), %rax\n";
+}
+
+void bool_const_class::value(){
+    nativeCode << "\tmov $" << (val ? 1 : 0) << ", %eax\n";
+}
+
+void string_const_class::code(){
+    nativeCode << "\tlea const" << vmConst(token, vmStringTag) << "(%rip), %rax\n";
+}
+
+void new__class::code(){
+    if(type_name != SELF_TYPE){
+        nativeNew(vmTags[type_name], get_line_number());
+        return;
+    }
+    int done = nativeLabel();
+    nativeCode << "\tmov " << nativeSlot(vmReceiver) << ", %rax\n\tmovl (%rax), %eax\n\tshl $4, %rax\n\tlea class_objTab(%rip), %rcx\n"
+               << "\tadd %rcx, %rax\n";
+    nativePush("8(%rax)", false);
+    nativeCode << "\tmov (%rax), %rax\n\tcall cool_clone\n";
+    nativeSafepoint();
+    nativePop("%rcx");
+    nativeCode << "\ttest %rcx, %rcx\n\tjz .L" << done << "\n";
+    nativeStackCheck(get_line_number());
+    nativePush("%rax", true);
+    nativeCode << "\tcall *%rcx\n";
+    nativeSafepoint();
+    nativeDrop(1);
+    nativeCode << ".L" << done << ":\n";
+}
+
+void isvoid_class::code(){
+    value();
+    nativeBox(Bool);
+}
+
+/* an Int or Bool is never void */
+void isvoid_class::value(){
+    if(nativeScalar(e1->get_type())){
+        e1->value();
+        nativeCode << "\txor %eax, %eax\n";
+        return;
+    }
+    e1->code();
+    nativeCode << "\ttest %rax, %rax\n\tsetz %al\n\tmovzbl %al, %eax\n";
+}
+
+void no_expr_class::code(){
+    nativeCode << "\txor %eax, %eax\n";
+}
+
+/* an unboxed variable needed as an object escapes if that happens more often than it is bound */
+void object_class::code(){
+    int slot = name == self ? vmReceiver : vmLocal(name);
+    if(nativeIsUnboxed(slot)){
+        if(nativeLoops > nativeDepth[slot]){
+            nativeEscaped.insert(nativeOwner[slot]);
+            nativeRetry = true;
+        }
+        value();
+        nativeBox(get_type());
+    }
+    else if(slot >= 0)
+        nativeCode << "\tmov " << nativeSlot(slot) << ", %rax\n";
+    else
+        nativeCode << "\tmov " << nativeSlot(vmReceiver) << ", %rcx\n\tmov " << nativeAttr(name) << "(%rcx), %rax\n";
+}
+
+void object_class::value(){
+    int slot = vmLocal(name);
+    if(nativeIsUnboxed(slot))
+        nativeCode << "\tmovl " << nativeSlot(slot) << ", %eax\n";
+    else
+        Expression_class::value();
+}
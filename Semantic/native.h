@@ -0,0 +1,15 @@
+/*
+ *  native.h
+ *
+ *  The x86-64 code generator of COOL_CODEGEN (see native.cc), which
+ *  writes the checked program to stdout as assembly for the runtime in
+ *  ../Runtime.
+ */
+#ifndef NATIVE_H_
+#define NATIVE_H_
+
+#include "semant.h"
+
+void emitNative(const char *target);			/* target is COOL_CODEGEN's value */
+
+#endif
@@ -1,12 +1,44 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <stddef.h>
+#include <errno.h>
+#include <time.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <new>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+#include <malloc.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <typeinfo>
 #include "semant.h"
+#include "vm.h"
+#include "cha.h"
+#include "inline.h"
+#include "fold.h"
+#include "interp.h"
+#include "native.h"
+#include "ssa.h"
 #include "utilities.h"
+#include "../Parser/cool-alloc.h"
+#include "../Parser/cool-dump.h"
 
 
 extern int semant_debug;
 extern char *curr_filename;
+extern Program ast_root;               /* what the driver dumps, see semant() */
+
+ClassTable *classtable;
+std::set<Symbol> *classDeps = NULL;
+bool classUncacheable;
+classMAP classGraph;
+std::vector<Class_> programClasses;
+symTab *methodTab, *attrTab;
 
 //////////////////////////////////////////////////////////////////////
 //
@@ -17,7 +49,7 @@ extern char *curr_filename;
 // as fixed names used by the runtime system.
 //
 //////////////////////////////////////////////////////////////////////
-static Symbol 
+Symbol 
     arg,
     arg2,
     Bool,
@@ -79,14 +111,109 @@ static void initialize_constants(void)
     val         = idtable.add_string("_val");
 }
 
+/*
+ *  Trace. With COOL_TRACE=<file>, the phases of semant, the steps of
+ *  the ClassTable constructor and each class checked are recorded as
+ *  Chrome trace events and appended to <file> at exit; chrome://tracing
+ *  and Perfetto open it. The lexer and parser append theirs to the same
+ *  file, so one file shows the whole compilation, one process per
+ *  phase. Delete the file to start a new trace. semant runs on one
+ *  thread, so its events go to a single ring that keeps the latest
+ *  TRACE_RING of them.
+ */
+#define TRACE_RING 65536
+
+struct trace_event {
+    const char *name, *cat;
+    double start, dur;					/* in us */
+};
+
+static char *traceFile;
+static trace_event traceRing[TRACE_RING];
+static unsigned long traceCount;		/* events recorded; the ring holds the last TRACE_RING */
+static double traceStart;				/* when semant() started */
+
+static double traceClock(){
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);		/* the clock the other phases use too */
+    return now.tv_sec * 1e6 + now.tv_nsec / 1e3;
+}
+
+static void traceEvent(const char *name, const char *cat, double start){
+    trace_event& e = traceRing[traceCount++ % TRACE_RING];
+    e.name = name;
+    e.cat = cat;
+    e.start = start;
+    e.dur = traceClock() - start;
+}
+
+/* a span from its construction or begin() to end() or to the end of its scope */
+struct trace_span {
+    const char *name, *cat;
+    double start;
+    trace_span(const char *n, const char *c) : name(n), cat(c), start(traceFile ? traceClock() : 0) { }
+    ~trace_span(){ end(); }
+    void begin(const char *n){
+        end();
+        name = n;
+        start = traceFile ? traceClock() : 0;
+    }
+    void end(){
+        if(traceFile != NULL && name != NULL)
+            traceEvent(name, cat, start);
+        name = NULL;
+    }
+};
+
+/* run at exit; the file is locked so phases finishing together do not interleave */
+static void writeTrace(){
+    traceEvent("semant", "phase", traceStart);
+    std::ostringstream out;
+    int pid = getpid();
+    out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << pid
+        << ",\"args\":{\"name\":\"semant\"}},\n";
+    unsigned long first = traceCount > TRACE_RING ? traceCount - TRACE_RING : 0;
+    char line[512];
+    for(unsigned long i = first; i < traceCount; i++){
+        trace_event& e = traceRing[i % TRACE_RING];
+        snprintf(line, sizeof(line), "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d},\n",
+                 e.name, e.cat, e.start, e.dur, pid, pid);
+        out << line;
+    }
+
+    std::string text = out.str();
+    text.resize(text.size() - 2);				/* the last event's ",\n" */
+    text += "\n]\n";
+
+    int fd = open(traceFile, O_RDWR | O_APPEND | O_CREAT, 0666);
+    if(fd < 0)
+        return;
+    struct stat st;
+    char tail[3];
+    flock(fd, LOCK_EX);
+    /* start the array, or reopen the one the last phase closed */
+    if(fstat(fd, &st) == 0 && st.st_size == 0)
+        write(fd, "[\n", 2);
+    else if(st.st_size >= 3 && pread(fd, tail, 3, st.st_size - 3) == 3 && memcmp(tail, "\n]\n", 3) == 0
+            && ftruncate(fd, st.st_size - 3) == 0)
+        write(fd, ",\n", 2);
+    write(fd, text.data(), text.size());
+    close(fd);
+}
+
 ClassTable::ClassTable(Classes classes) : semant_errors(0) , error_stream(cerr) {
     /* Fill this in */
 
-    install_basic_classes();		/* add basic classes Str,Int,Bool,IO,Object */
-    
+    trace_span basicSpan("install_basic_classes", "ClassTable");
+    if(classGraph.count(Object) == 0)	/* unless semantBasics() built them already */
+        install_basic_classes();		/* add basic classes Str,Int,Bool,IO,Object */
+    basicSpan.end();
+
+    trace_span graphSpan("class graph", "ClassTable");
     bool foundMain = false;         /* flag for Main class */
     cMAPit it;
-    for(int i=classes->first(); classes->more(i); i = classes->next(i)){
+    /* the list counts itself on every more(), so count it once */
+    for(int i=classes->first(), count = classes->len(); i < count; i = classes->next(i)){
     	Class_ cur = classes->nth(i);
     	Symbol name = cur->class_getName();
     	Symbol parent = cur->class_getParent();
@@ -111,6 +238,7 @@ ClassTable::ClassTable(Classes classes) : semant_errors(0) , error_stream(cerr)
     		semant_error(cur) << "Class "<<name<<" was previously defined.\n";
     		return;
     	}
+        programClasses.push_back(cur);
         /* verify if main found */
         if(name == Main){
             foundMain = true;
@@ -121,13 +249,18 @@ ClassTable::ClassTable(Classes classes) : semant_errors(0) , error_stream(cerr)
         semant_error() << "Class Main is not defined.\n";
         return;      
     }
+    graphSpan.end();
 
     /*
      *  check for cycle in the dependency graph above using 
-     *  two pointer method (mainly used in linked lists)
+     *  two pointer method (mainly used in linked lists); a walk stops at
+     *  a class an earlier walk found to reach Object, so each class is
+     *  walked past once
      */
+    trace_span cycleSpan("inheritance cycles", "ClassTable");
     classMAP::iterator start = classGraph.begin();
     Symbol pn,pnn,temp;
+    std::set<Symbol> reachesObject;
 
     while(start != classGraph.end()){
         pn = start->first;
@@ -135,7 +268,7 @@ ClassTable::ClassTable(Classes classes) : semant_errors(0) , error_stream(cerr)
         
         while(1){
             /* already reached end of graph */
-            if(pn == Object || pnn == Object)
+            if(pn == Object || pnn == Object || reachesObject.count(pnn))
                 break;
             temp = classGraph.find(pn)->second->class_getParent();
             /* check if class exists */
@@ -154,7 +287,7 @@ ClassTable::ClassTable(Classes classes) : semant_errors(0) , error_stream(cerr)
                 return;                
             }
             pnn = temp;
-            if(pnn == Object)
+            if(pnn == Object || reachesObject.count(pnn))
                 break;
             temp = classGraph.find(pnn)->second->class_getParent();
             /* check if class exists */
@@ -170,115 +303,82 @@ ClassTable::ClassTable(Classes classes) : semant_errors(0) , error_stream(cerr)
                 return;
             }
         }
+        for(pn = start->first; pn != Object && reachesObject.insert(pn).second; )
+            pn = classGraph.find(pn)->second->class_getParent();
         ++start;
     }
 }
 
-void ClassTable::install_basic_classes() {
+/*
+ *  The basic classes, as constant data. Each feature is a method unless
+ *  it is marked as an attribute; formals are name/type pairs. The
+ *  symbols are pointers to the variables above, which
+ *  initialize_constants fills in, so the table itself needs no code at
+ *  startup.
+ */
+struct basic_feature {
+    bool attribute;
+    Symbol *name, *type;
+    Symbol *formals[4];
+};
+
+struct basic_class {
+    Symbol *name, *parent;
+    basic_feature features[5];
+};
+
+static const basic_class basicClasses[] = {
+    /* abort() : Object, type_name() : Str, copy() : SELF_TYPE */
+    { &Object, &No_class, {
+        { false, &cool_abort, &Object, { NULL, NULL, NULL, NULL } },
+        { false, &type_name, &Str, { NULL, NULL, NULL, NULL } },
+        { false, &copy, &SELF_TYPE, { NULL, NULL, NULL, NULL } } } },
+    /* out_string(Str) : SELF_TYPE, out_int(Int) : SELF_TYPE, in_string() : Str, in_int() : Int */
+    { &IO, &Object, {
+        { false, &out_string, &SELF_TYPE, { &arg, &Str, NULL, NULL } },
+        { false, &out_int, &SELF_TYPE, { &arg, &Int, NULL, NULL } },
+        { false, &in_string, &Str, { NULL, NULL, NULL, NULL } },
+        { false, &in_int, &Int, { NULL, NULL, NULL, NULL } } } },
+    /* the "val" for the integer */
+    { &Int, &Object, {
+        { true, &val, &prim_slot, { NULL, NULL, NULL, NULL } } } },
+    { &Bool, &Object, {
+        { true, &val, &prim_slot, { NULL, NULL, NULL, NULL } } } },
+    /* the length and the string itself; length() : Int, concat(Str) : Str, substr(Int, Int) : Str */
+    { &Str, &Object, {
+        { true, &val, &Int, { NULL, NULL, NULL, NULL } },
+        { true, &str_field, &prim_slot, { NULL, NULL, NULL, NULL } },
+        { false, &length, &Int, { NULL, NULL, NULL, NULL } },
+        { false, &concat, &Str, { &arg, &Str, NULL, NULL } },
+        { false, &substr, &Str, { &arg, &Int, &arg2, &Int } } } }
+};
+
+/* the scopes every class below a basic class starts from, kept the first time they are built */
+struct basic_scope {
+    symTab methods, attrs;
+};
+static std::map<Symbol, basic_scope> basicScopes;
+Symbol basicFilename;
 
-    // The tree package uses these globals to annotate the classes built below.
-   // curr_lineno  = 0;
-    Symbol filename = stringtable.add_string("<basic class>");
-    
-    // The following demonstrates how to create dummy parse trees to
-    // refer to basic Cool classes.  There's no need for method
-    // bodies -- these are already built into the runtime system.
-    
-    // IMPORTANT: The results of the following expressions are
-    // stored in local variables.  You will want to do something
-    // with those variables at the end of this method to make this
-    // code meaningful.
-
-    // 
-    // The Object class has no parent class. Its methods are
-    //        abort() : Object    aborts the program
-    //        type_name() : Str   returns a string representation of class name
-    //        copy() : SELF_TYPE  returns a copy of the object
-    //
-    // There is no need for method bodies in the basic classes---these
-    // are already built in to the runtime system.
-
-    Class_ Object_class =
-	class_(Object, 
-	       No_class,
-	       append_Features(
-			       append_Features(
-					       single_Features(method(cool_abort, nil_Formals(), Object, no_expr())),
-					       single_Features(method(type_name, nil_Formals(), Str, no_expr()))),
-			       single_Features(method(copy, nil_Formals(), SELF_TYPE, no_expr()))),
-	       filename);
-
-    // 
-    // The IO class inherits from Object. Its methods are
-    //        out_string(Str) : SELF_TYPE       writes a string to the output
-    //        out_int(Int) : SELF_TYPE            "    an int    "  "     "
-    //        in_string() : Str                 reads a string from the input
-    //        in_int() : Int                      "   an int     "  "     "
-    //
-    Class_ IO_class = 
-	class_(IO, 
-	       Object,
-	       append_Features(
-			       append_Features(
-					       append_Features(
-							       single_Features(method(out_string, single_Formals(formal(arg, Str)),
-										      SELF_TYPE, no_expr())),
-							       single_Features(method(out_int, single_Formals(formal(arg, Int)),
-										      SELF_TYPE, no_expr()))),
-					       single_Features(method(in_string, nil_Formals(), Str, no_expr()))),
-			       single_Features(method(in_int, nil_Formals(), Int, no_expr()))),
-	       filename);  
-
-    //
-    // The Int class has no methods and only a single attribute, the
-    // "val" for the integer. 
-    //
-    Class_ Int_class =
-	class_(Int, 
-	       Object,
-	       single_Features(attr(val, prim_slot, no_expr())),
-	       filename);
-
-    //
-    // Bool also has only the "val" slot.
-    //
-    Class_ Bool_class =
-	class_(Bool, Object, single_Features(attr(val, prim_slot, no_expr())),filename);
-
-    //
-    // The class Str has a number of slots and operations:
-    //       val                                  the length of the string
-    //       str_field                            the string itself
-    //       length() : Int                       returns length of the string
-    //       concat(arg: Str) : Str               performs string concatenation
-    //       substr(arg: Int, arg2: Int): Str     substring selection
-    //       
-    Class_ Str_class =
-	class_(Str, 
-	       Object,
-	       append_Features(
-			       append_Features(
-					       append_Features(
-							       append_Features(
-									       single_Features(attr(val, Int, no_expr())),
-									       single_Features(attr(str_field, prim_slot, no_expr()))),
-							       single_Features(method(length, nil_Formals(), Int, no_expr()))),
-					       single_Features(method(concat, 
-								      single_Formals(formal(arg, Str)),
-								      Str, 
-								      no_expr()))),
-			       single_Features(method(substr, 
-						      append_Formals(single_Formals(formal(arg, Int)), 
-								     single_Formals(formal(arg2, Int))),
-						      Str, 
-						      no_expr()))),
-	       filename);
-
-    classGraph.insert(std::make_pair(Object_class->class_getName(),Object_class));
-    classGraph.insert(std::make_pair(IO_class->class_getName(),IO_class));
-    classGraph.insert(std::make_pair(Int_class->class_getName(),Int_class));
-    classGraph.insert(std::make_pair(Bool_class->class_getName(),Bool_class));
-    classGraph.insert(std::make_pair(Str_class->class_getName(),Str_class));
+void ClassTable::install_basic_classes() {
+    Symbol filename = basicFilename = stringtable.add_string("<basic class>");
+
+    /* There is no need for method bodies; they are built into the runtime system. */
+    for(size_t c = 0; c < sizeof(basicClasses) / sizeof(basicClasses[0]); c++){
+        const basic_class& basic = basicClasses[c];
+        Features features = nil_Features();
+        for(const basic_feature *f = basic.features; f < basic.features + 5 && f->name != NULL; f++){
+            if(f->attribute){
+                features = append_Features(features, single_Features(attr(*f->name, *f->type, no_expr())));
+                continue;
+            }
+            Formals formals = nil_Formals();
+            for(int i = 0; i < 4 && f->formals[i] != NULL; i += 2)
+                formals = append_Formals(formals, single_Formals(formal(*f->formals[i], *f->formals[i + 1])));
+            features = append_Features(features, single_Features(method(*f->name, formals, *f->type, no_expr())));
+        }
+        classGraph.insert(std::make_pair(*basic.name, class_(*basic.name, *basic.parent, features, filename)));
+    }
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -313,40 +413,74 @@ ostream& ClassTable::semant_error()
     return error_stream;
 } 
 
-bool checkClassInheritance(Symbol parent, Symbol target){
-    if(parent == target)
-        return true;
-    while(target != No_class){
+/* what the helpers walk, for COOL_SEMANT_PROFILE */
+bool hotProfile;
+long hotCompares;
+static hot_counter hotInheritance("checkClassInheritance"), hotAncestor("leastAncestorCheck"),
+    hotMethods("getMethods"), hotFind("classGraph.find"), hotLookup("symTab::lookup");
+
+/*
+ *  With COOL_SEMANT_STATE or COOL_SEMANT_CACHE, the classes the class
+ *  being checked looked at. The helpers below that walk up from a class
+ *  record it, and so do the checks that a named class exists; a class
+ *  stands for its ancestors too, see the incremental checking below.
+ */
+void dependOn(Symbol name){
+    if(classDeps != NULL)
+        classDeps->insert(name);
+}
+
+/* steps: the parents walked */
+bool checkClassInheritance(Symbol parent, Symbol target, hot_site site){
+    long steps = 0;
+    dependOn(target);
+    bool found = parent == target;
+    while(!found && target != No_class){
         target = classGraph.find(target)->second->class_getParent();
+        steps++;
         if(parent == target)
-            return true;
+            found = true;
     }
-    return false;
+    if(hotProfile)
+        hotInheritance.record(site, steps);
+    return found;
 }
 
-Symbol leastAncestorCheck(Symbol then_cond, Symbol else_cond){
+/* steps: the pairs of ancestors compared */
+Symbol leastAncestorCheck(Symbol then_cond, Symbol else_cond, hot_site site){
     Symbol else_copy = else_cond, then_copy = then_cond;
+    Symbol found = NULL;
+    long steps = 0;
+    dependOn(then_cond);
+    dependOn(else_cond);
 
-    while(then_copy != No_class){
+    while(found == NULL && then_copy != No_class){
         while(else_copy != No_class){
+            steps++;
             if(else_copy == then_copy){
-                return then_copy;
+                found = then_copy;
+                break;
             }
             else_copy = classGraph.find(else_copy)->second->class_getParent();
         }
         else_copy = else_cond;
-        then_copy = classGraph.find(then_copy)->second->class_getParent();
+        if(found == NULL)
+            then_copy = classGraph.find(then_copy)->second->class_getParent();
     }
-    return NULL;   
+    if(hotProfile)
+        hotAncestor.record(site, steps);
+    return found;   
 }
 
-Feature getMethods(Class_ cur_class , Symbol method_name){
+/* steps: the features looked at */
+static Feature searchMethods(Class_ cur_class , Symbol method_name, long& steps){
     Feature feature = NULL;
     Symbol feature_name;
     Features features = cur_class->class_getFeatures();
     for(int i=features->first();features->more(i);i=features->next(i)){
         feature = features->nth(i);
         feature_name = feature->feature_getName();
+        steps++;
         if(feature_name == method_name)
             return feature;
     }
@@ -354,10 +488,27 @@ Feature getMethods(Class_ cur_class , Symbol method_name){
     if(classGraph.find(parent) == classGraph.end())
         return NULL;
     cur_class = classGraph.find(parent)->second;
-    return getMethods(cur_class,method_name);
+    return searchMethods(cur_class,method_name,steps);
+}
+
+Feature getMethods(Class_ cur_class , Symbol method_name, hot_site site){
+    long steps = 0;
+    dependOn(cur_class->class_getName());
+    Feature feature = searchMethods(cur_class, method_name, steps);
+    if(hotProfile)
+        hotMethods.record(site, steps);
+    return feature;
 }
 
 void build_hierarchy(Class_ base){
+    /* a basic class's scopes are already built */
+    std::map<Symbol, basic_scope>::iterator basic = basicScopes.find(base->class_getName());
+    if(basic != basicScopes.end()){
+        *methodTab = basic->second.methods;
+        *attrTab = basic->second.attrs;
+        return;
+    }
+
     Symbol parent = base->class_getParent();
     /* reach top of the hierarchy */
     if(parent != No_class)
@@ -370,6 +521,36 @@ void build_hierarchy(Class_ base){
     /* evaluate each feature of the class */
     for(int i = featureList->first(); featureList->more(i); i = featureList->next(i))
         featureList->nth(i)->toSymTab(base);
+
+    /* the tables never change what they hold, so copies of them stay valid */
+    if(base->get_filename() == basicFilename){
+        basic_scope& scope = basicScopes[base->class_getName()];
+        scope.methods = *methodTab;
+        scope.attrs = *attrTab;
+    }
+}
+
+/* build the basic classes' scopes before any class needs them */
+static void buildBasicScopes(){
+    if(!basicScopes.empty())
+        return;
+    for(classMAP::iterator it = classGraph.begin(); it != classGraph.end(); ++it){
+        if(it->second->get_filename() != basicFilename)
+            continue;
+        methodTab = new symTab();
+        attrTab = new symTab();
+        build_hierarchy(it->second);
+        delete methodTab;
+        delete attrTab;
+    }
+    methodTab = attrTab = NULL;
+}
+
+/* see cool-tree.handcode.h */
+void semantBasics(){
+    initialize_constants();
+    ClassTable::install_basic_classes();
+    buildBasicScopes();
 }
 
 /* member methods to add to the respective symbol table */
@@ -384,8 +565,8 @@ void method_class::toSymTab(Class_ cur){
         /* get class features to verify overriding of method */
         Features featureList = classGraph.find(lookForName)->second->class_getFeatures();
 
-        Formals inheritedFormals;
-        Symbol inheritedReturnType;
+        Formals inheritedFormals = NULL;
+        Symbol inheritedReturnType = NULL;
         for(int i=featureList->first();featureList->more(i); i = featureList->next(i)){
             /* check the feature which matches */
             if(featureList->nth(i)->feature_getName() == name){
@@ -455,6 +636,13 @@ void attr_class::toSymTab(Class_ cur){
 }
 /********************************************************/
 
+/* check a feature's expression, on the compact tree when it is in use */
+static Symbol validateExpr(Feature feature, Expression expr, Symbol sym){
+    if(useCompact)
+        return checkCompact(compactBodies.find(feature)->second, sym);
+    return expr->validate(sym);
+}
+
 /* Member methods to validate feature types, methods and attributes */
 void method_class::validate(Class_ cur){
     /* main method should be valid in class Main */
@@ -484,7 +672,7 @@ void method_class::validate(Class_ cur){
     }
 
     /* get type of the expression */
-    Symbol expreval = expr->validate(cur->class_getName());
+    Symbol expreval = validateExpr(this, expr, cur->class_getName());
     Symbol current = return_type;
 
     if(return_type == SELF_TYPE && expreval!=return_type){
@@ -506,12 +694,13 @@ void method_class::validate(Class_ cur){
 
 void attr_class::validate(Class_ cur){
     /* validate the attribute initialization expression */
-    Symbol expreval = init->validate(cur->class_getName());
+    Symbol expreval = validateExpr(this, init, cur->class_getName());
     Symbol searchType = type_decl;
     if(type_decl == SELF_TYPE)
         searchType = cur->class_getName();
 
     /* attribute type must be a valid existing class */
+    dependOn(searchType);
     if(classGraph.find(searchType) == classGraph.end()){
         classtable->semant_error(cur)<<"Class "<<searchType<<" of attribute "<<name<<" is undefined.\n";
     }
@@ -550,6 +739,7 @@ Symbol assign_class::validate(Symbol sym){
 }
 
 Symbol static_dispatch_class::validate(Symbol sym){
+    dependOn(type_name);
     classMAP::iterator it = classGraph.find(type_name);
     Feature feature;
     /* find if class exists */
@@ -600,7 +790,8 @@ Symbol static_dispatch_class::validate(Symbol sym){
         return type;
     }
 
-    /* validate the feature expression */
+    /* validate the feature expression; this types nodes of the class defining it */
+    classUncacheable = true;
     type = feature->feature_getExpr()->validate(sym);
     if(type==SELF_TYPE)
         type = expreval;
@@ -615,6 +806,7 @@ Symbol dispatch_class::validate(Symbol sym){
         feature = getMethods(classGraph.find(sym)->second, name);
 
     else{
+        dependOn(expreval);
         classMAP::iterator it = classGraph.find(expreval);
         /* check if expression type exists */
         if(it == classGraph.end()){
@@ -708,6 +900,7 @@ Symbol typcase_class::validate(Symbol sym){
         Case c = cases->nth(i);
         Symbol branchtype = c->case_getType();
         /* a legal case type must be checked for */
+        dependOn(branchtype);
         if(classGraph.find(branchtype) == classGraph.end()){
             classtable->semant_error(classGraph.find(sym)->second) << "Class "<<branchtype<<" of case branch is undefined.\n";
             type = Object;
@@ -748,7 +941,7 @@ Symbol typcase_class::validate(Symbol sym){
 }
 
 Symbol block_class::validate(Symbol sym){
-    Symbol lastret;
+    Symbol lastret = NULL;
     /* verify all statements in block */
     for(int stmt = body->first(); body->more(stmt); stmt = body->next(stmt)){
         lastret = body->nth(stmt)->validate(sym);
@@ -922,6 +1115,7 @@ Symbol new__class::validate(Symbol sym){
     }
     /* check if class exists */
     else{
+        dependOn(type_name);
         if(classGraph.find(type_name) == classGraph.end()){
             classtable->semant_error(classGraph.find(sym)->second) << "'new' used with undefined class "<<type_name<<".\n";
             type = Object;
@@ -959,6 +1153,748 @@ Symbol object_class::validate(Symbol sym){
 }
 /********************************************************************/
 
+/*
+ *  Compact tree. lower() appends an expression to the arrays in semant.h
+ *  and queues its children, so that nesting depth is bounded by memory
+ *  rather than by the C stack. Nodes come out in pre-order. The meaning
+ *  of a node's operands depends on its kind:
+ *
+ *    assign            a = name, b = expr
+ *    static_dispatch   a = expr, b = name, c -> type_name, n, actuals...
+ *    dispatch          a = expr, b = name, c -> n, actuals...
+ *    cond              a = pred, b = then, c = else
+ *    loop              a = pred, b = body
+ *    typcase           a = expr, b -> (name, type, expr) per branch, c = branches
+ *    block             a -> statements, b = statements
+ *    let               a -> identifier, type_decl, b = init, c = body
+ *    arithmetic        a = e1, b = e2 (a only for neg, comp and isvoid)
+ *    new_              a = type_name
+ *    object            a = name
+ *
+ *  Names are ids in compactSymbols and "->" is an offset in compactOperands.
+ */
+std::vector<compact_node> compactTree;
+std::vector<Symbol> compactTypes;
+std::vector<Expression> compactOrigin;
+std::vector<int> compactOperands;
+std::vector<Symbol> compactSymbols;
+std::map<Symbol, int> compactSymbolIds;
+std::map<Feature, int> compactBodies;
+int compactDepth = 0;
+bool useCompact = false;
+std::map<Class_, std::pair<int, int> > compactClassNodes;
+
+struct lower_item {
+    Expression expr;
+    int slot;						/* where its node id goes, see storeNode() */
+    int depth;
+};
+static std::vector<lower_item> lowerStack;
+static int lowerDepth;				/* depth of the node being lowered */
+
+static int lowerSymbol(Symbol s){
+    std::pair<std::map<Symbol, int>::iterator, bool> it = compactSymbolIds.insert(std::make_pair(s, (int) compactSymbols.size()));
+    if(it.second)
+        compactSymbols.push_back(s);
+    return it.first->second;
+}
+
+static int newNode(compact_kind kind, Expression origin, int a = 0, int b = 0, int c = 0){
+    compact_node node;
+    node.kind = kind;
+    node.line = origin->get_line_number();
+    node.a = a;
+    node.b = b;
+    node.c = c;
+    compactTree.push_back(node);
+    compactTypes.push_back(NULL);
+    compactOrigin.push_back(origin);
+    return compactTree.size() - 1;
+}
+
+/* a slot is operand a, b or c of a node, or a negative operand offset */
+static int nodeSlot(int id, int operand){
+    return 3 * id + operand;
+}
+
+static int operandSlot(int offset){
+    return -1 - offset;
+}
+
+static void storeNode(int slot, int id){
+    if(slot < 0){
+        compactOperands[-1 - slot] = id;
+        return;
+    }
+    compact_node& node = compactTree[slot / 3];
+    switch(slot % 3){
+    case 0: node.a = id; break;
+    case 1: node.b = id; break;
+    default: node.c = id;
+    }
+}
+
+static void lowerLater(Expression e, int slot){
+    lower_item item;
+    item.expr = e;
+    item.slot = slot;
+    item.depth = lowerDepth + 1;
+    lowerStack.push_back(item);
+}
+
+static int reserveOperands(int n){
+    int offset = compactOperands.size();
+    compactOperands.resize(offset + n);
+    return offset;
+}
+
+/* lower e and everything below it, returning its node id */
+static int lowerExpr(Expression e){
+    lowerDepth = 1;
+    size_t mark = lowerStack.size();
+    int id = e->lower();
+    while(true){
+        /* the children were queued left to right; take the leftmost first */
+        std::reverse(lowerStack.begin() + mark, lowerStack.end());
+        if(lowerStack.empty())
+            break;
+        lower_item item = lowerStack.back();
+        lowerStack.pop_back();
+        lowerDepth = item.depth;
+        if(lowerDepth > compactDepth)
+            compactDepth = lowerDepth;
+        mark = lowerStack.size();
+        storeNode(item.slot, item.expr->lower());
+    }
+    return id;
+}
+
+static int lowerActuals(Expressions actual, int offset){
+    compactOperands[offset] = actual->len();
+    for(int i = actual->first(); actual->more(i); i = actual->next(i))
+        lowerLater(actual->nth(i), operandSlot(offset + 1 + i));
+    return offset;
+}
+
+int assign_class::lower(){
+    int id = newNode(K_ASSIGN, this, lowerSymbol(name));
+    lowerLater(expr, nodeSlot(id, 1));
+    return id;
+}
+
+int static_dispatch_class::lower(){
+    int ops = reserveOperands(2 + actual->len());
+    compactOperands[ops] = lowerSymbol(type_name);
+    int id = newNode(K_STATIC_DISPATCH, this, 0, lowerSymbol(name), ops);
+    lowerLater(expr, nodeSlot(id, 0));
+    lowerActuals(actual, ops + 1);
+    return id;
+}
+
+int dispatch_class::lower(){
+    int ops = reserveOperands(1 + actual->len());
+    int id = newNode(K_DISPATCH, this, 0, lowerSymbol(name), ops);
+    lowerLater(expr, nodeSlot(id, 0));
+    lowerActuals(actual, ops);
+    return id;
+}
+
+int cond_class::lower(){
+    int id = newNode(K_COND, this);
+    lowerLater(pred, nodeSlot(id, 0));
+    lowerLater(then_exp, nodeSlot(id, 1));
+    lowerLater(else_exp, nodeSlot(id, 2));
+    return id;
+}
+
+int loop_class::lower(){
+    int id = newNode(K_LOOP, this);
+    lowerLater(pred, nodeSlot(id, 0));
+    lowerLater(body, nodeSlot(id, 1));
+    return id;
+}
+
+int typcase_class::lower(){
+    int ops = reserveOperands(3 * cases->len());
+    int id = newNode(K_TYPCASE, this, 0, ops, cases->len());
+    lowerLater(expr, nodeSlot(id, 0));
+    for(int i = cases->first(); cases->more(i); i = cases->next(i)){
+        Case c = cases->nth(i);
+        compactOperands[ops + 3 * i] = lowerSymbol(c->case_getName());
+        compactOperands[ops + 3 * i + 1] = lowerSymbol(c->case_getType());
+        lowerLater(c->case_getExpr(), operandSlot(ops + 3 * i + 2));
+    }
+    return id;
+}
+
+int block_class::lower(){
+    int ops = reserveOperands(body->len());
+    int id = newNode(K_BLOCK, this, ops, body->len());
+    for(int i = body->first(); body->more(i); i = body->next(i))
+        lowerLater(body->nth(i), operandSlot(ops + i));
+    return id;
+}
+
+int let_class::lower(){
+    int ops = reserveOperands(2);
+    compactOperands[ops] = lowerSymbol(identifier);
+    compactOperands[ops + 1] = lowerSymbol(type_decl);
+    int id = newNode(K_LET, this, ops);
+    lowerLater(init, nodeSlot(id, 1));
+    lowerLater(body, nodeSlot(id, 2));
+    return id;
+}
+
+/* the binary and unary operators */
+static int lowerOperator(compact_kind kind, Expression origin, Expression e1, Expression e2 = NULL){
+    int id = newNode(kind, origin);
+    lowerLater(e1, nodeSlot(id, 0));
+    if(e2 != NULL)
+        lowerLater(e2, nodeSlot(id, 1));
+    return id;
+}
+
+int plus_class::lower(){
+    return lowerOperator(K_PLUS, this, e1, e2);
+}
+
+int sub_class::lower(){
+    return lowerOperator(K_SUB, this, e1, e2);
+}
+
+int mul_class::lower(){
+    return lowerOperator(K_MUL, this, e1, e2);
+}
+
+int divide_class::lower(){
+    return lowerOperator(K_DIVIDE, this, e1, e2);
+}
+
+int neg_class::lower(){
+    return lowerOperator(K_NEG, this, e1);
+}
+
+int lt_class::lower(){
+    return lowerOperator(K_LT, this, e1, e2);
+}
+
+int eq_class::lower(){
+    return lowerOperator(K_EQ, this, e1, e2);
+}
+
+int leq_class::lower(){
+    return lowerOperator(K_LEQ, this, e1, e2);
+}
+
+int comp_class::lower(){
+    return lowerOperator(K_COMP, this, e1);
+}
+
+int int_const_class::lower(){
+    return newNode(K_INT_CONST, this);
+}
+
+int bool_const_class::lower(){
+    return newNode(K_BOOL_CONST, this);
+}
+
+int string_const_class::lower(){
+    return newNode(K_STRING_CONST, this);
+}
+
+int new__class::lower(){
+    return newNode(K_NEW, this, lowerSymbol(type_name));
+}
+
+int isvoid_class::lower(){
+    return lowerOperator(K_ISVOID, this, e1);
+}
+
+int no_expr_class::lower(){
+    return newNode(K_NO_EXPR, this);
+}
+
+int object_class::lower(){
+    return newNode(K_OBJECT, this, lowerSymbol(name));
+}
+
+static void lowerFeatures(Class_ cur){
+    Features featureList = cur->class_getFeatures();
+    for(int i = featureList->first(); featureList->more(i); i = featureList->next(i)){
+        Feature feature = featureList->nth(i);
+        if(compactBodies.find(feature) == compactBodies.end())
+            compactBodies[feature] = lowerExpr(feature->feature_getExpr());
+    }
+}
+
+/* the program's classes first and in order, so that checking them walks the arrays forward */
+void lowerClasses(){
+    for(size_t i = 0; i < programClasses.size(); i++){
+        Class_ cur = programClasses[i];
+        int first = compactTree.size();
+        lowerFeatures(cur);
+        compactClassNodes[cur] = std::make_pair(first, (int) compactTree.size());
+    }
+    /* static dispatch can check the bodies of the basic classes */
+    for(classMAP::iterator it = classGraph.begin(); it != classGraph.end(); ++it)
+        lowerFeatures(it->second);
+}
+
+/* 
+ * Whether some body nests deeper than limit. shape() hands over each
+ * node's children, so the walk needs no recursion; it stops at the
+ * first node below the limit.
+ */
+static bool nestsDeeperThan(int limit){
+    std::vector<std::pair<Expression, int> > stack;
+    std::vector<Expression> children;
+    for(size_t i = 0; i < programClasses.size(); i++){
+        Features featureList = programClasses[i]->class_getFeatures();
+        int count = featureList->len();
+        for(int j = featureList->first(); j < count; j = featureList->next(j))
+            stack.push_back(std::make_pair(featureList->nth(j)->feature_getExpr(), 1));
+    }
+    while(!stack.empty()){
+        std::pair<Expression, int> top = stack.back();
+        stack.pop_back();
+        if(top.second > limit)
+            return true;
+        children.clear();
+        top.first->shape(children);
+        for(size_t i = 0; i < children.size(); i++)
+            stack.push_back(std::make_pair(children[i], top.second + 1));
+    }
+    return false;
+}
+
+void writeBackTypes(){
+    for(size_t i = 0; i < compactOrigin.size(); i++)
+        compactOrigin[i]->set_type(compactTypes[i]);
+}
+
+/*
+ *  The checker. Each node does what its validate() does, in the same
+ *  order, so that the errors and types come out the same. Instead of
+ *  recursing, a node asks for a child by returning its id; the child's
+ *  type is handed back in `result' at the node's next step.
+ */
+struct check_frame {
+    int id;
+    int step;						/* how far the node has got */
+    int i;							/* actual, branch or statement being checked */
+    Symbol value;					/* left operand, then branch, receiver type or case type */
+    Symbol *declared;				/* assign: the identifier's type */
+    Feature feature;				/* dispatch: the method called */
+    std::set<Symbol> *used;			/* typcase: branch types seen */
+};
+
+static ostream& compactError(Symbol sym){
+    return classtable->semant_error(classGraph.find(sym)->second);
+}
+
+static const char *arithmeticOp(int kind){
+    switch(kind){
+    case K_PLUS:    return "+";
+    case K_SUB:     return "-";
+    case K_MUL:     return "*";
+    case K_DIVIDE:  return "/";
+    case K_LT:      return "<";
+    default:        return "<=";
+    }
+}
+
+static int staticDispatchStep(check_frame& f, const compact_node& node, Symbol sym, Symbol& result){
+    Symbol name = compactSymbols[node.b];
+    Symbol type_name = compactSymbols[compactOperands[node.c]];
+    int num_actuals = compactOperands[node.c + 1];
+    int actuals = node.c + 2;
+    Formals formals;
+
+    switch(f.step){
+    case 0: {
+        dependOn(type_name);
+        classMAP::iterator it = classGraph.find(type_name);
+        /* find if class exists */
+        if(it == classGraph.end()){
+            compactError(sym)<<"Static dispatch to undefined class "<<type_name<<"\n";
+            result = Object;
+            return -1;
+        }
+        /* get the method from the classes hierarchy */
+        f.feature = getMethods(it->second, name);
+        if(f.feature == NULL){
+            compactError(sym)<<"Static dispatch to undefined method "<<name<<".\n";
+            result = Object;
+            return -1;
+        }
+        if(num_actuals != f.feature->feature_getFormals()->len()){
+            compactError(sym)<<"Method "<<name<<" invoked with wrong number of arguments.\n";
+            result = Object;
+            return -1;
+        }
+        f.i = 0;
+        if(num_actuals > 0){
+            f.step = 1;
+            return compactOperands[actuals];
+        }
+        f.step = 2;
+        return node.a;
+    }
+    case 1:
+        /* result is the type of actual i */
+        formals = f.feature->feature_getFormals();
+        if(!checkClassInheritance(formals->nth(f.i)->formal_getType(), result)){
+            compactError(sym)<<"In call of method "<<name<<", type "<<result<<" of parameter "<<formals->nth(f.i)->formal_getName()<<" does not conform to declared type "<<formals->nth(f.i)->formal_getType()<<".\n";
+            result = Object;
+            return -1;
+        }
+        if(++f.i < num_actuals)
+            return compactOperands[actuals + f.i];
+        f.step = 2;
+        return node.a;
+    case 2:
+        /* result is the type of the receiver */
+        f.value = result;
+        if(f.value == SELF_TYPE)
+            f.value = classGraph.find(sym)->second->class_getName();
+        if(!checkClassInheritance(type_name, f.value)){
+            compactError(sym)<<"Expression type "<<f.value<<" does not conform to declared static dispatch type "<<type_name<<".\n";
+            result = Object;
+            return -1;
+        }
+        /* validate the feature expression; this types nodes of the class defining it */
+        classUncacheable = true;
+        f.step = 3;
+        return compactBodies.find(f.feature)->second;
+    default:
+        if(result == SELF_TYPE)
+            result = f.value;
+        return -1;
+    }
+}
+
+static int dispatchStep(check_frame& f, const compact_node& node, Symbol sym, Symbol& result){
+    Symbol name = compactSymbols[node.b];
+    int num_actuals = compactOperands[node.c];
+
+    if(f.step == 0){
+        f.step = 1;
+        return node.a;
+    }
+    if(f.step == 1){
+        /* result is the type of the receiver */
+        f.value = result;
+        if(f.value == SELF_TYPE)
+            f.feature = getMethods(classGraph.find(sym)->second, name);
+        else{
+            dependOn(f.value);
+            classMAP::iterator it = classGraph.find(f.value);
+            if(it == classGraph.end()){
+                compactError(sym)<<"Return type "<<f.value<<" is undefined.\n";
+                result = Object;
+                return -1;
+            }
+            f.feature = getMethods(it->second, name);
+        }
+        if(f.feature == NULL){
+            compactError(sym)<<"Dispath to undefined method "<<name<<".\n";
+            result = Object;
+            return -1;
+        }
+        if(num_actuals != f.feature->feature_getFormals()->len())
+            compactError(sym)<<"Method "<<name<<" called with wrong number of arguments.\n";
+        f.i = 0;
+        f.step = 2;
+    }
+    else{
+        /* result is the type of actual i */
+        Symbol actual_type = result;
+        Symbol formal_type = f.feature->feature_getFormals()->nth(f.i)->formal_getType();
+        if(actual_type == SELF_TYPE)
+            actual_type = classGraph.find(sym)->second->class_getName();
+        if(!checkClassInheritance(formal_type, actual_type)){
+            compactError(sym)<<"In call of method "<<name<<", type "<<actual_type<<" of parameter a does not conform to declared type "<<formal_type<<".\n";
+            result = Object;
+            return -1;
+        }
+        f.i++;
+    }
+
+    if(f.i < num_actuals)
+        return compactOperands[node.c + 1 + f.i];
+    result = f.feature->feature_getType();
+    if(result == SELF_TYPE)
+        result = f.value;
+    return -1;
+}
+
+static int typcaseStep(check_frame& f, const compact_node& node, Symbol sym, Symbol& result){
+    if(f.step == 0){
+        f.step = 1;
+        return node.a;
+    }
+    if(f.step == 1){
+        f.used = new std::set<Symbol>();
+        f.value = NULL;
+        f.i = 0;
+        f.step = 2;
+    }
+    else{
+        /* result is the type of branch i */
+        int branch = node.b + 3 * f.i;
+        Symbol name = compactSymbols[compactOperands[branch]];
+        Symbol branchtype = compactSymbols[compactOperands[branch + 1]];
+        if(!checkClassInheritance(branchtype, result)){
+            compactError(sym) << "Inferred return type "<<result<<" of branch "<<name<<" does not conform to declared return type "<<branchtype<<".\n";
+            result = Object;
+            return -1;
+        }
+        /* return type of case is least ancestor of all case types */
+        if(f.value != NULL)
+            f.value = leastAncestorCheck(result, f.value);
+        else
+            f.value = result;
+        attrTab->exitscope();
+        f.i++;
+    }
+
+    if(f.i == node.c){
+        result = f.value;
+        return -1;
+    }
+    int branch = node.b + 3 * f.i;
+    Symbol branchtype = compactSymbols[compactOperands[branch + 1]];
+    dependOn(branchtype);
+    if(classGraph.find(branchtype) == classGraph.end()){
+        compactError(sym) << "Class "<<branchtype<<" of case branch is undefined.\n";
+        result = Object;
+        return -1;
+    }
+    if(!f.used->insert(branchtype).second){
+        compactError(sym) << "Duplicate branch "<<branchtype<<" in case statement.\n";
+        result = Object;
+        return -1;
+    }
+    attrTab->enterscope();
+    attrTab->addid(compactSymbols[compactOperands[branch]], new Symbol(branchtype));
+    return compactOperands[branch + 2];
+}
+
+static int letStep(check_frame& f, const compact_node& node, Symbol sym, Symbol& result){
+    Symbol identifier = compactSymbols[compactOperands[node.a]];
+    Symbol type_decl = compactSymbols[compactOperands[node.a + 1]];
+
+    switch(f.step){
+    case 0:
+        if(identifier == self){
+            compactError(sym) << "'self' cannot be bound in a 'let' expression.\n";
+            result = Object;
+            return -1;
+        }
+        f.step = 1;
+        return node.b;
+    case 1:
+        /* result is the type of the initialization */
+        attrTab->enterscope();
+        attrTab->addid(identifier, new Symbol(type_decl));
+        if(result != No_type && !checkClassInheritance(type_decl, result)){
+            compactError(sym) << "type mismatch in let.\n";
+            result = Object;
+            return -1;
+        }
+        f.step = 2;
+        return node.c;
+    default:
+        attrTab->exitscope();
+        return -1;
+    }
+}
+
+/* one step of node f: returns the child to check next, or -1 with its type in result */
+static int checkStep(check_frame& f, Symbol sym, Symbol& result){
+    const compact_node& node = compactTree[f.id];
+
+    switch(node.kind){
+    case K_ASSIGN:
+        if(f.step == 0){
+            f.declared = attrTab->lookup(compactSymbols[node.a]);
+            if(f.declared == NULL){
+                compactError(sym) << "Assignment to undeclared variable "<<compactSymbols[node.a]<<".\n";
+                result = Object;
+                return -1;
+            }
+            f.step = 1;
+            return node.b;
+        }
+        if(!checkClassInheritance(*f.declared, result)){
+            compactError(sym) << "Type "<<result<<" of assigned expression does not conform to declared type "<<*f.declared<<" of identifier "<<compactSymbols[node.a]<<".\n";
+            result = Object;
+        }
+        return -1;
+    case K_STATIC_DISPATCH:
+        return staticDispatchStep(f, node, sym, result);
+    case K_DISPATCH:
+        return dispatchStep(f, node, sym, result);
+    case K_COND:
+        switch(f.step++){
+        case 0:
+            return node.a;
+        case 1:
+            if(result != Bool){
+                compactError(sym) << "Predicate of 'if' does not have type Bool.\n";
+                result = Object;
+                return -1;
+            }
+            return node.b;
+        case 2:
+            f.value = result == SELF_TYPE ? sym : result;
+            return node.c;
+        default:
+            result = leastAncestorCheck(f.value, result == SELF_TYPE ? sym : result);
+            return -1;
+        }
+    case K_LOOP:
+        switch(f.step++){
+        case 0:
+            return node.a;
+        case 1:
+            if(result != Bool)
+                compactError(sym) << "Loop condition does not have type Bool.\n";
+            return node.b;
+        default:
+            result = Object;
+            return -1;
+        }
+    case K_TYPCASE:
+        return typcaseStep(f, node, sym, result);
+    case K_BLOCK:
+        /* the type of a block is that of its last statement */
+        if(f.step < node.b)
+            return compactOperands[node.a + f.step++];
+        return -1;
+    case K_LET:
+        return letStep(f, node, sym, result);
+    case K_PLUS: case K_SUB: case K_MUL: case K_DIVIDE: case K_LT: case K_LEQ: case K_EQ:
+        switch(f.step++){
+        case 0:
+            return node.a;
+        case 1:
+            f.value = result;
+            return node.b;
+        }
+        if(node.kind == K_EQ){
+            Symbol left = f.value, right = result;
+            if(((left==Int || right==Int) || (left==Bool || right==Bool) || (left==Str || right==Str)) && left != right){
+                compactError(sym) << "Illegal comparison\n";
+                result = Object;
+            }else{
+                result = Bool;
+            }
+        }
+        else if(f.value != Int || result != Int){
+            compactError(sym) << "non-Int arguments: "<<f.value<<" "<<arithmeticOp(node.kind)<<" "<<result<<"\n";
+            result = Object;
+        }else{
+            result = (node.kind == K_LT || node.kind == K_LEQ) ? Bool : Int;
+        }
+        return -1;
+    case K_NEG: case K_COMP: case K_ISVOID:
+        if(f.step++ == 0)
+            return node.a;
+        if(node.kind == K_ISVOID)
+            result = Bool;
+        else if(node.kind == K_NEG && result != Int){
+            compactError(sym) << "Argument of '~' has type "<<result<<" instead of Int.\n";
+            result = Object;
+        }
+        else if(node.kind == K_COMP && result != Bool){
+            compactError(sym) << "Argument of 'not' has type "<<result<<" instead of Bool.\n";
+            result = Object;
+        }
+        else
+            result = node.kind == K_NEG ? Int : Bool;
+        return -1;
+    case K_INT_CONST:
+        result = Int;
+        return -1;
+    case K_BOOL_CONST:
+        result = Bool;
+        return -1;
+    case K_STRING_CONST:
+        result = Str;
+        return -1;
+    case K_NEW: {
+        Symbol type_name = compactSymbols[node.a];
+        if(type_name != SELF_TYPE)
+            dependOn(type_name);
+        if(type_name == SELF_TYPE)
+            result = SELF_TYPE;
+        else if(classGraph.find(type_name) == classGraph.end()){
+            compactError(sym) << "'new' used with undefined class "<<type_name<<".\n";
+            result = Object;
+        }else{
+            result = type_name;
+        }
+        return -1;
+    }
+    case K_NO_EXPR:
+        result = No_type;
+        return -1;
+    case K_OBJECT: {
+        Symbol name = compactSymbols[node.a];
+        if(name == self){
+            result = SELF_TYPE;
+            return -1;
+        }
+        Symbol* res = attrTab->lookup(name);
+        if(res == NULL){
+            compactError(sym) << "Object "<<name<<" not found.\n";
+            result = Object;
+        }else{
+            result = *res;
+        }
+        return -1;
+    }
+    default:
+        assert(0);
+        result = Object;
+        return -1;
+    }
+}
+
+static void pushFrame(std::vector<check_frame>& stack, int id){
+    check_frame f;
+    f.id = id;
+    f.step = 0;
+    f.i = 0;
+    f.value = NULL;
+    f.declared = NULL;
+    f.feature = NULL;
+    f.used = NULL;
+    stack.push_back(f);
+}
+
+Symbol checkCompact(int root, Symbol sym){
+    std::vector<check_frame> stack;
+    Symbol result = NULL;
+
+    pushFrame(stack, root);
+    while(!stack.empty()){
+        int child = checkStep(stack.back(), sym, result);
+        if(child >= 0){
+            pushFrame(stack, child);
+            continue;
+        }
+        check_frame& done = stack.back();
+        compactTypes[done.id] = result;
+        delete done.used;
+        stack.pop_back();
+    }
+    return result;
+}
+
+/********************************************************************/
+
 /*   This is the entry point to the semantic checker.
 
      Your checker should do the following two things:
@@ -972,41 +1908,1473 @@ Symbol object_class::validate(Symbol sym){
      errors. Part 2) can be done in a second stage, when you want
      to build mycoolc.
  */
-void program_class::semant()
-{
-    initialize_constants();
-
-    /* ClassTable constructor may do some semantic analysis */
-    classtable = new ClassTable(classes);
+/********************************************************************/
 
-    /* some semantic analysis code may go here */
-    if (classtable->errors()) {
-        cerr << "Compilation halted due to static semantic errors." << endl;
-        exit(1);
+/*
+ *  Incremental checking. With COOL_SEMANT_STATE=<file>, the result of
+ *  checking each class is kept in that file: a hash of the class, a hash
+ *  of its signature, the classes it looked at while it was checked (see
+ *  dependOn()) and the types given to its expressions. On the next run
+ *  only the classes whose hash changed are checked again, with the ones
+ *  that looked at a class whose signature changed, or at a descendant of
+ *  one, which inherits what changed. The rest get their types back
+ *  without their symbol tables being built. Classes with errors, and
+ *  classes whose static dispatches check another class's method body,
+ *  are always checked.
+ */
+typedef unsigned long long fingerprint;
+
+struct class_state {
+    fingerprint hash;						/* classShape() */
+    fingerprint signature;					/* ownSignature() */
+    std::vector<std::string> deps;
+    std::string types;						/* of its expressions, as indexes into stateTypes */
+};
+
+#define STATE_VERSION "semant-state 2"
+
+static char *stateFile;
+static std::map<std::string, class_state> savedState;		/* read from stateFile */
+static std::map<std::string, class_state> newState;		/* written back to it */
+static std::map<std::string, Symbol> stateNames;			/* symbols for the names in it */
+static std::vector<Symbol> stateTypes(1);					/* the types named in it; 0 is none */
+static std::map<Symbol, int> stateTypeIndex;
+static std::map<Symbol, fingerprint> signatureHashes;
+
+static fingerprint hashBytes(const char *s, size_t n){
+    fingerprint h = 14695981039346656037ULL;		/* FNV-1a */
+    for(size_t i = 0; i < n; i++){
+        h ^= (unsigned char) s[i];
+        h *= 1099511628211ULL;
     }
+    return h;
+}
 
-    /* check semantic validity for every class */
-    for(int i=classes->first(); classes->more(i); i = classes->next(i)){
-        methodTab = new symTab();
-        attrTab = new symTab();
-        Class_ cur = classes->nth(i);
-        Features featureList = cur->class_getFeatures();
-        /* populate full hierarchy of classes for current (with class checking) */
-        build_hierarchy(cur);
+static fingerprint hashString(const std::string& s){
+    return hashBytes(s.data(), s.size());
+}
 
-        /* check all features validity */
-        for(int i = featureList->first(); featureList->more(i); i = featureList->next(i)){
-            methodTab->enterscope();
-            attrTab->enterscope();
-            /* check features validity here */
-            featureList->nth(i)->validate(cur);
-            attrTab->exitscope();
-            methodTab->exitscope();
-        }
-    }
+static fingerprint symbolHash(Symbol s){
+    return hashBytes(s->get_string(), s->get_len());
+}
+
+static fingerprint mixHash(fingerprint h, fingerprint x){
+    return (h ^ x) * 1099511628211ULL;
+}
+
+/*
+ *  shape(): a hash of an expression less its line number and its
+ *  children, which it leaves on the queue, last child first, so that
+ *  classShape() meets them in the order of the tree without recursing.
+ */
+static void queueChildren(std::vector<Expression>& queue, size_t from){
+    std::reverse(queue.begin() + from, queue.end());
+}
+
+static fingerprint queueList(std::vector<Expression>& queue, fingerprint h, Expressions list){
+    int count = list->len();				/* more() would count the list each time */
+    for(int i = list->first(); i < count; i = list->next(i))
+        queue.push_back(list->nth(i));
+    return mixHash(h, count);
+}
+
+fingerprint assign_class::shape(std::vector<Expression>& queue){
+    queue.push_back(expr);
+    return mixHash(K_ASSIGN, symbolHash(name));
+}
+
+fingerprint static_dispatch_class::shape(std::vector<Expression>& queue){
+    size_t from = queue.size();
+    queue.push_back(expr);
+    fingerprint h = queueList(queue, mixHash(mixHash(K_STATIC_DISPATCH, symbolHash(type_name)), symbolHash(name)), actual);
+    queueChildren(queue, from);
+    return h;
+}
+
+fingerprint dispatch_class::shape(std::vector<Expression>& queue){
+    size_t from = queue.size();
+    queue.push_back(expr);
+    fingerprint h = queueList(queue, mixHash(K_DISPATCH, symbolHash(name)), actual);
+    queueChildren(queue, from);
+    return h;
+}
+
+fingerprint cond_class::shape(std::vector<Expression>& queue){
+    queue.push_back(else_exp);
+    queue.push_back(then_exp);
+    queue.push_back(pred);
+    return K_COND;
+}
+
+fingerprint loop_class::shape(std::vector<Expression>& queue){
+    queue.push_back(body);
+    queue.push_back(pred);
+    return K_LOOP;
+}
+
+fingerprint typcase_class::shape(std::vector<Expression>& queue){
+    size_t from = queue.size();
+    fingerprint h = K_TYPCASE;
+    for(int i = cases->first(); cases->more(i); i = cases->next(i)){
+        Case c = cases->nth(i);
+        h = mixHash(mixHash(h, symbolHash(c->case_getName())), symbolHash(c->case_getType()));
+        queue.push_back(c->case_getExpr());
+    }
+    queueChildren(queue, from);
+    queue.push_back(expr);
+    return h;
+}
+
+fingerprint block_class::shape(std::vector<Expression>& queue){
+    size_t from = queue.size();
+    fingerprint h = queueList(queue, K_BLOCK, body);
+    queueChildren(queue, from);
+    return h;
+}
+
+fingerprint let_class::shape(std::vector<Expression>& queue){
+    queue.push_back(body);
+    queue.push_back(init);
+    return mixHash(mixHash(K_LET, symbolHash(identifier)), symbolHash(type_decl));
+}
+
+static fingerprint shapeBinary(std::vector<Expression>& queue, compact_kind kind, Expression e1, Expression e2){
+    queue.push_back(e2);
+    queue.push_back(e1);
+    return kind;
+}
+
+fingerprint plus_class::shape(std::vector<Expression>& queue){
+    return shapeBinary(queue, K_PLUS, e1, e2);
+}
+
+fingerprint sub_class::shape(std::vector<Expression>& queue){
+    return shapeBinary(queue, K_SUB, e1, e2);
+}
+
+fingerprint mul_class::shape(std::vector<Expression>& queue){
+    return shapeBinary(queue, K_MUL, e1, e2);
+}
+
+fingerprint divide_class::shape(std::vector<Expression>& queue){
+    return shapeBinary(queue, K_DIVIDE, e1, e2);
+}
+
+fingerprint neg_class::shape(std::vector<Expression>& queue){
+    queue.push_back(e1);
+    return K_NEG;
+}
+
+fingerprint lt_class::shape(std::vector<Expression>& queue){
+    return shapeBinary(queue, K_LT, e1, e2);
+}
+
+fingerprint eq_class::shape(std::vector<Expression>& queue){
+    return shapeBinary(queue, K_EQ, e1, e2);
+}
+
+fingerprint leq_class::shape(std::vector<Expression>& queue){
+    return shapeBinary(queue, K_LEQ, e1, e2);
+}
+
+fingerprint comp_class::shape(std::vector<Expression>& queue){
+    queue.push_back(e1);
+    return K_COMP;
+}
+
+fingerprint int_const_class::shape(std::vector<Expression>&){
+    return mixHash(K_INT_CONST, symbolHash(token));
+}
+
+fingerprint bool_const_class::shape(std::vector<Expression>&){
+    return mixHash(K_BOOL_CONST, val);
+}
+
+fingerprint string_const_class::shape(std::vector<Expression>&){
+    return mixHash(K_STRING_CONST, symbolHash(token));
+}
+
+fingerprint new__class::shape(std::vector<Expression>&){
+    return mixHash(K_NEW, symbolHash(type_name));
+}
+
+fingerprint isvoid_class::shape(std::vector<Expression>& queue){
+    queue.push_back(e1);
+    return K_ISVOID;
+}
+
+fingerprint no_expr_class::shape(std::vector<Expression>&){
+    return K_NO_EXPR;
+}
+
+fingerprint object_class::shape(std::vector<Expression>&){
+    return mixHash(K_OBJECT, symbolHash(name));
+}
+
+/*
+ *  The class less its line numbers and file name, so that moving it does
+ *  not count. Its expressions go into nodes in the order the walk meets
+ *  them, which is the order their types are kept in.
+ */
+static fingerprint classShape(Class_ cur, std::vector<Expression>& nodes){
+    fingerprint h = mixHash(symbolHash(cur->class_getName()), symbolHash(cur->class_getParent()));
+    std::vector<Expression> queue;
+    Features features = cur->class_getFeatures();
+    for(int i = features->first(); features->more(i); i = features->next(i)){
+        Feature f = features->nth(i);
+        Formals formals = f->feature_getFormals();
+        h = mixHash(mixHash(h, symbolHash(f->feature_getName())), symbolHash(f->feature_getType()));
+        if(formals == NULL)
+            h = mixHash(h, 0);					/* an attribute */
+        else{
+            h = mixHash(h, 1 + formals->len());
+            for(int j = formals->first(); formals->more(j); j = formals->next(j))
+                h = mixHash(mixHash(h, symbolHash(formals->nth(j)->formal_getName())),
+                            symbolHash(formals->nth(j)->formal_getType()));
+        }
+        queue.push_back(f->feature_getExpr());
+        while(!queue.empty()){
+            Expression e = queue.back();
+            queue.pop_back();
+            nodes.push_back(e);
+            h = mixHash(h, e->shape(queue));
+        }
+    }
+    return h;
+}
+
+/* what checking other classes can see of a class: its parent and feature declarations */
+static fingerprint ownSignature(Class_ c){
+    std::ostringstream sig;
+    sig << c->class_getName() << " " << c->class_getParent() << "\n";
+    Features features = c->class_getFeatures();
+    for(int i = features->first(); features->more(i); i = features->next(i)){
+        Feature f = features->nth(i);
+        Formals formals = f->feature_getFormals();
+        sig << f->feature_getName() << " " << f->feature_getType();
+        if(formals == NULL)
+            sig << " attr";
+        else
+            for(int j = formals->first(); formals->more(j); j = formals->next(j))
+                sig << " " << formals->nth(j)->formal_getName() << ":" << formals->nth(j)->formal_getType();
+        sig << "\n";
+    }
+    return hashString(sig.str());
+}
+
+/* the signatures of a class and its ancestors, for the cache below */
+static fingerprint signatureHash(Symbol name){
+    std::vector<Class_> chain;					/* the class and its ancestors not yet hashed */
+    fingerprint h = 0;							/* of an undefined class, or of No_class */
+    for(;;){
+        std::map<Symbol, fingerprint>::iterator found = signatureHashes.find(name);
+        if(found != signatureHashes.end()){
+            h = found->second;
+            break;
+        }
+        classMAP::iterator it = classGraph.find(name);
+        if(it == classGraph.end())
+            break;
+        chain.push_back(it->second);
+        name = it->second->class_getParent();
+    }
+    while(!chain.empty()){
+        h = mixHash(ownSignature(chain.back()), h);
+        signatureHashes[chain.back()->class_getName()] = h;
+        chain.pop_back();
+    }
+    return h;
+}
+
+static Symbol stateSymbol(const std::string& name){
+    if(name == "-")
+        return NULL;
+    std::map<std::string, Symbol>::iterator it = stateNames.find(name);
+    if(it != stateNames.end())
+        return it->second;
+    Symbol s = idtable.add_string((char *) name.c_str());
+    stateNames[name] = s;
+    return s;
+}
+
+/* the names a class's state can refer to without searching idtable */
+static void loadNames(){
+    stateNames["SELF_TYPE"] = SELF_TYPE;
+    stateNames["_no_type"] = No_type;
+    for(classMAP::iterator it = classGraph.begin(); it != classGraph.end(); ++it)
+        stateNames[it->first->get_string()] = it->first;
+}
+
+/* write through a temporary file, so that readers never see half of it */
+static void writeFile(const std::string& path, const std::string& text){
+    std::string temp = path + ".tmp";
+    std::ofstream out(temp.c_str());
+    out << text;
+    out.close();
+    if(!out || rename(temp.c_str(), path.c_str()) != 0)
+        cerr << "semant: could not write " << path << endl;
+}
+
+static int stateType(Symbol type){
+    if(type == NULL)
+        return 0;
+    std::map<Symbol, int>::iterator it = stateTypeIndex.find(type);
+    if(it != stateTypeIndex.end())
+        return it->second;
+    stateTypes.push_back(type);
+    return stateTypeIndex[type] = stateTypes.size() - 1;
+}
+
+/* a file from another version is ignored, and every class checked */
+static void loadState(){
+    std::ifstream in(stateFile);
+    std::string line, name;
+    if(!std::getline(in, line) || line != STATE_VERSION || !std::getline(in, line))
+        return;
+    std::istringstream types(line);
+    while(types >> name)
+        stateType(stateSymbol(name));
+
+    class_state state;
+    std::string deps;
+    while(std::getline(in, line) && std::getline(in, deps) && std::getline(in, state.types)){
+        std::istringstream head(line), names(deps);
+        if(!(head >> name >> state.hash >> state.signature))
+            break;
+        state.deps.clear();
+        while(names >> line)
+            state.deps.push_back(line);
+        savedState[name] = state;
+    }
+}
+
+static void saveState(){
+    std::ostringstream out;
+    out << STATE_VERSION << "\n";
+    for(size_t i = 1; i < stateTypes.size(); i++)
+        out << " " << stateTypes[i];
+    out << "\n";
+    for(std::map<std::string, class_state>::iterator it = newState.begin(); it != newState.end(); ++it){
+        class_state& state = it->second;
+        out << it->first << " " << state.hash << " " << state.signature << "\n";
+        for(size_t i = 0; i < state.deps.size(); i++)
+            out << " " << state.deps[i];
+        out << "\n" << state.types << "\n";
+    }
+    writeFile(stateFile, out.str());
+}
+
+/* the compact checker keeps a class's types in compactTypes until writeBackTypes() */
+static void compactToTree(Class_ cur){
+    std::pair<int, int> range = compactClassNodes[cur];
+    for(int i = range.first; i < range.second; i++)
+        compactOrigin[i]->set_type(compactTypes[i]);
+}
+
+static bool restoreTypes(Class_ cur, const std::vector<Expression>& nodes, const std::vector<Symbol>& types){
+    if(types.size() != nodes.size())
+        return false;
+    for(size_t i = 0; i < nodes.size(); i++)
+        nodes[i]->set_type(types[i]);
+    if(useCompact){
+        std::pair<int, int> range = compactClassNodes[cur];
+        for(int i = range.first; i < range.second; i++)
+            compactTypes[i] = compactOrigin[i]->get_type();
+    }
+    return true;
+}
+
+/* give the class the types it had last time */
+static bool restoreClass(Class_ cur, const std::vector<Expression>& nodes){
+    std::map<std::string, class_state>::iterator it = savedState.find(cur->class_getName()->get_string());
+    if(it == savedState.end())
+        return false;
+    std::vector<Symbol> types;
+    types.reserve(nodes.size());
+    /* by hand: strtol would take as long as the rest of restoring */
+    for(const char *p = it->second.types.c_str(); *p != '\0'; p++){
+        size_t type = 0;
+        for(; *p >= '0' && *p <= '9'; p++)
+            type = type * 10 + (*p - '0');
+        if(*p != ' ' || type >= stateTypes.size())
+            return false;
+        types.push_back(stateTypes[type]);
+    }
+    if(!restoreTypes(cur, nodes, types))
+        return false;
+    newState[it->first] = it->second;
+    return true;
+}
+
+static void recordClass(Class_ cur, fingerprint hash, const std::vector<Expression>& nodes, std::set<Symbol>& deps){
+    class_state state;
+    state.hash = hash;
+    state.signature = ownSignature(cur);
+    for(std::set<Symbol>::iterator d = deps.begin(); d != deps.end(); ++d)
+        state.deps.push_back((*d)->get_string());
+    char number[16];
+    for(size_t i = 0; i < nodes.size(); i++){
+        snprintf(number, sizeof(number), "%d ", stateType(nodes[i]->get_type()));
+        state.types += number;
+    }
+    newState[cur->class_getName()->get_string()] = state;
+}
+
+/*
+ *  The classes to check again: those whose hash changed, and those that
+ *  looked at a class whose signature changed, or at a descendant of one,
+ *  or at a class that is gone.
+ */
+static std::vector<bool> recheckClasses(const std::vector<fingerprint>& hashes, int& dependents){
+    std::vector<bool> recheck(programClasses.size());
+    std::set<std::string> changed, present;
+    std::vector<Symbol> signatures;				/* classes whose own signature changed */
+    for(size_t i = 0; i < programClasses.size(); i++){
+        Class_ cur = programClasses[i];
+        std::string name = cur->class_getName()->get_string();
+        present.insert(name);
+        std::map<std::string, class_state>::iterator it = savedState.find(name);
+        if(it != savedState.end() && it->second.hash == hashes[i])
+            continue;
+        recheck[i] = true;
+        if(it == savedState.end() || it->second.signature != ownSignature(cur))
+            signatures.push_back(cur->class_getName());
+    }
+    for(std::map<std::string, class_state>::iterator it = savedState.begin(); it != savedState.end(); ++it)
+        if(present.count(it->first) == 0)
+            changed.insert(it->first);
+
+    if(!signatures.empty()){
+        std::map<Symbol, std::vector<Symbol> > children;
+        for(size_t i = 0; i < programClasses.size(); i++)
+            children[programClasses[i]->class_getParent()].push_back(programClasses[i]->class_getName());
+        while(!signatures.empty()){
+            Symbol name = signatures.back();
+            signatures.pop_back();
+            if(!changed.insert(name->get_string()).second)
+                continue;
+            std::vector<Symbol>& below = children[name];
+            signatures.insert(signatures.end(), below.begin(), below.end());
+        }
+    }
+
+    dependents = 0;
+    for(size_t i = 0; i < programClasses.size() && !changed.empty(); i++){
+        std::map<std::string, class_state>::iterator it = savedState.find(programClasses[i]->class_getName()->get_string());
+        if(recheck[i] || it == savedState.end())
+            continue;
+        for(size_t d = 0; d < it->second.deps.size() && !recheck[i]; d++)
+            if(changed.count(it->second.deps[d])){
+                recheck[i] = true;
+                dependents++;
+            }
+    }
+    return recheck;
+}
+
+/*
+ *  Cache directory. With COOL_SEMANT_CACHE=<dir>, results are shared
+ *  by every program compiled with the same directory. For a class with
+ *  hash H, H.deps lists the classes it looked up when last checked, and
+ *  H-K holds its types and diagnostics, where K hashes the signatures
+ *  of those classes. Diagnostics carry line numbers, so K also covers
+ *  the position of a class that had any. COOL_SEMANT_CACHE_MAX=<KB>
+ *  evicts the least recently used files after the run; 0 empties it.
+ */
+struct cache_file {
+    time_t used;
+    off_t size;
+    std::string path;
+    bool operator<(const cache_file& other) const { return used < other.used; }
+};
+
+/* copies what is written to cerr, which still gets it straight away */
+struct tee_buf : public std::streambuf {
+    std::streambuf *out;
+    std::string text;
+    tee_buf(std::streambuf *o) : out(o) { }
+    int overflow(int c){
+        if(c != EOF)
+            text += (char) c;
+        return out->sputc(c);
+    }
+    std::streamsize xsputn(const char *s, std::streamsize n){
+        text.append(s, n);
+        return out->sputn(s, n);
+    }
+};
+
+static char *cacheDir;
+static int cacheHits, cacheMisses, cacheStores, cacheEvictions;
+
+static std::string cachePath(fingerprint hash, const char *suffix){
+    char name[40];
+    sprintf(name, "/%016llx%s", hash, suffix);
+    return cacheDir + std::string(name);
+}
+
+/* 
+ * The tree is read from the parser's dump, so no node in it is shared
+ * and every node prints its own line.
+ */
+static const use_line_map noUseLines;
+
+/* the class as dumped, line numbers and all */
+static fingerprint positionHash(Class_ cur){
+    std::ostringstream dump;
+    dump_tree(dump, cur, 0, false, noUseLines);
+    return hashString(dump.str());
+}
+
+static fingerprint cacheKey(Class_ cur, const std::vector<std::string>& deps, bool positional){
+    std::ostringstream key;
+    for(size_t i = 0; i < deps.size(); i++)
+        key << deps[i] << " " << signatureHash(stateSymbol(deps[i])) << "\n";
+    if(positional)
+        key << positionHash(cur) << "\n";
+    return hashString(key.str());
+}
+
+/* restore the class's types and replay its diagnostics from the cache */
+static bool cacheRestore(Class_ cur, fingerprint hash, const std::vector<Expression>& nodes, std::set<Symbol>& deps){
+    std::ifstream manifest(cachePath(hash, ".deps").c_str());
+    int positional;
+    std::vector<std::string> names;
+    std::string name;
+    if(!(manifest >> positional)){
+        cacheMisses++;
+        return false;
+    }
+    while(manifest >> name)
+        names.push_back(name);
+
+    char key[20];
+    sprintf(key, "-%016llx", cacheKey(cur, names, positional));
+    std::string entry = cachePath(hash, key);
+    std::ifstream in(entry.c_str());
+    int errors;
+    size_t length, ntypes;
+    if(!(in >> errors >> length) || in.get() != '\n'){
+        cacheMisses++;
+        return false;
+    }
+    std::string text(length, ' ');
+    in.read(&text[0], length);
+    in >> ntypes;
+    std::vector<Symbol> types(in ? ntypes : 0);
+    for(size_t i = 0; i < types.size() && in >> name; i++)
+        types[i] = stateSymbol(name);
+    if(!in || !restoreTypes(cur, nodes, types)){
+        cacheMisses++;
+        return false;
+    }
+
+    cerr << text;
+    classtable->add_errors(errors);
+    for(size_t i = 0; i < names.size(); i++)
+        deps.insert(stateSymbol(names[i]));
+    utime(entry.c_str(), NULL);			/* for eviction */
+    cacheHits++;
+    return true;
+}
+
+static void cacheStore(Class_ cur, fingerprint hash, const std::vector<Expression>& nodes, std::set<Symbol>& deps,
+                       int errors, const std::string& text){
+    std::vector<std::string> names;
+    std::ostringstream manifest, entry;
+    manifest << (errors > 0) << "\n";
+    for(std::set<Symbol>::iterator d = deps.begin(); d != deps.end(); ++d){
+        names.push_back((*d)->get_string());
+        manifest << names.back() << "\n";
+    }
+    entry << errors << " " << text.size() << "\n" << text;
+    entry << nodes.size() << "\n";
+    for(size_t i = 0; i < nodes.size(); i++)
+        entry << " " << (nodes[i]->get_type() == NULL ? "-" : nodes[i]->get_type()->get_string());
+    entry << "\n";
+
+    char key[20];
+    sprintf(key, "-%016llx", cacheKey(cur, names, errors > 0));
+    writeFile(cachePath(hash, ".deps"), manifest.str());
+    writeFile(cachePath(hash, key), entry.str());
+    cacheStores++;
+}
+
+/* remove the least recently used files until the cache fits in maxKB */
+static void evictCache(long maxKB){
+    DIR *dir = opendir(cacheDir);
+    if(dir == NULL)
+        return;
+    std::vector<cache_file> files;
+    off_t total = 0;
+    struct dirent *ent;
+    struct stat st;
+    while((ent = readdir(dir)) != NULL){
+        cache_file file;
+        file.path = std::string(cacheDir) + "/" + ent->d_name;
+        if(ent->d_name[0] == '.' || strcmp(ent->d_name, "stats") == 0
+           || stat(file.path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+            continue;
+        file.used = st.st_mtime;
+        file.size = st.st_size;
+        files.push_back(file);
+        total += st.st_size;
+    }
+    closedir(dir);
+
+    std::sort(files.begin(), files.end());
+    for(size_t i = 0; i < files.size() && total > (off_t) maxKB * 1024; i++)
+        if(unlink(files[i].path.c_str()) == 0){
+            total -= files[i].size;
+            cacheEvictions++;
+        }
+}
+
+/* add this run to the totals kept in <dir>/stats */
+static void cacheStats(){
+    std::string path = std::string(cacheDir) + "/stats";
+    std::ifstream in(path.c_str());
+    long hits = 0, misses = 0, stores = 0, evictions = 0;
+    in >> hits >> misses >> stores >> evictions;
+    in.close();
+    hits += cacheHits;
+    misses += cacheMisses;
+    stores += cacheStores;
+    evictions += cacheEvictions;
+    std::ostringstream out;
+    out << hits << " " << misses << " " << stores << " " << evictions << "\n";
+    writeFile(path, out.str());
+
+    if(semant_debug){
+        cerr << "semant: cache " << cacheHits << " hits, " << cacheMisses << " misses, "
+             << cacheStores << " stored, " << cacheEvictions << " evicted" << endl;
+        cerr << "semant: cache totals " << hits << " hits, " << misses << " misses, "
+             << stores << " stored, " << evictions << " evicted" << endl;
+    }
+}
+
+/*
+ *  Class arena. COOL_SEMANT_STREAM makes the symbol tables of a class
+ *  in an arena that is reused for the next one (symTab asks for its
+ *  cells through tableCell, nothing else comes from it), and writes each
+ *  class out as soon as it is checked and then frees its expressions,
+ *  so that what checking holds on to does not grow with the program:
+ *  the classes, features and formals stay for their names and types.
+ *  This is not streaming from the parser: the driver has read the
+ *  whole tree by the time semant() runs, and a class may use classes
+ *  defined after it, so the peak while reading is unchanged. The
+ *  classes are written to a temporary file and copied out once the
+ *  program has no errors.
+ *
+ *  Static dispatch checks the body of the method it names, again, from
+ *  the class it is in; the classes that may be named that way and
+ *  their ancestors keep their bodies and are written at the end, when
+ *  their types are final.
+ */
+static bool streaming;
+static std::vector<char *> arenaChunks;
+static size_t arenaChunk, arenaUsed;			/* the chunk being filled and its bytes used */
+#define ARENA_CHUNK 65536
+
+static FILE *streamFile;
+static std::vector<std::pair<long, long> > streamParts;	/* offset and length of each class's dump */
+static std::set<Symbol> streamKept;				/* classes whose bodies static dispatch may check */
+
+static void *arenaAlloc(size_t size){
+    size = (size + 15) & ~(size_t) 15;
+    assert(size <= ARENA_CHUNK);
+    if(arenaChunk < arenaChunks.size() && arenaUsed + size > ARENA_CHUNK){
+        arenaChunk++;
+        arenaUsed = 0;
+    }
+    if(arenaChunk == arenaChunks.size())
+        arenaChunks.push_back((char *) ::operator new(ARENA_CHUNK));
+    void *p = arenaChunks[arenaChunk] + arenaUsed;
+    arenaUsed += size;
+    return p;
+}
+
+static void startStream(){
+    /* the basic classes' scopes are kept, so they must not be made in the arena */
+    buildBasicScopes();
+    for(size_t i = 0; i < compactTree.size(); i++){
+        if(compactTree[i].kind != K_STATIC_DISPATCH)
+            continue;
+        Symbol name = compactSymbols[compactOperands[compactTree[i].c]];
+        while(name != No_class && streamKept.insert(name).second){
+            classMAP::iterator it = classGraph.find(name);
+            if(it == classGraph.end())
+                break;
+            name = it->second->class_getParent();
+        }
+    }
+    streamFile = tmpfile();
+    if(streamFile == NULL){
+        cerr << "semant: cannot stream: " << strerror(errno) << endl;
+        exit(1);
+    }
+    streamParts.resize(programClasses.size());
+    streaming = true;
+}
+
+static void writeClass(int index, Class_ cur){
+    std::pair<int, int> nodes = compactClassNodes[cur];
+    if(useCompact)
+        for(int i = nodes.first; i < nodes.second; i++)
+            compactOrigin[i]->set_type(compactTypes[i]);
+    std::ostringstream text;
+    dump_tree(text, cur, 2, true, noUseLines);
+    std::string dump = text.str();
+    streamParts[index] = std::make_pair(ftell(streamFile), (long) dump.size());
+    fwrite(dump.data(), 1, dump.size(), streamFile);
+}
+
+/* done with the class: write it out, free its expressions and its symbol tables */
+static void streamClass(int index, Class_ cur){
+    delete methodTab;
+    delete attrTab;
+    methodTab = attrTab = NULL;
+    arenaChunk = arenaUsed = 0;
+
+    if(streamKept.count(cur->class_getName()))
+        return;
+    writeClass(index, cur);
+    std::pair<int, int> nodes = compactClassNodes[cur];
+    std::set<Expression> freed;
+    for(int i = nodes.first; i < nodes.second; i++){
+        if(freed.insert(compactOrigin[i]).second)
+            delete compactOrigin[i];
+        compactOrigin[i] = NULL;
+    }
+}
+
+/* write the program as the driver would have */
+static void finishStream(ostream& stream, tree_node *program){
+    for(int i = 0; i < (int) programClasses.size(); i++)
+        if(streamKept.count(programClasses[i]->class_getName()))
+            writeClass(i, programClasses[i]);
+
+    stream << "#" << program->get_line_number() << "\n_program\n";
+    std::vector<char> buf;
+    for(size_t i = 0; i < streamParts.size(); i++){
+        buf.resize(streamParts[i].second);
+        fseek(streamFile, streamParts[i].first, SEEK_SET);
+        if(fread(&buf[0], 1, buf.size(), streamFile) != buf.size()){
+            cerr << "semant: cannot read back the streamed classes" << endl;
+            exit(1);
+        }
+        stream.write(&buf[0], buf.size());
+    }
+}
+
+/*
+ *  Memory report. COOL_MEM_REPORT reports on stderr at exit the peak of
+ *  the bytes live in each part of semant, what the allocator used beyond
+ *  the bytes asked for, and the bytes taken by each tree class (the
+ *  classes count themselves, see cool-tree.handcode.h), by the string
+ *  tables and by the symbol table scopes at each depth. Left unset,
+ *  each point below costs a test of memReport.
+ */
+enum mem_phase { M_READING, M_CLASSTABLE, M_LOWERING, M_CHECKING, M_WRITING, M_PHASES };
+static const char *memPhaseNames[M_PHASES] = { "reading the tree", "ClassTable", "lowering", "checking", "writing the tree" };
+
+bool memReport = getenv("COOL_MEM_REPORT") != NULL;	/* set before main(), so that the tree read in is counted */
+static mem_kind *memKinds;
+static long memAllocs, memRequested, memUsable;	/* every allocation made while memReport is set */
+static long memLive;							/* usable bytes allocated and not freed */
+static long memPeak[M_PHASES];
+static int memPhase = M_READING;
+
+#define MEM_DEPTHS 16							/* deeper scopes are counted with the last */
+static long memScopes[MEM_DEPTHS], memEntries[MEM_DEPTHS];
+
+mem_kind::mem_kind(const char *n) : name(n), objects(0), bytes(0), freed(0), freedBytes(0), next(memKinds){
+    memKinds = this;
+}
+
+void *memNew(mem_kind *kind, size_t size){
+    if(kind != NULL){
+        kind->objects++;
+        kind->bytes += size;
+    }
+    return cool_new(size);
+}
+
+void memDelete(mem_kind *kind, void *p, size_t size){
+    if(kind != NULL){
+        kind->freed++;
+        kind->freedBytes += size;
+    }
+    cool_delete(p);
+}
+
+static void memAllocated(void *p, size_t size){
+    size_t usable = malloc_usable_size(p);
+    memAllocs++;
+    memRequested += size;
+    memUsable += usable;
+    memLive += usable;
+    if(memLive > memPeak[memPhase])
+        memPeak[memPhase] = memLive;
+}
+
+static void memEnter(mem_phase phase){
+    memPhase = phase;
+    memPeak[phase] = memLive;
+}
+
+/* a symTab cell, from the arena while streaming; the cells are never freed one by one */
+template <class T> static T *tableCell(const T& cell){
+    void *p = streaming ? arenaAlloc(sizeof(T)) : ::operator new(sizeof(T));
+    return new(p) T(cell);
+}
+
+void symTab::enterscope(){
+    scopes = tableCell(List<scope>(NULL, scopes));
+    if(memReport)
+        memScopes[depth < MEM_DEPTHS ? depth : MEM_DEPTHS - 1]++;
+    depth++;
+}
+
+void symTab::exitscope(){
+    if(scopes == NULL){
+        cerr << "exitscope: Can't remove scope from an empty symbol table." << endl;
+        exit(1);
+    }
+    scopes = scopes->tl();
+    depth--;
+}
+
+symTab::entry *symTab::addid(Symbol name, Symbol *info){
+    if(scopes == NULL){
+        cerr << "addid: Can't add a symbol without a scope." << endl;
+        exit(1);
+    }
+    if(memReport){
+        int level = depth > 0 ? depth - 1 : 0;
+        memEntries[level < MEM_DEPTHS ? level : MEM_DEPTHS - 1]++;
+    }
+    if(streaming){
+        Symbol type = *info;
+        delete info;
+        info = tableCell(type);
+    }
+    entry *e = tableCell(entry(name, info));
+    scopes = tableCell(List<scope>(tableCell(scope(e, scopes->hd())), scopes->tl()));
+    return e;
+}
+
+Symbol *symTab::probe(Symbol name){
+    if(scopes == NULL){
+        cerr << "probe: No scope in symbol table." << endl;
+        exit(1);
+    }
+    for(scope *i = scopes->hd(); i != NULL; i = i->tl())
+        if(i->hd()->get_id() == name)
+            return i->hd()->get_info();
+    return NULL;
+}
+
+/* the cells of a string table's list, which it keeps to itself */
+template <class Elem> struct table_cells : public StringTable<Elem> {
+    static List<Elem> *of(StringTable<Elem>& table){ return table.*(&table_cells::tbl); }
+};
+
+template <class Elem> static void tableBytes(const char *name, StringTable<Elem>& table){
+    long entries = 0, bytes = 0;
+    for(List<Elem> *l = table_cells<Elem>::of(table); l != NULL; l = l->tl()){
+        entries++;
+        bytes += sizeof(Elem) + sizeof(List<Elem>) + l->hd()->get_len() + 1;
+    }
+    char line[256];
+    snprintf(line, sizeof(line), "  %-30s %10ld %12ld\n", name, entries, bytes);
+    cerr << line;
+}
+
+static bool moreBytes(const mem_kind *a, const mem_kind *b){
+    return a->bytes > b->bytes;
+}
+
+/* run at exit, so that programs with errors are reported too */
+static void reportMemory(){
+    char line[256];
+    snprintf(line, sizeof(line), "%-32s %10s %12s\n", "semant memory report", "", "peak live KB");
+    cerr << line;
+    long peak = 0;
+    for(int i = 0; i < M_PHASES; i++){
+        snprintf(line, sizeof(line), "  %-30s %10s %12.1f\n", memPhaseNames[i], "", memPeak[i] / 1024.0);
+        cerr << line;
+        peak = std::max(peak, memPeak[i]);
+    }
+    snprintf(line, sizeof(line), "  %-30s %10s %12.1f\n", "all", "", peak / 1024.0);
+    cerr << line;
+
+    /* glibc rounds each block up and puts a size word in front of it */
+    snprintf(line, sizeof(line), "%-32s %10s %12s\n", "allocator", "blocks", "KB");
+    cerr << line;
+    snprintf(line, sizeof(line), "  %-30s %10ld %12.1f\n", "asked for", memAllocs, memRequested / 1024.0);
+    cerr << line;
+    snprintf(line, sizeof(line), "  %-30s %10s %12.1f\n", "overhead", "",
+             (memUsable - memRequested + memAllocs * (long) sizeof(size_t)) / 1024.0);
+    cerr << line;
+
+    std::vector<mem_kind *> kinds;
+    for(mem_kind *k = memKinds; k != NULL; k = k->next)
+        kinds.push_back(k);
+    std::stable_sort(kinds.begin(), kinds.end(), moreBytes);
+    /* what was allocated in all, and what of it is still live */
+    snprintf(line, sizeof(line), "%-32s %10s %12s %10s %12s\n", "tree classes", "objects", "bytes", "live", "live bytes");
+    cerr << line;
+    for(size_t i = 0; i < kinds.size(); i++){
+        mem_kind *k = kinds[i];
+        snprintf(line, sizeof(line), "  %-30s %10ld %12ld %10ld %12ld\n", k->name, k->objects, k->bytes,
+                 k->objects - k->freed, k->bytes - k->freedBytes);
+        cerr << line;
+    }
+
+    snprintf(line, sizeof(line), "%-32s %10s %12s\n", "string tables", "entries", "bytes");
+    cerr << line;
+    tableBytes("idtable", idtable);
+    tableBytes("stringtable", stringtable);
+    tableBytes("inttable", inttable);
+
+    /* each scope is a list cell; each entry an entry, two list cells and the Symbol it maps to */
+    long scopeBytes = sizeof(List<SymtabEntry<Symbol,Symbol> >);
+    long entryBytes = sizeof(SymtabEntry<Symbol,Symbol>) + 2 * scopeBytes + sizeof(Symbol);
+    snprintf(line, sizeof(line), "%-32s %10s %10s %12s\n", "symbol table scopes", "scopes", "entries", "bytes");
+    cerr << line;
+    for(int i = 0; i < MEM_DEPTHS; i++){
+        if(memScopes[i] == 0 && memEntries[i] == 0)
+            continue;
+        char name[32];
+        snprintf(name, sizeof(name), i == MEM_DEPTHS - 1 ? "depth %d and deeper" : "depth %d", i);
+        snprintf(line, sizeof(line), "  %-30s %10ld %10ld %12ld\n", name, memScopes[i], memEntries[i],
+                 memScopes[i] * scopeBytes + memEntries[i] * entryBytes);
+        cerr << line;
+    }
+}
+
+/*
+ *  Hot-path profile (COOL_SEMANT_PROFILE). For each helper, the call
+ *  sites that used it most come first, with a histogram of the steps
+ *  their calls took: buckets of 0, 1, 2-3, 4-7 and so on.
+ */
+static hot_counter *hotCounters;
+
+hot_counter::hot_counter(const char *n) : name(n), next(NULL){
+    hot_counter **last = &hotCounters;
+    while(*last != NULL)
+        last = &(*last)->next;
+    *last = this;
+}
+
+void hot_counter::record(const hot_site& site, long steps){
+    hot_histogram& h = sites[std::make_pair(site.function, site.line)];
+    h.calls++;
+    h.steps += steps;
+    if(steps > h.max)
+        h.max = steps;
+    int bucket = 0;
+    while(bucket < HOT_BUCKETS - 1 && (steps >> bucket) != 0)
+        bucket++;
+    h.buckets[bucket]++;
+}
+
+/* steps: the names compared */
+classMAP::iterator classMAP::find(const Symbol& name, hot_site site){
+    long compares = hotCompares;
+    iterator it = std::map<Symbol, Class_, counted_less>::find(name);
+    if(hotProfile)
+        hotFind.record(site, hotCompares - compares);
+    return it;
+}
+
+/* steps: the entries passed */
+Symbol *symTab::lookup(Symbol s, hot_site site){
+    long steps = 0;
+    Symbol *found = NULL;
+    for(List<scope> *i = scopes; i != NULL && found == NULL; i = i->tl()){
+        for(scope *j = i->hd(); j != NULL; j = j->tl()){
+            steps++;
+            if(s == j->hd()->get_id()){
+                found = j->hd()->get_info();
+                break;
+            }
+        }
+    }
+    if(hotProfile)
+        hotLookup.record(site, steps);
+    return found;
+}
+
+typedef std::pair<std::pair<const char *, int>, hot_histogram> hot_entry;
+
+static bool moreSteps(const hot_entry& a, const hot_entry& b){
+    return a.second.steps > b.second.steps;
+}
+
+static void reportHot(){
+    char line[512];
+    for(hot_counter *c = hotCounters; c != NULL; c = c->next){
+        std::vector<hot_entry> sites(c->sites.begin(), c->sites.end());
+        std::stable_sort(sites.begin(), sites.end(), moreSteps);
+        long calls = 0, steps = 0;
+        for(size_t i = 0; i < sites.size(); i++){
+            calls += sites[i].second.calls;
+            steps += sites[i].second.steps;
+        }
+        snprintf(line, sizeof(line), "%-32s %10ld %12ld %8s %8s  %s\n", c->name, calls, steps, "mean", "max", "steps:calls");
+        cerr << line;
+        for(size_t i = 0; i < sites.size(); i++){
+            const hot_histogram& h = sites[i].second;
+            char name[64];
+            snprintf(name, sizeof(name), "%s:%d", sites[i].first.first, sites[i].first.second);
+            std::string histogram;
+            for(int b = 0; b < HOT_BUCKETS; b++){
+                if(h.buckets[b] == 0)
+                    continue;
+                char bucket[64];
+                long low = b == 0 ? 0 : 1L << (b - 1), high = (1L << b) - 1;
+                if(b == HOT_BUCKETS - 1)
+                    snprintf(bucket, sizeof(bucket), " %ld+:%ld", low, h.buckets[b]);
+                else if(low >= high)
+                    snprintf(bucket, sizeof(bucket), " %ld:%ld", low, h.buckets[b]);
+                else
+                    snprintf(bucket, sizeof(bucket), " %ld-%ld:%ld", low, high, h.buckets[b]);
+                histogram += bucket;
+            }
+            snprintf(line, sizeof(line), "  %-30s %10ld %12ld %8.1f %8ld %s\n", name, h.calls, h.steps,
+                     (double) h.steps / h.calls, h.max, histogram.c_str());
+            cerr << line;
+        }
+    }
+}
+
+/*
+ *  Time report. COOL_TIME_REPORT=text or COOL_TIME_REPORT=json reports
+ *  on stderr the wall time, CPU time and allocations of each part of
+ *  semant, and the slowest classes and features (COOL_TIME_REPORT_TOP
+ *  of each, 10 by default). Left unset, each point below costs a test
+ *  of timeReport.
+ */
+enum time_format { TIME_OFF, TIME_TEXT, TIME_JSON };
+enum time_phase { T_CLASSTABLE, T_LOWERING, T_BUILD_HIERARCHY, T_VALIDATE, T_TOTAL, T_PHASES };
+
+struct time_stats {
+    double wall, cpu;					/* in ms */
+    long allocs;
+    time_stats() : wall(0), cpu(0), allocs(0) { }
+    bool operator<(const time_stats& other) const { return wall > other.wall; }
+};
+
+typedef std::pair<time_stats, std::string> named_time;
+
+static time_format timeReport;
+static long allocations;				/* counted while timeReport is set */
+static const char *phaseNames[T_PHASES] = { "ClassTable", "lowering", "build_hierarchy", "validate", "total" };
+static time_stats phaseTimes[T_PHASES];
+static std::vector<named_time> classTimes, featureTimes;
+
+/* semant's hooks in operator new and delete, see cool-alloc.h */
+void semant_allocated(void *p, size_t size){
+    if(timeReport)
+        allocations++;
+    if(memReport)
+        memAllocated(p, size);
+}
+
+void semant_freeing(void *p){
+    if(memReport)
+        memLive -= malloc_usable_size(p);
+}
+
+static time_stats timeNow(){
+    timespec wall, cpu;
+    clock_gettime(CLOCK_MONOTONIC, &wall);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu);
+    time_stats t;
+    t.wall = wall.tv_sec * 1e3 + wall.tv_nsec / 1e6;
+    t.cpu = cpu.tv_sec * 1e3 + cpu.tv_nsec / 1e6;
+    t.allocs = allocations;
+    return t;
+}
+
+/* what has been spent since start, added to total as well */
+static time_stats timeSince(const time_stats& start, time_stats& total){
+    time_stats now = timeNow(), spent;
+    spent.wall = now.wall - start.wall;
+    spent.cpu = now.cpu - start.cpu;
+    spent.allocs = now.allocs - start.allocs;
+    total.wall += spent.wall;
+    total.cpu += spent.cpu;
+    total.allocs += spent.allocs;
+    return spent;
+}
+
+static void printTimes(const char *title, std::vector<named_time>& times, size_t top){
+    char line[256];
+    snprintf(line, sizeof(line), "%-32s %10s %10s %10s\n", title, "wall ms", "cpu ms", "allocs");
+    cerr << line;
+    for(size_t i = 0; i < times.size() && i < top; i++){
+        snprintf(line, sizeof(line), "  %-30s %10.3f %10.3f %10ld\n", times[i].second.c_str(),
+                 times[i].first.wall, times[i].first.cpu, times[i].first.allocs);
+        cerr << line;
+    }
+}
+
+static void printJson(const char *name, std::vector<named_time>& times, size_t top){
+    char entry[256];
+    cerr << "  \"" << name << "\": [";
+    for(size_t i = 0; i < times.size() && i < top; i++){
+        snprintf(entry, sizeof(entry), "%s\n    {\"name\": \"%s\", \"wall_ms\": %.3f, \"cpu_ms\": %.3f, \"allocs\": %ld}",
+                 i ? "," : "", times[i].second.c_str(), times[i].first.wall, times[i].first.cpu, times[i].first.allocs);
+        cerr << entry;
+    }
+    cerr << "\n  ]";
+}
+
+/* run at exit, so that programs with errors are reported too */
+static void reportTimes(){
+    static time_stats start = phaseTimes[T_TOTAL];	/* semant() left its start time here */
+    phaseTimes[T_TOTAL] = time_stats();
+    timeSince(start, phaseTimes[T_TOTAL]);
+
+    std::vector<named_time> phases;
+    for(int i = 0; i < T_PHASES; i++)
+        phases.push_back(std::make_pair(phaseTimes[i], std::string(phaseNames[i])));
+    std::stable_sort(classTimes.begin(), classTimes.end());
+    std::stable_sort(featureTimes.begin(), featureTimes.end());
+    char *topEnv = getenv("COOL_TIME_REPORT_TOP");
+    size_t top = topEnv != NULL ? atoi(topEnv) : 10;
+
+    if(timeReport == TIME_JSON){
+        cerr << "{\n  \"phase\": \"semant\",\n";
+        printJson("timers", phases, T_PHASES);
+        cerr << ",\n";
+        printJson("classes", classTimes, top);
+        cerr << ",\n";
+        printJson("features", featureTimes, top);
+        cerr << "\n}" << endl;
+        return;
+    }
+    printTimes("semant time report", phases, T_PHASES);
+    printTimes("slowest classes", classTimes, top);
+    printTimes("slowest features", featureTimes, top);
+}
+
+/* check semantic validity for every class */
+static void checkClasses(){
+    clock_t start = semant_debug ? clock() : 0;		/* reading the CPU clock is a system call */
+    int checked = 0, restored = 0, dependents = 0;
+
+    /* the classes' hashes and expressions, and which of them need checking */
+    std::vector<fingerprint> hashes;
+    std::vector<std::vector<Expression> > nodes(programClasses.size());
+    std::vector<bool> recheck(programClasses.size(), true);
+    if(stateFile != NULL || cacheDir != NULL){
+        for(size_t i = 0; i < programClasses.size(); i++)
+            hashes.push_back(classShape(programClasses[i], nodes[i]));
+        if(stateFile != NULL)
+            recheck = recheckClasses(hashes, dependents);
+    }
+
+    for(int i = 0; i < (int) programClasses.size(); i++){
+        Class_ cur = programClasses[i];
+        trace_span classSpan(cur->class_getName()->get_string(), "class");
+        fingerprint hash = 0;
+        std::set<Symbol> deps;
+        int errors = classtable->errors();
+        if(stateFile != NULL || cacheDir != NULL){
+            hash = hashes[i];
+            if(!recheck[i] && restoreClass(cur, nodes[i])){
+                restored++;
+                if(streaming)
+                    streamClass(i, cur);
+                continue;
+            }
+            if(cacheDir != NULL && cacheRestore(cur, hash, nodes[i], deps)){
+                if(stateFile != NULL && classtable->errors() == errors)
+                    recordClass(cur, hash, nodes[i], deps);
+                restored++;
+                if(streaming)
+                    streamClass(i, cur);
+                continue;
+            }
+            classDeps = &deps;
+            classUncacheable = false;
+        }
+    checked++;
+
+        /* keep the class's diagnostics for the cache */
+        tee_buf diagnostics(cerr.rdbuf());
+        if(cacheDir != NULL)
+            cerr.rdbuf(&diagnostics);
+
+        time_stats classStart, classTime;
+        if(timeReport)
+            classStart = timeNow();
+
+        methodTab = new symTab();
+        attrTab = new symTab();
+        Features featureList = cur->class_getFeatures();
+        /* populate full hierarchy of classes for current (with class checking);
+           the class stands for its ancestors, so they are not recorded one by one */
+        dependOn(cur->class_getName());
+        build_hierarchy(cur);
+        if(timeReport)
+            timeSince(classStart, phaseTimes[T_BUILD_HIERARCHY]);
+
+        /* check all features validity */
+        for(int i = featureList->first(); featureList->more(i); i = featureList->next(i)){
+            time_stats featureStart;
+            if(timeReport)
+                featureStart = timeNow();
+            methodTab->enterscope();
+            attrTab->enterscope();
+            /* check features validity here */
+            featureList->nth(i)->validate(cur);
+            attrTab->exitscope();
+            methodTab->exitscope();
+            if(timeReport){
+                std::string name = std::string(cur->class_getName()->get_string()) + "."
+                                 + featureList->nth(i)->feature_getName()->get_string();
+                featureTimes.push_back(std::make_pair(timeSince(featureStart, phaseTimes[T_VALIDATE]), name));
+            }
+        }
+        if(timeReport)
+            classTimes.push_back(std::make_pair(timeSince(classStart, classTime), std::string(cur->class_getName()->get_string())));
+
+        classDeps = NULL;
+        if(useCompact && (stateFile != NULL || cacheDir != NULL))
+            compactToTree(cur);
+        if(cacheDir != NULL){
+            cerr.rdbuf(diagnostics.out);
+            if(!classUncacheable)
+                cacheStore(cur, hash, nodes[i], deps, classtable->errors() - errors, diagnostics.text);
+        }
+        if(stateFile != NULL && !classUncacheable && classtable->errors() == errors)
+            recordClass(cur, hash, nodes[i], deps);
+        if(streaming)
+            streamClass(i, cur);
+    }
+
+    if(semant_debug)
+        cerr << "semant: checked " << checked << " classes (" << dependents << " for what they depend on), restored "
+             << restored << ", in "
+             << 1000.0 * (clock() - start) / CLOCKS_PER_SEC << " ms" << endl;
+}
+
+/*
+ *  COOL_SEMANT_BENCH=<rounds> times the expression checking of a correct
+ *  program, on the tree and on the compact tree, within the same scopes.
+ */
+static void benchCheckers(int rounds){
+    if(compactDepth > TREE_CHECK_DEPTH){
+        cerr << "semant bench: too deeply nested for the tree checker" << endl;
+        return;
+    }
+
+    bool saved = useCompact;
+    clock_t spent[2] = { 0, 0 };
+    for(int r = 0; r < rounds; r++){
+        for(size_t i = 0; i < programClasses.size(); i++){
+            methodTab = new symTab();
+            attrTab = new symTab();
+            Class_ cur = programClasses[i];
+            Features featureList = cur->class_getFeatures();
+            build_hierarchy(cur);
+
+            for(int compact = 0; compact < 2; compact++){
+                useCompact = compact;
+                clock_t start = clock();
+                for(int j = featureList->first(); featureList->more(j); j = featureList->next(j)){
+                    methodTab->enterscope();
+                    attrTab->enterscope();
+                    featureList->nth(j)->validate(cur);
+                    attrTab->exitscope();
+                    methodTab->exitscope();
+                }
+                spent[compact] += clock() - start;
+            }
+        }
+    }
+    useCompact = saved;
+
+    cerr << "semant bench: " << compactTree.size() << " nodes, tree "
+         << 1000.0 * spent[0] / CLOCKS_PER_SEC / rounds << " ms/round, compact "
+         << 1000.0 * spent[1] / CLOCKS_PER_SEC / rounds << " ms/round" << endl;
+}
+
+static void runProgram(const char *engine){
+    char *input = getenv("COOL_RUN_INPUT");
+    if(input != NULL && (vmInput = fopen(input, "r")) == NULL){
+        cerr << "semant: cannot read " << input << ": " << strerror(errno) << endl;
+        exit(1);
+    }
+    if(strcmp(engine, "vm") != 0 && strcmp(engine, "ast") != 0){
+        cerr << "semant: COOL_RUN=" << engine << " is not an engine; use vm or ast" << endl;
+        exit(1);
+    }
+    static char buf[1 << 16];
+    setvbuf(stdout, buf, _IOFBF, sizeof(buf));
+    if(strcmp(engine, "ast") == 0){
+        evalProgram();
+        return;
+    }
+    vmCompile();
+    vmRun();
+}
+
+/* 
+ * The driver writes the phase's output with ast_root->dump_with_types()
+ * once semant() returns, and dumptype.cc's would recurse as deep as the
+ * program nests. semant() hands it this root instead, as the parser
+ * does (see cool.y), which writes the checked tree with dump_tree(),
+ * the streamed classes, or nothing when the program was run or compiled
+ * and its output is already written.
+ */
+enum phase_output { OUT_TREE, OUT_STREAM, OUT_NONE };
+
+class checked_program_class : public program_class {
+    phase_output output;
+public:
+    checked_program_class(Classes a1, phase_output o) : program_class(a1), output(o) {}
+    void dump_with_types(ostream& stream, int n);
+};
+
+void checked_program_class::dump_with_types(ostream& stream, int n){
+    if(output == OUT_TREE)
+        dump_tree(stream, this, n, noUseLines);
+    else if(output == OUT_STREAM)
+        finishStream(stream, this);
+}
+
+void program_class::semant()
+{
+    traceFile = getenv("COOL_TRACE");
+    if(traceFile != NULL){
+        traceStart = traceClock();
+        atexit(writeTrace);
+    }
+
+    hotProfile = getenv("COOL_SEMANT_PROFILE") != NULL;
+    if(hotProfile)
+        atexit(reportHot);
+
+    char *report = getenv("COOL_TIME_REPORT");
+    time_stats start;
+    if(report != NULL){
+        timeReport = strcmp(report, "json") == 0 ? TIME_JSON : TIME_TEXT;
+        phaseTimes[T_TOTAL] = start = timeNow();
+        atexit(reportTimes);
+    }
+    if(memReport){
+        memEnter(M_CLASSTABLE);
+        atexit(reportMemory);
+    }
+
+    initialize_constants();
+
+    /* ClassTable constructor may do some semantic analysis */
+    trace_span span("ClassTable", "phase");
+    classtable = new ClassTable(classes);
+    if(timeReport)
+        timeSince(start, phaseTimes[T_CLASSTABLE]);
+    span.end();
+
+    /* some semantic analysis code may go here */
+    if (classtable->errors()) {
+        cerr << "Compilation halted due to static semantic errors." << endl;
+        exit(1);
+    }
+
+    useCompact = getenv("COOL_COMPACT_AST") != NULL || nestsDeeperThan(TREE_CHECK_DEPTH);
+    stateFile = getenv("COOL_SEMANT_STATE");
+    cacheDir = getenv("COOL_SEMANT_CACHE");
+    char *engine = getenv("COOL_RUN");
+    char *target = getenv("COOL_CODEGEN");
+    bool wholeProgram = engine != NULL || target != NULL || getenv("COOL_CHA_REPORT") != NULL || getenv("COOL_IR") != NULL;
+    char *bench = getenv("COOL_SEMANT_BENCH");
+
+    /* lowering does not recurse, so it is safe at any depth; the tree
+       checker needs none of it, and most programs use that */
+    if(useCompact || wholeProgram || bench != NULL
+       || getenv("COOL_SEMANT_STREAM") != NULL){
+        if(timeReport)
+            start = timeNow();
+        span.begin("lowering");
+        if(memReport)
+            memEnter(M_LOWERING);
+        lowerClasses();
+        if(timeReport)
+            timeSince(start, phaseTimes[T_LOWERING]);
+        span.end();
+    }
+
+    if(stateFile != NULL || cacheDir != NULL)
+        loadNames();
+    if(stateFile != NULL)
+        loadState();
+    if(cacheDir != NULL)
+        mkdir(cacheDir, 0777);
+    if(getenv("COOL_SEMANT_STREAM") != NULL && !wholeProgram)
+        startStream();
+
+    span.begin("checking");
+    if(memReport)
+        memEnter(M_CHECKING);
+    checkClasses();
+    span.end();
+
+    if(useCompact && !streaming){
+        span.begin("writeBackTypes");
+        writeBackTypes();
+        span.end();
+    }
+
+    if(cacheDir != NULL){
+        char *max = getenv("COOL_SEMANT_CACHE_MAX");
+        if(max != NULL)
+            evictCache(atol(max));
+        cacheStats();
+    }
 
     if (classtable->errors()) {
     	cerr << "Compilation halted due to static semantic errors." << endl;
     	exit(1);
     }
+
+    if(stateFile != NULL)
+        saveState();
+    if(wholeProgram){
+        vmLayoutClasses();
+        analyzeHierarchy();
+        if(getenv("COOL_IR") != NULL)
+            buildIR();
+    }
+    /* the tree interpreter runs the tree as checked */
+    if(target != NULL || (engine != NULL && strcmp(engine, "ast") != 0))
+        foldProgram();
+    phase_output output = OUT_TREE;
+    if(engine != NULL){
+        runProgram(engine);
+        output = OUT_NONE;
+    }
+    else if(target != NULL){
+        emitNative(target);
+        output = OUT_NONE;
+    }
+    else if(streaming)
+        output = OUT_STREAM;
+    else if(bench != NULL && atoi(bench) > 0)
+        benchCheckers(atoi(bench));
+    if(memReport && output != OUT_NONE)
+        memEnter(M_WRITING);
+
+    /* a root some phase gave a dump of its own already writes the tree */
+    if(output == OUT_TREE && typeid(*this) != typeid(program_class))
+        return;
+    checked_program_class *root = new checked_program_class(classes, output);
+    root->set(this);
+    ast_root = root;
 }
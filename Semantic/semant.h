@@ -5,6 +5,7 @@
 #include <map>
 #include <utility>
 #include <set>
+#include <vector>
 #include <iostream>  
 #include "cool-tree.h"
 #include "stringtab.h"
@@ -25,33 +26,139 @@ typedef ClassTable *ClassTableP;
 class ClassTable {
 private:
   int semant_errors;
-  void install_basic_classes();
   ostream& error_stream;
 
 public:
+  static void install_basic_classes();
   ClassTable(Classes);
   int errors() { return semant_errors; }
+  void add_errors(int n) { semant_errors += n; }	/* replayed from the cache */
   ostream& semant_error();
   ostream& semant_error(Class_ c);
   ostream& semant_error(Symbol filename, tree_node *t);
 };
 
-ClassTable *classtable;
+extern ClassTable *classtable;
 
-typedef std::map<Symbol, Class_> classMAP;		/* map to maintain name versus Class_ object */
+/* the predefined symbols, and the filename the basic classes carry; see semant.cc */
+extern Symbol arg, arg2, Bool, concat, cool_abort, copy, Int, in_int, in_string, IO, length, Main, main_meth,
+    No_class, No_type, Object, out_int, out_string, prim_slot, self, SELF_TYPE, Str, str_field, substr, type_name, val;
+extern Symbol basicFilename;
+
+/*
+ *  Hot-path profile. With COOL_SEMANT_PROFILE set, the helpers that walk
+ *  the class graph and the symbol tables count, for each place they are
+ *  called from, how often they ran and how many steps each call took.
+ *  The site is filled in by the compiler where a hot_site is defaulted.
+ */
+struct hot_site {
+    const char *function;
+    int line;
+    hot_site(const char *f = __builtin_FUNCTION(), int l = __builtin_LINE()) : function(f), line(l) { }
+};
+
+#define HOT_BUCKETS 20							/* steps 0, 1, 2-3, 4-7, ...; the last takes the rest */
+struct hot_histogram {
+    long calls, steps, max;
+    long buckets[HOT_BUCKETS];
+};
+
+struct hot_counter {
+    const char *name;
+    std::map<std::pair<const char *, int>, hot_histogram> sites;
+    hot_counter *next;
+    hot_counter(const char *);
+    void record(const hot_site& site, long steps);
+};
+
+extern bool hotProfile;
+extern long hotCompares;						/* class name comparisons made by classGraph */
+
+/* orders symbols as std::less does, counting the comparisons when profiling */
+struct counted_less {
+    bool operator()(const Symbol& a, const Symbol& b) const {
+        if(hotProfile)
+            hotCompares++;
+        return a < b;
+    }
+};
+
+extern std::set<Symbol> *classDeps;			/* when set, collects the classes dependOn() is given */
+extern bool classUncacheable;					/* checking reached into another class's method body */
+
+/* map to maintain name versus Class_ object */
+struct classMAP : public std::map<Symbol, Class_, counted_less> {
+    iterator find(const Symbol& name, hot_site site = hot_site());
+};
 typedef std::pair<classMAP::iterator, bool> cMAPit;	/* map iterator */
 typedef std::map<Symbol, bool> classMAP_bool;
 
-classMAP classGraph;					/* mapping from class name of type Symbol to Class_ object */
+extern classMAP classGraph;				/* mapping from class name of type Symbol to Class_ object */
+extern std::vector<Class_> programClasses;	/* the program's classes in order, as ClassTable met them */
 
-typedef SymbolTable<Symbol,Symbol> symTab;		/* symbol table structure */
-symTab *methodTab, *attrTab;					/* mapping from method/attribute to class name */
+/*
+ *  symbol table structure: SymbolTable's scopes, kept here rather than
+ *  behind SymbolTable's private members, so that lookup can count the
+ *  entries it passes for COOL_SEMANT_PROFILE and the scopes and entries
+ *  can be counted for COOL_MEM_REPORT
+ */
+struct symTab {
+    typedef SymtabEntry<Symbol,Symbol> entry;
+    typedef List<entry> scope;
+    List<scope> *scopes;						/* innermost first */
+    int depth;									/* scopes open */
+    symTab() : scopes(NULL), depth(0) { }
+    void enterscope();
+    void exitscope();
+    entry *addid(Symbol, Symbol *);
+    Symbol *lookup(Symbol, hot_site site = hot_site());
+    Symbol *probe(Symbol);						/* in the innermost scope only */
+};
+extern symTab *methodTab, *attrTab;			/* mapping from method/attribute to class name */
 
 /* added prototypes */
 
 void build_hierarchy(Class_); 					/* populate symbol tables from outermost scope to innermost */ 
-Symbol leastAncestorCheck(Symbol, Symbol);		/* find the closest ancestor of two names */
-Feature getMethods(Class_, Symbol);				/* search for a method recursively in full hierarchy of class */
-bool checkClassInheritance(Symbol, Symbol);		/* check whether target class is one of the sub classes of parent */
+Symbol leastAncestorCheck(Symbol, Symbol, hot_site = hot_site());	/* find the closest ancestor of two names */
+Feature getMethods(Class_, Symbol, hot_site = hot_site());		/* search for a method recursively in full hierarchy of class */
+bool checkClassInheritance(Symbol, Symbol, hot_site = hot_site());	/* check whether target class is one of the sub classes of parent */
+void dependOn(Symbol);							/* the class being checked looked at this one and its ancestors */
+
+/*
+ *  Compact tree: the expressions lowered into arrays indexed by node id,
+ *  checked with a switch and an explicit stack instead of the recursive
+ *  validate() calls. Set COOL_COMPACT_AST to use it; programs nested
+ *  deeper than TREE_CHECK_DEPTH always do, which a walk of the tree
+ *  tells before anything is lowered.
+ */
+#define TREE_CHECK_DEPTH 10000
+enum compact_kind {
+    K_ASSIGN, K_STATIC_DISPATCH, K_DISPATCH, K_COND, K_LOOP, K_TYPCASE, K_BLOCK, K_LET,
+    K_PLUS, K_SUB, K_MUL, K_DIVIDE, K_NEG, K_LT, K_EQ, K_LEQ, K_COMP,
+    K_INT_CONST, K_BOOL_CONST, K_STRING_CONST, K_NEW, K_ISVOID, K_NO_EXPR, K_OBJECT
+};
+
+struct compact_node {
+    unsigned kind : 8;					/* one of compact_kind */
+    unsigned line : 24;
+    int a, b, c;						/* children and operands, see the lower() methods */
+};
+typedef char compact_node_is_16_bytes[sizeof(compact_node) == 16 ? 1 : -1];
+
+extern std::vector<compact_node> compactTree;	/* the nodes */
+extern std::vector<Symbol> compactTypes;		/* inferred type of each node */
+extern std::vector<Expression> compactOrigin;	/* tree node each node was lowered from */
+extern std::vector<int> compactOperands;		/* operand lists too long for a node */
+extern std::vector<Symbol> compactSymbols;		/* symbols named by operands */
+extern std::map<Symbol, int> compactSymbolIds;
+extern std::map<Feature, int> compactBodies;	/* node id of each feature's expression */
+extern int compactDepth;						/* deepest expression lowered */
+extern bool useCompact;
+
+extern std::map<Class_, std::pair<int, int> > compactClassNodes;	/* nodes of each program class */
+
+void lowerClasses();							/* lower every class in classGraph */
+Symbol checkCompact(int, Symbol);				/* type check a node within a class */
+void writeBackTypes();							/* copy the inferred types to the tree */
 #endif
 
@@ -0,0 +1,696 @@
+/*
+ *  ssa.cc
+ *
+ *  SSA form. With COOL_IR set, each method of the checked program is
+ *  built, before folding, into a graph of basic blocks holding typed
+ *  values in static single assignment form. A formal, let or case
+ *  variable becomes the values assigned to it, joined by phis where
+ *  control flow meets, as in Braun et al., "Simple and Efficient
+ *  Construction of Static Single Assignment Form": a block looks up a
+ *  variable in its predecessors, through a phi if it has several, and a
+ *  loop's header, whose predecessors are not all known until the body
+ *  is built, is sealed then. Attributes stay in the object, read with
+ *  attr and written with setattr. Each branch of a case starts by
+ *  narrowing the case's value to the branch's class, giving its variable
+ *  that type. The phis that join a single value are then removed, the
+ *  dominator tree is computed as by Cooper, Harvey and Kennedy, and the
+ *  verifier checks the result. COOL_IR=dump writes the functions to
+ *  stderr; otherwise one line of counts goes there.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include "utilities.h"
+#include "vm.h"
+#include "cha.h"
+#include "ssa.h"
+
+enum ir_op {
+    IR_CONST, IR_PARAM, IR_SELF, IR_PHI, IR_ATTR, IR_SET_ATTR, IR_NEW, IR_DISPATCH,
+    IR_ADD, IR_SUB, IR_MUL, IR_DIV, IR_NEG, IR_LT, IR_LEQ, IR_EQ, IR_NOT, IR_ISVOID,
+    IR_NARROW, IR_JUMP, IR_BRANCH, IR_CASE, IR_RETURN
+};
+
+static const char *irNames[] = {
+    "const", "param", "self", "phi", "attr", "setattr", "new", "dispatch",
+    "add", "sub", "mul", "div", "neg", "lt", "leq", "eq", "not", "isvoid",
+    "narrow", "jump", "branch", "case", "return"
+};
+
+struct ir_value {
+    ir_op op;
+    Symbol type;						/* its static type; No_type for the terminators */
+    int block;
+    int line;
+    std::vector<int> args;				/* operands; a phi's in the order of its block's preds */
+    Symbol name;						/* the literal, attribute, class made or method called */
+    Symbol cls;							/* the class a static dispatch names */
+    int number;							/* a Bool's value, a formal's index, the function a dispatch always calls */
+    std::vector<Symbol> cases;			/* a case's classes, a branch to each successor */
+};
+
+struct ir_block {
+    std::vector<int> phis, values;		/* the terminator last */
+    std::vector<int> preds, succs;
+    int idom;							/* the immediate dominator; the entry's is itself */
+    bool sealed;						/* all preds known */
+    std::map<int, int> defs;			/* variable -> its value at the end of the block */
+    std::map<int, int> incomplete;		/* variable -> phi waiting for the block to be sealed */
+};
+
+struct ir_function {
+    Class_ cls;
+    Feature method;
+    std::vector<ir_value> values;
+    std::vector<ir_block> blocks;		/* the entry first */
+    std::vector<int> order;				/* the blocks in reverse postorder */
+};
+
+static std::vector<ir_function> irFunctions;
+static ir_function *irFn;				/* the function being built */
+static int irBlock;						/* where its values go */
+static int irSelf;
+static std::vector<std::pair<Symbol, int> > irScope;	/* variables, innermost last */
+static std::vector<Symbol> irVariables;	/* the type of each */
+static int irErrors;
+
+static int irValue(ir_op op, Symbol type, Expression from){
+    ir_value v;
+    v.op = op;
+    v.type = type;
+    v.block = irBlock;
+    v.line = from != NULL ? from->get_line_number() : 0;
+    v.name = v.cls = NULL;
+    v.number = -1;
+    irFn->values.push_back(v);
+    int id = irFn->values.size() - 1;
+    if(op == IR_PHI)
+        irFn->blocks[irBlock].phis.push_back(id);
+    else
+        irFn->blocks[irBlock].values.push_back(id);
+    return id;
+}
+
+static int irValue(ir_op op, Symbol type, Expression from, int a, int b = -1){
+    int id = irValue(op, type, from);
+    irFn->values[id].args.push_back(a);
+    if(b >= 0)
+        irFn->values[id].args.push_back(b);
+    return id;
+}
+
+static int irConst(Symbol type, Symbol name, int number, Expression from){
+    int id = irValue(IR_CONST, type, from);
+    irFn->values[id].name = name;
+    irFn->values[id].number = number;
+    return id;
+}
+
+/* a let variable's value when it has no initializer */
+static int irDefault(Symbol type, Expression from){
+    if(type == Int)
+        return irConst(Int, inttable.add_int(0), 0, from);
+    if(type == Str)
+        return irConst(Str, stringtable.add_string((char *) ""), 0, from);
+    return irConst(type, NULL, 0, from);
+}
+
+static int irNewBlock(){
+    ir_block b;
+    b.idom = -1;
+    b.sealed = false;
+    irFn->blocks.push_back(b);
+    return irFn->blocks.size() - 1;
+}
+
+static void irEdge(int from, int to){
+    irFn->blocks[from].succs.push_back(to);
+    irFn->blocks[to].preds.push_back(from);
+}
+
+static void irJump(int to){
+    irValue(IR_JUMP, No_type, NULL);
+    irEdge(irBlock, to);
+}
+
+static void irBranch(int test, int then_block, int else_block){
+    irValue(IR_BRANCH, No_type, NULL, test);
+    irEdge(irBlock, then_block);
+    irEdge(irBlock, else_block);
+}
+
+static int irBind(Symbol name, Symbol type){
+    irVariables.push_back(type);
+    irScope.push_back(std::make_pair(name, (int) irVariables.size() - 1));
+    return irVariables.size() - 1;
+}
+
+static int irVariable(Symbol name){
+    for(size_t i = irScope.size(); i-- > 0; )
+        if(irScope[i].first == name)
+            return irScope[i].second;
+    return -1;
+}
+
+static void irWrite(int var, int block, int value){
+    irFn->blocks[block].defs[var] = value;
+}
+
+static void irPhiOperands(int var, int phi);
+
+static int irRead(int var, int block){
+    std::map<int, int>::iterator def = irFn->blocks[block].defs.find(var);
+    if(def != irFn->blocks[block].defs.end())
+        return def->second;
+    int value, saved = irBlock;
+    irBlock = block;
+    if(!irFn->blocks[block].sealed){
+        value = irValue(IR_PHI, irVariables[var], NULL);
+        irFn->blocks[block].incomplete[var] = value;
+    }
+    else if(irFn->blocks[block].preds.size() == 1)
+        value = irRead(var, irFn->blocks[block].preds[0]);
+    else {
+        /* written before the operands are read, so that a loop back here finds it */
+        value = irValue(IR_PHI, irVariables[var], NULL);
+        irWrite(var, block, value);
+        irPhiOperands(var, value);
+    }
+    irBlock = saved;
+    irWrite(var, block, value);
+    return value;
+}
+
+static void irPhiOperands(int var, int phi){
+    int block = irFn->values[phi].block;
+    for(size_t i = 0; i < irFn->blocks[block].preds.size(); i++){
+        int value = irRead(var, irFn->blocks[block].preds[i]);
+        irFn->values[phi].args.push_back(value);
+    }
+}
+
+static void irSeal(int block){
+    std::map<int, int> incomplete;
+    incomplete.swap(irFn->blocks[block].incomplete);
+    irFn->blocks[block].sealed = true;
+    for(std::map<int, int>::iterator it = incomplete.begin(); it != incomplete.end(); ++it)
+        irPhiOperands(it->first, it->second);
+}
+
+/* a phi joining the values that reach block, in the order of its preds */
+static int irJoin(int block, Symbol type, const std::vector<int>& values){
+    irBlock = block;
+    int phi = irValue(IR_PHI, type, NULL);
+    irFn->values[phi].args = values;
+    return phi;
+}
+
+int assign_class::build(){
+    int value = expr->build();
+    int var = irVariable(name);
+    if(var >= 0)
+        irWrite(var, irBlock, value);
+    else
+        irFn->values[irValue(IR_SET_ATTR, get_type(), this, irSelf, value)].name = name;
+    return value;
+}
+
+/* the actuals, then the receiver, which the dispatch takes first */
+static int irDispatch(Expression site, Expression expr, Symbol type_name, Symbol name, Expressions actual, int function){
+    std::vector<int> args(1);
+    for(int i = actual->first(); actual->more(i); i = actual->next(i))
+        args.push_back(actual->nth(i)->build());
+    args[0] = expr->build();
+    int call = irValue(IR_DISPATCH, site->get_type(), site);
+    ir_value& v = irFn->values[call];
+    v.args = args;
+    v.name = name;
+    v.cls = type_name;
+    v.number = function;
+    return call;
+}
+
+int static_dispatch_class::build(){
+    vm_class& c = vmClasses[vmTags[type_name]];
+    return irDispatch(this, expr, type_name, name, actual, c.vtable[c.methodSlots[name]]);
+}
+
+int dispatch_class::build(){
+    std::map<Expression, int>::iterator direct = chaTargets.find(this);
+    return irDispatch(this, expr, NULL, name, actual, direct != chaTargets.end() ? direct->second : -1);
+}
+
+int cond_class::build(){
+    int test = pred->build();
+    int then_block = irNewBlock(), else_block = irNewBlock();
+    irBranch(test, then_block, else_block);
+    irSeal(then_block);
+    irSeal(else_block);
+    std::vector<int> values, ends;
+    irBlock = then_block;
+    values.push_back(then_exp->build());
+    ends.push_back(irBlock);
+    irBlock = else_block;
+    values.push_back(else_exp->build());
+    ends.push_back(irBlock);
+    int join = irNewBlock();
+    for(size_t i = 0; i < ends.size(); i++){
+        irBlock = ends[i];
+        irJump(join);
+    }
+    irSeal(join);
+    return irJoin(join, get_type(), values);
+}
+
+int loop_class::build(){
+    int header = irNewBlock();
+    irJump(header);
+    irBlock = header;
+    int test = pred->build();
+    int start = irNewBlock(), exit = irNewBlock();
+    irBranch(test, start, exit);
+    irSeal(start);
+    irSeal(exit);
+    irBlock = start;
+    body->build();
+    irJump(header);
+    irSeal(header);
+    irBlock = exit;
+    return irConst(Object, NULL, 0, this);
+}
+
+int typcase_class::build(){
+    int value = expr->build();
+    int from = irBlock;
+    int site = irValue(IR_CASE, No_type, this, value);
+    std::vector<int> values, ends;
+    for(int i = cases->first(); cases->more(i); i = cases->next(i)){
+        Case c = cases->nth(i);
+        irFn->values[site].cases.push_back(c->case_getType());
+        int branch = irNewBlock();
+        irEdge(from, branch);
+        irSeal(branch);
+        irBlock = branch;
+        irWrite(irBind(c->case_getName(), c->case_getType()), branch, irValue(IR_NARROW, c->case_getType(), this, value));
+        values.push_back(c->case_getExpr()->build());
+        irScope.pop_back();
+        ends.push_back(irBlock);
+    }
+    int join = irNewBlock();
+    for(size_t i = 0; i < ends.size(); i++){
+        irBlock = ends[i];
+        irJump(join);
+    }
+    irSeal(join);
+    return irJoin(join, get_type(), values);
+}
+
+int block_class::build(){
+    int value = -1;
+    for(int i = body->first(); body->more(i); i = body->next(i))
+        value = body->nth(i)->build();
+    return value;
+}
+
+int let_class::build(){
+    int value = init->get_type() == No_type ? irDefault(type_decl, this) : init->build();
+    irWrite(irBind(identifier, type_decl), irBlock, value);
+    int result = body->build();
+    irScope.pop_back();
+    return result;
+}
+
+static int irBinary(ir_op op, Symbol type, Expression from, Expression e1, Expression e2){
+    int a = e1->build();
+    int b = e2->build();
+    return irValue(op, type, from, a, b);
+}
+
+int plus_class::build(){
+    return irBinary(IR_ADD, Int, this, e1, e2);
+}
+
+int sub_class::build(){
+    return irBinary(IR_SUB, Int, this, e1, e2);
+}
+
+int mul_class::build(){
+    return irBinary(IR_MUL, Int, this, e1, e2);
+}
+
+int divide_class::build(){
+    return irBinary(IR_DIV, Int, this, e1, e2);
+}
+
+int neg_class::build(){
+    return irValue(IR_NEG, Int, this, e1->build());
+}
+
+int lt_class::build(){
+    return irBinary(IR_LT, Bool, this, e1, e2);
+}
+
+int eq_class::build(){
+    return irBinary(IR_EQ, Bool, this, e1, e2);
+}
+
+int leq_class::build(){
+    return irBinary(IR_LEQ, Bool, this, e1, e2);
+}
+
+int comp_class::build(){
+    return irValue(IR_NOT, Bool, this, e1->build());
+}
+
+int int_const_class::build(){
+    return irConst(Int, token, atoi(token->get_string()), this);
+}
+
+int bool_const_class::build(){
+    return irConst(Bool, NULL, val, this);
+}
+
+int string_const_class::build(){
+    return irConst(Str, token, 0, this);
+}
+
+int new__class::build(){
+    int id = type_name == SELF_TYPE ? irValue(IR_NEW, SELF_TYPE, this, irSelf) : irValue(IR_NEW, type_name, this);
+    irFn->values[id].name = type_name;
+    return id;
+}
+
+int isvoid_class::build(){
+    return irValue(IR_ISVOID, Bool, this, e1->build());
+}
+
+int no_expr_class::build(){
+    return irConst(Object, NULL, 0, this);
+}
+
+int object_class::build(){
+    if(name == self)
+        return irSelf;
+    int var = irVariable(name);
+    if(var >= 0)
+        return irRead(var, irBlock);
+    int id = irValue(IR_ATTR, get_type(), this, irSelf);
+    irFn->values[id].name = name;
+    return id;
+}
+
+static int irFind(std::vector<int>& forward, int value){
+    while(forward[value] != value)
+        value = forward[value];
+    return value;
+}
+
+/* a phi whose operands are itself and one other value is that value */
+static void irRemoveTrivialPhis(ir_function& fn){
+    std::vector<int> forward(fn.values.size());
+    for(size_t i = 0; i < forward.size(); i++)
+        forward[i] = i;
+    for(bool changed = true; changed; ){
+        changed = false;
+        for(size_t b = 0; b < fn.blocks.size(); b++){
+            std::vector<int>& phis = fn.blocks[b].phis;
+            for(size_t i = 0; i < phis.size(); ){
+                int phi = phis[i], same = -1;
+                bool trivial = true;
+                for(size_t k = 0; k < fn.values[phi].args.size() && trivial; k++){
+                    int arg = irFind(forward, fn.values[phi].args[k]);
+                    if(arg == phi || arg == same)
+                        continue;
+                    trivial = same < 0;
+                    same = arg;
+                }
+                if(!trivial || same < 0){
+                    i++;
+                    continue;
+                }
+                forward[phi] = same;
+                phis.erase(phis.begin() + i);
+                changed = true;
+            }
+        }
+    }
+    for(size_t i = 0; i < fn.values.size(); i++)
+        for(size_t k = 0; k < fn.values[i].args.size(); k++)
+            fn.values[i].args[k] = irFind(forward, fn.values[i].args[k]);
+}
+
+static int irIntersect(ir_function& fn, const std::vector<int>& number, int a, int b){
+    while(a != b){
+        while(number[a] < number[b])
+            a = fn.blocks[a].idom;
+        while(number[b] < number[a])
+            b = fn.blocks[b].idom;
+    }
+    return a;
+}
+
+/* reverse postorder, then each block's idom from its preds' until nothing changes */
+static void irDominators(ir_function& fn){
+    std::vector<int> number(fn.blocks.size(), -1), postorder;
+    std::vector<std::pair<int, size_t> > stack(1, std::make_pair(0, (size_t) 0));
+    number[0] = 0;
+    while(!stack.empty()){
+        int b = stack.back().first;
+        size_t& next = stack.back().second;
+        if(next < fn.blocks[b].succs.size()){
+            /* the last successor first, so that the first comes next in reverse postorder */
+            int s = fn.blocks[b].succs[fn.blocks[b].succs.size() - ++next];
+            if(number[s] < 0){
+                number[s] = 0;
+                stack.push_back(std::make_pair(s, (size_t) 0));
+            }
+            continue;
+        }
+        number[b] = postorder.size();
+        postorder.push_back(b);
+        stack.pop_back();
+    }
+    fn.order.assign(postorder.rbegin(), postorder.rend());
+    fn.blocks[0].idom = 0;
+    for(bool changed = true; changed; ){
+        changed = false;
+        for(size_t i = 1; i < fn.order.size(); i++){
+            ir_block& b = fn.blocks[fn.order[i]];
+            int idom = -1;
+            for(size_t k = 0; k < b.preds.size(); k++){
+                int p = b.preds[k];
+                if(fn.blocks[p].idom < 0)
+                    continue;
+                idom = idom < 0 ? p : irIntersect(fn, number, p, idom);
+            }
+            if(idom != b.idom){
+                b.idom = idom;
+                changed = true;
+            }
+        }
+    }
+}
+
+static bool irDominates(ir_function& fn, int a, int b){
+    while(b != a && b != 0)
+        b = fn.blocks[b].idom;
+    return b == a;
+}
+
+static void irError(ir_function& fn, int value, const char *message){
+    cerr << "ir: " << fn.cls->class_getName() << "." << fn.method->feature_getName() << ": ";
+    if(value >= 0)
+        cerr << "v" << value << ": ";
+    cerr << message << endl;
+    irErrors++;
+}
+
+static bool irTerminator(ir_op op){
+    return op == IR_JUMP || op == IR_BRANCH || op == IR_CASE || op == IR_RETURN;
+}
+
+/* the blocks fit together, every value is defined before its uses and the operators get their types */
+static void irVerify(ir_function& fn){
+    std::vector<int> position(fn.values.size(), -1);
+    for(size_t b = 0; b < fn.blocks.size(); b++){
+        ir_block& block = fn.blocks[b];
+        for(size_t i = 0; i < block.phis.size(); i++)
+            position[block.phis[i]] = 0;
+        for(size_t i = 0; i < block.values.size(); i++)
+            position[block.values[i]] = i + 1;
+    }
+    if(!fn.blocks[0].preds.empty())
+        irError(fn, -1, "the entry has predecessors");
+    for(size_t b = 0; b < fn.blocks.size(); b++){
+        ir_block& block = fn.blocks[b];
+        if(block.idom < 0){
+            irError(fn, -1, "a block is unreachable");
+            continue;
+        }
+        for(size_t i = 0; i < block.succs.size(); i++)
+            if(std::count(block.succs.begin(), block.succs.end(), block.succs[i])
+               != std::count(fn.blocks[block.succs[i]].preds.begin(), fn.blocks[block.succs[i]].preds.end(), (int) b))
+                irError(fn, -1, "a successor does not have the block as a predecessor");
+        for(size_t i = 0; i < block.preds.size(); i++)
+            if(std::find(fn.blocks[block.preds[i]].succs.begin(), fn.blocks[block.preds[i]].succs.end(), (int) b)
+               == fn.blocks[block.preds[i]].succs.end())
+                irError(fn, -1, "a predecessor does not have the block as a successor");
+        if(block.values.empty() || !irTerminator(fn.values[block.values.back()].op)){
+            irError(fn, -1, "a block does not end with a terminator");
+            continue;
+        }
+        for(size_t i = 0; i < block.phis.size(); i++){
+            ir_value& phi = fn.values[block.phis[i]];
+            if(phi.op != IR_PHI || phi.block != (int) b)
+                irError(fn, block.phis[i], "not a phi of the block");
+            if(phi.args.size() != block.preds.size()){
+                irError(fn, block.phis[i], "not an operand for each predecessor");
+                continue;
+            }
+            for(size_t k = 0; k < phi.args.size(); k++)
+                if(position[phi.args[k]] < 0 || !irDominates(fn, fn.values[phi.args[k]].block, block.preds[k]))
+                    irError(fn, block.phis[i], "an operand does not dominate its predecessor");
+        }
+        for(size_t i = 0; i < block.values.size(); i++){
+            int id = block.values[i];
+            ir_value& v = fn.values[id];
+            if(v.op == IR_PHI || v.block != (int) b)
+                irError(fn, id, "misplaced");
+            if(irTerminator(v.op) != (i + 1 == block.values.size()))
+                irError(fn, id, "a terminator not at the end of its block");
+            for(size_t k = 0; k < v.args.size(); k++){
+                int arg = v.args[k];
+                if(position[arg] < 0)
+                    irError(fn, id, "an operand is not in any block");
+                else if(fn.values[arg].block == (int) b ? position[arg] > (int) i : !irDominates(fn, fn.values[arg].block, b))
+                    irError(fn, id, "an operand does not dominate its use");
+                else if(v.op >= IR_ADD && v.op <= IR_LEQ && fn.values[arg].type != Int)
+                    irError(fn, id, "an arithmetic operand is not an Int");
+                else if((v.op == IR_NOT || v.op == IR_BRANCH) && fn.values[arg].type != Bool)
+                    irError(fn, id, "a test is not a Bool");
+            }
+        }
+        size_t succs = 0;
+        ir_value& last = fn.values[block.values.back()];
+        if(last.op == IR_JUMP)
+            succs = 1;
+        else if(last.op == IR_BRANCH)
+            succs = 2;
+        else if(last.op == IR_CASE)
+            succs = last.cases.size();
+        if(block.succs.size() != succs)
+            irError(fn, block.values.back(), "the wrong number of successors");
+    }
+}
+
+/* the method a function of the VM's runs */
+static std::string irFunctionName(int function){
+    for(size_t tag = 0; tag < vmClasses.size(); tag++){
+        Features features = vmClasses[tag].cls->class_getFeatures();
+        for(int i = features->first(); features->more(i); i = features->next(i)){
+            Symbol name = features->nth(i)->feature_getName();
+            if(features->nth(i)->feature_getFormals() != NULL && vmClasses[tag].vtable[vmClasses[tag].methodSlots[name]] == function)
+                return std::string(vmClasses[tag].cls->class_getName()->get_string()) + "." + name->get_string();
+        }
+    }
+    return "?";
+}
+
+static void irDumpValue(ir_function& fn, int id){
+    ir_value& v = fn.values[id];
+    cerr << "    ";
+    if(!irTerminator(v.op))
+        cerr << "v" << id << " = ";
+    cerr << irNames[v.op];
+    if(v.op == IR_CONST && v.type == Str){
+        cerr << " \"";
+        print_escaped_string(cerr, v.name->get_string());
+        cerr << "\"";
+    }
+    else if(v.op == IR_CONST)
+        cerr << " " << (v.type == Bool ? (v.number ? "true" : "false") : v.name == NULL ? "void" : v.name->get_string());
+    else if(v.op == IR_PARAM)
+        cerr << " " << v.number;
+    else if(v.name != NULL)
+        cerr << " " << (v.cls != NULL ? std::string(v.cls->get_string()) + "." : std::string()) << v.name;
+    for(size_t k = 0; k < v.args.size(); k++){
+        cerr << (k == 0 ? " " : ", ") << "v" << v.args[k];
+        if(v.op == IR_PHI)
+            cerr << " from b" << fn.blocks[v.block].preds[k];
+    }
+    for(size_t k = 0; k < v.cases.size(); k++)
+        cerr << ", " << v.cases[k] << ": b" << fn.blocks[v.block].succs[k];
+    if(v.op == IR_JUMP || v.op == IR_BRANCH)
+        for(size_t k = 0; k < fn.blocks[v.block].succs.size(); k++)
+            cerr << (k == 0 && v.args.empty() ? " " : ", ") << "b" << fn.blocks[v.block].succs[k];
+    if(v.op == IR_DISPATCH && v.number >= 0)
+        cerr << " (always " << irFunctionName(v.number) << ")";
+    if(v.type != No_type)
+        cerr << " : " << v.type;
+    cerr << "\n";
+}
+
+static void irDump(ir_function& fn){
+    cerr << fn.cls->class_getName() << "." << fn.method->feature_getName() << ":\n";
+    for(size_t i = 0; i < fn.order.size(); i++){
+        ir_block& block = fn.blocks[fn.order[i]];
+        cerr << "  b" << fn.order[i] << ":";
+        if(fn.order[i] != 0)
+            cerr << "\t\t\t\t; idom b" << block.idom;
+        cerr << "\n";
+        for(size_t k = 0; k < block.phis.size(); k++)
+            irDumpValue(fn, block.phis[k]);
+        for(size_t k = 0; k < block.values.size(); k++)
+            irDumpValue(fn, block.values[k]);
+    }
+}
+
+static void irMethod(Class_ cls, Feature method){
+    irFunctions.push_back(ir_function());
+    irFn = &irFunctions.back();
+    irFn->cls = cls;
+    irFn->method = method;
+    irScope.clear();
+    irVariables.clear();
+    irBlock = irNewBlock();
+    irSeal(irBlock);
+    Formals formals = method->feature_getFormals();
+    for(int i = formals->first(); formals->more(i); i = formals->next(i)){
+        Formal f = formals->nth(i);
+        int param = irValue(IR_PARAM, f->formal_getType(), NULL);
+        irFn->values[param].number = i;
+        irWrite(irBind(f->formal_getName(), f->formal_getType()), irBlock, param);
+    }
+    irSelf = irValue(IR_SELF, SELF_TYPE, NULL);
+    irValue(IR_RETURN, No_type, NULL, method->feature_getExpr()->build());
+    irRemoveTrivialPhis(*irFn);
+    irDominators(*irFn);
+    irVerify(*irFn);
+}
+
+void buildIR(){
+    for(classMAP::iterator it = classGraph.begin(); it != classGraph.end(); ++it){
+        if(it->second->get_filename() == basicFilename)
+            continue;
+        Features features = it->second->class_getFeatures();
+        for(int i = features->first(); features->more(i); i = features->next(i))
+            if(features->nth(i)->feature_getFormals() != NULL)
+                irMethod(it->second, features->nth(i));
+    }
+    bool dump = strcmp(getenv("COOL_IR"), "dump") == 0;
+    size_t blocks = 0, values = 0, phis = 0;
+    for(size_t i = 0; i < irFunctions.size(); i++){
+        ir_function& fn = irFunctions[i];
+        for(size_t b = 0; b < fn.blocks.size(); b++){
+            blocks++;
+            values += fn.blocks[b].phis.size() + fn.blocks[b].values.size();
+            phis += fn.blocks[b].phis.size();
+        }
+        if(dump)
+            irDump(fn);
+    }
+    cerr << "ir: " << irFunctions.size() << " methods, " << blocks << " blocks, " << values << " values, "
+         << phis << " phis, " << irErrors << " errors" << endl;
+    if(irErrors != 0)
+        exit(1);
+}
@@ -0,0 +1,14 @@
+/*
+ *  ssa.h
+ *
+ *  The SSA form of COOL_IR (see ssa.cc), built from the checked program
+ *  before it is folded.
+ */
+#ifndef SSA_H_
+#define SSA_H_
+
+#include "semant.h"
+
+void buildIR();									/* build, verify and report every method */
+
+#endif
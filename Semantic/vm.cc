@@ -0,0 +1,779 @@
+/*
+ *  vm.cc
+ *
+ *  Bytecode VM. COOL_RUN=vm runs the checked program instead of writing
+ *  out the tree. The compile() methods turn each method into a compact
+ *  stack bytecode, and vmRun() executes it in one loop that is threaded
+ *  with computed gotos. The tree comes in on stdin, so the program reads
+ *  its input from the file named by COOL_RUN_INPUT, if that is set.
+ *
+ *  Every value is an object, including Int, Bool and String; void is
+ *  NULL. A frame holds the actuals, then self, then the let and case
+ *  variables, with the operands above them. The manual evaluates the
+ *  actuals before the receiver, so they are already in place when the
+ *  call is made. Objects are never freed.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "vm.h"
+#include "cha.h"
+#include "inline.h"
+
+extern int semant_debug;
+
+struct vm_frame {
+    const int *pc;
+    vm_object **fp;
+    vm_function *fn;
+};
+
+std::vector<vm_class> vmClasses;
+std::map<Symbol, int> vmTags;
+std::vector<vm_function> vmFunctions;
+static std::vector<int> vmCode;
+std::vector<vm_object *> vmConsts;
+static std::map<std::pair<Symbol, int>, int> vmConstIds;
+static std::vector<vm_case> vmCases;
+int vmIntTag, vmBoolTag, vmStringTag;
+vm_object *vmTrue, *vmFalse;
+FILE *vmInput;
+
+/* what is being compiled */
+vm_class *vmClass;
+std::vector<std::pair<Symbol, int> > vmScope;
+int vmSelf, vmLocals, vmMaxLocals;
+static int vmDepth, vmMaxDepth;
+int vmReceiver;
+int vmFloor;
+
+#define VM_STACK (1 << 20)
+
+static char *vmHeap, *vmHeapEnd;
+
+vm_object *vmAlloc(int tag, size_t bytes){
+    bytes = (std::max(bytes, sizeof(vm_object)) + 7) & ~(size_t) 7;
+    if(vmHeap + bytes > vmHeapEnd){
+        size_t chunk = std::max(bytes, (size_t) 1 << 20);
+        vmHeap = (char *) malloc(chunk);
+        if(vmHeap == NULL){
+            fflush(stdout);
+            fprintf(stderr, "vm: out of memory\n");
+            exit(1);
+        }
+        vmHeapEnd = vmHeap + chunk;
+    }
+    vm_object *o = (vm_object *) vmHeap;
+    vmHeap += bytes;
+    o->tag = tag;
+    return o;
+}
+
+size_t vmSize(vm_object *o){
+    if(o->tag == vmStringTag)
+        return VM_HEADER + o->value + 1;
+    if(o->tag == vmIntTag || o->tag == vmBoolTag)
+        return sizeof(vm_object);
+    return VM_HEADER + vmClasses[o->tag].attrs.size() * sizeof(vm_object *);
+}
+
+vm_object *vmInt(int value){
+    vm_object *o = vmAlloc(vmIntTag, sizeof(vm_object));
+    o->value = value;
+    return o;
+}
+
+vm_object *vmString(const char *s, int length){
+    vm_object *o = vmAlloc(vmStringTag, VM_HEADER + length + 1);
+    o->value = length;
+    memcpy(o->chars, s, length);
+    o->chars[length] = '\0';
+    return o;
+}
+
+/* the constant for a literal, made once; kind tells the tables apart */
+int vmConst(Symbol token, int kind){
+    std::pair<std::map<std::pair<Symbol, int>, int>::iterator, bool> it =
+        vmConstIds.insert(std::make_pair(std::make_pair(token, kind), (int) vmConsts.size()));
+    if(it.second)
+        vmConsts.push_back(kind == vmIntTag ? vmInt(atoi(token->get_string()))
+                                            : vmString(token->get_string(), token->get_len()));
+    return it.first->second;
+}
+
+/* constants 0 to 4: void, false, true, 0 and "" */
+int vmDefault(Symbol type){
+    if(type == Int)
+        return 3;
+    if(type == Str)
+        return 4;
+    return type == Bool ? 1 : 0;
+}
+
+static void vmEmit(int op, int effect){
+    vmCode.push_back(op);
+    vmDepth += effect;
+    vmMaxDepth = std::max(vmMaxDepth, vmDepth);
+}
+
+static void vmEmit(int op, int effect, int a){
+    vmEmit(op, effect);
+    vmCode.push_back(a);
+}
+
+static void vmEmit(int op, int effect, int a, int b){
+    vmEmit(op, effect, a);
+    vmCode.push_back(b);
+}
+
+static void vmEmit(int op, int effect, int a, int b, int c){
+    vmEmit(op, effect, a);
+    vmCode.push_back(b);
+    vmCode.push_back(c);
+}
+
+/* a new local slot for a let or case variable */
+int vmBind(Symbol name){
+    int slot = vmLocals++;
+    vmMaxLocals = std::max(vmMaxLocals, vmLocals);
+    vmScope.push_back(std::make_pair(name, slot));
+    return slot;
+}
+
+void vmUnbind(){
+    vmScope.pop_back();
+    vmLocals--;
+}
+
+int vmLocal(Symbol name){
+    for(int i = vmScope.size(); i-- > vmFloor; )
+        if(vmScope[i].first == name)
+            return vmScope[i].second;
+    return -1;
+}
+
+/* compile a method or an initializer; the body's value is what it returns */
+static void vmFunction(int index, Symbol filename, Formals formals, Expression body, Feature *attrs = NULL, int count = 0){
+    vm_function& fn = vmFunctions[index];
+    fn.filename = filename;
+    fn.args = formals != NULL ? formals->len() : 0;
+    fn.code = vmCode.size();
+    vmScope.clear();
+    for(int i = 0; i < fn.args; i++)
+        vmScope.push_back(std::make_pair(formals->nth(i)->formal_getName(), i));
+    vmSelf = vmReceiver = fn.args;
+    vmFloor = 0;
+    vmLocals = vmMaxLocals = fn.args + 1;
+    vmDepth = vmMaxDepth = 0;
+
+    if(body != NULL)
+        body->compile();
+    else {
+        /* the initializer: the parent's, then each initialized attribute in order */
+        if(vmClass->parent >= 0 && vmClasses[vmClass->parent].init >= 0){
+            vmEmit(OP_LOCAL, 1, vmSelf);
+            vmEmit(OP_CALL, 0, vmClasses[vmClass->parent].init, 0, 0);
+            vmEmit(OP_POP, -1);
+        }
+        for(int i = 0; i < count; i++){
+            attrs[i]->feature_getExpr()->compile();
+            vmEmit(OP_SET_ATTR, 0, vmSelf, vmClass->attrSlots[attrs[i]->feature_getName()]);
+            vmEmit(OP_POP, -1);
+        }
+        vmEmit(OP_LOCAL, 1, vmSelf);
+    }
+    vmEmit(OP_RETURN, -1);
+    fn.locals = vmMaxLocals - fn.args - 1;
+    fn.stack = vmMaxLocals + vmMaxDepth;
+}
+
+static const struct { const char *name; vm_op op; } vmNatives[] = {
+    { "abort", OP_ABORT }, { "type_name", OP_TYPE_NAME }, { "copy", OP_COPY },
+    { "out_string", OP_OUT_STRING }, { "out_int", OP_OUT_INT }, { "in_string", OP_IN_STRING },
+    { "in_int", OP_IN_INT }, { "length", OP_LENGTH }, { "concat", OP_CONCAT }, { "substr", OP_SUBSTR }
+};
+
+/* the instruction that is the basic method name, -1 if there is none */
+int vmBasic(Symbol name){
+    for(size_t n = 0; n < sizeof(vmNatives) / sizeof(vmNatives[0]); n++)
+        if(strcmp(vmNatives[n].name, name->get_string()) == 0)
+            return vmNatives[n].op;
+    return -1;
+}
+
+/* number the classes in preorder, so that a class comes after its parent and before the next one not below it */
+static void vmNumber(Class_ cur, int parent, std::map<Symbol, std::vector<Class_> >& children){
+    int tag = vmClasses.size();
+    vmTags[cur->class_getName()] = tag;
+    vmClasses.push_back(vm_class());
+    vmClasses[tag].cls = cur;
+    vmClasses[tag].parent = parent;
+    std::vector<Class_>& below = children[cur->class_getName()];
+    for(size_t i = 0; i < below.size(); i++)
+        vmNumber(below[i], tag, children);
+    vmClasses[tag].last = vmClasses.size() - 1;
+}
+
+/*
+ *  The branch a case takes for each tag. A branch covers the tags from
+ *  its class to the class's last, and those ranges nest, so painting
+ *  them widest first leaves every tag with its closest branch; of two
+ *  branches on one class the first is kept. The result is a list of
+ *  runs of tags with the same branch, searched by the VM and the native
+ *  code in O(log runs) whatever the depth of the hierarchy.
+ */
+void vmCaseRuns(Cases cases, std::vector<int>& starts, std::vector<int>& branches){
+    std::vector<std::pair<int, int> > order;		/* -width, -branch */
+    for(int i = cases->first(), b = 0; cases->more(i); i = cases->next(i), b++){
+        int tag = vmTags[cases->nth(i)->case_getType()];
+        order.push_back(std::make_pair(tag - vmClasses[tag].last, -b));
+    }
+    std::sort(order.begin(), order.end());
+    std::vector<int> paint(vmClasses.size(), -1);
+    for(size_t i = 0; i < order.size(); i++){
+        int b = -order[i].second, tag = vmTags[cases->nth(b)->case_getType()];
+        std::fill(paint.begin() + tag, paint.begin() + vmClasses[tag].last + 1, b);
+    }
+    starts.clear();
+    branches.clear();
+    for(size_t tag = 0; tag < paint.size(); tag++)
+        if(tag == 0 || paint[tag] != paint[tag - 1]){
+            starts.push_back(tag);
+            branches.push_back(paint[tag]);
+        }
+}
+
+/* the class's attributes and methods follow its parent's; an override takes its method's slot */
+static void vmLayout(vm_class& c){
+    if(c.parent >= 0){
+        vm_class& parent = vmClasses[c.parent];
+        c.attrSlots = parent.attrSlots;
+        c.methodSlots = parent.methodSlots;
+        c.attrs = parent.attrs;
+        c.vtable = parent.vtable;
+    }
+    c.init = -1;
+    c.name = vmConsts.size();
+    Symbol name = c.cls->class_getName();
+    vmConsts.push_back(vmString(name->get_string(), name->get_len()));
+
+    bool basic = c.cls->get_filename() == basicFilename;
+    bool initialized = c.parent >= 0 && vmClasses[c.parent].init >= 0;
+    Features features = c.cls->class_getFeatures();
+    for(int i = features->first(); features->more(i); i = features->next(i)){
+        Feature f = features->nth(i);
+        if(f->feature_getFormals() == NULL){
+            /* Int, Bool and String keep their values in the object itself */
+            if(basic)
+                continue;
+            c.attrSlots[f->feature_getName()] = c.attrs.size();
+            c.attrs.push_back(vmConsts[vmDefault(f->feature_getType())]);
+            initialized |= f->feature_getExpr()->get_type() != No_type;
+            continue;
+        }
+        std::map<Symbol, int>::iterator slot = c.methodSlots.find(f->feature_getName());
+        if(slot == c.methodSlots.end()){
+            slot = c.methodSlots.insert(std::make_pair(f->feature_getName(), (int) c.vtable.size())).first;
+            c.vtable.push_back(0);
+        }
+        c.vtable[slot->second] = vmFunctions.size();
+        vmFunctions.push_back(vm_function());
+    }
+    if(initialized){
+        c.init = vmFunctions.size();
+        vmFunctions.push_back(vm_function());
+    }
+}
+
+/* number the classes and lay them out; the native code shares these tables */
+void vmLayoutClasses(){
+    std::map<Symbol, std::vector<Class_> > children;
+    for(classMAP::iterator it = classGraph.begin(); it != classGraph.end(); ++it)
+        if(it->first != Object)
+            children[it->second->class_getParent()].push_back(it->second);
+    vmNumber(classGraph.find(Object)->second, -1, children);
+    vmIntTag = vmTags[Int];
+    vmBoolTag = vmTags[Bool];
+    vmStringTag = vmTags[Str];
+
+    vmConsts.push_back(NULL);
+    vmConsts.push_back(vmFalse = vmAlloc(vmBoolTag, sizeof(vm_object)));
+    vmConsts.push_back(vmTrue = vmAlloc(vmBoolTag, sizeof(vm_object)));
+    vmConsts.push_back(vmInt(0));
+    vmConsts.push_back(vmString("", 0));
+    vmFalse->value = 0;
+    vmTrue->value = 1;
+    for(size_t tag = 0; tag < vmClasses.size(); tag++)
+        vmLayout(vmClasses[tag]);
+}
+
+void vmCompile(){
+    /* start: (new Main).main() */
+    vmFunctions.push_back(vm_function());
+    vmFunctions.back().filename = classGraph.find(Main)->second->get_filename();
+    vmFunctions.back().stack = 2;
+    vmClass = &vmClasses[vmTags[Main]];
+    vmEmit(OP_NEW, 1, vmTags[Main]);
+    vmEmit(OP_DISPATCH, 0, vmClass->methodSlots[main_meth], 0, 0);
+    vmEmit(OP_HALT, 0);
+
+    for(size_t tag = 0; tag < vmClasses.size(); tag++){
+        vmClass = &vmClasses[tag];
+        Class_ cur = vmClass->cls;
+        std::vector<Feature> inits;
+        Features features = cur->class_getFeatures();
+        for(int i = features->first(); features->more(i); i = features->next(i)){
+            Feature f = features->nth(i);
+            if(f->feature_getFormals() == NULL){
+                if(f->feature_getExpr()->get_type() != No_type)
+                    inits.push_back(f);
+                continue;
+            }
+            int index = vmClass->vtable[vmClass->methodSlots[f->feature_getName()]];
+            if(cur->get_filename() != basicFilename){
+                vmFunction(index, cur->get_filename(), f->feature_getFormals(), f->feature_getExpr());
+                continue;
+            }
+            /* a basic method is one instruction that finds its actuals and self in the frame */
+            vm_function& fn = vmFunctions[index];
+            fn.filename = cur->get_filename();
+            fn.args = f->feature_getFormals()->len();
+            fn.locals = 0;
+            fn.stack = fn.args + 2;
+            fn.code = vmCode.size();
+            vmCode.push_back(vmBasic(f->feature_getName()));
+            vmCode.push_back(OP_RETURN);
+        }
+        if(vmClass->init >= 0)
+            vmFunction(vmClass->init, cur->get_filename(), NULL, NULL, inits.empty() ? NULL : &inits[0], inits.size());
+    }
+    if(semant_debug)
+        cerr << "vm: " << vmClasses.size() << " classes, " << vmFunctions.size() << " functions, "
+             << vmCode.size() << " words of code, " << vmConsts.size() << " constants" << endl;
+}
+
+void assign_class::compile(){
+    expr->compile();
+    int slot = vmLocal(name);
+    if(slot >= 0)
+        vmEmit(OP_SET_LOCAL, 0, slot);
+    else
+        vmEmit(OP_SET_ATTR, 0, vmReceiver, vmClass->attrSlots[name]);
+}
+
+void static_dispatch_class::compile(){
+    for(int i = actual->first(); actual->more(i); i = actual->next(i))
+        actual->nth(i)->compile();
+    expr->compile();
+    vm_class& c = vmClasses[vmTags[type_name]];
+    vmEmit(OP_CALL, -actual->len(), c.vtable[c.methodSlots[name]], actual->len(), get_line_number());
+}
+
+void dispatch_class::compile(){
+    for(int i = actual->first(); actual->more(i); i = actual->next(i))
+        actual->nth(i)->compile();
+    expr->compile();
+    std::map<Expression, int>::iterator direct = chaTargets.find(this);
+    if(direct != chaTargets.end()){
+        vmEmit(OP_CALL, -actual->len(), direct->second, actual->len(), get_line_number());
+        return;
+    }
+    Symbol receiver = expr->get_type();
+    vm_class& c = receiver == SELF_TYPE ? *vmClass : vmClasses[vmTags[receiver]];
+    vmEmit(OP_DISPATCH, -actual->len(), c.methodSlots[name], actual->len(), get_line_number());
+}
+
+void cond_class::compile(){
+    pred->compile();
+    vmEmit(OP_JUMP_FALSE, -1, 0);
+    size_t toElse = vmCode.size() - 1;
+    then_exp->compile();
+    vmEmit(OP_JUMP, 0, 0);
+    size_t toEnd = vmCode.size() - 1;
+    vmDepth--;
+    vmCode[toElse] = vmCode.size();
+    else_exp->compile();
+    vmCode[toEnd] = vmCode.size();
+}
+
+void loop_class::compile(){
+    int start = vmCode.size();
+    pred->compile();
+    vmEmit(OP_JUMP_FALSE, -1, 0);
+    size_t toEnd = vmCode.size() - 1;
+    body->compile();
+    vmEmit(OP_POP, -1);
+    vmEmit(OP_JUMP, 0, start);
+    vmCode[toEnd] = vmCode.size();
+    vmEmit(OP_CONST, 1, 0);
+}
+
+void typcase_class::compile(){
+    expr->compile();
+    int site = vmCases.size();
+    vmCases.push_back(vm_case());
+    vmEmit(OP_CASE, 0, site);
+    vmCode.push_back(get_line_number());
+    vmCaseRuns(cases, vmCases[site].starts, vmCases[site].branches);
+    int depth = vmDepth;
+    std::vector<size_t> toEnd;
+    for(int i = cases->first(); cases->more(i); i = cases->next(i)){
+        Case c = cases->nth(i);
+        vmDepth = depth;
+        vmCases[site].targets.push_back(vmCode.size());
+        int slot = vmBind(c->case_getName());
+        vmEmit(OP_SET_LOCAL, 0, slot);
+        vmEmit(OP_POP, -1);
+        c->case_getExpr()->compile();
+        vmUnbind();
+        vmEmit(OP_JUMP, 0, 0);
+        toEnd.push_back(vmCode.size() - 1);
+    }
+    vmDepth = depth;
+    for(size_t i = 0; i < toEnd.size(); i++)
+        vmCode[toEnd[i]] = vmCode.size();
+}
+
+void block_class::compile(){
+    for(int i = body->first(); body->more(i); i = body->next(i)){
+        if(i != body->first())
+            vmEmit(OP_POP, -1);
+        body->nth(i)->compile();
+    }
+}
+
+void let_class::compile(){
+    if(init->get_type() == No_type)
+        vmEmit(OP_CONST, 1, vmDefault(type_decl));
+    else
+        init->compile();
+    int slot = vmBind(identifier);
+    vmEmit(OP_SET_LOCAL, 0, slot);
+    vmEmit(OP_POP, -1);
+    inline_state outer = inlineEnter(this, slot);
+    body->compile();
+    inlineLeave(outer);
+    vmUnbind();
+}
+
+void plus_class::compile(){
+    e1->compile();
+    e2->compile();
+    vmEmit(OP_ADD, -1);
+}
+
+void sub_class::compile(){
+    e1->compile();
+    e2->compile();
+    vmEmit(OP_SUB, -1);
+}
+
+void mul_class::compile(){
+    e1->compile();
+    e2->compile();
+    vmEmit(OP_MUL, -1);
+}
+
+void divide_class::compile(){
+    e1->compile();
+    e2->compile();
+    vmEmit(OP_DIV, -1, get_line_number());
+}
+
+void neg_class::compile(){
+    e1->compile();
+    vmEmit(OP_NEG, 0);
+}
+
+void lt_class::compile(){
+    e1->compile();
+    e2->compile();
+    vmEmit(OP_LT, -1);
+}
+
+void eq_class::compile(){
+    e1->compile();
+    e2->compile();
+    vmEmit(OP_EQ, -1);
+}
+
+void leq_class::compile(){
+    e1->compile();
+    e2->compile();
+    vmEmit(OP_LEQ, -1);
+}
+
+void comp_class::compile(){
+    e1->compile();
+    vmEmit(OP_NOT, 0);
+}
+
+void int_const_class::compile(){
+    vmEmit(OP_CONST, 1, vmConst(token, vmIntTag));
+}
+
+void bool_const_class::compile(){
+    vmEmit(OP_CONST, 1, val ? 2 : 1);
+}
+
+void string_const_class::compile(){
+    vmEmit(OP_CONST, 1, vmConst(token, vmStringTag));
+}
+
+void new__class::compile(){
+    if(type_name == SELF_TYPE)
+        vmEmit(OP_NEW_SELF, 1, vmReceiver);
+    else
+        vmEmit(OP_NEW, 1, vmTags[type_name]);
+}
+
+void isvoid_class::compile(){
+    e1->compile();
+    vmEmit(OP_ISVOID, 0);
+}
+
+void no_expr_class::compile(){
+    vmEmit(OP_CONST, 1, 0);
+}
+
+void object_class::compile(){
+    int slot = name == self ? vmReceiver : vmLocal(name);
+    if(slot >= 0)
+        vmEmit(OP_LOCAL, 1, slot);
+    else
+        vmEmit(OP_ATTR, 1, vmReceiver, vmClass->attrSlots[name]);
+}
+
+/* runtime errors stop the program the way the SPIM runtime does */
+static void vmError(vm_function *fn, int line, const std::string& message){
+    printf("%s:%d: %s\n", fn->filename->get_string(), line, message.c_str());
+    exit(1);
+}
+
+vm_object *vmReadLine(){
+    std::string line;
+    int c;
+    bool null = false;
+    while(vmInput != NULL && (c = getc(vmInput)) != EOF && c != '\n'){
+        null |= c == '\0';
+        line += (char) c;
+    }
+    return null ? vmConsts[4] : vmString(line.data(), line.size());
+}
+
+bool vmEqual(vm_object *a, vm_object *b){
+    if(a == b)
+        return true;
+    if(a == NULL || b == NULL || a->tag != b->tag)
+        return false;
+    if(a->tag == vmIntTag || a->tag == vmBoolTag)
+        return a->value == b->value;
+    return a->tag == vmStringTag && a->value == b->value && memcmp(a->chars, b->chars, a->value) == 0;
+}
+
+void vmRun(){
+    static const void *ops[OP_COUNT] = {
+        &&op_const, &&op_local, &&op_set_local, &&op_attr, &&op_set_attr, &&op_pop, &&op_jump, &&op_jump_false,
+        &&op_new, &&op_new_self, &&op_dispatch, &&op_call, &&op_return, &&op_case,
+        &&op_add, &&op_sub, &&op_mul, &&op_div, &&op_neg, &&op_lt, &&op_leq, &&op_eq, &&op_not, &&op_isvoid,
+        &&op_abort, &&op_type_name, &&op_copy, &&op_out_string, &&op_out_int, &&op_in_string, &&op_in_int,
+        &&op_length, &&op_concat, &&op_substr, &&op_halt
+    };
+    vm_object **stack = (vm_object **) malloc(VM_STACK * sizeof(vm_object *));
+    vm_frame *frames = (vm_frame *) malloc(VM_FRAMES * sizeof(vm_frame));
+    vm_object **stackEnd = stack + VM_STACK;
+    vm_frame *framesEnd = frames + VM_FRAMES;
+    vm_class *classes = &vmClasses[0];
+    vm_function *functions = &vmFunctions[0];
+    vm_object **consts = &vmConsts[0];
+    const int *code = &vmCode[0];
+
+    vm_function *fn = &vmFunctions.back();
+    const int *pc = code;
+    vm_object **fp = stack, **sp = stack;
+    vm_frame *frame = frames;
+    vm_function *callee;
+    vm_object *o;
+    int tag;
+    *sp++ = NULL;							/* the starting frame's self */
+
+#define NEXT goto *ops[*pc++]
+#define SELF fp[fn->args]
+/* the actuals and receiver are on the stack */
+#define CALL(index, args, line)                                         \
+    callee = functions + (index);                                       \
+    if(frame + 1 == framesEnd || sp + callee->stack > stackEnd)         \
+        vmError(fn, line, "Stack overflow.");                           \
+    frame->pc = pc;                                                     \
+    frame->fp = fp;                                                     \
+    frame->fn = fn;                                                     \
+    frame++;                                                            \
+    fp = sp - (args) - 1;                                               \
+    fn = callee;                                                        \
+    pc = code + callee->code;                                           \
+    for(int i = 0; i < callee->locals; i++)                             \
+        *sp++ = NULL;                                                   \
+    NEXT
+#define INT_OP(expr) { int b = (*--sp)->value, a = sp[-1]->value; sp[-1] = vmInt(expr); NEXT; }
+#define BOOL_OP(expr) { int b = (*--sp)->value, a = sp[-1]->value; sp[-1] = (expr) ? vmTrue : vmFalse; NEXT; }
+
+    NEXT;
+op_const:
+    *sp++ = consts[*pc++];
+    NEXT;
+op_local:
+    *sp++ = fp[*pc++];
+    NEXT;
+op_set_local:
+    fp[*pc++] = sp[-1];
+    NEXT;
+op_attr:
+    *sp++ = fp[pc[0]]->attrs[pc[1]];
+    pc += 2;
+    NEXT;
+op_set_attr:
+    fp[pc[0]]->attrs[pc[1]] = sp[-1];
+    pc += 2;
+    NEXT;
+op_pop:
+    sp--;
+    NEXT;
+op_jump:
+    pc = code + *pc;
+    NEXT;
+op_jump_false:
+    pc = (*--sp)->value ? pc + 1 : code + *pc;
+    NEXT;
+op_new_self:
+    tag = fp[*pc++]->tag;
+    goto allocate;
+op_new:
+    tag = *pc++;
+allocate: {
+        vm_class& c = classes[tag];
+        size_t n = c.attrs.size();
+        o = vmAlloc(tag, VM_HEADER + n * sizeof(vm_object *));
+        o->value = 0;
+        o->attrs[0] = NULL;					/* an empty String */
+        if(n != 0)
+            memcpy(o->attrs, &c.attrs[0], n * sizeof(vm_object *));
+        *sp++ = o;
+        if(c.init < 0)
+            NEXT;
+        CALL(c.init, 0, 0);
+    }
+op_dispatch:
+    o = sp[-1];
+    if(o == NULL)
+        vmError(fn, pc[2], "Dispatch to void.");
+    pc += 3;
+    CALL(classes[o->tag].vtable[pc[-3]], pc[-2], pc[-1]);
+op_call:
+    if(sp[-1] == NULL)
+        vmError(fn, pc[2], "Dispatch to void.");
+    pc += 3;
+    CALL(pc[-3], pc[-2], pc[-1]);
+op_return:
+    o = sp[-1];
+    sp = fp;
+    *sp++ = o;
+    frame--;
+    pc = frame->pc;
+    fp = frame->fp;
+    fn = frame->fn;
+    NEXT;
+op_case: {
+        o = sp[-1];
+        if(o == NULL)
+            vmError(fn, pc[1], "Match on void in case statement.");
+        vm_case& site = vmCases[*pc];
+        tag = site.branches[std::upper_bound(site.starts.begin(), site.starts.end(), o->tag) - site.starts.begin() - 1];
+        if(tag >= 0){
+            pc = code + site.targets[tag];
+            NEXT;
+        }
+        printf("No match in case statement for Class %s\n", classes[o->tag].cls->class_getName()->get_string());
+        exit(1);
+    }
+op_add:
+    INT_OP((int) ((unsigned) a + (unsigned) b));
+op_sub:
+    INT_OP((int) ((unsigned) a - (unsigned) b));
+op_mul:
+    INT_OP((int) ((unsigned) a * (unsigned) b));
+op_div:
+    if(sp[-1]->value == 0)
+        vmError(fn, *pc, "Division by zero.");
+    pc++;
+    INT_OP(b == -1 ? (int) (0u - (unsigned) a) : a / b);
+op_neg:
+    sp[-1] = vmInt((int) (0u - (unsigned) sp[-1]->value));
+    NEXT;
+op_lt:
+    BOOL_OP(a < b);
+op_leq:
+    BOOL_OP(a <= b);
+op_eq:
+    o = *--sp;
+    sp[-1] = vmEqual(sp[-1], o) ? vmTrue : vmFalse;
+    NEXT;
+op_not:
+    sp[-1] = sp[-1]->value ? vmFalse : vmTrue;
+    NEXT;
+op_isvoid:
+    sp[-1] = sp[-1] == NULL ? vmTrue : vmFalse;
+    NEXT;
+
+    /* the basic methods; the actuals are fp[0], fp[1], and self follows them */
+op_abort:
+    printf("Abort called from class %s\n", classes[SELF->tag].cls->class_getName()->get_string());
+    exit(0);
+op_type_name:
+    *sp++ = consts[classes[SELF->tag].name];
+    NEXT;
+op_copy:
+    o = vmAlloc(SELF->tag, vmSize(SELF));
+    memcpy(o, SELF, vmSize(SELF));
+    *sp++ = o;
+    NEXT;
+op_out_string:
+    fwrite(fp[0]->chars, 1, fp[0]->value, stdout);
+    *sp++ = SELF;
+    NEXT;
+op_out_int:
+    printf("%d", fp[0]->value);
+    *sp++ = SELF;
+    NEXT;
+op_in_string:
+    *sp++ = vmReadLine();
+    NEXT;
+op_in_int:
+    o = vmReadLine();
+    *sp++ = vmInt(atoi(o->chars));
+    NEXT;
+op_length:
+    *sp++ = vmInt(SELF->value);
+    NEXT;
+op_concat:
+    o = vmAlloc(vmStringTag, VM_HEADER + SELF->value + fp[0]->value + 1);
+    o->value = SELF->value + fp[0]->value;
+    memcpy(o->chars, SELF->chars, SELF->value);
+    memcpy(o->chars + SELF->value, fp[0]->chars, fp[0]->value + 1);
+    *sp++ = o;
+    NEXT;
+op_substr:
+    if(fp[0]->value < 0 || fp[1]->value < 0 || fp[0]->value + fp[1]->value > SELF->value){
+        printf("Index to substr is out of range\n");
+        exit(1);
+    }
+    *sp++ = vmString(SELF->chars + fp[0]->value, fp[1]->value);
+    NEXT;
+op_halt:
+    return;
+#undef NEXT
+#undef SELF
+#undef CALL
+#undef INT_OP
+#undef BOOL_OP
+}
@@ -0,0 +1,94 @@
+/*
+ *  vm.h
+ *
+ *  The bytecode VM of COOL_RUN=vm (see vm.cc): the objects, the class
+ *  layouts and the instructions of the basic methods, which the tree
+ *  interpreter and the native code share with it, and the state the
+ *  compile() methods work on.
+ */
+#ifndef VM_H_
+#define VM_H_
+
+#include <stddef.h>
+#include <stdio.h>
+#include "semant.h"
+
+enum vm_op {
+    OP_CONST, OP_LOCAL, OP_SET_LOCAL, OP_ATTR, OP_SET_ATTR, OP_POP, OP_JUMP, OP_JUMP_FALSE,
+    OP_NEW, OP_NEW_SELF, OP_DISPATCH, OP_CALL, OP_RETURN, OP_CASE,
+    OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_NEG, OP_LT, OP_LEQ, OP_EQ, OP_NOT, OP_ISVOID,
+    OP_ABORT, OP_TYPE_NAME, OP_COPY, OP_OUT_STRING, OP_OUT_INT, OP_IN_STRING, OP_IN_INT,
+    OP_LENGTH, OP_CONCAT, OP_SUBSTR, OP_HALT, OP_COUNT
+};
+
+struct vm_object {
+    int tag;							/* class number */
+    int value;							/* Int and Bool: the value; String: the length */
+    union {
+        vm_object *attrs[1];			/* the attributes, the ancestors' first */
+        char chars[1];					/* a String's characters */
+    };
+};
+#define VM_HEADER offsetof(vm_object, attrs)
+
+struct vm_class {
+    Class_ cls;
+    int parent;							/* number of the parent class, -1 for Object */
+    int last;							/* the last tag below it: its subclasses are the tags up to here */
+    std::map<Symbol, int> attrSlots, methodSlots;
+    std::vector<vm_object *> attrs;		/* what new objects start with */
+    std::vector<int> vtable;			/* function of each method slot */
+    std::vector<int> single;			/* the function a slot runs in this class and all below it, -1 if several */
+    int init;							/* function running the initializers, -1 if none */
+    int name;							/* constant holding the name */
+};
+
+struct vm_function {
+    Symbol filename;
+    int args;							/* formals; self is next */
+    int locals;							/* let and case variables */
+    int stack;							/* slots used above the frame's start */
+    int code;							/* offset of the code in vmCode */
+};
+
+struct vm_case {
+    std::vector<int> starts, branches;	/* the branch taken from each start tag up to the next, -1 if none */
+    std::vector<int> targets;			/* where each branch's code starts */
+};
+
+#define VM_FRAMES (1 << 16)						/* calls deep before a stack overflow */
+
+extern std::vector<vm_class> vmClasses;			/* by tag, in preorder */
+extern std::map<Symbol, int> vmTags;
+extern std::vector<vm_function> vmFunctions;
+extern std::vector<vm_object *> vmConsts;		/* 0 to 4: void, false, true, 0 and "" */
+extern int vmIntTag, vmBoolTag, vmStringTag;
+extern vm_object *vmTrue, *vmFalse;
+extern FILE *vmInput;							/* what in_string and in_int read */
+
+/* what is being compiled */
+extern vm_class *vmClass;
+extern std::vector<std::pair<Symbol, int> > vmScope;	/* formals and variables, innermost last */
+extern int vmSelf, vmLocals, vmMaxLocals;
+extern int vmReceiver;							/* slot of what self is: vmSelf, or an inlined call's receiver */
+extern int vmFloor;								/* the variables in vmScope below it are out of sight */
+
+vm_object *vmAlloc(int tag, size_t bytes);
+size_t vmSize(vm_object *);
+vm_object *vmInt(int value);
+vm_object *vmString(const char *s, int length);
+int vmConst(Symbol token, int kind);			/* the constant of a literal; kind is vmIntTag or vmStringTag */
+int vmDefault(Symbol type);						/* the constant a variable of the type starts as */
+int vmBind(Symbol name);						/* a new local slot */
+void vmUnbind();
+int vmLocal(Symbol name);						/* the slot of a variable, -1 for an attribute */
+int vmBasic(Symbol name);						/* the instruction of a basic method, -1 if none */
+void vmCaseRuns(Cases, std::vector<int>& starts, std::vector<int>& branches);
+vm_object *vmReadLine();
+bool vmEqual(vm_object *, vm_object *);
+
+void vmLayoutClasses();							/* number the classes and lay them out */
+void vmCompile();
+void vmRun();
+
+#endif
@@ -0,0 +1,122 @@
+/*
+ *  semant-client: lexes, parses and checks COOL files through
+ *  semant-server, with the command line and output of mysemant.
+ *
+ *    semant-client [-lps ...] file.cl ...
+ *
+ *  The options are handle_flags', as for every phase. The client passes
+ *  the server its descriptors and working directory, so the server
+ *  writes the typed tree or the errors where mysemant would and opens
+ *  the files by the names given, and it exits as the server's compile
+ *  did. When no server answers on the socket (see server.h) it starts
+ *  one next to itself and waits for it.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <iostream>
+#include <string>
+#include "server.h"
+
+using std::cerr;
+using std::endl;
+
+/* handle_flags sets these; the client's are not used beyond the request */
+int yy_flex_debug;
+int cool_yydebug;
+extern int semant_debug;
+void handle_flags(int argc, char *argv[]);
+
+static int connectServer(){
+    sockaddr_un address;
+    serverAddress(address);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0)
+        return -1;
+    if(connect(fd, (sockaddr *) &address, sizeof(address)) == 0)
+        return fd;
+    close(fd);
+    return -1;
+}
+
+/* semant-server in the client's own directory, detached from the terminal */
+static void startServer(const char *client){
+    std::string program = "semant-server";
+    const char *slash = strrchr(client, '/');
+    if(slash != NULL)
+        program = std::string(client, slash + 1 - client) + program;
+    pid_t pid = fork();
+    if(pid != 0){
+        if(pid > 0)
+            waitpid(pid, NULL, 0);
+        return;
+    }
+    /* a grandchild, so that nobody has to wait for the server */
+    if(fork() != 0)
+        _exit(0);
+    setsid();
+    int null = open("/dev/null", O_RDWR);
+    dup2(null, 0);
+    dup2(null, 1);
+    dup2(null, 2);
+    execlp(program.c_str(), program.c_str(), (char *) NULL);
+    _exit(127);
+}
+
+int main(int argc, char *argv[]){
+    handle_flags(argc, argv);
+
+    server_request request;
+    memset(&request, 0, sizeof(request));
+    request.version = SERVER_VERSION;
+    request.lexDebug = yy_flex_debug;
+    request.parseDebug = cool_yydebug;
+    request.semantDebug = semant_debug;
+    std::string names;
+    for(int i = optind; i < argc; i++){
+        names.append(argv[i]);
+        names.push_back('\0');
+        request.files++;
+    }
+    request.names = names.size();
+    if(request.names > SERVER_MAX_NAMES){
+        cerr << "semant-client: too many file names" << endl;
+        exit(1);
+    }
+
+    int fd = connectServer();
+    if(fd < 0){
+        startServer(argv[0]);
+        /* up to 5 s for it to build the basic classes and listen */
+        for(int tries = 0; fd < 0 && tries < 500; tries++){
+            timespec wait = { 0, 10000000 };
+            nanosleep(&wait, NULL);
+            fd = connectServer();
+        }
+    }
+    if(fd < 0){
+        cerr << "semant-client: no semant-server answers: " << strerror(errno) << endl;
+        exit(1);
+    }
+
+    int fds[SERVER_FDS] = { 0, 1, 2, open(".", O_RDONLY | O_DIRECTORY) };
+    if(fds[3] < 0){
+        cerr << "semant-client: cannot open the working directory" << endl;
+        exit(1);
+    }
+    int status;
+    if(!sendRequest(fd, request, fds) || !sendAll(fd, names.data(), names.size())
+       || !receiveAll(fd, &status, sizeof(status))){
+        cerr << "semant-client: the server closed the connection" << endl;
+        exit(1);
+    }
+
+    /* end the way the compile did */
+    if(WIFSIGNALED(status)){
+        signal(WTERMSIG(status), SIG_DFL);
+        kill(getpid(), WTERMSIG(status));
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
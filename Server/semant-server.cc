@@ -0,0 +1,263 @@
+/*
+ *  semant-server: the lexer, the parser and semant in one process that
+ *  stays up between compiles, for semant-client.
+ *
+ *    semant-server
+ *
+ *  It builds semant's constants and the basic classes with their scopes
+ *  once (semantBasics()), then listens on the socket of server.h. Each
+ *  request is compiled in a child forked from that state before the
+ *  request came, so that the fork costs the client nothing: the child
+ *  takes the client's descriptors and working directory, lexes the
+ *  files in turn with the flex lexer, parses them with parse_phase()
+ *  and runs semant() and the dump, exactly as the lexer | parser |
+ *  semant pipeline would, and exits as the last phase would have. The
+ *  server sends the client the child's wait status. Whatever a compile
+ *  allocates or sets goes away with its child, so every compile starts
+ *  from the same tables.
+ *
+ *  COOL_* settings come from the server's own environment. It exits
+ *  after COOL_SEMANT_SERVER_IDLE seconds (600) without a compile, 0 for
+ *  never, or on SIGTERM, and removes its socket.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <map>
+#include <vector>
+#include "cool-tree.h"
+#include "cool.tab.h"
+#include "utilities.h"
+#include "server.h"
+
+/* what the lexer reads from, and the flags of the phases */
+FILE *fin;
+char *curr_filename = (char *) "<stdin>";
+extern int curr_lineno;
+extern YYSTYPE cool_yylval;
+extern int cool_yylex();
+extern int yy_flex_debug;
+extern int cool_yydebug;
+extern int semant_debug;
+extern Program ast_root;
+
+/* the files of one compile, lexed one after the other as the lexer phase does */
+struct source_files {
+    std::vector<char *> names;
+    size_t next;						/* the file to open once the one read is done */
+    int lastLine;						/* the end of the input is on the last token's line */
+    source_files() : next(0), lastLine(0) { }
+};
+
+static int sourceLexer(void *state, YYSTYPE *value, int *lineno, char **filename){
+    source_files *files = (source_files *) state;
+    for(;;){
+        if(fin == NULL){
+            if(files->next == files->names.size()){
+                *lineno = files->lastLine;
+                *filename = curr_filename;
+                return 0;
+            }
+            curr_filename = files->names[files->next++];
+            if((fin = fopen(curr_filename, "r")) == NULL){
+                cerr << "Could not open input file " << curr_filename << endl;
+                exit(1);
+            }
+            curr_lineno = 1;
+        }
+        int token = cool_yylex();
+        if(token != 0){
+            *value = cool_yylval;
+            *lineno = files->lastLine = curr_lineno;
+            *filename = curr_filename;
+            return token;
+        }
+        fclose(fin);
+        fin = NULL;
+    }
+}
+
+/* in the child: one request, from reading it to the exit status */
+static void compile(int conn){
+    server_request request;
+    int fds[SERVER_FDS];
+    if(!receiveRequest(conn, request, fds) || request.version != SERVER_VERSION
+       || request.names < 0 || request.names > SERVER_MAX_NAMES)
+        _exit(2);
+    std::vector<char> names(request.names + 1, '\0');
+    if(!receiveAll(conn, &names[0], request.names))
+        _exit(2);
+    for(int i = 0; i < 3; i++)
+        dup2(fds[i], i);
+    if(fchdir(fds[3]) != 0){
+        cerr << "semant-server: cannot enter the client's directory" << endl;
+        exit(1);
+    }
+    for(int i = 0; i < SERVER_FDS; i++)
+        if(fds[i] > 2)
+            close(fds[i]);
+
+    yy_flex_debug = request.lexDebug;
+    cool_yydebug = request.parseDebug;
+    semant_debug = request.semantDebug;
+    source_files files;
+    for(char *name = &names[0]; (int) files.names.size() < request.files; name += strlen(name) + 1)
+        files.names.push_back(name);
+
+    if(parse_phase(sourceLexer, &files) != 0){
+        cerr << "Compilation halted due to lex and parse errors\n";
+        exit(1);
+    }
+    ast_root->semant();
+    ast_root->dump_with_types(cout, 0);
+    exit(0);
+}
+
+/* SIGCHLD and the signals that stop the server, as bytes for poll() to see */
+static int wakeup[2];
+
+static void wake(int sig){
+    char why = sig == SIGCHLD ? 'C' : 'T';
+    int saved = errno;
+    write(wakeup[1], &why, 1);
+    errno = saved;
+}
+
+/*
+ * The child that takes the next request: forked ahead of it, so that no
+ * client waits for the fork. It waits on spareChannel for the
+ * connection.
+ */
+static pid_t spare = -1;
+static int spareChannel = -1;
+
+static void forkSpare(int listener, std::map<pid_t, int>& compiles){
+    int channel[2];
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, channel) != 0)
+        return;
+    pid_t pid = fork();
+    if(pid == 0){
+        close(channel[0]);
+        close(listener);
+        close(wakeup[0]);
+        close(wakeup[1]);
+        for(std::map<pid_t, int>::iterator it = compiles.begin(); it != compiles.end(); ++it)
+            close(it->second);
+        signal(SIGCHLD, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+        signal(SIGINT, SIG_DFL);
+        signal(SIGPIPE, SIG_DFL);
+        char byte;
+        int conn;
+        if(!receiveWithFds(channel[1], &byte, 1, &conn, 1))
+            _exit(0);					/* the server stopped first */
+        close(channel[1]);
+        compile(conn);
+    }
+    close(channel[1]);
+    if(pid < 0){
+        close(channel[0]);
+        return;
+    }
+    spare = pid;
+    spareChannel = channel[0];
+}
+
+/* give each finished compile's client its status */
+static void reap(std::map<pid_t, int>& compiles){
+    pid_t pid;
+    int status;
+    while((pid = waitpid(-1, &status, WNOHANG)) > 0){
+        if(pid == spare){
+            close(spareChannel);
+            spare = -1;
+        }
+        std::map<pid_t, int>::iterator it = compiles.find(pid);
+        if(it == compiles.end())
+            continue;
+        sendAll(it->second, &status, sizeof(status));
+        close(it->second);
+        compiles.erase(it);
+    }
+}
+
+int main(int argc, char *argv[]){
+    sockaddr_un address;
+    serverAddress(address);
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listener < 0){
+        perror("semant-server: socket");
+        exit(1);
+    }
+    if(bind(listener, (sockaddr *) &address, sizeof(address)) != 0){
+        /* a server that answers keeps its socket; one that does not left it behind */
+        bool inUse = errno == EADDRINUSE;
+        int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        if(!inUse || connect(probe, (sockaddr *) &address, sizeof(address)) == 0){
+            cerr << "semant-server: cannot listen on " << address.sun_path << endl;
+            exit(1);
+        }
+        close(probe);
+        unlink(address.sun_path);
+        if(bind(listener, (sockaddr *) &address, sizeof(address)) != 0){
+            perror("semant-server: bind");
+            exit(1);
+        }
+    }
+    char *idleSetting = getenv("COOL_SEMANT_SERVER_IDLE");
+    int idle = idleSetting != NULL ? atoi(idleSetting) : 600;
+
+    semantBasics();
+    yy_flex_debug = 0;
+
+    if(pipe(wakeup) != 0 || listen(listener, 64) != 0){
+        perror("semant-server");
+        unlink(address.sun_path);
+        exit(1);
+    }
+    fcntl(wakeup[1], F_SETFL, O_NONBLOCK);
+    signal(SIGCHLD, wake);
+    signal(SIGTERM, wake);
+    signal(SIGINT, wake);
+    signal(SIGPIPE, SIG_IGN);
+
+    std::map<pid_t, int> compiles;		/* the client of each child still compiling */
+    forkSpare(listener, compiles);
+    for(;;){
+        pollfd polls[2] = { { listener, POLLIN, 0 }, { wakeup[0], POLLIN, 0 } };
+        int ready = poll(polls, 2, compiles.empty() && idle > 0 ? idle * 1000 : -1);
+        if(ready < 0 && errno == EINTR)
+            continue;
+        if(ready <= 0)
+            break;
+        if(polls[1].revents & POLLIN){
+            char why[64];
+            ssize_t n = read(wakeup[0], why, sizeof(why));
+            if(n > 0 && memchr(why, 'T', n) != NULL)
+                break;
+            reap(compiles);
+        }
+        if(polls[0].revents & POLLIN){
+            int conn = accept(listener, NULL, NULL);
+            if(conn < 0)
+                continue;
+            if(spare < 0)
+                forkSpare(listener, compiles);
+            char byte = 0;
+            if(spare < 0 || !sendWithFds(spareChannel, &byte, 1, &conn, 1)){
+                close(conn);			/* the client sees the connection close */
+                continue;
+            }
+            compiles[spare] = conn;
+            close(spareChannel);
+            spare = -1;
+            forkSpare(listener, compiles);
+        }
+    }
+    unlink(address.sun_path);
+    if(spare > 0)
+        close(spareChannel);			/* the spare sees it close, and exits */
+    return 0;
+}
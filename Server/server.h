@@ -0,0 +1,112 @@
+/*
+ *  server.h
+ *
+ *  What semant-client and semant-server say to each other over a Unix
+ *  socket. The client sends a server_request, its file names after it,
+ *  and with them its stdin, stdout, stderr and working directory as
+ *  descriptors; the server compiles in a child that writes straight to
+ *  them and answers with the child's wait status.
+ */
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define SERVER_VERSION 1
+#define SERVER_FDS 4					/* stdin, stdout, stderr and the working directory */
+#define SERVER_MAX_NAMES (1 << 20)		/* bytes of file names a request may carry */
+
+/* the flags of handle_flags that the front end reads */
+struct server_request {
+    int version;						/* SERVER_VERSION */
+    int lexDebug, parseDebug, semantDebug;	/* -l, -p and -s */
+    int files;							/* file names that follow */
+    int names;							/* their bytes, each ending in a NUL */
+};
+
+/* COOL_SEMANT_SERVER, or one socket per user in /tmp */
+static void serverAddress(sockaddr_un& address){
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    const char *path = getenv("COOL_SEMANT_SERVER");
+    if(path != NULL)
+        snprintf(address.sun_path, sizeof(address.sun_path), "%s", path);
+    else
+        snprintf(address.sun_path, sizeof(address.sun_path), "/tmp/semant-server.%d", (int) getuid());
+}
+
+/* write or read all of size bytes; false if the other end went away */
+static bool sendAll(int fd, const void *data, size_t size){
+    for(const char *p = (const char *) data; size > 0; ){
+        ssize_t n = write(fd, p, size);
+        if(n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool receiveAll(int fd, void *data, size_t size){
+    for(char *p = (char *) data; size > 0; ){
+        ssize_t n = read(fd, p, size);
+        if(n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+/* data with count descriptors riding on it, sent in one message */
+static bool sendWithFds(int fd, const void *data, size_t size, const int *fds, int count){
+    iovec part = { (void *) data, size };
+    char control[CMSG_SPACE(SERVER_FDS * sizeof(int))];
+    msghdr message;
+    memset(&message, 0, sizeof(message));
+    memset(control, 0, sizeof(control));
+    message.msg_iov = &part;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = CMSG_SPACE(count * sizeof(int));
+    cmsghdr *c = CMSG_FIRSTHDR(&message);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(count * sizeof(int));
+    memcpy(CMSG_DATA(c), fds, count * sizeof(int));
+    return sendmsg(fd, &message, 0) == (ssize_t) size;
+}
+
+static bool receiveWithFds(int fd, void *data, size_t size, int *fds, int count){
+    iovec part = { data, size };
+    char control[CMSG_SPACE(SERVER_FDS * sizeof(int))];
+    msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &part;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = CMSG_SPACE(count * sizeof(int));
+    if(recvmsg(fd, &message, MSG_WAITALL) != (ssize_t) size)
+        return false;
+    cmsghdr *c = CMSG_FIRSTHDR(&message);
+    if(c == NULL || c->cmsg_type != SCM_RIGHTS || c->cmsg_len != CMSG_LEN(count * sizeof(int)))
+        return false;
+    memcpy(fds, CMSG_DATA(c), count * sizeof(int));
+    return true;
+}
+
+/* the request itself, with the client's descriptors */
+static bool sendRequest(int fd, const server_request& request, const int fds[SERVER_FDS]){
+    return sendWithFds(fd, &request, sizeof(request), fds, SERVER_FDS);
+}
+
+static bool receiveRequest(int fd, server_request& request, int fds[SERVER_FDS]){
+    return receiveWithFds(fd, &request, sizeof(request), fds, SERVER_FDS);
+}
+
+#endif